@@ -23,8 +23,15 @@
 #ifndef MONITOR_ADAFRUIT_IO_MQTT_HPP
 #define MONITOR_ADAFRUIT_IO_MQTT_HPP
 
+#ifdef ARDUINO
 #include <Adafruit_MQTT.h>
 #include <Adafruit_MQTT_Client.h>
+#else
+#ifndef MAXBUFFERSIZE
+#define MAXBUFFERSIZE 150  // The Adafruit_MQTT default, so packets fit the same.
+#endif
+#define PROGMEM  // The native build has no flash to keep constants in.
+#endif
 
 // Store the MQTT server, username, and password in flash memory.
 // This is required for using the Adafruit MQTT library.
@@ -33,16 +40,38 @@ static const char MQTT_CLIENTID[] = AIO_KEY __DATE__ __TIME__;
 static const char MQTT_USERNAME[] = AIO_USERNAME;
 static const char MQTT_PASSWORD[] = AIO_KEY;
 
+// Feed keys within the group.
+#define AIO_FEED_BATTERY_VDC     "battery-vdc"
+#define AIO_FEED_CURRENT_MA      "current-ma"
+#define AIO_FEED_HUMIDITY_RH     "humidity-rh"
+#define AIO_FEED_TEMPERATURE_F   "temperature-f"
+#define AIO_FEED_UNIX_EPOCH_TIME "unix-epoch-eastern"
+#define AIO_FEED_DIAGNOSTICS     "diagnostics"
+#define AIO_FEED_BATCH           "batch"
+
 // Define Feeds
-static const char BATTERY_VDC[]     = AIO_USERNAME "/feeds/" AIO_GROUP_KEY ".battery-vdc";
-static const char CURRENT_MA[]      = AIO_USERNAME "/feeds/" AIO_GROUP_KEY ".current-ma";
-static const char HUMIDITY_RH[]     = AIO_USERNAME "/feeds/" AIO_GROUP_KEY ".humidity-rh";
-static const char TEMPERATURE_F[]   = AIO_USERNAME "/feeds/" AIO_GROUP_KEY ".temperature-f";
-static const char UNIX_EPOCH_TIME[] = AIO_USERNAME "/feeds/" AIO_GROUP_KEY ".unix-epoch-eastern";
+static const char BATTERY_VDC[]     = AIO_USERNAME "/feeds/" AIO_GROUP_KEY "." AIO_FEED_BATTERY_VDC;
+static const char CURRENT_MA[]      = AIO_USERNAME "/feeds/" AIO_GROUP_KEY "." AIO_FEED_CURRENT_MA;
+static const char HUMIDITY_RH[]     = AIO_USERNAME "/feeds/" AIO_GROUP_KEY "." AIO_FEED_HUMIDITY_RH;
+static const char TEMPERATURE_F[]   = AIO_USERNAME "/feeds/" AIO_GROUP_KEY "." AIO_FEED_TEMPERATURE_F;
+static const char UNIX_EPOCH_TIME[] = AIO_USERNAME "/feeds/" AIO_GROUP_KEY "." AIO_FEED_UNIX_EPOCH_TIME;
+static const char DIAGNOSTICS[]     = AIO_USERNAME "/feeds/" AIO_GROUP_KEY "." AIO_FEED_DIAGNOSTICS;
+static const char BATCH[]           = AIO_USERNAME "/feeds/" AIO_GROUP_KEY "." AIO_FEED_BATCH;
+
+// Define Group. One JSON document sets every feed in the group at once.
+static const char GROUP[] = AIO_USERNAME "/groups/" AIO_GROUP_KEY;
+#define AIO_GROUP_PAYLOAD_MAX_SIZE 200
 
+// The CA the broker's certificate must lead to, kept in flash until a full
+// handshake needs it. AIO_CA_CERT names a header that defines caCert[] and
+// caCertLen instead, e.g. the one written by tools/bench_broker.py for a
+// local broker.
+#ifdef AIO_CA_CERT
+#include AIO_CA_CERT
+#else
 // DigiCert Global Root G2 used by io.adafruit.com
 // Expires after January 15, 2038, 7:00:00 AM GMT-5
-const unsigned char caCert[] = {
+const unsigned char caCert[] PROGMEM = {
         0x30, 0x82, 0x03, 0x8E, 0x30, 0x82, 0x02, 0x76, 0xA0, 0x03, 0x02, 0x01, 0x02, 0x02, 0x10,
         0x03, 0x3A, 0xF1, 0xE6, 0xA7, 0x11, 0xA9, 0xA0, 0xBB, 0x28, 0x64, 0xB1, 0x1D, 0x09, 0xFA,
         0xE5, 0x30, 0x0D, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x01, 0x0B, 0x05,
@@ -106,5 +135,20 @@ const unsigned char caCert[] = {
         0xC4, 0x5D, 0x56, 0x5B, 0xA2, 0xD9, 0x66, 0x6E, 0xB3, 0x35, 0x37, 0xE5, 0x32, 0xB6
 };
 const unsigned int caCertLen = 914;
+#endif
+
+// The broker's public keys to accept without verifying its chain, in order of
+// preference: the current key, then the keys it may move to. AIO_PINNED_KEYS
+// names a header written by tools/pin_keys.py that defines pinnedKeys[]. The
+// chain is still verified against caCert when no pinned key matches.
+struct aio_pinned_key {
+    const unsigned char *der;  // SubjectPublicKeyInfo, in flash.
+    unsigned int len;
+};
+
+#ifdef AIO_PINNED_KEYS
+#include AIO_PINNED_KEYS
+#define AIO_PINNED_KEY_COUNT (sizeof(pinnedKeys) / sizeof(pinnedKeys[0]))
+#endif
 
 #endif //MONITOR_ADAFRUIT_IO_MQTT_HPP
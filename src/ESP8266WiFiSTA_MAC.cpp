@@ -20,9 +20,13 @@
     SOFTWARE.
  */
 
+#ifdef ARDUINO
+
 #include "ESP8266WiFiSTA_MAC.hpp"
 
 bool wifi_sta_set_mac() {
     uint8 wifi_sta_mac_addr[7] = WIFI_MAC_ADDR;
     return wifi_set_macaddr(STATION_IF, wifi_sta_mac_addr);
-}
\ No newline at end of file
+}
+
+#endif
@@ -21,219 +21,504 @@
  */
 
 #include <bitset>
-#include <Arduino.h>
-#include <WiFiClientSecure.h>
-#include <ESP8266WiFi.h>
+#include "monitor_hal.hpp"
 #include "monitor_data.hpp"
-#include "ESP8266WiFiSTA_MAC.hpp"
 #include "ntp_time_utils.hpp"
 #include "ADAFRUIT_IO_MQTT.hpp"
 #include "monitor_oled_display.hpp"
-#include "monitor_temp_rh_sensor.hpp"
-#include "monitor_current_sensor.hpp"
-#include "monitor_read_battery.hpp"
+#include "monitor_sampler.hpp"
+#include "monitor_ring_buffer.hpp"
+#include "monitor_wifi.hpp"
+#include "monitor_adaptive_sleep.hpp"
+#include "monitor_profiler.hpp"
+#include "monitor_display_mode.hpp"
+#include "monitor_publish.hpp"
+#include "monitor_node.hpp"
+#include "monitor_gateway.hpp"
+#include "monitor_session.hpp"
+#include "monitor_log.hpp"
+#include "monitor_boot.hpp"
+#include "monitor_radio.hpp"
+#include "monitor_battery.hpp"
 
-/*
- * The hardware WDT seemingly objects to running the loop more 5 times.
- * No amount of feeding will dissuade it.
- */
-#define WDT_LOOP_LIMIT 5
+#define DISPLAY_POLL_MS 20
 
-#define SLEEP_TIME_MS ((uint64_t)300e6)
+// On mains power (MONITOR_MAINS) a sampling window starts this often.
+#ifndef MAINS_SAMPLE_MS
+#define MAINS_SAMPLE_MS 500
+#endif
+// Publish at least this often on mains power, whether or not anything changed.
+#ifndef MAINS_PUBLISH_S
+#define MAINS_PUBLISH_S 60
+#endif
+
+#define WIFI_RETRY_INTERVAL_MS 3000
+#define WIFI_CONNECTION_ATTEMPTS_MAX 10
 
 // struct to hold sensor measurements.
 monitor_data sensor;
 
-// Create an ESP8266 WiFiClient class to connect to the MQTT server.
-WiFiClientSecure client;
-
-// Setup the MQTT client class by passing in the WiFi client and MQTT server and login details.
-Adafruit_MQTT_Client mqtt(&client,
-                          MQTT_SERVER,
-                          AIO_SERVERPORT,
-                          MQTT_CLIENTID,
-                          MQTT_USERNAME,
-                          MQTT_PASSWORD);
-
 // struct for setting system time of day.
 ntp_time_utils time_util;
 
 // OLED Display Utilities
 monitor_display oled;
 
-// Temperature and Humidity Utilities
-DHT_Unified dht(DHTPIN, DHTTYPE);
+// Collects every sensor reading while WiFi is associating.
+monitor_sampler sampler;
+
+// Readings waiting to be published.
+monitor_ring_buffer readings;
+
+// WiFi station with fast reconnect.
+monitor_wifi wifi;
+
+// Picks the sleep interval and which readings are worth sending.
+monitor_adaptive_sleep adaptive;
+
+// Where the time of each wake goes.
+monitor_profiler profiler;
+
+// What happened this wake, kept for the serial port until deep sleep.
+monitor_log logger;
+
+// Which wakes boot with the radio, and when it is calibrated.
+monitor_radio radio;
+
+// The battery's state of charge and the hours left.
+monitor_battery battery;
+
+// The MQTT session of the gateway and of mains powered monitors.
+monitor_session session;
+
+#ifdef MONITOR_GATEWAY
+// Publishes for the battery nodes instead of sampling.
+monitor_gateway gateway;
+#endif
 
-// Current Sensor Utilities
-Adafruit_INA219 ina219;
+#ifdef MONITOR_NODE
+// Sends the readings to a gateway instead of publishing them.
+monitor_node node;
+#endif
+
+// What the button interrupts pressed, for loop() to act on.
+monitor_display_mode::button_queue buttons;
+
+// Display mode samples on its own cadence and redraws only when a button or a
+// new reading changed the page.
+monitor_display_mode display_mode;
 
-volatile bool display_data{false};  // Button A toggles the display
-volatile bool degrees_c_f{false};   // Button C toggles the temperature scale.
 volatile bool system_time_set{false};
 volatile int8_t mqtt_connect_status{-1};
-volatile int loop_counter{1};
 
-void monitor_deep_sleep();  //  Advance declaration.
+void monitor_deep_sleep();  //  Advance declarations.
+void start_upload();
+void radio_hop();
+void report_profile();
+void queue_reading();
+uint32_t epoch_now();
+std::bitset<5> drain_readings();
+void display_step();
+bool uplink_ready();
+void mains_step();
 
 int wifi_connection_attempts{0};
+unsigned long next_wifi_check_ms{0};
+bool upload_wake{false};     // Only some wakes bring up the radio.
+bool reading_queued{false};  // The current sampling window is in the queue.
+bool uploaded{false};        // This wake's reading has been published.
+unsigned long mains_sample_ms{0};
+unsigned long mains_published_ms{0};
+bool mains_sampled{false};
+bool mains_display_on{false};
+
+/*
+ * The button interrupts only queue the press; loop() acts on it.
+ */
+HAL_ISR_ATTR void button_a_isr() {
+    buttons.push(BUTTON_A);
+}
+
+HAL_ISR_ATTR void button_b_isr() {
+    buttons.push(BUTTON_B);
+}
+
+HAL_ISR_ATTR void button_c_isr() {
+    buttons.push(BUTTON_C);
+}
 
 void setup() {
-    Serial.begin(115200);
-    // Serial.setDebugOutput(true);
-    dht.begin();     // Initialize the DHT sensor.
-    ina219.begin();  // Initialize the INA219 sensor.
-    oled.enable();   // Enable the SSD1306 OLED Display.
-    pinMode(LED, LOW);  // Turn off the status LED.
-    pinMode(BUTTON_A, INPUT_PULLUP);
-    attachInterrupt(
-            digitalPinToInterrupt(BUTTON_A),
-            [](){display_data = not display_data;},
-            FALLING);
-    pinMode(BUTTON_B, INPUT_PULLUP);
-    attachInterrupt(
-            digitalPinToInterrupt(BUTTON_B),
-            [](){oled.page == 2 ? (oled.page = 0) : (oled.page++);},
-            FALLING);
-    pinMode(BUTTON_C, INPUT_PULLUP);
-    attachInterrupt(
-            digitalPinToInterrupt(BUTTON_C),
-            [](){degrees_c_f = not degrees_c_f;},
-            FALLING);
-    wifi_sta_set_mac();
-    WiFi.begin(WIFI_SSID, WIFI_PASS);
-    while (!Serial) {
-        delay(33);  // Do not exit setup until Serial has success.
+    profiler.begin();
+    hal_begin();
+#ifdef MONITOR_GATEWAY
+    gateway.begin();  // Mains powered. It never sleeps.
+    return;
+#endif
+    radio.begin(hal_reset_reason());
+    if (not radio.on()) {
+        profiler.flag(PROFILE_RADIO_OFF);
+    } else if (radio.booted == HAL_RF_CAL) {
+        profiler.flag(PROFILE_RF_CAL);
+    }
+    battery.begin(radio.on());
+    // The end of a hop for display mode counts as button A held.
+    bool button_a_held = hal_button_down(BUTTON_A) or radio.display;
+#ifdef MONITOR_MAINS
+    monitor_boot boot = monitor_boot::plan(hal_reset_reason(), button_a_held, true);
+#else
+    monitor_boot boot = monitor_boot::plan(hal_reset_reason(), button_a_held, false);
+#endif
+    LOG_INFO("Reset %d, radio %d. Buttons %d, display %d.",
+             hal_reset_reason(), radio.booted, boot.buttons, boot.display);
+    if (boot.buttons) {
+        hal_button_attach(BUTTON_A, button_a_isr);
+        hal_button_attach(BUTTON_B, button_b_isr);
+        hal_button_attach(BUTTON_C, button_c_isr);
+    }
+    if (boot.display) {
+        display_mode.begin();  // The OLED is begun when the first page is shown.
+        profiler.flag(PROFILE_DISPLAY);
+    }
+    time_util.begin();  // Rebuild the clock without the network.
+    readings.begin();
+    adaptive.begin();
+#ifdef MONITOR_MAINS
+    start_upload();  // On mains power the radio stays up.
+#else
+    if (readings.upload_due() and not battery.can_transmit()) {
+        LOG_WARN("The battery can't carry a transmit. The readings stay queued.");
     }
+    if (readings.upload_due() and battery.can_transmit()) {
+        start_upload();
+    } else {
+        hal_wifi_off();  // This wake only samples.
+    }
+#endif
+    sampler.begin();  // Start sampling while WiFi associates.
 }
 
 
 void loop() {
-    ESP.wdtFeed();  // This API only works when software watchdog is enabled.
-    yield();
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.print("IP: ");  Serial.println(WiFi.localIP());
-        Serial.print("DNS: ");  Serial.println(WiFi.dnsIP());
-
-        // SSL certificate validation depends upon setting system time of day.
-        time_util.set_time_of_day();
-        Serial.println(sensor.unix_epoch_time);
-
-        if (mqtt_connect_status != 0) {
-            mqtt_connect_status = mqtt.connect();
-            // Load root certificate in DER format into WiFiClientSecure object.
-            bool res = client.setCACert_P(caCert, caCertLen);
-            if (!res) {
-                Serial.println("Failed to load root CA certificate!");
+    hal_feed_watchdog();
+#ifdef MONITOR_GATEWAY
+    gateway.poll();
+    logger.flush();  // It never sleeps.
+    return;
+#endif
+    display_mode.handle(buttons);
+#ifdef MONITOR_MAINS
+    mains_step();
+    logger.flush();  // It never sleeps.
+    return;
+#endif
+    if (not upload_wake) {
+        if (display_mode.on) {
+            start_upload();  // The display wants fresh readings published.
+        } else {
+            if (sampler.poll(sensor)) {
+                sensor.unix_epoch_time = epoch_now();
+                if (adaptive.changed(sensor)) {
+                    queue_reading();
+                } else {
+                    LOG_INFO("Readings within their deadbands. Not queued.");
+                }
+                LOG_INFO("%u readings queued. Going back to sleep. ZZZzzz...", readings.pending());
+                monitor_deep_sleep();
             }
-            // Verify validity of server's SSL certificate.
-            if (client.verifyCertChain(MQTT_SERVER)) {
-                Serial.println("Server SSL certificate verified.");
-            } else {
-                Serial.println("ERROR: Server SSL certificate verification failed!");
+            hal_delay(sampler.idle_ms());
+            return;
+        }
+    }
+    if (uplink_ready()) {
+        if (mqtt_connect_status != 0) {  // Once per wake.
+#ifdef MONITOR_NODE
+            // No SNTP and no TLS. The gateway's acks carry the time of day.
+            mqtt_connect_status = node.begin() ? 0 : -1;
+            if (mqtt_connect_status != 0) {
+                monitor_deep_sleep();  // The readings stay queued for the next upload.
                 return;
             }
+#else
+            wifi.connected();
+            profiler.mark(PROFILE_WIFI);
+            if (wifi.fast) {
+                profiler.flag(PROFILE_WIFI_FAST);
+            }
+
+            // SSL certificate validation depends upon setting system time of day.
+            if (time_util.set_time_of_day()) {
+                profiler.flag(PROFILE_NTP_SYNCED);
+            }
+            profiler.mark(PROFILE_NTP);
+            char date_time[TIME_STRING_SIZE];
+            LOG_INFO("%s", time_util.format_time(hal_time(), date_time, sizeof(date_time)));
+
+            mqtt_connect_status = hal_mqtt_connect();
+            if (mqtt_connect_status != 0) {
+                LOG_ERROR("ERROR: MQTT connect failed: %s", hal_mqtt_error(mqtt_connect_status));
+                monitor_deep_sleep();  // The readings stay queued for the next upload.
+                return;
+            }
+            profiler.mark(PROFILE_TLS);
+#endif
         }
 
-        sensor.battery_vdc = get_battery_vdc();
-        sensor.current_ma = get_current_ma();
-        if (isnan(sensor.current_ma) or sensor.current_ma < 0) {
-            Serial.println("Error reading current sensor!");
+        if (not uploaded) {
+            // Finish whatever part of the sampling window association didn't cover.
+            sampler.wait(sensor);
+            queue_reading();
+            std::bitset<5> publish_status = drain_readings();
+            uploaded = true;
+            hal_delay(100);
+            LOG_INFO("Publish status battery: %d", publish_status.test(0));
+            LOG_INFO("Publish status current: %d", publish_status.test(1));
+            LOG_INFO("Publish status humidity: %d", publish_status.test(2));
+            LOG_INFO("Publish status temperature: %d", publish_status.test(3));
+            LOG_INFO("Publish status time: %d", publish_status.test(4));
+        }
+        if (display_mode.timed_out()) {
+            LOG_INFO("No button pressed for a while. Going back to sleep. ZZZzzz...");
+            monitor_deep_sleep();
+        } else if (display_mode.on) {
+            display_step();
         } else {
-            Serial.print("Current : ");
-            Serial.print(sensor.current_ma);
-            Serial.println("mA");
+            LOG_INFO("No display work. Going back to sleep. ZZZzzz...");
+            monitor_deep_sleep();
+        }
+    } else {
+        if (sampler.poll(sensor)) {
+            queue_reading();  // Keep the reading should WiFi never come up.
+        }
+        wifi.poll();
+        if ((long) (hal_millis() - next_wifi_check_ms) >= 0) {
+            next_wifi_check_ms = hal_millis() + WIFI_RETRY_INTERVAL_MS;
+            char mac[18];
+            LOG_WARN("WiFi is not connected.");
+            LOG_INFO("MAC Address: %s", hal_wifi_mac(mac, sizeof(mac)));
+            wifi_connection_attempts++;
+            LOG_WARN("Connection attempt #%d failed.", wifi_connection_attempts);
+            if (wifi_connection_attempts == WIFI_CONNECTION_ATTEMPTS_MAX) {
+                monitor_deep_sleep();
+            }
         }
+        hal_delay(sampler.idle_ms());
+    }
+}
 
-        sensors_event_t event;
-        dht.temperature().getEvent(&event);
-        if (isnan(event.temperature)) {
-            Serial.println("Error reading temperature!");
-        } else {
-            sensor.temperature_f = event.temperature * 1.8 + 32;
-            Serial.print("Temperature: ");
-            Serial.print(sensor.temperature_f);
-            Serial.println(" ℉");
-        };
-
-        dht.humidity().getEvent(&event);
-        if (isnan(event.relative_humidity)) {
-            Serial.println("Error reading humidity!");
-        } else {
-            sensor.humidity_rh = event.relative_humidity;
-            Serial.print("Relative Humidity: ");
-            Serial.print(sensor.humidity_rh);
-            Serial.println(" ϕ");
+/*
+ * One pass of display mode, which never blocks for longer than a sensor
+ * conversion. A new reading is published only when it is outside the
+ * deadbands, like a sampling wake would queue it.
+ */
+void display_step() {
+    if (display_mode.step(sampler, sensor)) {
+        sensor.unix_epoch_time = epoch_now();
+        if (adaptive.changed(sensor)) {
+            reading_queued = false;
+            queue_reading();
+            drain_readings();
         }
+    }
+    if (display_mode.dirty) {
+        oled.show_page(display_mode.page);
+        display_mode.dirty = false;
+    }
+    hal_delay(display_mode.state == DISPLAY_SAMPLING ? min(sampler.idle_ms(), (unsigned long) DISPLAY_POLL_MS)
+                                                     : DISPLAY_POLL_MS);
+}
 
-        char payload_float[AIO_MQTT_PAYLOAD_FLOAT_MAX_SIZE];  // Float max 39 digits and minus sign.
-        char zero{'\0'};
-        std::bitset<5> publish_status{0};
-        if (mqtt_connect_status == 0) {
-            // Publish Battery VDC Percent
-            dtostrf(sensor.battery_vdc, 0, AIO_FLOAT_PRECISION, payload_float);
-            publish_status[0] = mqtt.publish(BATTERY_VDC, payload_float, 0);
-            memcpy(&payload_float, &zero, AIO_MQTT_PAYLOAD_FLOAT_MAX_SIZE);
-
-            // Publish Current mA
-            dtostrf(sensor.current_ma, 0, AIO_FLOAT_PRECISION, payload_float);
-            publish_status[1] = mqtt.publish(CURRENT_MA, payload_float, 0);
-            memcpy(&payload_float, &zero, AIO_MQTT_PAYLOAD_FLOAT_MAX_SIZE);
-
-            // Publish Humidity ϕ
-            dtostrf(sensor.humidity_rh, 0, AIO_FLOAT_PRECISION, payload_float);
-            publish_status[2] = mqtt.publish(HUMIDITY_RH, payload_float, 0);
-            memcpy(&payload_float, &zero, AIO_MQTT_PAYLOAD_FLOAT_MAX_SIZE);
-
-            // Publish Temperature ℉
-            dtostrf(sensor.temperature_f, 0, AIO_FLOAT_PRECISION, payload_float);
-            publish_status[3] = mqtt.publish(TEMPERATURE_F, payload_float, 0);
-            memcpy(&payload_float, &zero, AIO_MQTT_PAYLOAD_FLOAT_MAX_SIZE);
-
-            // Publish Unix Epoch Time UTC
-            publish_status[4] = mqtt.publish(UNIX_EPOCH_TIME, sensor.unix_epoch_time, 0);
+/*
+ * One pass on mains power. Sampling windows start every MAINS_SAMPLE_MS and
+ * a reading is queued as soon as it moves outside its deadbands, or every
+ * MAINS_PUBLISH_S. The queue is drained over one session kept open, and holds
+ * the readings while the session is down.
+ */
+void mains_step() {
+    bool up = session.poll();
+    if (not mains_sampled and sampler.poll(sensor)) {
+        mains_sampled = true;
+        sensor.unix_epoch_time = epoch_now();
+        if (adaptive.changed(sensor) or hal_millis() - mains_published_ms >= MAINS_PUBLISH_S * 1000UL) {
+            reading_queued = false;
+            queue_reading();
+            mains_published_ms = hal_millis();
         }
-        Serial.print("Loop "); Serial.print(loop_counter); Serial.print(" of ");
-        Serial.println(WDT_LOOP_LIMIT);
-        if (display_data) {
-            oled.show_page(oled.page);
-            delay(5900);
-            loop_counter++;
-            if (loop_counter > WDT_LOOP_LIMIT) {
-                Serial.println("Display work is exhausting. Tired now. Going to sleep. ZZZzzz...");
-                monitor_deep_sleep();
+        display_mode.dirty = true;
+    }
+    if (mains_sampled and (long) (hal_millis() - mains_sample_ms) >= 0) {
+        mains_sample_ms = hal_millis() + MAINS_SAMPLE_MS;
+        mains_sampled = false;
+        sampler.begin();
+    }
+    if (up and readings.pending()) {
+        drain_readings();
+    }
+    if (display_mode.on != mains_display_on) {  // Button A turns the display on and off.
+        mains_display_on = display_mode.on;
+        if (display_mode.on) {
+            oled.enable();
+        } else {
+            oled.disable();
+        }
+    }
+    if (display_mode.on and display_mode.dirty) {
+        oled.show_page(display_mode.page);
+        display_mode.dirty = false;
+    }
+    hal_delay(min(sampler.idle_ms(), (unsigned long) DISPLAY_POLL_MS));
+}
+
+/*
+ * Bring up the radio to publish the queued readings.
+ */
+void start_upload() {
+    if (not radio.on()) {
+        radio_hop();
+        return;
+    }
+    upload_wake = true;
+    profiler.flag(PROFILE_UPLOAD_WAKE);
+#if defined(MONITOR_NODE) and not defined(MONITOR_LINK_UDP)
+    hal_wifi_on();  // ESP-NOW needs no access point.
+#else
+    wifi.begin();
+#endif
+}
+
+/*
+ * This wake booted with the radio disabled and can't turn it on. Sleep for a
+ * moment and wake with it, still in display mode if that was the reason.
+ */
+void radio_hop() {
+    LOG_INFO("The radio is off this wake. Waking again with it on.");
+    profiler.sleep(0);
+    report_profile();
+    time_util.sleep(0);
+    hal_rf rf = radio.hop(display_mode.on);
+    oled.disable();
+    logger.flush();
+    hal_deep_sleep(RADIO_HOP_MS * 1000ULL, rf);
+}
+
+/*
+ * Whether the readings can be sent: WiFi is up, or for a node on ESP-NOW,
+ * always.
+ */
+bool uplink_ready() {
+#if defined(MONITOR_NODE) and not defined(MONITOR_LINK_UDP)
+    return true;
+#else
+    return hal_wifi_connected();
+#endif
+}
+
+/*
+ * Queue the reading from the current sampling window, once.
+ */
+void queue_reading() {
+    if (reading_queued) {
+        return;
+    }
+    sensor.unix_epoch_time = epoch_now();
+    readings.push(sensor);
+    adaptive.queued(sensor);
+    reading_queued = true;
+}
+
+/*
+ * The time once the clock is set, either by SNTP or carried across deep sleep.
+ */
+uint32_t epoch_now() {
+    return system_time_set ? hal_time() : 0;
+}
+
+/*
+ * Publish the queued readings oldest first. Those not published stay queued
+ * for the next upload.
+ */
+std::bitset<5> drain_readings() {
+    std::bitset<5> publish_status{0};
+    monitor_data reading;
+    uint32_t seq;
+#if defined(AIO_PUBLISH_BATCH) and not defined(MONITOR_NODE)
+    // A backlog goes as batches. A lone reading goes on in the group as usual.
+    monitor_data backlog[RING_BUFFER_CAPACITY];
+    size_t pending;
+    while ((pending = readings.peek(backlog, RING_BUFFER_CAPACITY)) > 1) {
+        for (size_t i = 0; i < pending; i++) {
+            if (backlog[i].unix_epoch_time == 0) {
+                backlog[i].unix_epoch_time = (uint32_t) hal_time();
             }
-        } else if (publish_status != 0) {  // At least one item was published.
-            delay(100);
-            Serial.print("Publish status battery: ");
-            Serial.println(publish_status[0]);
-            Serial.print("Publish status current: ");
-            Serial.println(publish_status[1]);
-            Serial.print("Publish status humidity: ");
-            Serial.println(publish_status[2]);
-            Serial.print("Publish status temperature: ");
-            Serial.println(publish_status[3]);
-            Serial.print("Publish status time: ");
-            Serial.println(publish_status[4]);
-            Serial.println("No display work. Going back to sleep. ZZZzzz...");
-            monitor_deep_sleep();
         }
-    } else {
-        Serial.println("WiFi is not connected.");
-        Serial.print("MAC Address: ");
-        Serial.println(WiFi.macAddress());
-        wifi_connection_attempts++;
-        Serial.print("Connection attempt #");
-        Serial.print(wifi_connection_attempts);
-        Serial.println(" failed.");
-        if (wifi_connection_attempts == 10) {
-            monitor_deep_sleep();
+        size_t sent = publish_batch(backlog, pending);
+        if (sent == 0) {
+            return publish_status;
+        }
+        publish_status.set();
+        while (sent--) {
+            readings.pop();
+        }
+    }
+#endif
+    while (readings.peek(reading, seq)) {
+#ifdef MONITOR_NODE
+        // The gateway stamps readings taken before the clock was ever set.
+        publish_status.reset();
+        if (node.send(reading, seq)) {
+            publish_status.set();
+            time_util.set_time(node.gateway_epoch);
+        }
+#else
+        // Readings taken before the clock was ever set are stamped now.
+        time_t created_at = reading.unix_epoch_time ? reading.unix_epoch_time : hal_time();
+#ifdef AIO_PUBLISH_PER_FEED
+        publish_status = publish_feeds(reading, created_at);
+#else
+        publish_status = publish_group(reading, created_at);
+#endif
+#endif
+        if (publish_status.none()) {
+            break;
+        }
+        readings.pop();
+    }
+    return publish_status;
+}
+
+/*
+ * Print this wake's profile and, with PROFILE_FEED, publish it together with
+ * the last wake's, which is usually a sampling-only wake.
+ */
+void report_profile() {
+    char text[PROFILE_TEXT_SIZE];
+    LOG_INFO("PROFILE %s", monitor_profiler::encode(profiler.current, text, sizeof(text)));
+#if defined(PROFILE_FEED) and not defined(MONITOR_NODE)
+    if (upload_wake and mqtt_connect_status == 0) {
+        if (profiler.last_valid) {
+            hal_mqtt_publish(DIAGNOSTICS, monitor_profiler::encode(profiler.last, text, sizeof(text)));
         }
-        delay(3000);
+        hal_mqtt_publish(DIAGNOSTICS, monitor_profiler::encode(profiler.current, text, sizeof(text)));
     }
+#endif
 }
 
 void monitor_deep_sleep() {
+    LOG_INFO("Awake for %lu ms.", hal_millis());
+    uint32_t sleep_s = battery.stretch(adaptive.sleep(sensor));
+    battery.sleep(sensor, hal_millis(), sleep_s);
+    LOG_INFO("Battery %d%%, about %u h left at %d uA.", battery.percent(), battery.runtime_h(),
+             (int) battery.current.drain_ua);
+    profiler.sleep(sleep_s);
+    report_profile();
+    LOG_INFO("Sleeping for %u s.", sleep_s);
+    readings.sleep(upload_wake);
+    // The queue decides at boot from RTC memory, so it can tell now.
+    hal_rf rf = radio.sleep(readings.upload_due() and battery.can_transmit(), sleep_s);
+    LOG_INFO("Next wake radio %d, %u s since it was calibrated.", rf, radio.current.cal_age_s);
+    time_util.sleep(sleep_s);
     oled.disable();
-    mqtt.disconnect();
-    ESP.deepSleep(SLEEP_TIME_MS, RF_NO_CAL);
+    hal_mqtt_disconnect();
+    hal_wifi_off();
+    logger.flush();  // With the radio off.
+    hal_deep_sleep(sleep_s * 1000000ULL, rf);
 }
\ No newline at end of file
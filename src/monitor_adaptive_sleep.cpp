@@ -0,0 +1,85 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_adaptive_sleep.hpp"
+
+void monitor_adaptive_sleep::begin() {
+    history_valid = rtc_load(RTC_ADAPTIVE_SLEEP_OFFSET, history);
+    if (not history_valid) {
+        history = state{};
+        history.sleep_s = ADAPTIVE_SLEEP_MIN_S;
+    }
+}
+
+/*
+ * Whether a reading is worth queueing: it moved outside a deadband of the last
+ * one queued, or the heartbeat is due.
+ */
+bool monitor_adaptive_sleep::changed(const monitor_data &reading) const {
+    return history.queued_epoch == 0  // Nothing queued yet, or no history.
+           or reading.unix_epoch_time - history.queued_epoch >= ADAPTIVE_HEARTBEAT_S
+           or outside_deadbands(history.queued, reading);
+}
+
+void monitor_adaptive_sleep::queued(const monitor_data &reading) {
+    remember(history.queued, reading);
+    history.queued_epoch = reading.unix_epoch_time;
+}
+
+/*
+ * Pick the next sleep interval on the way into deep sleep. Returns seconds.
+ */
+uint32_t monitor_adaptive_sleep::sleep(const monitor_data &reading) {
+    if (not history_valid or outside_deadbands(history.sampled, reading)) {
+        history.sleep_s = ADAPTIVE_SLEEP_MIN_S;
+    } else {
+        history.sleep_s = min((uint32_t) ADAPTIVE_SLEEP_MAX_S, history.sleep_s * 2);
+    }
+    remember(history.sampled, reading);
+    rtc_save(RTC_ADAPTIVE_SLEEP_OFFSET, history);
+    return history.sleep_s;
+}
+
+bool monitor_adaptive_sleep::outside_deadbands(const channels &was, const monitor_data &reading) {
+    if ((reading.flags & MONITOR_DATA_TEMPERATURE_VALID)
+        and abs(reading.temperature_cf - was.temperature_cf) > ADAPTIVE_DEADBAND_CF) {
+        return true;
+    }
+    if ((reading.flags & MONITOR_DATA_HUMIDITY_VALID)
+        and abs((int32_t) reading.humidity_crh - was.humidity_crh) > ADAPTIVE_DEADBAND_CRH) {
+        return true;
+    }
+    return (reading.flags & MONITOR_DATA_CURRENT_VALID)
+           and abs(reading.current_cma - was.current_cma) > ADAPTIVE_DEADBAND_CMA;
+}
+
+void monitor_adaptive_sleep::remember(channels &into, const monitor_data &reading) {
+    if (reading.flags & MONITOR_DATA_CURRENT_VALID) {
+        into.current_cma = reading.current_cma;
+    }
+    if (reading.flags & MONITOR_DATA_TEMPERATURE_VALID) {
+        into.temperature_cf = reading.temperature_cf;
+    }
+    if (reading.flags & MONITOR_DATA_HUMIDITY_VALID) {
+        into.humidity_crh = reading.humidity_crh;
+    }
+}
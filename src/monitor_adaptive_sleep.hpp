@@ -0,0 +1,86 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_ADAPTIVE_SLEEP_HPP
+#define MONITOR_MONITOR_ADAPTIVE_SLEEP_HPP
+
+#include "monitor_hal.hpp"
+#include "monitor_data.hpp"
+#include "monitor_rtc_memory.hpp"
+
+// Shortest and longest deep sleep, in seconds.
+#ifndef ADAPTIVE_SLEEP_MIN_S
+#define ADAPTIVE_SLEEP_MIN_S 300
+#endif
+#ifndef ADAPTIVE_SLEEP_MAX_S
+#define ADAPTIVE_SLEEP_MAX_S 1800
+#endif
+
+// Changes smaller than these, in hundredths, are not worth sending.
+#ifndef ADAPTIVE_DEADBAND_CF
+#define ADAPTIVE_DEADBAND_CF 50
+#endif
+#ifndef ADAPTIVE_DEADBAND_CRH
+#define ADAPTIVE_DEADBAND_CRH 100
+#endif
+#ifndef ADAPTIVE_DEADBAND_CMA
+#define ADAPTIVE_DEADBAND_CMA 500
+#endif
+
+// Queue a reading at least this often even when nothing changed.
+#ifndef ADAPTIVE_HEARTBEAT_S
+#define ADAPTIVE_HEARTBEAT_S 3600
+#endif
+
+/*
+ * Stretches the sleep interval while temperature, humidity and current stay
+ * inside their deadbands and drops back to the shortest interval as soon as
+ * one of them moves. Readings within the deadbands of the last one queued are
+ * not queued at all, so a quiet room keeps the radio off.
+ */
+struct monitor_adaptive_sleep {
+    struct channels {
+        int32_t current_cma;
+        int16_t temperature_cf;
+        uint16_t humidity_crh;
+    };
+    struct state {
+        channels sampled;  // The reading from the last wake.
+        channels queued;   // The reading last queued for publishing.
+        uint32_t queued_epoch;
+        uint32_t sleep_s;
+    };
+    void begin();
+    bool changed(const monitor_data &reading) const;
+    void queued(const monitor_data &reading);
+    uint32_t sleep(const monitor_data &reading);
+    state history{};
+    bool history_valid{false};
+private:
+    static bool outside_deadbands(const channels &was, const monitor_data &reading);
+    static void remember(channels &into, const monitor_data &reading);
+};
+
+static_assert(sizeof(rtc_region<monitor_adaptive_sleep::state>) <= RTC_ADAPTIVE_SLEEP_BLOCKS * 4,
+              "The adaptive sleep state outgrew its RTC memory region.");
+
+#endif //MONITOR_MONITOR_ADAPTIVE_SLEEP_HPP
@@ -0,0 +1,119 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_batch.hpp"
+
+#define BATCH_COUNT_AT 1  // After the 1 byte version.
+// The gaps interval() looks at, from the oldest readings.
+#define BATCH_INTERVAL_GAPS 15
+
+monitor_batch::monitor_batch(uint8_t *buffer, size_t buffer_len) : buffer(buffer), size(buffer_len) {
+}
+
+/*
+ * Start a batch. When even the header doesn't fit nothing is written, and
+ * add() fails.
+ */
+void monitor_batch::begin(uint32_t base_time, uint32_t interval_s) {
+    len = 0;
+    count = 0;
+    this->interval_s = interval_s;
+    last = monitor_data{};
+    last.unix_epoch_time = base_time - interval_s;
+    last.flags = MONITOR_DATA_CURRENT_VALID | MONITOR_DATA_HUMIDITY_VALID | MONITOR_DATA_TEMPERATURE_VALID;
+    if (not (put_varint(BATCH_VERSION) and put_varint(0) and put_varint(base_time) and put_varint(interval_s))) {
+        len = 0;
+    }
+}
+
+/*
+ * Append a reading. False, with the batch as it was, when it doesn't fit or
+ * the batch is full.
+ */
+bool monitor_batch::add(const monitor_data &reading) {
+    if (len == 0 or count == UINT8_MAX) {
+        return false;
+    }
+    size_t start = len;
+    bool flags_changed = reading.flags != last.flags;
+    uint32_t time = (uint32_t) (reading.unix_epoch_time - last.unix_epoch_time - interval_s);
+    uint64_t zigzag = (uint32_t) ((time << 1) ^ (uint32_t) ((int32_t) time >> 31));
+    bool fits = put_varint(zigzag << 1 | (flags_changed ? 1 : 0))
+                and (not flags_changed or put_varint(reading.flags))
+                and put_zigzag((uint32_t) (reading.battery_vdc - last.battery_vdc));
+    monitor_data next = last;
+    next.unix_epoch_time = reading.unix_epoch_time;
+    next.flags = reading.flags;
+    next.battery_vdc = reading.battery_vdc;
+    if (fits and reading.flags & MONITOR_DATA_CURRENT_VALID) {
+        fits = put_zigzag((uint32_t) reading.current_cma - (uint32_t) last.current_cma);
+        next.current_cma = reading.current_cma;
+    }
+    if (fits and reading.flags & MONITOR_DATA_HUMIDITY_VALID) {
+        fits = put_zigzag((uint32_t) (reading.humidity_crh - last.humidity_crh));
+        next.humidity_crh = reading.humidity_crh;
+    }
+    if (fits and reading.flags & MONITOR_DATA_TEMPERATURE_VALID) {
+        fits = put_zigzag((uint32_t) (reading.temperature_cf - last.temperature_cf));
+        next.temperature_cf = reading.temperature_cf;
+    }
+    if (not fits) {
+        len = start;
+        return false;
+    }
+    last = next;
+    buffer[BATCH_COUNT_AT] = ++count;
+    return true;
+}
+
+/*
+ * The median gap between the readings, which most of the time deltas are
+ * closest to. The readings are oldest first.
+ */
+uint32_t monitor_batch::interval(const monitor_data *readings, size_t count) {
+    uint32_t gaps[BATCH_INTERVAL_GAPS];
+    size_t n{0};
+    for (size_t i = 1; i < count and n < BATCH_INTERVAL_GAPS; i++) {
+        uint32_t gap = readings[i].unix_epoch_time - readings[i - 1].unix_epoch_time;
+        size_t at = n++;
+        for (; at > 0 and gaps[at - 1] > gap; at--) {
+            gaps[at] = gaps[at - 1];
+        }
+        gaps[at] = gap;
+    }
+    return n ? gaps[n / 2] : 0;
+}
+
+bool monitor_batch::put_varint(uint64_t value) {
+    do {
+        if (len >= size) {
+            return false;
+        }
+        buffer[len++] = (uint8_t) ((value & 0x7F) | (value > 0x7F ? 0x80 : 0));
+        value >>= 7;
+    } while (value);
+    return true;
+}
+
+bool monitor_batch::put_zigzag(uint32_t difference) {
+    return put_varint((difference << 1) ^ (uint32_t) ((int32_t) difference >> 31));
+}
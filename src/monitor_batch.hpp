@@ -0,0 +1,75 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_BATCH_HPP
+#define MONITOR_MONITOR_BATCH_HPP
+
+#include "monitor_data.hpp"
+
+#define BATCH_VERSION 1
+// The largest batch the firmware sends, before base64.
+#ifndef BATCH_SIZE_MAX
+#define BATCH_SIZE_MAX 96
+#endif
+
+/*
+ * A compact wire format for a run of readings, for uploading a backlog in one
+ * message. Each channel is sent as the change from its last value, which is
+ * usually a byte or two. Varints are little-endian base 128; signed values are
+ * zigzag encoded first, so small changes either way stay small.
+ *
+ *   version      1 byte, BATCH_VERSION.
+ *   count        1 byte, the number of readings.
+ *   base time    varint, the Unix time of the first reading.
+ *   interval     varint, the usual seconds between readings.
+ *   Then for each reading:
+ *   time         zigzag of the seconds since the last reading less the
+ *                interval, shifted left by one. The low bit is set when flags
+ *                follow. The reading before the first is taken to be an
+ *                interval before base time, so the first one is 0 or 1.
+ *   flags        1 byte, the MONITOR_DATA_*_VALID bits, only when they changed.
+ *                All three are set before the first reading.
+ *   battery      zigzag of the change in percent.
+ *   current      zigzag of the change in hundredths of a mA, when valid.
+ *   humidity     zigzag of the change in hundredths of a percent, when valid.
+ *   temperature  zigzag of the change in hundredths of a ℉, when valid.
+ *
+ * Each change is from the last valid value of the channel, 0 before the first
+ * one. Differences wrap at 32 bits. tools/batch_bridge.py decodes batches.
+ */
+struct monitor_batch {
+    monitor_batch(uint8_t *buffer, size_t buffer_len);
+    void begin(uint32_t base_time, uint32_t interval_s);
+    bool add(const monitor_data &reading);
+    static uint32_t interval(const monitor_data *readings, size_t count);
+    uint8_t *buffer;
+    size_t size;
+    size_t len{0};
+    uint8_t count{0};
+private:
+    bool put_varint(uint64_t value);
+    bool put_zigzag(uint32_t difference);
+    monitor_data last{};
+    uint32_t interval_s{0};
+};
+
+#endif //MONITOR_MONITOR_BATCH_HPP
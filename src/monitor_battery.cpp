@@ -0,0 +1,161 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_battery.hpp"
+
+/*
+ * Open circuit voltage of a LiPo cell at rest, in mV, at 0%, 5% ... 100%
+ * state of charge.
+ */
+constexpr uint16_t ocv_table_mv[BATTERY_OCV_POINTS] {
+        3270, 3610, 3690, 3710, 3730, 3750, 3770, 3790, 3800, 3820, 3840,
+        3850, 3870, 3910, 3950, 3980, 4020, 4080, 4110, 4150, 4200
+};
+
+void monitor_battery::begin(bool radio_on) {
+    known = rtc_load(RTC_BATTERY_OFFSET, current);
+    if (not known) {
+        current = state{};
+        current.scale = 1.0f;
+    }
+    active_ma = radio_on ? BATTERY_RADIO_MA : BATTERY_CPU_MA;
+}
+
+/*
+ * Correct the state of charge with a battery reading taken at active_ma.
+ */
+void monitor_battery::measure(int loaded_mv) {
+    int ocv_mv = loaded_mv + (int) (active_ma * BATTERY_RESISTANCE_MOHM / 1000.0f);
+    float observed = soc_at(ocv_mv);
+    float noise = BATTERY_VOLTAGE_NOISE_MV / slope_at(observed);
+    float observed_variance = noise * noise;
+    float innovation = observed - current.soc;
+    if (not known or (fabsf(innovation) > BATTERY_RESEED_SOC
+                      and innovation * innovation > 16.0f * (current.variance + observed_variance))) {
+        current.soc = observed;
+        current.variance = observed_variance;
+        current.anchor = observed;
+        current.counted = 0.0f;
+        known = true;
+    } else {
+        float gain = current.variance / (current.variance + observed_variance);
+        current.soc += gain * innovation;
+        current.variance *= 1.0f - gain;
+    }
+    current.ocv_mv = (uint16_t) ocv_mv;
+}
+
+/*
+ * Count off this wake and the coming sleep, and keep the state for the next
+ * wake.
+ */
+void monitor_battery::sleep(const monitor_data &reading, unsigned long awake_ms, uint32_t sleep_s) {
+    if (not known) {
+        return;  // No reading yet to start from.
+    }
+    float awake_ma = active_ma;
+#ifdef BATTERY_INA219_SUPPLY
+    if (reading.flags & MONITOR_DATA_CURRENT_VALID) {
+        awake_ma = reading.current_cma / 100.0f;
+    }
+#endif
+    float used_uah = (awake_ma * awake_ms / 3600.0f + BATTERY_SLEEP_UA * sleep_s / 3600.0f) * current.scale;
+    float used = used_uah / (BATTERY_CAPACITY_MAH * 1000.0f);
+    current.soc = current.soc > used ? current.soc - used : 0.0f;
+    current.variance += BATTERY_COUNT_ERROR * BATTERY_COUNT_ERROR * used;
+    current.counted += used;
+    if (current.counted >= BATTERY_LEARN_SOC) {
+        // Halfway to what the fall asks for, since the fall was partly counted.
+        float scale = current.scale * (1.0f + ((current.anchor - current.soc) / current.counted - 1.0f) / 2);
+        current.scale = scale < 0.5f ? 0.5f : (scale > 2.0f ? 2.0f : scale);
+        current.anchor = current.soc;
+        current.counted = 0.0f;
+    }
+    float cycle_s = awake_ms / 1000.0f + sleep_s;
+    float draw_ua = used_uah * 3600.0f / cycle_s;
+    if (current.drain_ua > 0.0f) {
+        current.drain_ua += (draw_ua - current.drain_ua) * cycle_s / (BATTERY_DRAIN_TAU_S + cycle_s);
+    } else {
+        current.drain_ua = draw_ua;
+    }
+    rtc_save(RTC_BATTERY_OFFSET, current);
+}
+
+/*
+ * The sleep interval, longer in proportion when fewer than BATTERY_RESERVE_H
+ * hours are left.
+ */
+uint32_t monitor_battery::stretch(uint32_t sleep_s) const {
+    if (not known or current.drain_ua <= 0.0f or sleep_s >= BATTERY_SLEEP_MAX_S) {
+        return sleep_s;
+    }
+    uint32_t hours = runtime_h();
+    if (hours >= BATTERY_RESERVE_H) {
+        return sleep_s;
+    }
+    uint32_t stretched = sleep_s * BATTERY_RESERVE_H / (hours ? hours : 1);
+    return stretched < BATTERY_SLEEP_MAX_S ? stretched : BATTERY_SLEEP_MAX_S;
+}
+
+int8_t monitor_battery::percent() const {
+    return (int8_t) lroundf(current.soc * 100.0f);
+}
+
+/*
+ * Hours left at the mean draw, until empty.
+ */
+uint32_t monitor_battery::runtime_h() const {
+    float usable = current.soc - empty_soc();
+    if (usable <= 0.0f or current.drain_ua <= 0.0f) {
+        return 0;
+    }
+    return (uint32_t) (usable * BATTERY_CAPACITY_MAH * 1000.0f / current.drain_ua);
+}
+
+/*
+ * State of charge at an open circuit voltage, from the table.
+ */
+float monitor_battery::soc_at(int ocv_mv) {
+    if (ocv_mv <= ocv_table_mv[0]) {
+        return 0.0f;
+    }
+    for (int i = 1; i < BATTERY_OCV_POINTS; i++) {
+        if (ocv_mv < ocv_table_mv[i]) {
+            float part = (float) (ocv_mv - ocv_table_mv[i - 1]) / (ocv_table_mv[i] - ocv_table_mv[i - 1]);
+            return (i - 1 + part) / (BATTERY_OCV_POINTS - 1);
+        }
+    }
+    return 1.0f;
+}
+
+/*
+ * mV per unit of state of charge, where the table has it.
+ */
+float monitor_battery::slope_at(float soc) {
+    int i = (int) (soc * (BATTERY_OCV_POINTS - 1));
+    i = i < 0 ? 0 : (i > BATTERY_OCV_POINTS - 2 ? BATTERY_OCV_POINTS - 2 : i);
+    return (float) (ocv_table_mv[i + 1] - ocv_table_mv[i]) * (BATTERY_OCV_POINTS - 1);
+}
+
+float monitor_battery::empty_soc() {
+    return soc_at(BATTERY_CUTOFF_MV + BATTERY_PEAK_MA * BATTERY_RESISTANCE_MOHM / 1000);
+}
@@ -0,0 +1,128 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_BATTERY_HPP
+#define MONITOR_MONITOR_BATTERY_HPP
+
+#include "monitor_hal.hpp"
+#include "monitor_data.hpp"
+#include "monitor_rtc_memory.hpp"
+
+// The cell, and the resistance of the cell and its wiring.
+#ifndef BATTERY_CAPACITY_MAH
+#define BATTERY_CAPACITY_MAH 2500
+#endif
+#ifndef BATTERY_RESISTANCE_MOHM
+#define BATTERY_RESISTANCE_MOHM 200
+#endif
+// The board's draw awake with the radio on and with it off, and in deep sleep.
+#ifndef BATTERY_RADIO_MA
+#define BATTERY_RADIO_MA 75
+#endif
+#ifndef BATTERY_CPU_MA
+#define BATTERY_CPU_MA 20
+#endif
+#ifndef BATTERY_SLEEP_UA
+#define BATTERY_SLEEP_UA 100
+#endif
+// The cell is empty once a transmit peak would pull it below the cutoff, where
+// the regulator's output sags and the ESP8266 browns out.
+#ifndef BATTERY_PEAK_MA
+#define BATTERY_PEAK_MA 400
+#endif
+#ifndef BATTERY_CUTOFF_MV
+#define BATTERY_CUTOFF_MV 3450
+#endif
+// Below this many hours to empty, the sleep interval is stretched in proportion,
+// up to BATTERY_SLEEP_MAX_S.
+#ifndef BATTERY_RESERVE_H
+#define BATTERY_RESERVE_H 168
+#endif
+#ifndef BATTERY_SLEEP_MAX_S
+#define BATTERY_SLEEP_MAX_S 3600
+#endif
+// The error of a corrected voltage reading, and of the charge counted by the
+// model as a fraction of it. They weigh the voltage against the count.
+#define BATTERY_VOLTAGE_NOISE_MV 20.0f
+#define BATTERY_COUNT_ERROR 0.2f
+// A reading this far from the count, and well outside their errors, means the
+// cell was charged or swapped. The count starts again from the voltage.
+#define BATTERY_RESEED_SOC 0.25f
+// The mean draw follows the last few days.
+#define BATTERY_DRAIN_TAU_S 259200.0f
+// Each time this much has been counted, the count is scaled toward the fall in
+// the state of charge it was checked against, which learns the model's error.
+#define BATTERY_LEARN_SOC 0.05f
+#define BATTERY_OCV_POINTS 21
+
+/*
+ * The battery's state of charge, by coulomb counting checked against the
+ * cell's open circuit voltage.
+ *
+ * On the way into deep sleep the charge of the wake, its time at
+ * BATTERY_RADIO_MA or BATTERY_CPU_MA, or at the current the INA219 measured
+ * when BATTERY_INA219_SUPPLY says it sits in the battery lead, is counted off,
+ * with the coming sleep at BATTERY_SLEEP_UA. Each wake's battery reading, with
+ * the drop across the cell's resistance put back, is looked up in a LiPo open
+ * circuit voltage table and blended in as a one-state Kalman filter: the
+ * count's variance grows with the charge counted, the reading's is the voltage
+ * noise over the slope of the table. So on the flat middle of the curve the
+ * count is trusted and near empty, where the curve is steep, the voltage is.
+ *
+ * The fall in the state of charge against the charge counted, every
+ * BATTERY_LEARN_SOC, scales the count, so the model's currents needn't be
+ * right. The mean draw over the last few days gives the hours left until the
+ * cell can no longer carry a transmit peak. Below BATTERY_RESERVE_H they
+ * stretch the sleep interval, and at empty the radio stays off.
+ */
+struct monitor_battery {
+    struct state {
+        float soc;       // State of charge, 0 to 1.
+        float variance;  // Of soc.
+        float drain_ua;  // The mean draw, awake and asleep.
+        float scale;     // Of the modelled draw.
+        float anchor;    // The state of charge when counting started.
+        float counted;   // Since then.
+        uint16_t ocv_mv;
+        uint16_t reserved;
+    };
+    void begin(bool radio_on);
+    void measure(int loaded_mv);
+    void sleep(const monitor_data &reading, unsigned long awake_ms, uint32_t sleep_s);
+    uint32_t stretch(uint32_t sleep_s) const;
+    bool can_transmit() const { return not known or current.soc > empty_soc(); }
+    int8_t percent() const;
+    uint32_t runtime_h() const;
+    static float soc_at(int ocv_mv);
+    static float slope_at(float soc);
+    static float empty_soc();
+    state current{};
+    bool known{false};  // There is a state of charge, from RTC memory or a reading.
+    float active_ma{BATTERY_RADIO_MA};
+};
+
+extern monitor_battery battery;
+
+static_assert(sizeof(rtc_region<monitor_battery::state>) <= RTC_BATTERY_BLOCKS * 4,
+              "The battery state outgrew its RTC memory region.");
+
+#endif //MONITOR_MONITOR_BATTERY_HPP
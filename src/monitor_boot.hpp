@@ -0,0 +1,54 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_BOOT_HPP
+#define MONITOR_MONITOR_BOOT_HPP
+
+#include "monitor_hal.hpp"
+
+/*
+ * What a wake brings up besides the sensors, decided from why it woke and
+ * whether button A was held as it did. The sensors are begun by their drivers
+ * at their first conversion, so a wake that doesn't sample never begins them.
+ *
+ *   reset        button A   power      buttons   display
+ *   deep sleep   up         battery    no        no
+ *   deep sleep   held       battery    yes       yes
+ *   power on     up         battery    yes       no
+ *   power on     held       battery    yes       yes
+ *   crash        up         battery    no        no
+ *   crash        held       battery    yes       yes
+ *   any          up         mains      yes       no
+ *   any          held       mains      yes       yes
+ *
+ * The usual wake, out of deep sleep with nobody there, attaches no interrupts
+ * and leaves the OLED as the last wake left it, switched off. A power on or a
+ * press of the reset button means someone is at the device, so the buttons
+ * work from the start. The OLED is begun the first time a page is shown.
+ */
+struct monitor_boot {
+    bool buttons;  // Attach the button interrupts.
+    bool display;  // Start in display mode.
+    static monitor_boot plan(hal_reset reset, bool button_a_held, bool mains);
+};
+
+#endif //MONITOR_MONITOR_BOOT_HPP
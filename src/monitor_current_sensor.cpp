@@ -24,17 +24,7 @@
 //
 
 #include "monitor_current_sensor.hpp"
-extern Adafruit_INA219 ina219;
 
-double get_current_ma(){
-    const size_t readings_len{30};
-    std::array<double, readings_len> readings{};
-    readings.fill(0.0);
-    for (int i=0; i < (int) readings_len; i++) {
-        readings[i] = ina219.getCurrent_mA();
-        delay(33);
-    }
-    double sum = accumulate(begin(readings), end(readings), 0, std::plus<double>());
-    double level = sum / (double) readings_len;
-    return level;
-}
\ No newline at end of file
+double read_current_ma() {
+    return hal_current_ma();
+}
@@ -24,8 +24,8 @@
 #define MONITOR_MONITOR_CURRENT_SENSOR_HPP
 
 // Measure high side voltage and DC current draw over I2C.
-#include <Adafruit_INA219.h>
+#include "monitor_hal.hpp"
 
-double get_current_ma(void);
+double read_current_ma(void);
 
 #endif //MONITOR_MONITOR_CURRENT_SENSOR_HPP
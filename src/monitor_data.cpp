@@ -0,0 +1,45 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_data.hpp"
+#include "monitor_text.hpp"
+
+#ifndef AIO_FLOAT_PRECISION
+#define AIO_FLOAT_PRECISION 2
+#endif
+
+/*
+ * Hundredths of a degree Fahrenheit to hundredths of a degree Celsius, rounded.
+ */
+int32_t centi_f_to_c(int32_t centi_f) {
+    int32_t scaled = (centi_f - 3200) * 5;
+    return (scaled + (scaled < 0 ? -4 : 4)) / 9;
+}
+
+/*
+ * Write a value held in hundredths as decimal text with AIO_FLOAT_PRECISION
+ * places, rounding half away from zero as dtostrf() does.
+ */
+char *format_centi(int32_t centi, char *buffer, size_t buffer_len) {
+    monitor_text(buffer, buffer_len).print_fixed(centi, 2, AIO_FLOAT_PRECISION);
+    return buffer;
+}
@@ -23,12 +23,35 @@
 #ifndef MONITOR_MONITOR_DATA_HPP
 #define MONITOR_MONITOR_DATA_HPP
 
+#include <stddef.h>
+#include <stdint.h>
+
+// Which of the readings in a monitor_data are good.
+#define MONITOR_DATA_CURRENT_VALID     0x01
+#define MONITOR_DATA_HUMIDITY_VALID    0x02
+#define MONITOR_DATA_TEMPERATURE_VALID 0x04
+
+/*
+ * One set of readings in fixed-point. The ESP8266 has no FPU so readings are
+ * kept as integer hundredths and only turned into text for the display and the
+ * wire. This is also the record kept in the store-and-forward queue.
+ */
 struct monitor_data {
-    int battery_vdc;
-    double current_ma;
-    double humidity_rh;
-    double temperature_f;
-    char unix_epoch_time[29]; // Wed Dec 28 11:44:28 2011 GMT
+    uint32_t unix_epoch_time;  // UTC
+    int32_t current_cma;       // Hundredths of a milliamp.
+    int16_t temperature_cf;    // Hundredths of a degree Fahrenheit.
+    uint16_t humidity_crh;     // Hundredths of a percent relative humidity.
+    int8_t battery_vdc;        // Percent.
+    uint8_t flags;
+    uint16_t reserved;
 };
 
+static_assert(sizeof(monitor_data) == 16, "monitor_data should pack into 16 bytes.");
+
+// The text of the widest value in hundredths, "-21474836.48", and its terminator.
+#define CENTI_TEXT_SIZE 13
+
+int32_t centi_f_to_c(int32_t centi_f);
+char *format_centi(int32_t centi, char *buffer, size_t buffer_len);
+
 #endif //MONITOR_MONITOR_DATA_HPP
@@ -0,0 +1,107 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_display_mode.hpp"
+
+/*
+ * Display mode from boot, as if button A was pressed.
+ */
+void monitor_display_mode::begin() {
+    on = true;
+    touched_ms = hal_millis();
+}
+
+/*
+ * Act on the presses the interrupts queued. Contact bounce shows up as repeats
+ * of the same button, which are dropped.
+ */
+void monitor_display_mode::handle(button_queue &buttons) {
+    uint8_t button;
+    while (buttons.pop(button)) {
+        unsigned long now_ms = hal_millis();
+        if (button == last_button and now_ms - last_button_ms < BUTTON_DEBOUNCE_MS) {
+            continue;
+        }
+        last_button = button;
+        last_button_ms = now_ms;
+        touched_ms = now_ms;
+        switch (button) {
+            case BUTTON_A:
+                on = not on;
+                break;
+            case BUTTON_B:
+                page = page == 2 ? 0 : page + 1;
+                break;
+            case BUTTON_C:
+                celsius = not celsius;
+                break;
+            default:
+                break;
+        }
+        dirty = true;
+    }
+    if (not on) {
+        state = DISPLAY_OFF;
+    }
+}
+
+/*
+ * Whether display mode just ended because no button was pressed for
+ * DISPLAY_TIMEOUT_S. On mains power it is never asked, and stays on.
+ */
+bool monitor_display_mode::timed_out() {
+    if (not on or (long) (hal_millis() - touched_ms) < DISPLAY_TIMEOUT_S * 1000L) {
+        return false;
+    }
+    on = false;
+    state = DISPLAY_OFF;
+    return true;
+}
+
+/*
+ * One pass of display mode. Returns true when a sampling window finished with
+ * a new reading in data.
+ */
+bool monitor_display_mode::step(monitor_sampler &sampler, monitor_data &data) {
+    switch (state) {
+        case DISPLAY_OFF:
+            state = DISPLAY_WAITING;  // The upload just took a reading.
+            refresh_ms = hal_millis() + DISPLAY_REFRESH_MS;
+            dirty = true;
+            break;
+        case DISPLAY_SAMPLING:
+            if (sampler.poll(data)) {
+                state = DISPLAY_WAITING;
+                refresh_ms = hal_millis() + DISPLAY_REFRESH_MS;
+                dirty = true;
+                return true;
+            }
+            break;
+        case DISPLAY_WAITING:
+            if ((long) (hal_millis() - refresh_ms) >= 0) {
+                sampler.begin();
+                state = DISPLAY_SAMPLING;
+            }
+            break;
+    }
+    return false;
+}
@@ -0,0 +1,82 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_DISPLAY_MODE_HPP
+#define MONITOR_MONITOR_DISPLAY_MODE_HPP
+
+#include "monitor_hal.hpp"
+#include "monitor_data.hpp"
+#include "monitor_event_queue.hpp"
+#include "monitor_sampler.hpp"
+
+#if defined(ESP8266) or not defined(ARDUINO)
+#define BUTTON_A 12
+#define BUTTON_B 13
+#define BUTTON_C 14
+#define LED      0
+#endif
+
+#define BUTTON_EVENTS 8  // Presses the interrupts can queue between passes of loop().
+// A press toggles once. Long enough to swallow the bounce on release, too.
+#define BUTTON_DEBOUNCE_MS 250
+
+// How often display mode samples the sensors.
+#ifndef DISPLAY_REFRESH_MS
+#define DISPLAY_REFRESH_MS 5000
+#endif
+// Display mode ends this long after the last button press.
+#ifndef DISPLAY_TIMEOUT_S
+#define DISPLAY_TIMEOUT_S 60
+#endif
+
+enum display_state {
+    DISPLAY_OFF,
+    DISPLAY_SAMPLING,  // A sampling window is running.
+    DISPLAY_WAITING,   // Until the next refresh.
+};
+
+/*
+ * What the buttons asked of the display, and the cadence display mode samples
+ * on. Button A turns it on and off, B steps through the pages and C switches
+ * the temperature scale; each press marks the page dirty. Once on, it waits
+ * DISPLAY_REFRESH_MS, runs a sampling window, and waits again, never blocking
+ * for longer than a sensor conversion. It goes back to DISPLAY_OFF when button
+ * A turns it off or when no button was pressed for DISPLAY_TIMEOUT_S.
+ */
+struct monitor_display_mode {
+    typedef monitor_event_queue<uint8_t, BUTTON_EVENTS> button_queue;
+    void begin();
+    void handle(button_queue &buttons);
+    bool timed_out();
+    bool step(monitor_sampler &sampler, monitor_data &data);
+    display_state state{DISPLAY_OFF};
+    bool on{false};       // Button A toggles the display.
+    bool celsius{false};  // Button C toggles the temperature scale.
+    int page{0};
+    bool dirty{false};    // The page needs drawing.
+    unsigned long refresh_ms{0};
+    unsigned long touched_ms{0};
+    uint8_t last_button{0};
+    unsigned long last_button_ms{0};
+};
+
+#endif //MONITOR_MONITOR_DISPLAY_MODE_HPP
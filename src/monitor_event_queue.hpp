@@ -0,0 +1,71 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_EVENT_QUEUE_HPP
+#define MONITOR_MONITOR_EVENT_QUEUE_HPP
+
+#include <atomic>
+#include "monitor_hal.hpp"
+
+/*
+ * Lock-free queue from one interrupt handler to loop(). Only push() writes
+ * head and only pop() writes tail, so neither needs interrupts disabled. The
+ * ESP8266 has one core, so compiler fences are enough to order the item
+ * against the index that publishes it. N must be a power of two so the 8-bit
+ * indices can wrap.
+ */
+template <typename T, uint8_t N>
+struct monitor_event_queue {
+    static_assert(N and (N & (N - 1)) == 0 and N <= 128, "N must be a power of two up to 128.");
+
+    // Inlined so it runs from IRAM inside the interrupt handler.
+    __attribute__((always_inline)) bool push(const T &item) {
+        uint8_t h = head;
+        if ((uint8_t) (h - tail) == N) {
+            dropped++;
+            return false;
+        }
+        items[h % N] = item;
+        std::atomic_signal_fence(std::memory_order_release);
+        head = h + 1;
+        return true;
+    }
+
+    bool pop(T &item) {
+        uint8_t t = tail;
+        if (t == head) {
+            return false;
+        }
+        std::atomic_signal_fence(std::memory_order_acquire);
+        item = items[t % N];
+        std::atomic_signal_fence(std::memory_order_release);
+        tail = t + 1;
+        return true;
+    }
+
+    T items[N];
+    volatile uint8_t head{0};
+    volatile uint8_t tail{0};
+    volatile uint8_t dropped{0};
+};
+
+#endif //MONITOR_MONITOR_EVENT_QUEUE_HPP
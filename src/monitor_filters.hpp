@@ -0,0 +1,154 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_FILTERS_HPP
+#define MONITOR_MONITOR_FILTERS_HPP
+
+#include <stdint.h>
+#include <algorithm>
+
+/*
+ * Streaming filters that take one sample at a time in constant memory, so a
+ * sampling window can stop as soon as its estimate is good enough.
+ */
+
+/*
+ * Running mean and variance by Welford's method, which doesn't lose precision
+ * the way a sum of squares does.
+ */
+template <typename T>
+struct running_stats {
+    void add(T x) {
+        count++;
+        T delta = x - mean;
+        mean += delta / (T) count;
+        m2 += delta * (x - mean);
+    }
+    T variance() const {
+        return count > 1 ? m2 / (T) (count - 1) : (T) 0;
+    }
+    /*
+     * Whether the confidence interval of the mean is within ±tolerance, for z
+     * standard errors (1.96 is 95%). Compared squared to save a square root.
+     */
+    bool within(T tolerance, T z) const {
+        return count > 1 and z * z * variance() <= tolerance * tolerance * (T) count;
+    }
+    uint16_t count{0};
+    T mean{0};
+    T m2{0};
+};
+
+/*
+ * The median of the last N samples. N is small and odd, so a sort is cheap.
+ */
+template <typename T, uint8_t N>
+struct median_filter {
+    static_assert(N % 2 == 1, "N must be odd.");
+    T add(T x) {
+        window[next] = x;
+        next = (next + 1) % N;
+        if (filled < N) {
+            filled++;
+        }
+        T sorted[N];
+        std::copy(window, window + filled, sorted);
+        std::nth_element(sorted, sorted + filled / 2, sorted + filled);
+        return sorted[filled / 2];
+    }
+    T window[N];
+    uint8_t next{0};
+    uint8_t filled{0};
+};
+
+/*
+ * Exponential moving average; alpha is the weight of the newest sample.
+ */
+template <typename T>
+struct ema_filter {
+    explicit ema_filter(T alpha) : alpha(alpha) {}
+    T add(T x) {
+        value = primed ? value + alpha * (x - value) : x;
+        primed = true;
+        return value;
+    }
+    T alpha;
+    T value{0};
+    bool primed{false};
+};
+
+/*
+ * Running statistics that leave out samples more than k standard deviations
+ * from the mean, once there are enough samples to judge by. The deviation is
+ * taken as at least quantum, the step of the samples, so that a run of equal
+ * samples doesn't reject every one that differs by a step.
+ */
+template <typename T>
+struct outlier_filter {
+    outlier_filter(T k, uint16_t min_count, T quantum) : k(k), min_count(min_count), quantum(quantum) {}
+    bool add(T x) {
+        T delta = x - stats.mean;
+        T variance = std::max(stats.variance(), quantum * quantum);
+        if (stats.count >= min_count and delta * delta > k * k * variance) {
+            rejected++;
+            return false;
+        }
+        stats.add(x);
+        return true;
+    }
+    running_stats<T> stats;
+    T k;
+    uint16_t min_count;
+    T quantum;
+    uint16_t rejected{0};
+};
+
+/*
+ * The mean of a noisy reading, sampled until its confidence interval is
+ * within ±tolerance or max_count samples were taken. A median of 3 and the
+ * outlier filter take out the spikes a WiFi transmission puts on a reading;
+ * quantum is the reading's resolution.
+ */
+template <typename T>
+struct converging_mean {
+    converging_mean(T tolerance, T quantum, uint16_t min_count, uint16_t max_count)
+            : filter{(T) 3, 5, quantum}, tolerance(tolerance), min_count(min_count), max_count(max_count) {}
+    void add(T x) {
+        samples++;
+        filter.add(median.add(x));
+    }
+    bool done() const {
+        return samples >= max_count
+               or (filter.stats.count >= min_count and filter.stats.within(tolerance, (T) 1.96));
+    }
+    T mean() const {
+        return filter.stats.mean;
+    }
+    median_filter<T, 3> median;
+    outlier_filter<T> filter;
+    T tolerance;
+    uint16_t min_count;
+    uint16_t max_count;
+    uint16_t samples{0};
+};
+
+#endif //MONITOR_MONITOR_FILTERS_HPP
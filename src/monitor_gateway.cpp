@@ -0,0 +1,199 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_gateway.hpp"
+#include "monitor_publish.hpp"
+#include "monitor_session.hpp"
+#include "ntp_time_utils.hpp"
+#include "monitor_log.hpp"
+
+extern monitor_session session;
+
+// A node's group topic is ours, a dash and the node's MAC address in hex, and
+// every message to it holds at least one feed.
+#define GATEWAY_TOPIC_LEN (sizeof(GROUP) - 1 + 13)
+static_assert(GATEWAY_TOPIC_LEN < GATEWAY_TOPIC_SIZE, "GATEWAY_TOPIC_SIZE can't hold a node's group topic.");
+#ifdef MONITOR_GATEWAY
+static_assert(AIO_GROUP_PACKET_MIN_SIZE(GATEWAY_TOPIC_LEN) <= MAXBUFFERSIZE,
+              "MAXBUFFERSIZE can't hold a node's group message with one feed; raise it or shorten the group key.");
+#endif
+
+void monitor_gateway::begin() {
+    LOG_INFO("Gateway mode.");
+    hal_wifi_on();
+    hal_wifi_begin(nullptr);
+    stats_ms = hal_millis();
+}
+
+/*
+ * One pass of the gateway: keep the network up and publish whatever frame the
+ * nodes sent.
+ */
+void monitor_gateway::poll() {
+    if (not session.poll()) {
+        hal_delay(GATEWAY_POLL_MS);
+        return;
+    }
+    if (not link_up) {
+        link_up = hal_link_begin(true);  // On the access point's channel by now.
+        if (not link_up) {
+            LOG_ERROR("ERROR: The node link didn't start.");
+            hal_delay(GATEWAY_POLL_MS);
+            return;
+        }
+    }
+    monitor_node_frame frame;
+    hal_link_peer peer;
+    size_t len = hal_link_receive(peer, (uint8_t *) &frame, sizeof(frame), GATEWAY_POLL_MS);
+    if (len) {
+        stats.received++;
+        if (len == sizeof(frame) and frame.version == NODE_FRAME_VERSION and frame.type == NODE_FRAME_READING
+            and from_node(frame, peer)) {
+            handle(frame, peer);
+        } else {
+            stats.invalid++;
+        }
+    }
+    if (hal_millis() - stats_ms >= SESSION_STATS_S * 1000UL) {
+        report();
+    }
+}
+
+/*
+ * A frame is only taken from the node it names: on ESP-NOW the sender's MAC
+ * address must be the node's (UDP peers have none), and the tag must be right.
+ */
+bool monitor_gateway::from_node(const monitor_node_frame &frame, const hal_link_peer &peer) {
+    static const uint8_t no_mac[6]{};
+    if (memcmp(peer.mac, no_mac, sizeof(no_mac)) != 0 and memcmp(peer.mac, frame.node, sizeof(frame.node)) != 0) {
+        return false;
+    }
+    return node_tag_valid(&frame, offsetof(monitor_node_frame, tag), frame.tag);
+}
+
+/*
+ * Print the counters since the last report, then start them again.
+ */
+void monitor_gateway::report() {
+    unsigned long elapsed_ms = hal_millis() - stats_ms;
+    LOG_INFO("Gateway: %lu frames in %lu ms, %lu published, %lu duplicates, %lu replayed, %lu invalid, "
+             "%lu failed, %u nodes.", stats.received, elapsed_ms, stats.published, stats.duplicates,
+             stats.replayed, stats.invalid, stats.failed, node_count);
+    stats = counters{};
+    stats_ms = hal_millis();
+}
+
+/*
+ * The group topic of a node.
+ */
+char *monitor_gateway::topic(const uint8_t mac[6], char *buffer, size_t buffer_len) {
+    snprintf(buffer, buffer_len, "%s/groups/%s-%02x%02x%02x%02x%02x%02x", AIO_USERNAME, AIO_GROUP_KEY,
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return buffer;
+}
+
+/*
+ * Whether a frame is newer than the last one published for its node: taken
+ * later, or at the same time (0 before the node's clock was set) with a later
+ * sequence number, allowing for wrap-around. A node that lost its RTC memory
+ * counts from 1 again, but its readings are still later than the last.
+ */
+bool monitor_gateway::newer(const node &known, const monitor_node_frame &frame) {
+    if (frame.reading.unix_epoch_time != known.epoch) {
+        return frame.reading.unix_epoch_time > known.epoch;
+    }
+    return (int32_t) (frame.sequence - known.sequence) > 0;
+}
+
+/*
+ * Publish a node's reading and ack it. The frame last published is only
+ * acked again; its first ack was lost. An older one is a replay and is
+ * dropped, so frames recorded off the link can't be published again. A node
+ * that lost its clock with its RTC memory sends readings at time 0 until it
+ * has the time again; those are acked, for the time of day in the ack, but
+ * not published. Without an ack the node keeps the reading queued.
+ */
+void monitor_gateway::handle(const monitor_node_frame &frame, const hal_link_peer &peer) {
+    node *known = find(frame.node);
+    if (known and not newer(*known, frame)) {
+        if (known->sequence == frame.sequence and known->epoch == frame.reading.unix_epoch_time) {
+            stats.duplicates++;
+            ack(frame, peer);
+        } else {
+            stats.replayed++;
+            LOG_WARN("Dropped reading %lu of a node, older than the last published.",
+                     (unsigned long) frame.sequence);
+            if (frame.reading.unix_epoch_time == 0) {
+                ack(frame, peer);
+            }
+        }
+        return;
+    }
+    char group[GATEWAY_TOPIC_SIZE];
+    time_t created_at = frame.reading.unix_epoch_time ? frame.reading.unix_epoch_time : hal_time();
+    if (publish_group(frame.reading, created_at, topic(frame.node, group, sizeof(group))).none()) {
+        stats.failed++;
+        return;
+    }
+    stats.published++;
+    remember(frame);
+    ack(frame, peer);
+}
+
+monitor_gateway::node *monitor_gateway::find(const uint8_t mac[6]) {
+    for (size_t i = 0; i < node_count; i++) {
+        if (memcmp(nodes[i].mac, mac, sizeof(nodes[i].mac)) == 0) {
+            return &nodes[i];
+        }
+    }
+    return nullptr;
+}
+
+/*
+ * Remember the last reading of a node, forgetting the node heard from least
+ * recently when the table is full.
+ */
+void monitor_gateway::remember(const monitor_node_frame &frame) {
+    node *entry = find(frame.node);
+    if (not entry and node_count < GATEWAY_NODES_MAX) {
+        entry = &nodes[node_count++];
+    } else if (not entry) {
+        entry = &nodes[0];
+        for (size_t i = 1; i < node_count; i++) {
+            if (hal_millis() - nodes[i].seen_ms > hal_millis() - entry->seen_ms) {
+                entry = &nodes[i];
+            }
+        }
+    }
+    memcpy(entry->mac, frame.node, sizeof(entry->mac));
+    entry->sequence = frame.sequence;
+    entry->epoch = frame.reading.unix_epoch_time;
+    entry->seen_ms = hal_millis();
+}
+
+void monitor_gateway::ack(const monitor_node_frame &frame, const hal_link_peer &peer) {
+    uint32_t epoch = system_time_set ? hal_time() : 0;
+    monitor_node_ack answer{NODE_FRAME_VERSION, NODE_FRAME_ACK, {}, frame.sequence, epoch, {}};
+    memcpy(answer.node, frame.node, sizeof(answer.node));
+    node_tag(&answer, offsetof(monitor_node_ack, tag), answer.tag);
+    hal_link_send(&peer, (const uint8_t *) &answer, sizeof(answer));
+}
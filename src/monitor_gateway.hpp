@@ -0,0 +1,74 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_GATEWAY_HPP
+#define MONITOR_MONITOR_GATEWAY_HPP
+
+#include "monitor_hal.hpp"
+#include "monitor_node.hpp"
+
+// How many nodes the gateway remembers, to drop frames it has already published.
+#ifndef GATEWAY_NODES_MAX
+#define GATEWAY_NODES_MAX 256
+#endif
+#define GATEWAY_POLL_MS 50
+#define GATEWAY_TOPIC_SIZE 80
+
+/*
+ * A mains powered monitor that keeps one MQTT session (monitor_session) open
+ * and publishes the readings of the battery nodes around it, each to a group
+ * of its own: AIO_GROUP_KEY followed by the node's MAC address.
+ */
+struct monitor_gateway {
+    struct node {
+        uint8_t mac[6];
+        uint32_t sequence;  // Of the last reading published.
+        uint32_t epoch;
+        unsigned long seen_ms;
+    };
+    struct counters {
+        uint32_t received;
+        uint32_t published;
+        uint32_t duplicates;
+        uint32_t replayed;  // Older than the last published, and dropped.
+        uint32_t invalid;
+        uint32_t failed;
+    };
+    void begin();
+    void poll();
+    void report();
+    static char *topic(const uint8_t mac[6], char *buffer, size_t buffer_len);
+    node nodes[GATEWAY_NODES_MAX];
+    size_t node_count{0};
+    counters stats{};
+    bool link_up{false};
+    unsigned long stats_ms{0};
+private:
+    static bool from_node(const monitor_node_frame &frame, const hal_link_peer &peer);
+    static bool newer(const node &known, const monitor_node_frame &frame);
+    void handle(const monitor_node_frame &frame, const hal_link_peer &peer);
+    node *find(const uint8_t mac[6]);
+    void remember(const monitor_node_frame &frame);
+    void ack(const monitor_node_frame &frame, const hal_link_peer &peer);
+};
+
+#endif //MONITOR_MONITOR_GATEWAY_HPP
@@ -0,0 +1,181 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_HAL_HPP
+#define MONITOR_MONITOR_HAL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * The few things the firmware needs from the hardware, so the same logic runs
+ * on the ESP8266 (monitor_hal_esp8266.cpp) and as a native Linux program
+ * (monitor_hal_native.cpp). Only one of the two is compiled; the Arduino
+ * framework defines ARDUINO.
+ */
+#ifdef ARDUINO
+#include <Arduino.h>
+// Interrupt handlers must run from IRAM; flash may be busy when they fire.
+#define HAL_ISR_ATTR ICACHE_RAM_ATTR
+#else
+#define HAL_ISR_ATTR
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+using std::min;
+using std::max;
+
+/*
+ * The native console. Prints to stdout with the same calls as Serial.
+ */
+struct hal_console {
+    void begin(unsigned long baud) {}
+    explicit operator bool() const { return true; }
+    size_t print(const char *text);
+    size_t print(char c);
+    size_t print(int value);
+    size_t print(unsigned int value);
+    size_t print(long value);
+    size_t print(unsigned long value);
+    size_t print(double value, int digits = 2);
+    template <typename T>
+    size_t println(T value) { return print(value) + print('\n'); }
+    size_t println() { return print('\n'); }
+    size_t write(const uint8_t *data, size_t len);
+    void flush();
+};
+
+extern hal_console Serial;
+
+// What the native build's fake SSD1306 holds in its display memory.
+const uint8_t *hal_native_oled_memory();
+#endif
+
+enum hal_reset {
+    HAL_RESET_POWER_ON,    // Cold boot or the reset button. Someone is there.
+    HAL_RESET_DEEP_SLEEP,  // The deep sleep timer woke us.
+    HAL_RESET_CRASH,       // A watchdog, an exception or a restart.
+};
+
+// How the radio comes up on the wake after deep sleep. A wake that boots with
+// it disabled can't turn it on.
+enum hal_rf {
+    HAL_RF_NO_CAL,    // On, without calibrating.
+    HAL_RF_CAL,       // On, after a full calibration.
+    HAL_RF_DISABLED,  // Off for the whole wake.
+};
+
+// Boot and power.
+void hal_begin();
+hal_reset hal_reset_reason();
+void hal_feed_watchdog();
+void hal_deep_sleep(uint64_t sleep_us, hal_rf rf);  // Does not return.
+uint32_t hal_free_heap();
+
+// Time since boot, and the time of day in UTC.
+unsigned long hal_millis();
+unsigned long hal_micros();
+void hal_delay(unsigned long ms);
+time_t hal_time();
+uint64_t hal_time_ms();
+void hal_set_time(uint64_t epoch_ms);
+void hal_sntp_begin();
+bool hal_sntp_synced();
+
+// The 512 bytes of RTC user memory, addressed in 4-byte blocks.
+bool hal_rtc_read(uint32_t offset, void *data, size_t size);
+bool hal_rtc_write(uint32_t offset, const void *data, size_t size);
+
+// Sensors. The DHT22 readings are NaN when it doesn't answer. The INA219 is
+// powered down after begin; a conversion takes about 600 µs after power up.
+void hal_ina219_begin();
+void hal_ina219_power(bool on);
+void hal_dht_begin();
+int hal_adc_read();
+double hal_current_ma();
+float hal_temperature_c();
+float hal_relative_humidity();
+bool hal_button_down(int pin);  // Held at the time of the call.
+void hal_button_attach(int pin, void (*isr)());  // isr runs on the falling edge.
+
+// One write to an I2C device. True when it was acknowledged.
+bool hal_i2c_write(uint8_t address, const uint8_t *data, size_t len);
+
+/*
+ * The access point and the lease it handed out, enough to reconnect without a
+ * scan or DHCP.
+ */
+struct hal_wifi_lease {
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+};
+
+// WiFi station. Without a lease, begin() scans and asks for DHCP.
+void hal_wifi_on();
+void hal_wifi_begin(const hal_wifi_lease *lease);
+void hal_wifi_disconnect();
+void hal_wifi_off();
+bool hal_wifi_connected();
+void hal_wifi_get_lease(hal_wifi_lease &lease);
+char *hal_wifi_mac(char *buffer, size_t buffer_len);
+
+// MQTT over the network. connect() returns 0 on success.
+int8_t hal_mqtt_connect();
+const char *hal_mqtt_error(int8_t status);
+bool hal_mqtt_publish(const char *topic, const uint8_t *payload, uint16_t payload_len);
+void hal_mqtt_disconnect();
+bool hal_mqtt_ping();
+bool hal_mqtt_connected();
+
+inline bool hal_mqtt_publish(const char *topic, const char *payload) {
+    return hal_mqtt_publish(topic, (const uint8_t *) payload, (uint16_t) strlen(payload));
+}
+
+/*
+ * The link between battery nodes and their gateway: ESP-NOW, or UDP on the LAN
+ * when MONITOR_LINK_UDP is defined. The native build always uses UDP. A peer is
+ * known by its MAC address on ESP-NOW and by its IP address and port on UDP.
+ */
+#define HAL_LINK_PACKET_MAX 48
+
+struct hal_link_peer {
+    uint8_t mac[6];
+    uint16_t port;
+    uint32_t ip;
+};
+
+bool hal_link_begin(bool gateway);
+// To the peer, or to the gateway without one.
+bool hal_link_send(const hal_link_peer *peer, const uint8_t *data, size_t len);
+// Waits up to timeout_ms for a packet. Returns its length, 0 for none.
+size_t hal_link_receive(hal_link_peer &peer, uint8_t *buffer, size_t buffer_len, unsigned long timeout_ms);
+// HMAC-SHA256 of data under key, with BearSSL on the ESP8266.
+void hal_hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len, uint8_t mac[32]);
+
+#endif //MONITOR_MONITOR_HAL_HPP
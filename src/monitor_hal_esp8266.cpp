@@ -0,0 +1,481 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifdef ARDUINO
+
+#include <ESP8266WiFi.h>
+#include <WiFiClientSecure.h>
+#include <WiFiUdp.h>
+#include <espnow.h>
+#include <bearssl/bearssl_hmac.h>
+#include <Adafruit_INA219.h>
+#include <Wire.h>
+#include <coredecls.h>
+#include <sys/time.h>
+#include <memory>
+#include "monitor_hal.hpp"
+#include "ESP8266WiFiSTA_MAC.hpp"
+#include "ADAFRUIT_IO_MQTT.hpp"
+#include "monitor_oled_display.hpp"
+#include "monitor_temp_rh_sensor.hpp"
+#include "monitor_tls_session.hpp"
+#include "monitor_node.hpp"
+#include "monitor_event_queue.hpp"
+#include "monitor_log.hpp"
+
+// Create an ESP8266 WiFiClient class to connect to the MQTT server.
+BearSSL::WiFiClientSecure client;
+
+// Root certificate the server's certificate chain is verified against. It is
+// only parsed out of flash when a full handshake needs it.
+std::unique_ptr<BearSSL::X509List> ca_cert;
+
+#ifdef AIO_PINNED_KEYS
+// The pinned key being tried, parsed out of flash. It stays with the
+// connection it verified.
+std::unique_ptr<BearSSL::PublicKey> pinned_key;
+#endif
+
+// TLS session resumed across deep sleep.
+BearSSL::Session tls_session;
+tls_session_cache tls_cache;
+
+// Setup the MQTT client class by passing in the WiFi client and MQTT server and login details.
+Adafruit_MQTT_Client mqtt(&client,
+                          MQTT_SERVER,
+                          AIO_SERVERPORT,
+                          MQTT_CLIENTID,
+                          MQTT_USERNAME,
+                          MQTT_PASSWORD);
+
+// Temperature and Humidity Utilities
+DHT_Unified dht(DHTPIN, DHTTYPE);
+
+// Current Sensor Utilities
+Adafruit_INA219 ina219;
+
+void hal_begin() {
+    Serial.begin(115200);
+    // Serial.setDebugOutput(true);
+    pinMode(LED, LOW);  // Turn off the status LED.
+}
+
+hal_reset hal_reset_reason() {
+    switch (ESP.getResetInfoPtr()->reason) {
+        case REASON_DEEP_SLEEP_AWAKE:
+            return HAL_RESET_DEEP_SLEEP;
+        case REASON_WDT_RST:
+        case REASON_EXCEPTION_RST:
+        case REASON_SOFT_WDT_RST:
+        case REASON_SOFT_RESTART:
+            return HAL_RESET_CRASH;
+        default:
+            return HAL_RESET_POWER_ON;
+    }
+}
+
+void hal_feed_watchdog() {
+    ESP.wdtFeed();  // This API only works when software watchdog is enabled.
+    yield();
+}
+
+void hal_deep_sleep(uint64_t sleep_us, hal_rf rf) {
+    switch (rf) {
+        case HAL_RF_CAL:
+            ESP.deepSleep(sleep_us, RF_CAL);
+            break;
+        case HAL_RF_DISABLED:
+            ESP.deepSleep(sleep_us, RF_DISABLED);
+            break;
+        default:
+            ESP.deepSleep(sleep_us, RF_NO_CAL);
+            break;
+    }
+}
+
+uint32_t hal_free_heap() {
+    return ESP.getFreeHeap();
+}
+
+unsigned long hal_millis() {
+    return millis();
+}
+
+unsigned long hal_micros() {
+    return micros();
+}
+
+void hal_delay(unsigned long ms) {
+    delay(ms);
+}
+
+time_t hal_time() {
+    return time(nullptr);
+}
+
+uint64_t hal_time_ms() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+void hal_set_time(uint64_t epoch_ms) {
+    struct timeval tv;
+    tv.tv_sec = epoch_ms / 1000;
+    tv.tv_usec = (epoch_ms % 1000) * 1000;
+    settimeofday(&tv, nullptr);
+}
+
+volatile bool sntp_synced{false};
+
+/*
+ * Ask SNTP for the time of day, in UTC. hal_sntp_synced() turns true once the
+ * clock has been set.
+ */
+void hal_sntp_begin() {
+    sntp_synced = false;
+    settimeofday_cb([](){ sntp_synced = true; });
+    configTime(0,
+               0,
+               "pool.ntp.org",
+               "time.nist.gov");
+}
+
+bool hal_sntp_synced() {
+    return sntp_synced;
+}
+
+bool hal_rtc_read(uint32_t offset, void *data, size_t size) {
+    return ESP.rtcUserMemoryRead(offset, (uint32_t *) data, size);
+}
+
+bool hal_rtc_write(uint32_t offset, const void *data, size_t size) {
+    return ESP.rtcUserMemoryWrite(offset, (uint32_t *) data, size);
+}
+
+void hal_ina219_begin() {
+    ina219.begin();
+    ina219.powerSave(true);
+}
+
+/*
+ * Power down keeps the configuration. Power up restarts the conversions in
+ * the configured mode.
+ */
+void hal_ina219_power(bool on) {
+    ina219.powerSave(not on);
+}
+
+void hal_dht_begin() {
+    dht.begin();
+}
+
+int hal_adc_read() {
+    return analogRead(A0);
+}
+
+double hal_current_ma() {
+    return ina219.getCurrent_mA();
+}
+
+float hal_temperature_c() {
+    sensors_event_t event;
+    dht.temperature().getEvent(&event);
+    return event.temperature;
+}
+
+float hal_relative_humidity() {
+    sensors_event_t event;
+    dht.humidity().getEvent(&event);
+    return event.relative_humidity;
+}
+
+bool hal_button_down(int pin) {
+    pinMode(pin, INPUT_PULLUP);
+    delayMicroseconds(10);  // Let the pull-up charge the pin.
+    return digitalRead(pin) == LOW;
+}
+
+void hal_button_attach(int pin, void (*isr)()) {
+    pinMode(pin, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(pin), isr, FALLING);
+}
+
+bool hal_i2c_write(uint8_t address, const uint8_t *data, size_t len) {
+    Wire.beginTransmission(address);
+    Wire.write(data, len);
+    return Wire.endTransmission() == 0;
+}
+
+/*
+ * Wake the radio as a station with our own MAC address.
+ */
+void hal_wifi_on() {
+    WiFi.persistent(false);  // The SDK's own copy in flash isn't needed.
+    WiFi.forceSleepWake();
+    WiFi.mode(WIFI_STA);
+    wifi_sta_set_mac();
+}
+
+void hal_wifi_begin(const hal_wifi_lease *lease) {
+    if (lease) {
+        WiFi.config(IPAddress(lease->ip),
+                    IPAddress(lease->gateway),
+                    IPAddress(lease->subnet),
+                    IPAddress(lease->dns));
+        WiFi.begin(WIFI_SSID, WIFI_PASS, lease->channel, lease->bssid, true);
+    } else {
+        WiFi.config(IPAddress(0u), IPAddress(0u), IPAddress(0u));  // Back to DHCP.
+        WiFi.begin(WIFI_SSID, WIFI_PASS);
+    }
+}
+
+void hal_wifi_disconnect() {
+    WiFi.disconnect();
+}
+
+void hal_wifi_off() {
+    WiFi.mode(WIFI_OFF);
+    WiFi.forceSleepBegin();
+}
+
+bool hal_wifi_connected() {
+    return WiFi.status() == WL_CONNECTED;
+}
+
+void hal_wifi_get_lease(hal_wifi_lease &lease) {
+    memcpy(lease.bssid, WiFi.BSSID(), sizeof(lease.bssid));
+    lease.channel = WiFi.channel();
+    lease.ip = WiFi.localIP();
+    lease.gateway = WiFi.gatewayIP();
+    lease.subnet = WiFi.subnetMask();
+    lease.dns = WiFi.dnsIP();
+}
+
+char *hal_wifi_mac(char *buffer, size_t buffer_len) {
+    snprintf(buffer, buffer_len, "%s", WiFi.macAddress().c_str());
+    return buffer;
+}
+
+/*
+ * BearSSL parses keys and certificates from RAM and keeps its own copy, so
+ * copy them out of flash just for the parse.
+ */
+template <typename T>
+T *parse_from_flash(const unsigned char *der, size_t len) {
+    std::unique_ptr<uint8_t[]> copy(new uint8_t[len]);
+    memcpy_P(copy.get(), der, len);
+    return new T(copy.get(), len);
+}
+
+/*
+ * A pinned key skips the certificate chain: BearSSL takes the key as the
+ * server's and the handshake only succeeds if the server holds it. Each
+ * pinned key is tried in turn and, if the server holds none of them, the
+ * chain is verified against the root certificate. A failure short of the
+ * TLS handshake isn't retried. A resumed session doesn't look at either.
+ */
+int8_t hal_mqtt_connect() {
+    if (tls_cache.load(tls_session)) {
+        LOG_INFO("Resuming TLS session.");
+    }
+    unsigned long handshake_ms = millis();
+    int8_t status = -1;
+    int verified_by = -1;  // The pinned key that matched, -1 for the chain.
+#ifdef AIO_PINNED_KEYS
+    for (size_t pin = 0; pin < AIO_PINNED_KEY_COUNT and verified_by < 0; ++pin) {
+        pinned_key.reset(parse_from_flash<BearSSL::PublicKey>(pinnedKeys[pin].der, pinnedKeys[pin].len));
+        client.setKnownKey(pinned_key.get());
+        client.setSession(&tls_session);
+        status = mqtt.connect();
+        if (status == 0) {
+            verified_by = (int) pin;
+        } else if (client.getLastSSLError() == 0) {
+            return status;
+        } else {
+            LOG_WARN("The server doesn't hold pinned key %u.", pin);
+        }
+    }
+    client.setKnownKey(nullptr);  // The trust anchors, from here on.
+    if (verified_by < 0) {
+        pinned_key.reset();
+    }
+#endif
+    if (verified_by < 0) {
+        if (not ca_cert) {
+            ca_cert.reset(parse_from_flash<BearSSL::X509List>(caCert, caCertLen));
+        }
+        client.setTrustAnchors(ca_cert.get());
+        client.setSession(&tls_session);
+        status = mqtt.connect();
+    }
+    handshake_ms = millis() - handshake_ms;
+    if (status != 0) {
+        return status;
+    }
+    if (not tls_cache.store(tls_session)) {
+        LOG_INFO("TLS session resumed: %lu ms.", handshake_ms);
+    } else if (verified_by < 0) {
+        LOG_INFO("Server SSL certificate verified. Full handshake: %lu ms.", handshake_ms);
+    } else {
+        LOG_INFO("Server holds pinned key %d. Full handshake: %lu ms.", verified_by, handshake_ms);
+    }
+    return status;
+}
+
+const char *hal_mqtt_error(int8_t status) {
+    static char error[40];
+    strncpy_P(error, (PGM_P) mqtt.connectErrorString(status), sizeof(error) - 1);
+    return error;
+}
+
+bool hal_mqtt_publish(const char *topic, const uint8_t *payload, uint16_t payload_len) {
+    return mqtt.publish(topic, (uint8_t *) payload, payload_len, 0);
+}
+
+void hal_mqtt_disconnect() {
+    mqtt.disconnect();
+}
+
+bool hal_mqtt_ping() {
+    return mqtt.ping();
+}
+
+bool hal_mqtt_connected() {
+    return mqtt.connected();
+}
+
+#ifdef MONITOR_LINK_UDP
+
+WiFiUDP link_udp;
+
+bool hal_link_begin(bool gateway) {
+    return link_udp.begin(gateway ? GATEWAY_UDP_PORT : 0);
+}
+
+bool hal_link_send(const hal_link_peer *peer, const uint8_t *data, size_t len) {
+    bool begun = peer ? link_udp.beginPacket(IPAddress(peer->ip), peer->port)
+                      : link_udp.beginPacket(GATEWAY_HOST, GATEWAY_UDP_PORT);
+    return begun and link_udp.write(data, len) == len and link_udp.endPacket();
+}
+
+size_t hal_link_receive(hal_link_peer &peer, uint8_t *buffer, size_t buffer_len, unsigned long timeout_ms) {
+    unsigned long started_ms = millis();
+    do {
+        if (link_udp.parsePacket() > 0) {
+            memset(peer.mac, 0, sizeof(peer.mac));
+            peer.ip = link_udp.remoteIP();
+            peer.port = link_udp.remotePort();
+            return link_udp.read(buffer, buffer_len);
+        }
+        delay(1);
+    } while (millis() - started_ms < timeout_ms);
+    return 0;
+}
+
+#else
+
+/*
+ * ESP-NOW hands packets to a callback, which queues them for
+ * hal_link_receive().
+ */
+struct link_packet {
+    hal_link_peer peer;
+    uint8_t len;
+    uint8_t data[HAL_LINK_PACKET_MAX];
+};
+
+monitor_event_queue<link_packet, 8> link_packets;
+
+void link_received(uint8_t *mac, uint8_t *data, uint8_t len) {
+    link_packet packet{};
+    memcpy(packet.peer.mac, mac, sizeof(packet.peer.mac));
+    packet.len = min(len, (uint8_t) sizeof(packet.data));
+    memcpy(packet.data, data, packet.len);
+    link_packets.push(packet);
+}
+
+/*
+ * A node doesn't associate with the access point. It only has to be on the
+ * gateway's channel. The gateway is on the channel of its access point.
+ */
+bool hal_link_begin(bool gateway) {
+    if (not gateway) {
+        hal_wifi_on();
+        wifi_set_channel(GATEWAY_CHANNEL);
+    }
+    if (esp_now_init() != 0) {
+        return false;
+    }
+    esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
+    esp_now_register_recv_cb(link_received);
+    if (not gateway) {
+        uint8_t gateway_mac[6] = GATEWAY_MAC;
+        return esp_now_add_peer(gateway_mac, ESP_NOW_ROLE_COMBO, GATEWAY_CHANNEL, nullptr, 0) == 0;
+    }
+    return true;
+}
+
+/*
+ * The gateway answers a node as a peer only for as long as it takes, since
+ * ESP-NOW keeps no more than 20 of them.
+ */
+bool hal_link_send(const hal_link_peer *peer, const uint8_t *data, size_t len) {
+    if (not peer) {
+        uint8_t gateway_mac[6] = GATEWAY_MAC;
+        return esp_now_send(gateway_mac, (uint8_t *) data, len) == 0;
+    }
+    uint8_t mac[6];
+    memcpy(mac, peer->mac, sizeof(mac));
+    esp_now_add_peer(mac, ESP_NOW_ROLE_COMBO, WiFi.channel(), nullptr, 0);
+    bool sent = esp_now_send(mac, (uint8_t *) data, len) == 0;
+    esp_now_del_peer(mac);
+    return sent;
+}
+
+size_t hal_link_receive(hal_link_peer &peer, uint8_t *buffer, size_t buffer_len, unsigned long timeout_ms) {
+    unsigned long started_ms = millis();
+    link_packet packet;
+    while (not link_packets.pop(packet)) {
+        if (millis() - started_ms >= timeout_ms) {
+            return 0;
+        }
+        delay(1);
+    }
+    peer = packet.peer;
+    size_t len = min((size_t) packet.len, buffer_len);
+    memcpy(buffer, packet.data, len);
+    return len;
+}
+
+#endif
+
+void hal_hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len, uint8_t mac[32]) {
+    br_hmac_key_context key_context;
+    br_hmac_key_init(&key_context, &br_sha256_vtable, key, key_len);
+    br_hmac_context context;
+    br_hmac_init(&context, &key_context, 0);
+    br_hmac_update(&context, data, data_len);
+    br_hmac_out(&context, mac);
+}
+
+#endif
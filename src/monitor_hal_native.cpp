@@ -0,0 +1,1167 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef ARDUINO
+
+#include <stdio.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+#ifdef NATIVE_TLS
+#include <openssl/err.h>
+#include <openssl/sha.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+#include "monitor_hal.hpp"
+#include "ADAFRUIT_IO_MQTT.hpp"
+#include "monitor_oled_frame.hpp"
+#include "monitor_oled_display.hpp"
+#include "monitor_node.hpp"
+#include "monitor_log.hpp"
+
+/*
+ * The native build runs the firmware as a Linux program against simulated
+ * hardware. Time is simulated: delay() returns at once and only moves the
+ * clock, so a wake takes as long on the host as the firmware's own work. Each
+ * wake is one run of the program. Deep sleep saves the RTC memory and the
+ * simulated time of day to a file and starts the next wake with a fresh
+ * process, just like the ESP8266 comes out of deep sleep with nothing but
+ * its RTC memory. Delete the file to simulate a cold boot.
+ *
+ * MQTT goes to a real broker, plain TCP or, built with NATIVE_TLS, TLS checked
+ * against caCert like the ESP8266 does. The TLS session is kept in the state
+ * file and resumed by later wakes, as tls_session_cache keeps it in RTC memory
+ * on the ESP8266. The time spent on the network is
+ * added to the simulated clock. So is the time spent waiting for a packet from
+ * the gateway link, which is UDP to the gateway at -g.
+ *
+ * Buttons are pressed from a script of presses, each a button and the
+ * simulated ms since boot of the first wake, e.g. -p A@2000,B@9000,C@12000.
+ * A press fires the interrupt handler a few times, the way a bouncing contact
+ * does. A press before boot is over, A@0 say, is a button held down at boot.
+ *
+ * Usage: monitor [-n wakes] [-s state_file] [-b broker[:port]] [-g gateway[:port]]
+ *                [-p presses]
+ */
+#ifndef NATIVE_STATE_FILE
+#define NATIVE_STATE_FILE "monitor_native.state"
+#endif
+#ifndef NATIVE_MQTT_BROKER
+#define NATIVE_MQTT_BROKER "127.0.0.1"
+#endif
+#ifndef NATIVE_MQTT_PORT
+#ifdef NATIVE_TLS
+#define NATIVE_MQTT_PORT "8883"
+#else
+#define NATIVE_MQTT_PORT "1883"
+#endif
+#endif
+
+// How long the simulated hardware takes, roughly as measured on a Huzzah.
+#define NATIVE_BOOT_MS 80
+#define NATIVE_ADC_US 100
+#define NATIVE_INA219_US 300
+#define NATIVE_INA219_CONVERSION_US 570  // From power up, at 12 bits.
+#define NATIVE_INA219_BEGIN_US 400
+#define NATIVE_DHT_US 5000
+#define NATIVE_WIFI_FAST_CONNECT_MS 350
+#define NATIVE_WIFI_SCAN_MS 2800
+#define NATIVE_SNTP_MS 60
+#define NATIVE_I2C_BYTE_US 23  // 9 bits at 400 kHz.
+#define NATIVE_BOUNCES 3
+#define NATIVE_BOUNCE_US 800
+// The error of the simulated deep sleep timer.
+#ifndef NATIVE_SLEEP_DRIFT_PPM
+#define NATIVE_SLEEP_DRIFT_PPM 1500
+#endif
+
+#define NATIVE_STATE_MAGIC 0x4D4F4E33  // MON3
+#define NATIVE_RTC_BYTES 512
+// A TLS session in DER, with the broker's certificate in it.
+#define NATIVE_TLS_SESSION_BYTES 4096
+#ifndef TLS_SESSION_MAX_AGE_S
+#define TLS_SESSION_MAX_AGE_S 86400
+#endif
+
+hal_console Serial;
+
+void setup();
+void loop();
+
+/*
+ * Everything that survives deep sleep.
+ */
+struct native_state {
+    uint32_t magic;
+    uint32_t wakes;
+    uint64_t first_boot_us;  // Unix epoch of the cold boot, in µs.
+    uint64_t world_us;       // Unix epoch on the way into deep sleep, in µs.
+    uint64_t sleep_us;       // 0 unless we went into deep sleep.
+    uint8_t rtc[NATIVE_RTC_BYTES];
+    uint32_t rf;             // The hal_rf of the next wake.
+    uint32_t tls_created;    // Unix epoch of the full handshake.
+    uint32_t tls_session_len;
+    uint8_t tls_session[NATIVE_TLS_SESSION_BYTES];
+};
+
+native_state state;
+std::string state_file{NATIVE_STATE_FILE};
+std::string broker{NATIVE_MQTT_BROKER};
+std::string broker_port{NATIVE_MQTT_PORT};
+std::string gateway{GATEWAY_HOST};
+std::string gateway_port{std::to_string(GATEWAY_UDP_PORT)};
+unsigned long wakes_left{1};
+hal_reset reset_reason{HAL_RESET_POWER_ON};
+hal_rf rf{HAL_RF_CAL};  // How this wake booted the radio.
+
+uint64_t now_us{NATIVE_BOOT_MS * 1000};  // Simulated time since boot.
+uint64_t world_boot_us;   // The real time of day at boot.
+int64_t clock_offset_us;  // The system clock is now_us plus this.
+uint64_t sntp_due_us{0};
+uint64_t wifi_due_us{0};
+bool wifi_fast{false};
+uint32_t noise_seed;
+int mqtt_socket{-1};
+int link_socket{-1};
+#ifdef NATIVE_TLS
+SSL_CTX *tls_context{nullptr};
+SSL *tls{nullptr};
+int tls_pinned_by{-1};  // The pinned key the server holds, -1 for the chain.
+int tls_round_trips{0};
+bool tls_sending{false};
+#ifdef AIO_PINNED_KEYS
+uint8_t tls_pins[AIO_PINNED_KEY_COUNT][SHA256_DIGEST_LENGTH];
+#endif
+#endif
+
+/*
+ * A fake SSD1306 at OLED_I2C_ADDRESS. It follows the address window and keeps
+ * a display memory, so partial updates can be checked against the frame.
+ */
+struct native_ssd1306 {
+    uint8_t memory[OLED_FRAME_SIZE];
+    uint8_t first_column{0}, last_column{OLED_WIDTH - 1};
+    uint8_t first_page{0}, last_page{OLED_PAGES - 1};
+    uint8_t column{0}, page{0};
+    uint8_t command[3];
+    size_t command_len{0};
+    void write_command(uint8_t byte);
+    void write_data(uint8_t byte);
+};
+
+native_ssd1306 ssd1306;
+uint32_t i2c_bytes{0};
+uint32_t i2c_writes{0};
+
+/*
+ * One falling edge of a button, from the script of presses.
+ */
+struct native_edge {
+    uint64_t at_us;
+    int pin;
+};
+
+std::vector<native_edge> edges;  // In order of time.
+size_t next_edge{0};
+uint32_t buttons_down{0};  // Pins held at boot, as bits.
+void (*button_isrs[3])();
+const int button_pins[3]{BUTTON_A, BUTTON_B, BUTTON_C};
+
+/*
+ * Move the clock on, firing the button interrupts that fall due on the way.
+ */
+void advance_us(uint64_t us) {
+    uint64_t until_us = now_us + us;
+    while (next_edge < edges.size() and edges[next_edge].at_us <= until_us) {
+        const native_edge &edge = edges[next_edge++];
+        now_us = max(now_us, edge.at_us);
+        for (int i = 0; i < 3; i++) {
+            if (button_pins[i] == edge.pin and button_isrs[i]) {
+                button_isrs[i]();
+            }
+        }
+    }
+    now_us = until_us;
+}
+
+/*
+ * Parse a script of presses such as A@2000,B@9000.
+ */
+bool parse_presses(const char *script) {
+    const char *p = script;
+    while (*p) {
+        char button = *p++;
+        if (button < 'A' or button > 'C' or *p++ != '@') {
+            return false;
+        }
+        char *end;
+        uint64_t at_us = strtoull(p, &end, 10) * 1000;
+        if (end == p or (*end and *end != ',')) {
+            return false;
+        }
+        for (int i = 0; i < NATIVE_BOUNCES; i++) {
+            edges.push_back({at_us + i * NATIVE_BOUNCE_US, button_pins[button - 'A']});
+        }
+        p = *end ? end + 1 : end;
+    }
+    std::stable_sort(edges.begin(), edges.end(),
+                     [](const native_edge &a, const native_edge &b) { return a.at_us < b.at_us; });
+    return true;
+}
+
+uint64_t wall_us() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * xorshift32, seeded from the time of day so each run is repeatable.
+ */
+float noise(float amplitude) {
+    noise_seed ^= noise_seed << 13;
+    noise_seed ^= noise_seed >> 17;
+    noise_seed ^= noise_seed << 5;
+    return amplitude * ((float) (noise_seed % 2001) / 1000.0f - 1.0f);
+}
+
+float hours_of_day() {
+    return (float) ((world_boot_us + now_us) % 86400000000ULL) / 3600e6f;
+}
+
+void load_state() {
+    FILE *file = fopen(state_file.c_str(), "rb");
+    bool loaded = file and fread(&state, sizeof(state), 1, file) == 1
+                  and state.magic == NATIVE_STATE_MAGIC;
+    if (file) {
+        fclose(file);
+    }
+    if (loaded and state.sleep_us) {
+        reset_reason = HAL_RESET_DEEP_SLEEP;
+        rf = (hal_rf) state.rf;
+        world_boot_us = state.world_us
+                        + state.sleep_us * (1000000 + NATIVE_SLEEP_DRIFT_PPM) / 1000000;
+    } else {
+        if (not loaded) {
+            memset(&state, 0, sizeof(state));  // Power-on RTC memory is garbage.
+            state.magic = NATIVE_STATE_MAGIC;
+            state.first_boot_us = wall_us();
+        }
+        world_boot_us = wall_us();
+    }
+    state.wakes++;
+    state.sleep_us = 0;  // Anything but deep sleep ends as a power-on reset.
+    noise_seed = (uint32_t) (world_boot_us / 1000) | 1;
+}
+
+void save_state() {
+    FILE *file = fopen(state_file.c_str(), "wb");
+    if (not file or fwrite(&state, sizeof(state), 1, file) != 1) {
+        perror(state_file.c_str());
+        exit(1);
+    }
+    fclose(file);
+}
+
+int main(int argc, char *argv[]) {
+    int option;
+    while ((option = getopt(argc, argv, "n:s:b:g:p:")) != -1) {
+        switch (option) {
+            case 'n':
+                wakes_left = strtoul(optarg, nullptr, 10);
+                break;
+            case 's':
+                state_file = optarg;
+                break;
+            case 'b': {
+                broker = optarg;
+                size_t colon = broker.find(':');
+                if (colon != std::string::npos) {
+                    broker_port = broker.substr(colon + 1);
+                    broker.resize(colon);
+                }
+                break;
+            }
+            case 'g': {
+                gateway = optarg;
+                size_t colon = gateway.find(':');
+                if (colon != std::string::npos) {
+                    gateway_port = gateway.substr(colon + 1);
+                    gateway.resize(colon);
+                }
+                break;
+            }
+            case 'p':
+                if (parse_presses(optarg)) {
+                    break;
+                }
+                fprintf(stderr, "Bad presses: %s\n", optarg);
+                return 2;
+            default:
+                fprintf(stderr, "Usage: %s [-n wakes] [-s state_file] [-b broker[:port]] "
+                                "[-g gateway[:port]] [-p presses]\n", argv[0]);
+                return 2;
+        }
+    }
+    setvbuf(stdout, nullptr, _IOLBF, 0);  // Keep up with a gateway's log.
+    load_state();
+    while (next_edge < edges.size() and edges[next_edge].at_us <= now_us) {
+        buttons_down |= 1UL << edges[next_edge++].pin;  // It woke us, no interrupt.
+    }
+    setup();
+    for (;;) {
+        loop();
+    }
+}
+
+size_t hal_console::print(const char *text) {
+    return fputs(text, stdout) < 0 ? 0 : strlen(text);
+}
+
+size_t hal_console::print(char c) {
+    return fputc(c, stdout) < 0 ? 0 : 1;
+}
+
+size_t hal_console::print(int value) {
+    return printf("%d", value);
+}
+
+size_t hal_console::print(unsigned int value) {
+    return printf("%u", value);
+}
+
+size_t hal_console::print(long value) {
+    return printf("%ld", value);
+}
+
+size_t hal_console::print(unsigned long value) {
+    return printf("%lu", value);
+}
+
+size_t hal_console::print(double value, int digits) {
+    return printf("%.*f", digits, value);
+}
+
+size_t hal_console::write(const uint8_t *data, size_t len) {
+    return fwrite(data, 1, len, stdout);
+}
+
+void hal_console::flush() {
+    fflush(stdout);
+}
+
+void hal_begin() {
+}
+
+hal_reset hal_reset_reason() {
+    return reset_reason;
+}
+
+void hal_feed_watchdog() {
+}
+
+/*
+ * Save what the ESP8266 would keep through deep sleep and start the next wake.
+ */
+void hal_deep_sleep(uint64_t sleep_us, hal_rf next_rf) {
+    hal_mqtt_disconnect();
+    state.world_us = world_boot_us + now_us;
+    state.sleep_us = sleep_us;
+    state.rf = next_rf;
+    save_state();
+    fflush(stdout);
+    fprintf(stderr, "Wake %u: awake %llu ms, sleeping %llu s",
+            state.wakes,
+            (unsigned long long) (now_us / 1000),
+            (unsigned long long) (sleep_us / 1000000));
+    if (rf == HAL_RF_DISABLED) {
+        fprintf(stderr, ", radio off");
+    } else if (rf == HAL_RF_CAL) {
+        fprintf(stderr, ", RF calibrated");
+    }
+    if (i2c_writes) {
+        fprintf(stderr, ", %u I2C writes of %u bytes", i2c_writes, i2c_bytes);
+    }
+    fprintf(stderr, ".\n");
+    if (--wakes_left == 0) {
+        exit(0);
+    }
+    std::string wakes = std::to_string(wakes_left);
+    std::string broker_address = broker + ":" + broker_port;
+    std::string gateway_address = gateway + ":" + gateway_port;
+    std::vector<char *> args{(char *) "monitor",
+                             (char *) "-n", (char *) wakes.c_str(),
+                             (char *) "-s", (char *) state_file.c_str(),
+                             (char *) "-b", (char *) broker_address.c_str(),
+                             (char *) "-g", (char *) gateway_address.c_str(),
+                             nullptr};
+    execv("/proc/self/exe", args.data());
+    perror("execv");
+    exit(1);
+}
+
+/*
+ * The free space in the malloc arena, which shrinks should anything leak.
+ */
+uint32_t hal_free_heap() {
+    return mallinfo2().fordblks;
+}
+
+unsigned long hal_millis() {
+    return now_us / 1000;
+}
+
+unsigned long hal_micros() {
+    return now_us;
+}
+
+void hal_delay(unsigned long ms) {
+    advance_us((uint64_t) ms * 1000);
+}
+
+time_t hal_time() {
+    return (time_t) (((int64_t) now_us + clock_offset_us) / 1000000);
+}
+
+uint64_t hal_time_ms() {
+    return (uint64_t) (((int64_t) now_us + clock_offset_us) / 1000);
+}
+
+void hal_set_time(uint64_t epoch_ms) {
+    clock_offset_us = (int64_t) (epoch_ms * 1000) - (int64_t) now_us;
+}
+
+void hal_sntp_begin() {
+    sntp_due_us = now_us + NATIVE_SNTP_MS * 1000;
+}
+
+bool hal_sntp_synced() {
+    if (sntp_due_us == 0 or now_us < sntp_due_us) {
+        return false;
+    }
+    clock_offset_us = (int64_t) world_boot_us;
+    sntp_due_us = 0;
+    return true;
+}
+
+bool hal_rtc_read(uint32_t offset, void *data, size_t size) {
+    if (offset * 4 + size > NATIVE_RTC_BYTES) {
+        return false;
+    }
+    memcpy(data, &state.rtc[offset * 4], size);
+    return true;
+}
+
+bool hal_rtc_write(uint32_t offset, const void *data, size_t size) {
+    if (offset * 4 + size > NATIVE_RTC_BYTES) {
+        return false;
+    }
+    memcpy(&state.rtc[offset * 4], data, size);
+    return true;
+}
+
+bool ina219_on{false};
+uint64_t ina219_on_us{0};
+
+void hal_ina219_begin() {
+    advance_us(NATIVE_INA219_BEGIN_US);
+}
+
+void hal_ina219_power(bool on) {
+    if (on and not ina219_on) {
+        ina219_on_us = now_us;
+    }
+    ina219_on = on;
+}
+
+void hal_dht_begin() {
+}
+
+/*
+ * A battery that starts full and loses a little every day.
+ */
+int hal_adc_read() {
+    advance_us(NATIVE_ADC_US);
+    float days = (float) (world_boot_us + now_us - state.first_boot_us) / 86400e6f;
+    float level = 740.0f - 2.0f * days + noise(2.0f);
+    return lround(level < 560.0f ? 560.0f : level);
+}
+
+/*
+ * The load follows the time of day. It is NaN, which fails the reading, when
+ * the INA219 is powered down or hasn't finished a conversion since power up.
+ */
+double hal_current_ma() {
+    bool converted = ina219_on and now_us - ina219_on_us >= NATIVE_INA219_CONVERSION_US;
+    advance_us(NATIVE_INA219_US);
+    if (not converted) {
+        return NAN;
+    }
+    return 60.0 + 40.0 * sin(hours_of_day() * M_PI / 12.0) + noise(0.5f);
+}
+
+float hal_temperature_c() {
+    advance_us(NATIVE_DHT_US);
+    return 21.0f + 3.0f * sinf((hours_of_day() - 9.0f) * (float) M_PI / 12.0f) + noise(0.05f);
+}
+
+float hal_relative_humidity() {
+    advance_us(NATIVE_DHT_US);
+    return 45.0f - 8.0f * sinf((hours_of_day() - 9.0f) * (float) M_PI / 12.0f) + noise(0.2f);
+}
+
+bool hal_button_down(int pin) {
+    return buttons_down & (1UL << pin);
+}
+
+void hal_button_attach(int pin, void (*isr)()) {
+    for (int i = 0; i < 3; i++) {
+        if (button_pins[i] == pin) {
+            button_isrs[i] = isr;
+        }
+    }
+}
+
+/*
+ * SSD1306 commands that take arguments, and how many.
+ */
+size_t ssd1306_arguments(uint8_t command) {
+    switch (command) {
+        case 0x21: case 0x22:
+            return 2;
+        case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3: case 0xD5:
+        case 0xD9: case 0xDA: case 0xDB:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+void native_ssd1306::write_command(uint8_t byte) {
+    command[command_len++] = byte;
+    if (command_len <= ssd1306_arguments(command[0])) {
+        return;
+    }
+    if (command[0] == OLED_COLUMN_ADDRESS) {
+        first_column = column = command[1] % OLED_WIDTH;
+        last_column = command[2] % OLED_WIDTH;
+    } else if (command[0] == OLED_PAGE_ADDRESS) {
+        first_page = page = command[1] % OLED_PAGES;
+        last_page = command[2] % OLED_PAGES;
+    }
+    command_len = 0;
+}
+
+/*
+ * Horizontal addressing: across the window, then down a page, then wrap.
+ */
+void native_ssd1306::write_data(uint8_t byte) {
+    memory[page * OLED_WIDTH + column] = byte;
+    if (column++ == last_column) {
+        column = first_column;
+        page = page == last_page ? first_page : page + 1;
+    }
+}
+
+/*
+ * Each control byte says whether commands or data follow, and whether only
+ * one byte (Co=1) or the rest of the write (Co=0).
+ */
+bool hal_i2c_write(uint8_t address, const uint8_t *data, size_t len) {
+    advance_us((len + 1) * NATIVE_I2C_BYTE_US);
+    i2c_bytes += len + 1;
+    i2c_writes++;
+    if (address != OLED_I2C_ADDRESS) {
+        return false;
+    }
+    size_t i{0};
+    while (i < len) {
+        uint8_t control = data[i++];
+        size_t end = control & 0x80 ? i + 1 : len;
+        for (; i < end and i < len; i++) {
+            if (control & 0x40) {
+                ssd1306.write_data(data[i]);
+            } else {
+                ssd1306.write_command(data[i]);
+            }
+        }
+    }
+    return true;
+}
+
+const uint8_t *hal_native_oled_memory() {
+    return ssd1306.memory;
+}
+
+void hal_wifi_on() {
+}
+
+/*
+ * Associates after a fixed time; faster with a lease.
+ */
+void hal_wifi_begin(const hal_wifi_lease *lease) {
+    if (rf == HAL_RF_DISABLED) {
+        fprintf(stderr, "Wake %u: WiFi started with the radio disabled.\n", state.wakes);
+        return;  // It never connects.
+    }
+    wifi_fast = lease != nullptr;
+    wifi_due_us = now_us + (wifi_fast ? NATIVE_WIFI_FAST_CONNECT_MS : NATIVE_WIFI_SCAN_MS) * 1000;
+}
+
+void hal_wifi_disconnect() {
+    wifi_due_us = 0;
+}
+
+void hal_wifi_off() {
+    wifi_due_us = 0;
+}
+
+bool hal_wifi_connected() {
+    return wifi_due_us != 0 and now_us >= wifi_due_us;
+}
+
+void hal_wifi_get_lease(hal_wifi_lease &lease) {
+    static const uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    memcpy(lease.bssid, bssid, sizeof(lease.bssid));
+    lease.channel = 6;
+    lease.reserved = 0;
+    lease.ip = 0x3201A8C0;       // 192.168.1.50
+    lease.gateway = 0x0101A8C0;  // 192.168.1.1
+    lease.subnet = 0x00FFFFFF;   // 255.255.255.0
+    lease.dns = 0x0101A8C0;
+}
+
+char *hal_wifi_mac(char *buffer, size_t buffer_len) {
+    uint8_t mac[6] = WIFI_MAC_ADDR;
+    snprintf(buffer, buffer_len, "%02X:%02X:%02X:%02X:%02X:%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return buffer;
+}
+
+/*
+ * Minimal MQTT 3.1.1 over plain TCP or TLS: CONNECT, QoS 0 PUBLISH, PINGREQ
+ * and DISCONNECT.
+ * The time each exchange really takes is added to the simulated clock.
+ */
+bool mqtt_send(const uint8_t *data, size_t len) {
+    while (len) {
+#ifdef NATIVE_TLS
+        ssize_t sent = SSL_write(tls, data, (int) len);
+#else
+        ssize_t sent = send(mqtt_socket, data, len, MSG_NOSIGNAL);
+#endif
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+// Waits for exactly len bytes, up to the socket's receive timeout.
+bool mqtt_receive(uint8_t *data, size_t len) {
+    while (len) {
+#ifdef NATIVE_TLS
+        ssize_t received = SSL_read(tls, data, (int) len);
+#else
+        ssize_t received = recv(mqtt_socket, data, len, 0);
+#endif
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        len -= received;
+    }
+    return true;
+}
+
+void mqtt_close() {
+#ifdef NATIVE_TLS
+    if (tls) {
+        SSL_shutdown(tls);  // Sends close_notify, as WiFiClientSecure::stop() does.
+        SSL_free(tls);
+        tls = nullptr;
+    }
+#endif
+    close(mqtt_socket);
+    mqtt_socket = -1;
+}
+
+#ifdef NATIVE_TLS
+#ifdef AIO_PINNED_KEYS
+/*
+ * Takes the place of OpenSSL's chain verification. A server key whose SHA-256
+ * is one of the pins is accepted without its chain, as the ESP8266 accepts a
+ * pinned key. Any other key has its chain verified as usual.
+ */
+int tls_verify(X509_STORE_CTX *store, void *) {
+    unsigned char *der{nullptr};
+    int len = i2d_X509_PUBKEY(X509_get_X509_PUBKEY(X509_STORE_CTX_get0_cert(store)), &der);
+    uint8_t hash[SHA256_DIGEST_LENGTH];
+    bool hashed = len > 0 and SHA256(der, len, hash);
+    OPENSSL_free(der);
+    for (size_t pin = 0; hashed and pin < AIO_PINNED_KEY_COUNT; ++pin) {
+        if (memcmp(hash, tls_pins[pin], sizeof(hash)) == 0) {
+            tls_pinned_by = (int) pin;
+            return 1;
+        }
+    }
+    tls_pinned_by = -1;
+    return X509_verify_cert(store);
+}
+#endif
+
+/*
+ * Counts the handshake's round trips: each flight the client waits on the
+ * server's answer to.
+ */
+void tls_message(int write_p, int version, int content_type, const void *, size_t, SSL *, void *) {
+    if (content_type != SSL3_RT_HANDSHAKE and content_type != SSL3_RT_CHANGE_CIPHER_SPEC) {
+        return;
+    }
+    if (not write_p and tls_sending) {
+        tls_round_trips++;
+    }
+    tls_sending = write_p;
+}
+
+/*
+ * Keeps a new session in the state file for the wakes to come. A resumed
+ * session isn't new, so it keeps its age.
+ */
+int tls_new_session(SSL *, SSL_SESSION *session) {
+    int len = i2d_SSL_SESSION(session, nullptr);
+    if (len <= 0 or len > NATIVE_TLS_SESSION_BYTES) {
+        LOG_WARN("The TLS session doesn't fit the state file.");
+        state.tls_session_len = 0;
+        return 0;
+    }
+    unsigned char *der = state.tls_session;
+    i2d_SSL_SESSION(session, &der);
+    state.tls_session_len = (uint32_t) len;
+    state.tls_created = (uint32_t) hal_time();
+    return 0;  // Not kept; OpenSSL frees it.
+}
+
+/*
+ * The session saved by an earlier wake, if there is one and it hasn't expired.
+ */
+void tls_resume(SSL *ssl) {
+    if (state.tls_session_len == 0) {
+        return;
+    }
+    if (hal_time() - (time_t) state.tls_created > TLS_SESSION_MAX_AGE_S) {
+        LOG_INFO("TLS session expired.");
+        state.tls_session_len = 0;
+        return;
+    }
+    const unsigned char *der = state.tls_session;
+    SSL_SESSION *session = d2i_SSL_SESSION(nullptr, &der, state.tls_session_len);
+    if (session) {
+        SSL_set_session(ssl, session);
+        SSL_SESSION_free(session);
+        LOG_INFO("Resuming TLS session.");
+    }
+}
+
+/*
+ * The TLS handshake on a connected socket. As on the ESP8266 the broker's
+ * chain must lead to caCert and name the broker, by host name or address,
+ * unless the broker holds a pinned key. BearSSL speaks TLS 1.2 at most, so
+ * this does too, and takes as many round trips.
+ */
+bool tls_open(int fd) {
+    if (not tls_context) {
+        tls_context = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_max_proto_version(tls_context, TLS1_2_VERSION);
+        SSL_CTX_set_session_cache_mode(tls_context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(tls_context, tls_new_session);
+        SSL_CTX_set_msg_callback(tls_context, tls_message);
+        const unsigned char *der = caCert;
+        X509 *ca = d2i_X509(nullptr, &der, caCertLen);
+        if (not ca or X509_STORE_add_cert(SSL_CTX_get_cert_store(tls_context), ca) != 1) {
+            fprintf(stderr, "caCert is not a DER certificate.\n");
+            exit(1);
+        }
+        X509_free(ca);
+        SSL_CTX_set_verify(tls_context, SSL_VERIFY_PEER, nullptr);
+#ifdef AIO_PINNED_KEYS
+        for (size_t pin = 0; pin < AIO_PINNED_KEY_COUNT; ++pin) {
+            SHA256(pinnedKeys[pin].der, pinnedKeys[pin].len, tls_pins[pin]);
+        }
+        SSL_CTX_set_cert_verify_callback(tls_context, tls_verify, nullptr);
+#endif
+    }
+    tls = SSL_new(tls_context);
+    SSL_set_fd(tls, fd);
+    SSL_set_tlsext_host_name(tls, broker.c_str());
+    X509_VERIFY_PARAM *param = SSL_get0_param(tls);
+    if (X509_VERIFY_PARAM_set1_ip_asc(param, broker.c_str()) != 1) {
+        X509_VERIFY_PARAM_set1_host(param, broker.c_str(), 0);
+    }
+    tls_resume(tls);
+    tls_round_trips = 0;
+    tls_sending = false;
+    uint64_t handshake_us = wall_us();
+    if (SSL_connect(tls) == 1) {
+        handshake_us = wall_us() - handshake_us;
+        if (SSL_session_reused(tls)) {
+            LOG_INFO("Resumed handshake: %lu us, round trips: %d.", (unsigned long) handshake_us, tls_round_trips);
+        } else if (tls_pinned_by < 0) {
+            LOG_INFO("Server SSL certificate verified. Full handshake: %lu us, round trips: %d.",
+                     (unsigned long) handshake_us, tls_round_trips);
+        } else {
+            LOG_INFO("Server holds pinned key %d. Full handshake: %lu us, round trips: %d.", tls_pinned_by,
+                     (unsigned long) handshake_us, tls_round_trips);
+        }
+        return true;
+    }
+    LOG_ERROR("TLS handshake failed: %s", ERR_reason_error_string(ERR_get_error()));
+    SSL_free(tls);
+    tls = nullptr;
+    return false;
+}
+#endif
+
+size_t mqtt_header(uint8_t *buffer, uint8_t type, size_t remaining) {
+    size_t len{0};
+    buffer[len++] = type;
+    do {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        buffer[len++] = remaining ? digit | 0x80 : digit;
+    } while (remaining);
+    return len;
+}
+
+void mqtt_string(std::vector<uint8_t> &packet, const char *text) {
+    size_t len = strlen(text);
+    packet.push_back(len >> 8);
+    packet.push_back(len & 0xFF);
+    packet.insert(packet.end(), text, text + len);
+}
+
+int mqtt_open() {
+    struct addrinfo hints{};
+    struct addrinfo *addresses;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(broker.c_str(), broker_port.c_str(), &hints, &addresses) != 0) {
+        return -1;
+    }
+    int fd{-1};
+    for (struct addrinfo *a = addresses; a; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 and connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+            break;
+        }
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd >= 0) {
+        struct timeval timeout{5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#ifdef NATIVE_TLS
+        if (not tls_open(fd)) {
+            close(fd);
+            fd = -1;
+        }
+#endif
+    }
+    return fd;
+}
+
+int8_t hal_mqtt_connect() {
+    uint64_t started_us = wall_us();
+    hal_mqtt_disconnect();
+    mqtt_socket = mqtt_open();
+    if (mqtt_socket < 0) {
+        advance_us(wall_us() - started_us);
+        return -1;
+    }
+    std::vector<uint8_t> body{0, 4, 'M', 'Q', 'T', 'T', 4, 0xC2, 0, 60};
+    mqtt_string(body, MQTT_CLIENTID);
+    mqtt_string(body, MQTT_USERNAME);
+    mqtt_string(body, MQTT_PASSWORD);
+    uint8_t header[5];
+    size_t header_len = mqtt_header(header, 0x10, body.size());
+    uint8_t connack[4];
+    bool sent = mqtt_send(header, header_len) and mqtt_send(body.data(), body.size());
+    bool acked = sent and mqtt_receive(connack, sizeof(connack)) and connack[0] == 0x20;
+    advance_us(wall_us() - started_us);
+    if (not acked) {
+        hal_mqtt_disconnect();
+        return -1;
+    }
+    if (connack[3] != 0) {
+        hal_mqtt_disconnect();
+    } else {
+        LOG_INFO("MQTT connected to %s in %lu ms.", broker.c_str(),
+                 (unsigned long) ((wall_us() - started_us) / 1000));
+    }
+    return connack[3];
+}
+
+const char *hal_mqtt_error(int8_t status) {
+    switch (status) {
+        case 1: return "The Server does not support the level of the MQTT protocol requested";
+        case 2: return "The Client identifier is correct UTF-8 but not allowed by the Server";
+        case 3: return "The MQTT service is unavailable";
+        case 4: return "The data in the user name or password is malformed";
+        case 5: return "Not authorized to connect";
+        case -1: return "Connection failed";
+        default: return "Unknown error";
+    }
+}
+
+bool hal_mqtt_publish(const char *topic, const uint8_t *payload, uint16_t payload_len) {
+    if (mqtt_socket < 0) {
+        return false;
+    }
+    uint64_t started_us = wall_us();
+    std::vector<uint8_t> body;
+    mqtt_string(body, topic);
+    body.insert(body.end(), payload, payload + payload_len);
+    uint8_t header[5];
+    size_t header_len = mqtt_header(header, 0x30, body.size());
+    bool sent = mqtt_send(header, header_len) and mqtt_send(body.data(), body.size());
+    advance_us(wall_us() - started_us);
+    if (not sent) {
+        mqtt_close();
+    }
+    return sent;
+}
+
+bool hal_mqtt_ping() {
+    if (mqtt_socket < 0) {
+        return false;
+    }
+    uint64_t started_us = wall_us();
+    static const uint8_t pingreq[2] = {0xC0, 0x00};
+    uint8_t pingresp[2];
+    bool answered = mqtt_send(pingreq, sizeof(pingreq))
+                    and mqtt_receive(pingresp, sizeof(pingresp)) and pingresp[0] == 0xD0;
+    advance_us(wall_us() - started_us);
+    if (not answered) {
+        mqtt_close();
+    }
+    return answered;
+}
+
+bool hal_mqtt_connected() {
+    return mqtt_socket >= 0;
+}
+
+void hal_mqtt_disconnect() {
+    if (mqtt_socket < 0) {
+        return;
+    }
+    static const uint8_t disconnect[2] = {0xE0, 0x00};
+    mqtt_send(disconnect, sizeof(disconnect));
+    mqtt_close();
+}
+
+/*
+ * The gateway link is UDP. The gateway listens on the port of -g; a node sends
+ * to it from any port.
+ */
+bool hal_link_begin(bool gateway_role) {
+    if (link_socket >= 0) {
+        return true;
+    }
+    if (rf == HAL_RF_DISABLED) {
+        fprintf(stderr, "Wake %u: The link started with the radio disabled.\n", state.wakes);
+        return false;
+    }
+    link_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (link_socket < 0) {
+        return false;
+    }
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = gateway_role ? htons(atoi(gateway_port.c_str())) : 0;
+    if (bind(link_socket, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        perror("bind");
+        close(link_socket);
+        link_socket = -1;
+        return false;
+    }
+    return true;
+}
+
+bool hal_link_send(const hal_link_peer *peer, const uint8_t *data, size_t len) {
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    if (peer) {
+        address.sin_addr.s_addr = peer->ip;
+        address.sin_port = htons(peer->port);
+    } else {
+        struct addrinfo hints{};
+        struct addrinfo *addresses;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo(gateway.c_str(), gateway_port.c_str(), &hints, &addresses) != 0) {
+            return false;
+        }
+        address = *(struct sockaddr_in *) addresses->ai_addr;
+        freeaddrinfo(addresses);
+    }
+    advance_us(len * 8 + 200);  // About 1 Mbit/s plus the preamble.
+    return sendto(link_socket, data, len, 0, (struct sockaddr *) &address, sizeof(address)) == (ssize_t) len;
+}
+
+size_t hal_link_receive(hal_link_peer &peer, uint8_t *buffer, size_t buffer_len, unsigned long timeout_ms) {
+    uint64_t started_us = wall_us();
+    struct pollfd ready{link_socket, POLLIN, 0};
+    ssize_t len{0};
+    if (poll(&ready, 1, timeout_ms) > 0) {
+        struct sockaddr_in address{};
+        socklen_t address_len = sizeof(address);
+        len = recvfrom(link_socket, buffer, buffer_len, 0, (struct sockaddr *) &address, &address_len);
+        memset(peer.mac, 0, sizeof(peer.mac));
+        peer.ip = address.sin_addr.s_addr;
+        peer.port = ntohs(address.sin_port);
+    }
+    advance_us(wall_us() - started_us);
+    return len > 0 ? len : 0;
+}
+
+/*
+ * SHA-256 (FIPS 180-4), for the link's HMAC without a crypto library; the
+ * native build only needs one with NATIVE_TLS.
+ */
+struct sha256 {
+    uint32_t state[8]{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    uint8_t block[64];
+    size_t block_len{0};
+    uint64_t total_len{0};
+    void update(const uint8_t *data, size_t len);
+    void out(uint8_t digest[32]);
+    void compress();
+};
+
+uint32_t rotate_right(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+void sha256::compress() {
+    static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t) block[i * 4] << 24 | block[i * 4 + 1] << 16 | block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotate_right(w[i - 15], 7) ^ rotate_right(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotate_right(w[i - 2], 17) ^ rotate_right(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t v[8];
+    memcpy(v, state, sizeof(v));
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = rotate_right(v[4], 6) ^ rotate_right(v[4], 11) ^ rotate_right(v[4], 25);
+        uint32_t t1 = v[7] + s1 + ((v[4] & v[5]) ^ (~v[4] & v[6])) + k[i] + w[i];
+        uint32_t s0 = rotate_right(v[0], 2) ^ rotate_right(v[0], 13) ^ rotate_right(v[0], 22);
+        uint32_t t2 = s0 + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(v + 1, v, 7 * sizeof(v[0]));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++) {
+        state[i] += v[i];
+    }
+}
+
+void sha256::update(const uint8_t *data, size_t len) {
+    total_len += len;
+    while (len--) {
+        block[block_len++] = *data++;
+        if (block_len == sizeof(block)) {
+            compress();
+            block_len = 0;
+        }
+    }
+}
+
+void sha256::out(uint8_t digest[32]) {
+    uint64_t bits = total_len * 8;
+    uint8_t padding = 0x80;
+    update(&padding, 1);
+    padding = 0;
+    while (block_len != 56) {
+        update(&padding, 1);
+    }
+    for (int i = 7; i >= 0; i--) {
+        uint8_t byte = bits >> (i * 8);
+        update(&byte, 1);
+    }
+    for (int i = 0; i < 32; i++) {
+        digest[i] = state[i / 4] >> (24 - i % 4 * 8);
+    }
+}
+
+void hal_hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len, uint8_t mac[32]) {
+    uint8_t pad[64]{};
+    if (key_len > sizeof(pad)) {
+        sha256 hash;
+        hash.update(key, key_len);
+        hash.out(pad);
+    } else {
+        memcpy(pad, key, key_len);
+    }
+    for (uint8_t &byte : pad) {
+        byte ^= 0x36;
+    }
+    sha256 inner;
+    inner.update(pad, sizeof(pad));
+    inner.update(data, data_len);
+    uint8_t digest[32];
+    inner.out(digest);
+    for (uint8_t &byte : pad) {
+        byte ^= 0x36 ^ 0x5c;
+    }
+    sha256 outer;
+    outer.update(pad, sizeof(pad));
+    outer.update(digest, sizeof(digest));
+    outer.out(mac);
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_log.hpp"
+
+/*
+ * Write the records out as one frame and empty the ring.
+ */
+void monitor_log::flush() {
+    if (used == 0 and dropped == 0) {
+        return;
+    }
+    uint8_t header[LOG_FRAME_MARKER_LEN + 4];
+    memcpy(header, LOG_FRAME_MARKER, LOG_FRAME_MARKER_LEN);
+    header[LOG_FRAME_MARKER_LEN] = used & 0xFF;
+    header[LOG_FRAME_MARKER_LEN + 1] = used >> 8;
+    header[LOG_FRAME_MARKER_LEN + 2] = dropped & 0xFF;
+    header[LOG_FRAME_MARKER_LEN + 3] = dropped >> 8;
+    Serial.write(header, sizeof(header));
+    size_t tail = (head + LOG_BUFFER_SIZE - used) % LOG_BUFFER_SIZE;
+    size_t first = min(used, LOG_BUFFER_SIZE - tail);
+    Serial.write(buffer + tail, first);
+    Serial.write(buffer, used - first);
+    Serial.flush();  // All of it, before deep sleep stops the UART.
+    used = 0;
+    dropped = 0;
+}
+
+/*
+ * Append a record, dropping the oldest until it fits.
+ */
+void monitor_log::push(const uint8_t *entry, size_t len) {
+    while (used + len > LOG_BUFFER_SIZE) {
+        used -= buffer[(head + LOG_BUFFER_SIZE - used) % LOG_BUFFER_SIZE];
+        dropped++;
+    }
+    for (size_t i = 0; i < len; i++) {
+        buffer[head] = entry[i];
+        head = (head + 1) % LOG_BUFFER_SIZE;
+    }
+    used += len;
+}
+
+void monitor_log::put_float(uint8_t *entry, size_t &len, float value) {
+    if (len + sizeof(value) <= LOG_RECORD_MAX) {
+        memcpy(entry + len, &value, sizeof(value));
+        len += sizeof(value);
+    }
+}
+
+/*
+ * As much of the string as fits in the record.
+ */
+void monitor_log::put(uint8_t *entry, size_t &len, const char *text) {
+    size_t text_len = strlen(text);
+    if (len + 1 + text_len > LOG_RECORD_MAX) {
+        text_len = len + 1 < LOG_RECORD_MAX ? LOG_RECORD_MAX - len - 1 : 0;
+    }
+    if (len < LOG_RECORD_MAX) {
+        put_varint(entry, len, text_len);
+        memcpy(entry + len, text, text_len);
+        len += text_len;
+    }
+}
+
+void monitor_log::put_varint(uint8_t *entry, size_t &len, uint64_t value) {
+    uint8_t bytes[10];
+    size_t n{0};
+    do {
+        bytes[n++] = (value & 0x7F) | (value > 0x7F ? 0x80 : 0);
+        value >>= 7;
+    } while (value);
+    if (len + n <= LOG_RECORD_MAX) {
+        memcpy(entry + len, bytes, n);
+        len += n;
+    }
+}
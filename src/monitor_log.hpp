@@ -0,0 +1,152 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_LOG_HPP
+#define MONITOR_MONITOR_LOG_HPP
+
+#include <type_traits>
+#include "monitor_hal.hpp"
+
+// Messages above LOG_LEVEL compile to nothing, arguments included.
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// RAM kept for the records of a wake. The oldest are dropped when it is full.
+#ifndef LOG_BUFFER_SIZE
+#if LOG_LEVEL > LOG_LEVEL_NONE
+#define LOG_BUFFER_SIZE 1024
+#else
+#define LOG_BUFFER_SIZE 1  // Nothing is ever logged.
+#endif
+#endif
+#define LOG_RECORD_MAX 128
+
+// Each flush is one frame: the marker, the length of the records that follow
+// and how many were dropped since the last flush, both 16-bit little endian.
+#define LOG_FRAME_MARKER "\0ML"
+#define LOG_FRAME_MARKER_LEN 3
+
+/*
+ * The ID of a message is the 32-bit FNV-1a hash of its format string, worked
+ * out by the compiler. The string itself isn't kept in the firmware at all;
+ * tools/log_decode.py finds it in the sources by the same hash.
+ */
+constexpr uint32_t log_hash(const char *format, uint32_t hash = 2166136261u) {
+    return *format ? log_hash(format + 1, (hash ^ (uint8_t) *format) * 16777619u) : hash;
+}
+
+/*
+ * A log of binary records in a RAM ring. A record is its length, the message
+ * ID, the millis() it was made and the arguments: integers as zigzag varints,
+ * floating point as a 32-bit float and strings as a varint length and the
+ * bytes. Nothing goes to the serial port until flush(), which the firmware
+ * calls on the way into deep sleep with the radio off, or once a pass of
+ * loop() when it never sleeps. Not for use from interrupt handlers.
+ *
+ * Formats take printf's conversions with the argument types above, e.g. %d,
+ * %lu or %x for any integer, %.2f for a float and %s for a string.
+ */
+struct monitor_log {
+    template <typename... Args>
+    void record(uint32_t id, const Args &... args) {
+        uint8_t entry[LOG_RECORD_MAX];
+        size_t len{1};
+        memcpy(entry + len, &id, sizeof(id));
+        len += sizeof(id);
+        put_varint(entry, len, hal_millis());
+        put_args(entry, len, args...);
+        entry[0] = (uint8_t) len;
+        push(entry, len);
+    }
+    void flush();
+    size_t pending() const { return used; }
+    uint8_t buffer[LOG_BUFFER_SIZE];
+    size_t head{0};
+    size_t used{0};
+    uint16_t dropped{0};
+private:
+    void push(const uint8_t *entry, size_t len);
+    static void put_args(uint8_t *entry, size_t &len) {}
+    template <typename T, typename... Rest>
+    static void put_args(uint8_t *entry, size_t &len, const T &arg, const Rest &... rest) {
+        put(entry, len, arg);
+        put_args(entry, len, rest...);
+    }
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value or std::is_enum<T>::value>::type
+    put(uint8_t *entry, size_t &len, T value) {
+        int64_t x = (int64_t) value;
+        put_varint(entry, len, ((uint64_t) x << 1) ^ (uint64_t) (x >> 63));
+    }
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+    put(uint8_t *entry, size_t &len, T value) {
+        put_float(entry, len, (float) value);
+    }
+    static void put(uint8_t *entry, size_t &len, const char *text);
+    static void put_float(uint8_t *entry, size_t &len, float value);
+    static void put_varint(uint8_t *entry, size_t &len, uint64_t value);
+};
+
+extern monitor_log logger;
+
+#define LOG_RECORD(format, ...) do { \
+        constexpr uint32_t log_id = log_hash(format); \
+        logger.record(log_id, ##__VA_ARGS__); \
+    } while (0)
+
+// A message that is compiled out. Its arguments are still checked, and count
+// as used, but the compiler drops the call and nothing is evaluated.
+#define LOG_DISABLED(...) do { \
+        if (false) { \
+            LOG_RECORD(__VA_ARGS__); \
+        } \
+    } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_RECORD(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_RECORD(__VA_ARGS__)
+#else
+#define LOG_WARN(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_RECORD(__VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_RECORD(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#endif //MONITOR_MONITOR_LOG_HPP
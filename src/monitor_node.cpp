@@ -0,0 +1,82 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_node.hpp"
+#include "monitor_log.hpp"
+
+void node_tag(const void *message, size_t len, uint8_t tag[NODE_TAG_SIZE]) {
+    uint8_t mac[32];
+    hal_hmac_sha256((const uint8_t *) NODE_LINK_KEY, sizeof(NODE_LINK_KEY) - 1, (const uint8_t *) message, len, mac);
+    memcpy(tag, mac, NODE_TAG_SIZE);
+}
+
+/*
+ * Compares every byte, so the time taken doesn't tell how much of a forged
+ * tag was right.
+ */
+bool node_tag_valid(const void *message, size_t len, const uint8_t tag[NODE_TAG_SIZE]) {
+    uint8_t expected[NODE_TAG_SIZE];
+    node_tag(message, len, expected);
+    uint8_t difference{0};
+    for (size_t i = 0; i < NODE_TAG_SIZE; i++) {
+        difference |= expected[i] ^ tag[i];
+    }
+    return difference == 0;
+}
+
+bool monitor_node::begin() {
+    if (not hal_link_begin(false)) {
+        LOG_ERROR("ERROR: The gateway link didn't start.");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Send one reading and wait for the gateway to ack it. Without an ack the
+ * reading stays queued and is sent again on the next upload; the gateway drops
+ * the copy should only its ack have been lost.
+ */
+bool monitor_node::send(const monitor_data &reading, uint32_t sequence) {
+    monitor_node_frame frame{NODE_FRAME_VERSION, NODE_FRAME_READING, {}, sequence, reading, {}};
+    memcpy(frame.node, mac, sizeof(frame.node));
+    node_tag(&frame, offsetof(monitor_node_frame, tag), frame.tag);
+    if (not hal_link_send(nullptr, (const uint8_t *) &frame, sizeof(frame))) {
+        return false;
+    }
+    unsigned long started_ms = hal_millis();
+    unsigned long waited_ms{0};
+    while (waited_ms < NODE_ACK_TIMEOUT_MS) {
+        hal_link_peer peer;
+        monitor_node_ack ack;
+        size_t len = hal_link_receive(peer, (uint8_t *) &ack, sizeof(ack), NODE_ACK_TIMEOUT_MS - waited_ms);
+        if (len == sizeof(ack) and ack.version == NODE_FRAME_VERSION and ack.type == NODE_FRAME_ACK
+            and ack.sequence == sequence and memcmp(ack.node, mac, sizeof(mac)) == 0
+            and node_tag_valid(&ack, offsetof(monitor_node_ack, tag), ack.tag)) {
+            gateway_epoch = ack.epoch;
+            return true;
+        }
+        waited_ms = hal_millis() - started_ms;
+    }
+    LOG_WARN("No ack from the gateway for reading %lu", sequence);
+    return false;
+}
@@ -0,0 +1,113 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_NODE_HPP
+#define MONITOR_MONITOR_NODE_HPP
+
+#include "monitor_hal.hpp"
+#include "monitor_data.hpp"
+
+// The gateway's UDP port, and its address for nodes with MONITOR_LINK_UDP.
+#ifndef GATEWAY_UDP_PORT
+#define GATEWAY_UDP_PORT 4210
+#endif
+#ifndef GATEWAY_HOST
+#define GATEWAY_HOST "127.0.0.1"
+#endif
+// ESP-NOW nodes send to this MAC address on this WiFi channel, which must be
+// the channel of the access point the gateway is associated with.
+#ifndef GATEWAY_MAC
+#define GATEWAY_MAC {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}
+#endif
+#ifndef GATEWAY_CHANNEL
+#define GATEWAY_CHANNEL 1
+#endif
+// How long a node waits for the gateway to publish a reading and ack it.
+#ifndef NODE_ACK_TIMEOUT_MS
+#define NODE_ACK_TIMEOUT_MS 300
+#endif
+
+// The key nodes and their gateway share, to tag frames and acks.
+#if defined(MONITOR_NODE) or defined(MONITOR_GATEWAY)
+#ifndef NODE_LINK_KEY
+#error "Define NODE_LINK_KEY, the key nodes and their gateway share."
+#endif
+#else
+#define NODE_LINK_KEY ""
+#endif
+#define NODE_TAG_SIZE 8
+
+#define NODE_FRAME_VERSION 2
+#define NODE_FRAME_READING 1
+#define NODE_FRAME_ACK 2
+
+/*
+ * One queued reading, sent by a battery node to its gateway instead of being
+ * published over TLS. The node is known by its WIFI_MAC_ADDR. The sequence
+ * number is the reading's sequence in the node's store-and-forward queue.
+ * The tag is the first NODE_TAG_SIZE bytes of the HMAC-SHA256 of the rest of
+ * the frame under NODE_LINK_KEY.
+ */
+struct monitor_node_frame {
+    uint8_t version;
+    uint8_t type;
+    uint8_t node[6];
+    uint32_t sequence;
+    monitor_data reading;
+    uint8_t tag[NODE_TAG_SIZE];
+};
+
+/*
+ * The gateway's answer once it has published a reading. It carries the time
+ * of day, which is all the clock a node on ESP-NOW gets. It is tagged like a
+ * frame.
+ */
+struct monitor_node_ack {
+    uint8_t version;
+    uint8_t type;
+    uint8_t node[6];
+    uint32_t sequence;
+    uint32_t epoch;
+    uint8_t tag[NODE_TAG_SIZE];
+};
+
+static_assert(sizeof(monitor_node_frame) == 36, "monitor_node_frame should pack into 36 bytes.");
+static_assert(sizeof(monitor_node_ack) == 24, "monitor_node_ack should pack into 24 bytes.");
+static_assert(sizeof(monitor_node_frame) <= HAL_LINK_PACKET_MAX, "A frame must fit one link packet.");
+
+/*
+ * Tagging a frame or an ack: the tag covers the len bytes before it.
+ */
+void node_tag(const void *message, size_t len, uint8_t tag[NODE_TAG_SIZE]);
+bool node_tag_valid(const void *message, size_t len, const uint8_t tag[NODE_TAG_SIZE]);
+
+/*
+ * The battery node's side of the link.
+ */
+struct monitor_node {
+    bool begin();
+    bool send(const monitor_data &reading, uint32_t sequence);
+    uint32_t gateway_epoch{0};  // The time of day in the last ack.
+    uint8_t mac[6] = WIFI_MAC_ADDR;
+};
+
+#endif //MONITOR_MONITOR_NODE_HPP
@@ -21,110 +21,221 @@
  */
 
 #include "monitor_oled_display.hpp"
+#include "monitor_battery.hpp"
+#include "monitor_log.hpp"
+#include "monitor_profiler.hpp"
+extern monitor_profiler profiler;
 extern monitor_data sensor;
+extern ntp_time_utils time_util;
+extern monitor_display_mode display_mode;
+
+/*
+ * Draw the page, then send only the part of the frame that changed. The panel
+ * is begun the first time, so wakes that show nothing never touch it.
+ */
+void monitor_display::show_page(int page) {
+    if (not enabled) {
+        enable();
+    }
+    if (page != drawn_page or display_mode.celsius != drawn_celsius) {
+        draw_labels(page);
+        drawn_page = page;
+        drawn_celsius = display_mode.celsius;
+    }
+    draw_values(page);
+#ifdef ARDUINO
+    size_t sent = frame.flush(oled.getBuffer());
+#else
+    size_t sent = frame.flush(buffer);
+    if (memcmp(hal_native_oled_memory(), buffer, sizeof(buffer)) != 0) {
+        LOG_ERROR("ERROR: The OLED doesn't show the frame.");
+    }
+#endif
+    LOG_INFO("OLED frame: %u bytes, %lu since boot.", sent, frame.bytes_sent);
+}
+
+#ifdef ARDUINO
 extern ESP8266WiFiClass WiFi;
-extern bool degrees_c_f;
+
+// Values are right-aligned in front of their labels.
+#define VALUE_WIDTH 48
+
+void monitor_oled::render_icons() {
+    fillRect(0, 0, 128, 8, BLACK);
+    fillRect(0, 24, 128, 8, BLACK);
+    renderBattery();
+    renderConnected();
+    renderRSSI();
+    renderIPAddress();
+}
 
 void monitor_display::enable() {
-    display.begin(SSD1306_SWITCHCAPVCC, 0x3C);  // Initialize I2C address 0x3C.
-    display.clearDisplay();
-    display.display();
+    unsigned long started_us = hal_micros();
+    oled.begin(SSD1306_SWITCHCAPVCC, OLED_I2C_ADDRESS);
+    oled.setTextSize(1);
+    oled.setTextColor(WHITE);
+    oled.clearDisplay();
+    frame.invalidate();  // Whatever the panel holds after power-up goes.
+    frame.flush(oled.getBuffer());
+    drawn_page = -1;
+    enabled = true;
+    profiler.init(PROFILE_INIT_OLED, started_us);
 }
 
+/*
+ * A panel that was never begun this wake is still off from the last one.
+ */
 void monitor_display::disable() {
-    display.ssd1306_command(SSD1306_DISPLAYOFF);
+    if (enabled) {
+        oled.ssd1306_command(SSD1306_DISPLAYOFF);
+        enabled = false;
+    }
 }
 
-void monitor_display::show_page(int page) {
-    display.setTextSize(1);
-    display.setTextColor(WHITE);
-    display.setCursor(0,0);
-
-    oled_wifi.init();
-    oled_wifi.clearDisplay();
-    oled_wifi.clearMsgArea();
-    oled_wifi.setBatteryVisible(false);
-    oled_wifi.setBatteryIcon(false);
-    oled_wifi.renderBattery();
-    oled_wifi.setConnectedVisible(false);
-    oled_wifi.setRSSIVisible(false);
-    oled_wifi.setIPAddressVisible(false);
-    oled_wifi.refreshIcons();
-
-    display.display();
+/*
+ * Whatever of a page stays put while it is shown.
+ */
+void monitor_display::draw_labels(int page) {
+    oled.clearDisplay();
+    switch (page) {
+        default:
+        case 0 : {
+            oled.setCursor(VALUE_WIDTH, 8);
+            oled.print(display_mode.celsius ? " C" : " F");
+            oled.setCursor(VALUE_WIDTH, 16);
+            oled.print(" rH");
+            oled.setCursor(VALUE_WIDTH, 24);
+            oled.print(" mA");
+            break;
+        }
+        case 1 : {
+            break;  // Nothing but icons.
+        }
+        case 2 : {
+            oled.setCursor(0, 0);
+            oled.print("ID: ");
+            oled.println(AIO_GROUP_KEY);
+
+            oled.print(ESP.getSdkVersion());
+            oled.print(" ");
+            oled.println(ESP.getCoreVersion());
+
+            oled.print("S U/F ");
+            oled.print(ESP.getSketchSize());
+            oled.print("/");
+            oled.println(ESP.getFreeSketchSpace());
+
+            oled.print("Free Heap: ");
+            break;
+        }
+    }
+}
+
+/*
+ * Print text right-aligned to end at column x, over whatever was there.
+ */
+void print_right(Adafruit_GFX &gfx, int16_t x, int16_t y, const char *text) {
+    int16_t width = 6 * strlen(text);  // Text size 1 is 6 pixels a character.
+    gfx.fillRect(0, y, x, 8, BLACK);
+    gfx.setCursor(x - width, y);
+    gfx.print(text);
+}
 
+void monitor_display::draw_values(int page) {
     switch (page) {
         default:
         case 0 : {
-            char date_time[21];
-            memcpy(&date_time, &sensor.unix_epoch_time[4], sizeof(date_time));
-            display.println(date_time);
-            if (degrees_c_f) {
-                double temperature_c = (sensor.temperature_f - 32.0) * (5.0 / 9.0);
-                display.print(temperature_c);
-                display.println(" C");
-            } else {
-                display.print(sensor.temperature_f);
-                display.println(" F");
-            }
-            display.print(sensor.humidity_rh);
-            display.println(" rH");
-            display.print(sensor.current_ma);
-            display.println(" mA");
+            char value[CENTI_TEXT_SIZE];
+            char date_time[TIME_STRING_SIZE];
+            time_util.format_time(sensor.unix_epoch_time, date_time, sizeof(date_time));
+            date_time[24] = '\0';  // Drop the timezone.
+            oled.fillRect(0, 0, OLED_WIDTH, 8, BLACK);
+            oled.setCursor(0, 0);
+            oled.print(&date_time[4]);  // And the day of the week.
+            int32_t temperature = display_mode.celsius ? centi_f_to_c(sensor.temperature_cf)
+                                                       : sensor.temperature_cf;
+            print_right(oled, VALUE_WIDTH, 8, format_centi(temperature, value, sizeof(value)));
+            print_right(oled, VALUE_WIDTH, 16, format_centi(sensor.humidity_crh, value, sizeof(value)));
+            print_right(oled, VALUE_WIDTH, 24, format_centi(sensor.current_cma, value, sizeof(value)));
             break;
         }
         case 1 : {
-            float voltage;
-            voltage = map(sensor.battery_vdc, 0, 100, 3.14, 4.20);
-            if (voltage >= 3.15) {
-                oled_wifi.setBattery(voltage);
-                oled_wifi.setBatteryVisible(true);
-                oled_wifi.setBatteryIcon(true);
-                oled_wifi.renderBattery();
-            }
+            float voltage = battery.current.ocv_mv / 1000.0f;
+            bool battery_visible = voltage >= 3.15;
+            oled.setBattery(voltage);
+            oled.setBatteryVisible(battery_visible);
+            oled.setBatteryIcon(battery_visible);
             bool wifi_connect_status = WiFi.isConnected();
+            oled.setConnected(wifi_connect_status);
+            oled.setConnectedVisible(wifi_connect_status);
             if (wifi_connect_status){
-                oled_wifi.setConnected(wifi_connect_status);
-                oled_wifi.setConnectedVisible(true);
                 int32_t rssi = WiFi.RSSI();
                 uint32_t ipAddress = WiFi.localIP();
-                oled_wifi.setRSSI(rssi);
-                oled_wifi.setRSSIVisible(true);
-                oled_wifi.setIPAddress(ipAddress);
-                oled_wifi.setIPAddressVisible(true);
-                oled_wifi.setConnected(true);
-                oled_wifi.setConnectedVisible(true);
+                oled.setRSSI(rssi);
+                oled.setIPAddress(ipAddress);
             }
-            oled_wifi.refreshIcons();
+            oled.setRSSIVisible(wifi_connect_status);
+            oled.setIPAddressVisible(wifi_connect_status);
+            oled.render_icons();
             break;
         }
         case 2 : {
-            display.print("ID: ");
-            display.println(AIO_GROUP_KEY);
+            char value[CENTI_TEXT_SIZE];
+            snprintf(value, sizeof(value), "%u", ESP.getFreeHeap());
+            oled.fillRect(66, 24, OLED_WIDTH - 66, 8, BLACK);  // After "Free Heap: ".
+            oled.setCursor(66, 24);
+            oled.print(value);
+            break;
+        }
+    }
+}
+
+#else
+
+void monitor_display::enable() {
+    unsigned long started_us = hal_micros();
+    memset(buffer, 0, sizeof(buffer));
+    frame.invalidate();
+    frame.flush(buffer);
+    drawn_page = -1;
+    enabled = true;
+    profiler.init(PROFILE_INIT_OLED, started_us);
+}
 
-            display.print(ESP.getSdkVersion());
-            display.print(" ");
-            display.println(ESP.getCoreVersion());
+void monitor_display::disable() {
+    enabled = false;
+}
 
-            display.print("S U/F ");
-            display.print(ESP.getSketchSize());
-            display.print("/");
-            display.println(ESP.getFreeSketchSpace());
+/*
+ * The native build has no fonts. Each page row is a bar as long as a reading.
+ */
+void monitor_display::draw_labels(int page) {
+    memset(buffer, 0, sizeof(buffer));
+}
 
-            display.print("Free Heap: ");
-            display.println(ESP.getFreeHeap());
+void draw_bar(uint8_t *buffer, int row, int32_t value, int32_t full_scale) {
+    int32_t length = value <= 0 ? 0 : (value >= full_scale ? OLED_WIDTH : value * OLED_WIDTH / full_scale);
+    for (int column = 0; column < OLED_WIDTH; column++) {
+        buffer[row * OLED_WIDTH + column] = column < length ? 0x7E : 0x00;
+    }
+}
 
+void monitor_display::draw_values(int page) {
+    switch (page) {
+        default:
+        case 0 :
+            draw_bar(buffer, 0, sensor.unix_epoch_time % 86400, 86400);
+            draw_bar(buffer, 1, display_mode.celsius ? centi_f_to_c(sensor.temperature_cf)
+                                                      : sensor.temperature_cf, 10000);
+            draw_bar(buffer, 2, sensor.humidity_crh, 10000);
+            draw_bar(buffer, 3, sensor.current_cma, 20000);
+            break;
+        case 1 :
+            draw_bar(buffer, 0, sensor.battery_vdc, 100);
+            break;
+        case 2 :
             break;
-        }
     }
-    display.setCursor(0,0);
-    display.display();
 }
 
-float monitor_display::map(long x, long in_min, long in_max, float out_min, float out_max) {
-    long divisor = (in_max - in_min);
-    if(divisor == 0){
-        return -1; //AVR returns -1, SAM returns 0
-    }
-    return (x - in_min) * (out_max - out_min) / divisor + out_min;
-}
\ No newline at end of file
+#endif
@@ -23,29 +23,50 @@
 #ifndef MONITOR_MONITOR_OLED_DISPLAY_HPP
 #define MONITOR_MONITOR_OLED_DISPLAY_HPP
 
+#ifdef ARDUINO
 #include <Wire.h>
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include <Adafruit_FeatherOLED.h>
 #include <Adafruit_FeatherOLED_WiFi.h>
 #include <ESP8266WiFi.h>
+#endif
 #include "monitor_data.hpp"
+#include "monitor_display_mode.hpp"
+#include "monitor_oled_frame.hpp"
+#include "ntp_time_utils.hpp"
 
-#if defined(ESP8266)
-#define BUTTON_A 12
-#define BUTTON_B 13
-#define BUTTON_C 14
-#define LED      0
+#ifdef ARDUINO
+/*
+ * The FeatherOLED WiFi icons, drawn into the frame buffer without sending it to
+ * the panel the way refreshIcons() does.
+ */
+struct monitor_oled : public Adafruit_FeatherOLED_WiFi {
+    void render_icons();
+};
 #endif
 
+/*
+ * Draws the pages into a frame buffer and lets monitor_oled_frame send only
+ * what changed. The labels of a page are drawn once, when the page is shown;
+ * later calls only redraw the values.
+ */
 struct monitor_display {
-    volatile int page{0};
     void enable();
     void disable();
     void show_page(int page);
-    float map(long x, long in_min, long in_max, float out_min, float out_max);
-    Adafruit_SSD1306 display = Adafruit_SSD1306();
-    Adafruit_FeatherOLED_WiFi oled_wifi = Adafruit_FeatherOLED_WiFi();
+    monitor_oled_frame frame;
+    int drawn_page{-1};
+    bool drawn_celsius{false};
+    bool enabled{false};  // Begun this wake.
+#ifdef ARDUINO
+    monitor_oled oled;
+#else
+    uint8_t buffer[OLED_FRAME_SIZE];  // The native build draws bar graphs.
+#endif
+private:
+    void draw_labels(int page);
+    void draw_values(int page);
 };
 
 #endif //MONITOR_MONITOR_OLED_DISPLAY_HPP
@@ -0,0 +1,104 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_oled_frame.hpp"
+#include "monitor_log.hpp"
+
+/*
+ * The panel's memory is unknown, e.g. after power-up. The next flush sends the
+ * whole frame.
+ */
+void monitor_oled_frame::invalidate() {
+    shown_valid = false;
+}
+
+/*
+ * Send what changed since the last flush. Returns the bytes put on the bus.
+ * A write the panel didn't ack leaves its memory unknown, so the flush stops
+ * there and the next one sends the whole frame.
+ */
+size_t monitor_oled_frame::flush(const uint8_t *frame) {
+    uint8_t first_page{OLED_PAGES}, last_page{0};
+    uint8_t first_column{OLED_WIDTH}, last_column{0};
+    for (uint8_t page = 0; page < OLED_PAGES; page++) {
+        for (uint8_t column = 0; column < OLED_WIDTH; column++) {
+            size_t i = page * OLED_WIDTH + column;
+            if (shown_valid and frame[i] == shown[i]) {
+                continue;
+            }
+            first_page = page < first_page ? page : first_page;
+            last_page = page;
+            first_column = column < first_column ? column : first_column;
+            last_column = column > last_column ? column : last_column;
+        }
+    }
+    if (first_page == OLED_PAGES) {
+        return 0;  // Nothing changed.
+    }
+
+    uint8_t buffer[OLED_I2C_BUFFER];
+    size_t len{0};
+    const uint8_t window[] = {OLED_COLUMN_ADDRESS, first_column, last_column,
+                              OLED_PAGE_ADDRESS, first_page, last_page};
+    for (uint8_t command : window) {
+        buffer[len++] = OLED_CONTROL_COMMAND;
+        buffer[len++] = command;
+    }
+    buffer[len++] = OLED_CONTROL_DATA;
+    size_t sent{0};
+    for (uint8_t page = first_page; page <= last_page; page++) {
+        for (uint8_t column = first_column; column <= last_column; column++) {
+            if (len == sizeof(buffer)) {
+                // The window keeps its place, the data just carries on.
+                if (not write(buffer, len, sent)) {
+                    return sent;
+                }
+                len = 0;
+                buffer[len++] = OLED_CONTROL_DATA;
+            }
+            size_t i = page * OLED_WIDTH + column;
+            buffer[len++] = frame[i];
+            shown[i] = frame[i];
+        }
+    }
+    if (write(buffer, len, sent)) {
+        shown_valid = true;
+    }
+    return sent;
+}
+
+/*
+ * One write of a flush, counted in sent, the address byte too. Returns false
+ * when the panel didn't ack it.
+ */
+bool monitor_oled_frame::write(const uint8_t *buffer, size_t len, size_t &sent) {
+    sent += len + 1;
+    writes++;
+    bytes_sent += len + 1;
+    if (not hal_i2c_write(OLED_I2C_ADDRESS, buffer, len)) {
+        LOG_WARN("The OLED didn't ack a write. Sending the whole frame next.");
+        shown_valid = false;
+        nacks++;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_OLED_FRAME_HPP
+#define MONITOR_MONITOR_OLED_FRAME_HPP
+
+#include "monitor_hal.hpp"
+
+// The FeatherOLED's SSD1306 is 128x32; 4 pages of 8 pixel rows.
+#define OLED_WIDTH 128
+#define OLED_PAGES 4
+#define OLED_FRAME_SIZE (OLED_WIDTH * OLED_PAGES)
+#define OLED_I2C_ADDRESS 0x3C
+
+// The most one I2C write can carry; BUFFER_LENGTH of the ESP8266 Wire library.
+#ifndef OLED_I2C_BUFFER
+#define OLED_I2C_BUFFER 128
+#endif
+
+// SSD1306 commands and I2C control bytes.
+#define OLED_COLUMN_ADDRESS 0x21
+#define OLED_PAGE_ADDRESS 0x22
+#define OLED_CONTROL_COMMAND 0x80  // Co=1: one command byte follows.
+#define OLED_CONTROL_DATA 0x40     // Co=0, D/C#=1: data to the end of the write.
+
+/*
+ * Sends a frame buffer in the SSD1306 page layout to the panel, but only the
+ * part that changed since the last one. The columns and pages that differ
+ * from the frame last sent are bounded by one rectangle. The address window is
+ * set to it and its bytes follow in the same I2C write, as far as the Wire
+ * buffer allows.
+ */
+struct monitor_oled_frame {
+    void invalidate();
+    size_t flush(const uint8_t *frame);
+    uint8_t shown[OLED_FRAME_SIZE];
+    bool shown_valid{false};
+    uint32_t bytes_sent{0};  // Bytes on the I2C bus, address bytes included.
+    uint32_t writes{0};      // I2C writes.
+    uint32_t nacks{0};       // Writes the panel didn't ack.
+
+private:
+    bool write(const uint8_t *buffer, size_t len, size_t &sent);
+};
+
+#endif //MONITOR_MONITOR_OLED_FRAME_HPP
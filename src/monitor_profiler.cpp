@@ -0,0 +1,88 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_profiler.hpp"
+#include "monitor_text.hpp"
+
+/*
+ * Call first thing in setup(). The time before it is the boot ROM and the
+ * core starting up.
+ */
+void monitor_profiler::begin() {
+    current.phase_us[PROFILE_BOOT] = hal_micros();
+    last_valid = rtc_load(RTC_PROFILE_OFFSET, last) and last.version == PROFILE_VERSION;
+    current.version = PROFILE_VERSION;
+    current.wake = last_valid ? last.wake + 1 : 0;
+    if (hal_reset_reason() != HAL_RESET_DEEP_SLEEP) {
+        current.flags |= PROFILE_COLD_BOOT;
+    }
+}
+
+/*
+ * The end of a phase. Only the first time counts, as loop() passes the same
+ * points again while the display is on.
+ */
+void monitor_profiler::mark(profile_phase phase) {
+    if (current.phase_us[phase] == 0) {
+        current.phase_us[phase] = hal_micros();
+    }
+}
+
+void monitor_profiler::flag(uint8_t flag) {
+    current.flags |= flag;
+}
+
+void monitor_profiler::sensor(profile_sensor sensor, unsigned long started_us) {
+    current.sensor_us[sensor] += hal_micros() - started_us;
+}
+
+void monitor_profiler::init(profile_init peripheral, unsigned long started_us) {
+    current.init_us[peripheral] += hal_micros() - started_us;
+}
+
+void monitor_profiler::published(unsigned long started_us) {
+    unsigned long now = hal_micros();
+    current.publish_us += now - started_us;
+    if (current.publishes < 255) {
+        current.publishes++;
+    }
+    mark(PROFILE_FIRST_PUBLISH);
+    current.phase_us[PROFILE_LAST_PUBLISH] = now;
+}
+
+/*
+ * Close the record on the way into deep sleep and keep it for the next wake.
+ */
+void monitor_profiler::sleep(uint32_t sleep_s) {
+    mark(PROFILE_SLEEP);
+    current.sleep_s = sleep_s;
+    rtc_save(RTC_PROFILE_OFFSET, current);
+}
+
+/*
+ * Base64 of the record as it is laid out in memory, little-endian.
+ */
+char *monitor_profiler::encode(const record &r, char *buffer, size_t buffer_len) {
+    static_assert(sizeof(record) % 3 == 0, "The record should encode without padding.");
+    monitor_text(buffer, buffer_len).print_base64((const uint8_t *) &r, sizeof(record));
+    return buffer;
+}
@@ -0,0 +1,109 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_PROFILER_HPP
+#define MONITOR_MONITOR_PROFILER_HPP
+
+#include "monitor_hal.hpp"
+#include "monitor_rtc_memory.hpp"
+
+#define PROFILE_VERSION 2
+
+// The end of each phase of a wake, in micros() since reset.
+enum profile_phase {
+    PROFILE_BOOT,           // setup() is entered.
+    PROFILE_SENSORS,        // The sampling window is complete.
+    PROFILE_WIFI,           // WL_CONNECTED.
+    PROFILE_NTP,            // The clock is good.
+    PROFILE_TLS,            // MQTT is connected.
+    PROFILE_FIRST_PUBLISH,
+    PROFILE_LAST_PUBLISH,
+    PROFILE_SLEEP,          // On the way into deep sleep.
+    PROFILE_PHASES
+};
+
+// Time spent reading each sensor, in µs.
+enum profile_sensor {
+    PROFILE_ADC,
+    PROFILE_INA219,
+    PROFILE_DHT,
+    PROFILE_SENSOR_COUNT
+};
+
+// Time spent bringing up each peripheral, in µs. 0 when the wake didn't.
+enum profile_init {
+    PROFILE_INIT_INA219,
+    PROFILE_INIT_DHT,
+    PROFILE_INIT_OLED,
+    PROFILE_INIT_COUNT
+};
+
+// What kind of wake it was.
+#define PROFILE_UPLOAD_WAKE 0x01
+#define PROFILE_COLD_BOOT   0x02
+#define PROFILE_WIFI_FAST   0x04
+#define PROFILE_NTP_SYNCED  0x08
+#define PROFILE_DISPLAY     0x10  // Woke with button A held.
+#define PROFILE_RADIO_OFF   0x20  // Booted with the radio disabled.
+#define PROFILE_RF_CAL      0x40  // Booted with a full RF calibration.
+
+// A record is 72 bytes, or 96 characters of base64.
+#define PROFILE_TEXT_SIZE 97
+
+/*
+ * Records where the time of a wake goes, with little more than a micros() call
+ * per phase. The record is saved to RTC memory on the way into deep sleep, so
+ * the next wake still has it. Each wake prints its own record as one line of
+ * base64. With PROFILE_FEED defined, upload wakes also publish the last wake's
+ * record and their own to the diagnostics feed. tools/profile_report.py turns
+ * them into per-phase latencies and the charge used per wake.
+ */
+struct monitor_profiler {
+    struct record {
+        uint8_t version;
+        uint8_t flags;
+        uint8_t publishes;
+        uint8_t reserved;
+        uint32_t wake;     // Counts wakes since the RTC memory was lost.
+        uint32_t sleep_s;  // The deep sleep that followed.
+        uint32_t phase_us[PROFILE_PHASES];   // 0 for phases that didn't happen.
+        uint32_t sensor_us[PROFILE_SENSOR_COUNT];
+        uint32_t publish_us;
+        uint32_t init_us[PROFILE_INIT_COUNT];
+    };
+    void begin();
+    void mark(profile_phase phase);
+    void flag(uint8_t flag);
+    void sensor(profile_sensor sensor, unsigned long started_us);
+    void init(profile_init peripheral, unsigned long started_us);
+    void published(unsigned long started_us);
+    void sleep(uint32_t sleep_s);
+    static char *encode(const record &r, char *buffer, size_t buffer_len);
+    record current{};
+    record last{};
+    bool last_valid{false};
+};
+
+static_assert(sizeof(rtc_region<monitor_profiler::record>) <= RTC_PROFILE_BLOCKS * 4,
+              "The profile outgrew its RTC memory region.");
+
+#endif //MONITOR_MONITOR_PROFILER_HPP
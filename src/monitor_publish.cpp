@@ -0,0 +1,184 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_publish.hpp"
+#include "monitor_batch.hpp"
+#include "monitor_profiler.hpp"
+#include "monitor_session.hpp"
+#include "monitor_text.hpp"
+#include "ntp_time_utils.hpp"
+#include "monitor_log.hpp"
+
+extern ntp_time_utils time_util;
+extern monitor_profiler profiler;
+extern monitor_session session;
+
+// Every group message holds at least one feed.
+static_assert(AIO_GROUP_PACKET_MIN_SIZE(sizeof(GROUP) - 1) <= MAXBUFFERSIZE,
+              "MAXBUFFERSIZE can't hold a group message with one feed; raise it or shorten the group key.");
+
+/*
+ * Publish a value held in hundredths to a feed. Text that doesn't fit isn't
+ * published rather than published cut short.
+ */
+bool publish_centi(const char *topic, int32_t centi) {
+    char payload[CENTI_TEXT_SIZE];
+    monitor_text text(payload, sizeof(payload));
+    text.print_fixed(centi, 2, AIO_FLOAT_PRECISION);
+    if (not text.fits()) {
+        LOG_ERROR("ERROR: %s doesn't fit its payload.", topic);
+        return false;
+    }
+    return publish(topic, payload);
+}
+
+/*
+ * Publish each reading to its own feed; one MQTT message per feed.
+ */
+std::bitset<5> publish_feeds(const monitor_data &reading, time_t created_at) {
+    char payload[CENTI_TEXT_SIZE];
+    std::bitset<5> publish_status{0};
+
+    // Publish Battery VDC Percent
+    monitor_text(payload, sizeof(payload)).print_int(reading.battery_vdc);
+    publish_status[0] = publish(BATTERY_VDC, payload);
+
+    // Publish Current mA
+    if (reading.flags & MONITOR_DATA_CURRENT_VALID) {
+        publish_status[1] = publish_centi(CURRENT_MA, reading.current_cma);
+    }
+
+    // Publish Humidity ϕ
+    if (reading.flags & MONITOR_DATA_HUMIDITY_VALID) {
+        publish_status[2] = publish_centi(HUMIDITY_RH, reading.humidity_crh);
+    }
+
+    // Publish Temperature ℉
+    if (reading.flags & MONITOR_DATA_TEMPERATURE_VALID) {
+        publish_status[3] = publish_centi(TEMPERATURE_F, reading.temperature_cf);
+    }
+
+    // Publish Unix Epoch Time UTC
+    char date_time[TIME_STRING_SIZE];
+    time_util.format_time(created_at, date_time, sizeof(date_time));
+    publish_status[4] = publish(UNIX_EPOCH_TIME, date_time);
+    return publish_status;
+}
+
+/*
+ * Publish every reading in one JSON document to a group topic; one MQTT
+ * message, TLS record and TCP segment per wake when the Adafruit_MQTT buffer
+ * holds them all. Otherwise the feeds are spread over as few messages as fit,
+ * each with the reading's created_at. Readings that failed are left out. The
+ * result is all or nothing: a reading that only went in part is published
+ * again, whole.
+ */
+std::bitset<5> publish_group(const monitor_data &reading, time_t created_at, const char *topic) {
+    // Each feed of the reading in the order of its bit, empty when the reading failed.
+    char feeds[4][sizeof(AIO_GROUP_WIDEST_FEED)] = {};
+    monitor_text(feeds[0], sizeof(feeds[0])).print("\"" AIO_FEED_BATTERY_VDC "\":").print_int(reading.battery_vdc);
+    if (reading.flags & MONITOR_DATA_CURRENT_VALID) {
+        monitor_text(feeds[1], sizeof(feeds[1])).print("\"" AIO_FEED_CURRENT_MA "\":")
+                .print_fixed(reading.current_cma, 2, AIO_FLOAT_PRECISION);
+    }
+    if (reading.flags & MONITOR_DATA_HUMIDITY_VALID) {
+        monitor_text(feeds[2], sizeof(feeds[2])).print("\"" AIO_FEED_HUMIDITY_RH "\":")
+                .print_fixed(reading.humidity_crh, 2, AIO_FLOAT_PRECISION);
+    }
+    if (reading.flags & MONITOR_DATA_TEMPERATURE_VALID) {
+        monitor_text(feeds[3], sizeof(feeds[3])).print("\"" AIO_FEED_TEMPERATURE_F "\":")
+                .print_fixed(reading.temperature_cf, 2, AIO_FLOAT_PRECISION);
+    }
+
+    // Fixed header, remaining length, topic length and topic, then the payload.
+    char payload[AIO_GROUP_PAYLOAD_MAX_SIZE];
+    size_t room = min(MAXBUFFERSIZE - (1 + 2 + 2 + strlen(topic)), sizeof(payload) - 1);
+    monitor_text json(payload, sizeof(payload));
+    size_t in_json{0};
+    for (size_t i = 0; i <= 4; i++) {
+        if (i < 4 and feeds[i][0] == '\0') {
+            continue;
+        }
+        // Close and publish the message when the next feed won't fit it, or after the last.
+        if (in_json and (i == 4 or json.len + 1 + strlen(feeds[i]) + 2 > room)) {
+            json.print("}}");
+            LOG_DEBUG("Publishing %u feeds to the group in %u bytes.", in_json, json.len);
+            if (not publish(topic, (const uint8_t *) payload, (uint16_t) json.len)) {
+                return std::bitset<5>{0};
+            }
+            in_json = 0;
+        }
+        if (i == 4) {
+            break;
+        }
+        if (in_json == 0) {
+            // The original time of a queued reading.
+            json = monitor_text(payload, sizeof(payload));
+            json.print("{\"created_at\":\"").print_iso8601(created_at).print("\",\"feeds\":{");
+        } else {
+            json.print(',');
+        }
+        json.print(feeds[i]);
+        in_json++;
+    }
+    return std::bitset<5>{}.set();
+}
+
+/*
+ * Publish a backlog as one batch (monitor_batch.hpp) in the batch feed, in
+ * base64 since feeds hold text. tools/batch_bridge.py spreads it over the
+ * feeds. As many readings go as fit the Adafruit_MQTT buffer, oldest first.
+ * Returns how many, 0 when the publish failed.
+ */
+size_t publish_batch(const monitor_data *readings, size_t count) {
+    // Fixed header, remaining length, topic length and topic, then 4 characters per 3 bytes.
+    size_t room = MAXBUFFERSIZE - (1 + 2 + 2 + strlen(BATCH));
+    uint8_t batch_buffer[BATCH_SIZE_MAX];
+    monitor_batch batch(batch_buffer, min(room / 4 * 3, sizeof(batch_buffer)));
+    batch.begin(count ? readings[0].unix_epoch_time : 0, monitor_batch::interval(readings, count));
+    while (batch.count < count and batch.add(readings[batch.count])) {
+    }
+    if (batch.count == 0) {
+        LOG_ERROR("ERROR: Not even one reading fits a batch.");
+        return 0;
+    }
+    char payload[BATCH_SIZE_MAX / 3 * 4 + 5];
+    monitor_text text(payload, sizeof(payload));
+    text.print_base64(batch.buffer, batch.len);
+    LOG_DEBUG("Publishing %u readings in a batch of %u bytes.", batch.count, batch.len);
+    return publish(BATCH, (const uint8_t *) payload, (uint16_t) text.len) ? batch.count : 0;
+}
+
+/*
+ * Publish one MQTT message, timed by the profiler and the session.
+ */
+bool publish(const char *topic, const uint8_t *payload, uint16_t payload_len) {
+    unsigned long started_us = hal_micros();
+    bool published = hal_mqtt_publish(topic, payload, payload_len);
+    profiler.published(started_us);
+    session.published(started_us, published);
+    return published;
+}
+
+bool publish(const char *topic, const char *payload) {
+    return publish(topic, (const uint8_t *) payload, (uint16_t) strlen(payload));
+}
@@ -0,0 +1,49 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_PUBLISH_HPP
+#define MONITOR_MONITOR_PUBLISH_HPP
+
+#include <bitset>
+#include "monitor_hal.hpp"
+#include "monitor_data.hpp"
+#include "ADAFRUIT_IO_MQTT.hpp"
+
+// The widest feed of a group message and the longest message holding just it,
+// on a topic topic_len long: fixed header, remaining length, topic length,
+// topic and payload.
+#define AIO_GROUP_WIDEST_FEED "\"" AIO_FEED_CURRENT_MA "\":-21474836.48"
+#define AIO_GROUP_PACKET_MIN_SIZE(topic_len) (1 + 2 + 2 + (topic_len) + \
+        sizeof("{\"created_at\":\"2018-01-01T00:00:00Z\",\"feeds\":{" AIO_GROUP_WIDEST_FEED "}}") - 1)
+
+/*
+ * Publishing a reading to Adafruit IO. Each bit of the result is one reading:
+ * battery, current, humidity, temperature and time.
+ */
+std::bitset<5> publish_feeds(const monitor_data &reading, time_t created_at);
+std::bitset<5> publish_group(const monitor_data &reading, time_t created_at, const char *topic = GROUP);
+bool publish_centi(const char *topic, int32_t centi);
+size_t publish_batch(const monitor_data *readings, size_t count);
+bool publish(const char *topic, const uint8_t *payload, uint16_t payload_len);
+bool publish(const char *topic, const char *payload);
+
+#endif //MONITOR_MONITOR_PUBLISH_HPP
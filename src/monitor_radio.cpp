@@ -0,0 +1,65 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_radio.hpp"
+
+/*
+ * Only a timer wake booted the way the last wake asked. Anything else booted
+ * with the radio on, and a power on calibrated it.
+ */
+void monitor_radio::begin(hal_reset reset) {
+    bool loaded = rtc_load(RTC_RADIO_OFFSET, current);
+    if (not loaded or reset == HAL_RESET_POWER_ON) {
+        current = state{};
+    }
+    booted = reset == HAL_RESET_DEEP_SLEEP and loaded ? (hal_rf) current.rf : HAL_RF_CAL;
+    if (booted == HAL_RF_CAL and reset != HAL_RESET_CRASH) {
+        current.cal_age_s = 0;
+    }
+    display = reset == HAL_RESET_DEEP_SLEEP and current.display;
+    current.display = false;
+}
+
+hal_rf monitor_radio::next(uint32_t cal_age_s, bool transmit) {
+    if (not transmit) {
+        return HAL_RF_DISABLED;
+    }
+    return cal_age_s >= RADIO_CAL_INTERVAL_S ? HAL_RF_CAL : HAL_RF_NO_CAL;
+}
+
+/*
+ * The mode for the next wake, saved for it. transmit is whether it will.
+ */
+hal_rf monitor_radio::sleep(bool transmit, uint32_t sleep_s) {
+    current.cal_age_s += (hal_millis() + 500) / 1000 + sleep_s;
+    current.rf = next(current.cal_age_s, transmit);
+    rtc_save(RTC_RADIO_OFFSET, current);
+    return (hal_rf) current.rf;
+}
+
+/*
+ * The mode to hop with, back into display mode when that was the reason.
+ */
+hal_rf monitor_radio::hop(bool display_mode) {
+    current.display = display_mode;
+    return sleep(true, 0);
+}
@@ -0,0 +1,76 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_RADIO_HPP
+#define MONITOR_MONITOR_RADIO_HPP
+
+#include "monitor_hal.hpp"
+#include "monitor_rtc_memory.hpp"
+
+// Calibrate the radio again once it has gone this long without. The ESP8266
+// calibrates at power on; after that the calibration drifts with temperature.
+#ifndef RADIO_CAL_INTERVAL_S
+#define RADIO_CAL_INTERVAL_S 43200
+#endif
+// How long a wake booted with the radio off sleeps before waking with it on.
+#ifndef RADIO_HOP_MS
+#define RADIO_HOP_MS 100
+#endif
+
+/*
+ * Picks how the radio comes up on the next wake, on the way into deep sleep.
+ * Only the wakes that will transmit get the radio. The others boot with it
+ * disabled, sample into RTC memory and go back to sleep. Which wakes transmit
+ * is known a wake ahead: the queue decides at boot from what is in RTC memory,
+ * which doesn't change while we sleep.
+ *
+ *   this wake        next wake transmits   calibration age        next wake
+ *   any              no                    any                    disabled
+ *   any              yes                   < RADIO_CAL_INTERVAL_S no cal
+ *   any              yes                   >= it                  cal
+ *
+ * A wake that finds it must transmit with the radio off, because the display
+ * was asked for, hops: it sleeps for RADIO_HOP_MS and wakes with the radio,
+ * in display mode when that was the reason. The calibration age counts the
+ * time awake and asleep since the last wake that calibrated, or power on.
+ */
+struct monitor_radio {
+    struct state {
+        uint32_t cal_age_s;  // At the end of the last wake.
+        uint8_t rf;          // The hal_rf this wake booted with.
+        uint8_t display;     // A hop for display mode.
+        uint16_t reserved;
+    };
+    void begin(hal_reset reset);
+    bool on() const { return booted != HAL_RF_DISABLED; }
+    hal_rf sleep(bool transmit, uint32_t sleep_s);
+    hal_rf hop(bool display_mode);
+    static hal_rf next(uint32_t cal_age_s, bool transmit);
+    state current{};
+    hal_rf booted{HAL_RF_CAL};
+    bool display{false};  // This wake is the end of a hop for display mode.
+};
+
+static_assert(sizeof(rtc_region<monitor_radio::state>) <= RTC_RADIO_BLOCKS * 4,
+              "The radio state outgrew its RTC memory region.");
+
+#endif //MONITOR_MONITOR_RADIO_HPP
@@ -22,28 +22,17 @@
 
 #include "monitor_read_battery.hpp"
 
-int get_battery_vdc() {
+int read_battery_adc() {
     // Read the battery level from the ESP8266 analog in pin.
     // Analog read level is 10 bit 0-1023 (0V-1V).
-    // our 10MΩ & 2.2MΩ voltage divider takes the max
+    // our 10MΩ & 2.2MΩ voltage divider takes the max
     // lipo value of 4.2V and drops it to 0.757V max.
     // this means our min analog read value should be 566 (3.14V)
     // and the max analog read value should be 757 (4.2V).
-    const size_t readings_len{30};
-    std::array<int, readings_len> readings;
-    std::fill_n(begin(readings), readings_len, 0);
-    for (int i=0; i < (int) readings_len; i++) {
-        readings[i] = lround(analogRead(A0) * 0.97656) + MONITOR_READ_BATTERY_VDC_CALIBRATION;
-        delay(33);
-    }
-    int sum = accumulate(begin(readings), end(readings), 0, std::plus<int>());
-    int level = sum / readings_len;
-    Serial.print("Raw ADC value: ");
-    Serial.println(level);
-    // convert battery level to percent
-    level = map(level, 566, 757, 0, 100);
-    Serial.print("Battery level: ");
-    Serial.print(level);
-    Serial.println("%");
-    return level;
-}
\ No newline at end of file
+    return lround(hal_adc_read() * 0.97656) + MONITOR_READ_BATTERY_VDC_CALIBRATION;
+}
+
+int battery_mv(int adc_level) {
+    // Each count is a mV at the pin, and the divider is (10MΩ + 2.2MΩ) / 2.2MΩ.
+    return adc_level * 122 / 22;
+}
@@ -24,7 +24,8 @@
 #define MONITOR_READ_BATTERY_HPP
 #define MONITOR_READ_BATTERY_VDC_CALIBRATION 25
 
-#include <Arduino.h>
-int get_battery_vdc();
+#include "monitor_hal.hpp"
+int read_battery_adc();
+int battery_mv(int adc_level);
 
 #endif //MONITOR_READ_BATTERY_HPP
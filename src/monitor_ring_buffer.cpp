@@ -0,0 +1,146 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_ring_buffer.hpp"
+
+/*
+ * Recover the queue from RTC memory. Spoiled slots are treated as empty.
+ */
+void monitor_ring_buffer::begin() {
+    state_valid = rtc_load(RTC_RING_HEADER_OFFSET, state);
+    if (not state_valid) {
+        state = header{};
+    }
+    newest_seq = 0;
+    for (size_t i = 0; i < RING_BUFFER_CAPACITY; i++) {
+        if (not rtc_load(RTC_RING_SLOTS_OFFSET + i * RTC_RING_SLOT_BLOCKS, slots[i])
+            or slots[i].seq % RING_BUFFER_CAPACITY != i) {
+            slots[i].seq = 0;
+        }
+        if (slots[i].seq > newest_seq) {
+            newest_seq = slots[i].seq;
+        }
+    }
+}
+
+/*
+ * Bring up the radio every UPLOAD_EVERY_N_WAKES wakes if anything is queued,
+ * when this wake's reading would fill the queue, or when the queue's state was
+ * lost.
+ */
+bool monitor_ring_buffer::upload_due() const {
+    size_t queued = pending();
+    return not state_valid
+           or (queued > 0 and state.wakes_since_upload + 1 >= UPLOAD_EVERY_N_WAKES)
+           or queued + 1 >= RING_BUFFER_CAPACITY;
+}
+
+/*
+ * Append a record, overwriting the oldest one when the queue is full.
+ */
+void monitor_ring_buffer::push(const monitor_data &record) {
+    newest_seq++;
+    size_t i = newest_seq % RING_BUFFER_CAPACITY;
+    slots[i].seq = newest_seq;
+    slots[i].record = record;
+    rtc_save(RTC_RING_SLOTS_OFFSET + i * RTC_RING_SLOT_BLOCKS, slots[i]);
+}
+
+/*
+ * The oldest record not yet acknowledged.
+ */
+bool monitor_ring_buffer::peek(monitor_data &record) const {
+    uint32_t seq;
+    return peek(record, seq);
+}
+
+/*
+ * The same, with its sequence number, which is what a gateway knows it by.
+ */
+bool monitor_ring_buffer::peek(monitor_data &record, uint32_t &seq) const {
+    seq = oldest_pending_seq();
+    if (seq == 0) {
+        return false;
+    }
+    record = slots[seq % RING_BUFFER_CAPACITY].record;
+    return true;
+}
+
+/*
+ * Up to max of the records not yet acknowledged, oldest first, for a batch.
+ * pop() acknowledges them one at a time.
+ */
+size_t monitor_ring_buffer::peek(monitor_data *records, size_t max) const {
+    size_t count{0};
+    uint32_t oldest = oldest_pending_seq();
+    for (uint32_t seq = oldest; oldest != 0 and seq <= newest_seq and count < max; seq++) {
+        const slot &s = slots[seq % RING_BUFFER_CAPACITY];
+        if (s.seq == seq) {
+            records[count++] = s.record;
+        }
+    }
+    return count;
+}
+
+/*
+ * Acknowledge the record returned by peek().
+ */
+void monitor_ring_buffer::pop() {
+    uint32_t seq = oldest_pending_seq();
+    if (seq != 0) {
+        state.acked_seq = seq;
+        save_state();
+    }
+}
+
+size_t monitor_ring_buffer::pending() const {
+    size_t count{0};
+    for (const slot &s : slots) {
+        if (s.seq > state.acked_seq) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ * Called on the way into deep sleep.
+ */
+void monitor_ring_buffer::sleep(bool upload_attempted) {
+    state.wakes_since_upload = upload_attempted ? 0 : state.wakes_since_upload + 1;
+    save_state();
+}
+
+uint32_t monitor_ring_buffer::oldest_pending_seq() const {
+    uint32_t oldest{0};
+    for (const slot &s : slots) {
+        if (s.seq > state.acked_seq and (oldest == 0 or s.seq < oldest)) {
+            oldest = s.seq;
+        }
+    }
+    return oldest;
+}
+
+void monitor_ring_buffer::save_state() {
+    rtc_save(RTC_RING_HEADER_OFFSET, state);
+    state_valid = true;
+}
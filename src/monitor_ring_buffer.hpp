@@ -0,0 +1,82 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_RING_BUFFER_HPP
+#define MONITOR_MONITOR_RING_BUFFER_HPP
+
+#include "monitor_hal.hpp"
+#include "monitor_data.hpp"
+#include "monitor_rtc_memory.hpp"
+
+#ifndef RING_BUFFER_CAPACITY
+#define RING_BUFFER_CAPACITY 8
+#endif
+
+#ifndef UPLOAD_EVERY_N_WAKES
+#define UPLOAD_EVERY_N_WAKES 6
+#endif
+
+/*
+ * Store-and-forward queue of readings kept in RTC memory.
+ *
+ * Every record is written to its own CRC guarded slot together with a sequence
+ * number, and the slot is picked by that sequence number. Losing power in the
+ * middle of a write can only spoil the slot being written, which held the
+ * oldest record. The header only tracks the last sequence number the server
+ * acknowledged; if it is spoiled the surviving records are sent again rather
+ * than lost.
+ */
+struct monitor_ring_buffer {
+    struct slot {
+        uint32_t seq;  // 0 marks an empty slot.
+        monitor_data record;
+    };
+    struct header {
+        uint32_t acked_seq;
+        uint32_t wakes_since_upload;
+    };
+    void begin();
+    bool upload_due() const;
+    void push(const monitor_data &record);
+    bool peek(monitor_data &record) const;
+    bool peek(monitor_data &record, uint32_t &seq) const;
+    size_t peek(monitor_data *records, size_t max) const;
+    void pop();
+    size_t pending() const;
+    void sleep(bool upload_attempted);
+    header state{};
+    bool state_valid{false};
+    slot slots[RING_BUFFER_CAPACITY];
+    uint32_t newest_seq{0};
+private:
+    uint32_t oldest_pending_seq() const;
+    void save_state();
+};
+
+static_assert(sizeof(rtc_region<monitor_ring_buffer::header>) <= RTC_RING_HEADER_BLOCKS * 4,
+              "The ring buffer header outgrew its RTC memory region.");
+static_assert(sizeof(rtc_region<monitor_ring_buffer::slot>) <= RTC_RING_SLOT_BLOCKS * 4,
+              "The ring buffer slot outgrew its RTC memory region.");
+static_assert(RTC_RING_SLOTS_OFFSET + RING_BUFFER_CAPACITY * RTC_RING_SLOT_BLOCKS <= RTC_USER_MEMORY_BLOCKS,
+              "RING_BUFFER_CAPACITY doesn't fit in RTC memory.");
+
+#endif //MONITOR_MONITOR_RING_BUFFER_HPP
@@ -0,0 +1,88 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_RTC_MEMORY_HPP
+#define MONITOR_MONITOR_RTC_MEMORY_HPP
+
+#include "monitor_hal.hpp"
+
+/*
+ * The ESP8266 keeps 512 bytes of RTC user memory powered through deep sleep.
+ * It is addressed in 4-byte blocks. This firmware does not use OTA updates so
+ * all 128 blocks are ours. Each region is guarded by its own CRC32 so that one
+ * can be rewritten without touching the others.
+ */
+#define RTC_USER_MEMORY_BLOCKS 128
+
+// Block offsets and sizes of each region in RTC user memory.
+#define RTC_TLS_SESSION_OFFSET 0
+#define RTC_TLS_SESSION_BLOCKS 24
+#define RTC_RING_HEADER_OFFSET 24
+#define RTC_RING_HEADER_BLOCKS 4
+#define RTC_WIFI_LEASE_OFFSET 28
+#define RTC_WIFI_LEASE_BLOCKS 8
+#define RTC_CLOCK_OFFSET 36
+#define RTC_CLOCK_BLOCKS 6
+#define RTC_ADAPTIVE_SLEEP_OFFSET 42
+#define RTC_ADAPTIVE_SLEEP_BLOCKS 7
+#define RTC_PROFILE_OFFSET 49
+#define RTC_PROFILE_BLOCKS 19
+#define RTC_RADIO_OFFSET 68
+#define RTC_RADIO_BLOCKS 3
+#define RTC_BATTERY_OFFSET 71
+#define RTC_BATTERY_BLOCKS 8
+// The ring buffer slots take the rest of the memory.
+#define RTC_RING_SLOTS_OFFSET 79
+#define RTC_RING_SLOT_BLOCKS 6
+
+uint32_t rtc_crc32(const void *data, size_t length);
+
+template <typename T>
+struct rtc_region {
+    uint32_t crc;
+    T data;
+};
+
+template <typename T>
+bool rtc_load(uint32_t offset, T &data) {
+    static_assert(sizeof(rtc_region<T>) % 4 == 0, "RTC regions must fill whole 4-byte blocks.");
+    rtc_region<T> region;
+    if (not hal_rtc_read(offset, &region, sizeof(region))) {
+        return false;
+    }
+    if (region.crc != rtc_crc32(&region.data, sizeof(region.data))) {
+        return false;  // Cold boot or the region was never written.
+    }
+    data = region.data;
+    return true;
+}
+
+template <typename T>
+bool rtc_save(uint32_t offset, const T &data) {
+    static_assert(sizeof(rtc_region<T>) % 4 == 0, "RTC regions must fill whole 4-byte blocks.");
+    rtc_region<T> region;
+    region.data = data;
+    region.crc = rtc_crc32(&region.data, sizeof(region.data));
+    return hal_rtc_write(offset, &region, sizeof(region));
+}
+
+#endif //MONITOR_MONITOR_RTC_MEMORY_HPP
@@ -0,0 +1,60 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_sampler.hpp"
+
+void monitor_sampler::begin() {
+    complete = false;
+    sensors.begin(hal_millis());
+}
+
+/*
+ * Take whichever readings are due and return true once the window is done.
+ */
+bool monitor_sampler::poll(monitor_data &data) {
+    if (complete) {
+        return true;
+    }
+    sensors.poll(hal_millis(), data);
+    if (sensors.done()) {
+        sensors.finish(data);
+        complete = true;
+        profiler.mark(PROFILE_SENSORS);
+    }
+    return complete;
+}
+
+/*
+ * Block (while feeding the watchdog) until the sampling window is complete.
+ */
+void monitor_sampler::wait(monitor_data &data) {
+    while (not poll(data)) {
+        hal_delay(idle_ms());
+    }
+}
+
+/*
+ * Milliseconds until the next reading falls due.
+ */
+unsigned long monitor_sampler::idle_ms() const {
+    return complete ? SAMPLER_INTERVAL_MS : sensors.wait_ms(hal_millis());
+}
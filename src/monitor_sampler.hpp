@@ -0,0 +1,45 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_SAMPLER_HPP
+#define MONITOR_MONITOR_SAMPLER_HPP
+
+#include "monitor_hal.hpp"
+#include "monitor_data.hpp"
+#include "monitor_profiler.hpp"
+#include "monitor_sensors.hpp"
+
+/*
+ * Interleaves the readings of every sensor in monitor_sensors in one sampling
+ * window. poll() never blocks for longer than a single conversion so the
+ * caller can keep the window running while WiFi associates.
+ */
+struct monitor_sampler {
+    void begin();
+    bool poll(monitor_data &data);
+    void wait(monitor_data &data);
+    unsigned long idle_ms() const;
+    bool complete{false};
+    monitor_sensors sensors;
+};
+
+#endif //MONITOR_MONITOR_SAMPLER_HPP
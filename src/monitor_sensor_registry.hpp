@@ -0,0 +1,103 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_SENSOR_REGISTRY_HPP
+#define MONITOR_MONITOR_SENSOR_REGISTRY_HPP
+
+#include <limits.h>
+#include "monitor_hal.hpp"
+#include "monitor_data.hpp"
+#include "monitor_profiler.hpp"
+
+extern monitor_profiler profiler;
+
+/*
+ * A sensor driver is any type with these members. None of them may block for
+ * longer than one conversion, since the sampler runs while WiFi associates.
+ *
+ *   static const profile_sensor profile;   Where its read time is profiled.
+ *   void begin(unsigned long now_ms);      A sampling window starts.
+ *   bool start_conversion(unsigned long now_ms);
+ *                                          Starts a conversion if one is due.
+ *                                          True while one is under way.
+ *   bool poll_ready(unsigned long now_ms); The conversion has a result.
+ *   void read(monitor_data &data);         Takes the result.
+ *   bool done() const;                     The window needs no more readings.
+ *   unsigned long wait_ms(unsigned long now_ms) const;
+ *                                          Until the next call could do
+ *                                          something, 0 for now.
+ *   void finish(monitor_data &data);       The window is over.
+ *
+ * sensor_registry composes the drivers at compile time, each one a member of
+ * the registry. Every call walks the list through templates, so each driver
+ * call is a direct call the compiler can inline. There are no virtual calls.
+ */
+template <typename... Sensors>
+struct sensor_registry;
+
+template <>
+struct sensor_registry<> {
+    static constexpr size_t count = 0;
+    void begin(unsigned long now_ms) {}
+    void poll(unsigned long now_ms, monitor_data &data) {}
+    bool done() const { return true; }
+    unsigned long wait_ms(unsigned long now_ms) const { return ULONG_MAX; }
+    void finish(monitor_data &data) {}
+};
+
+template <typename Sensor, typename... Rest>
+struct sensor_registry<Sensor, Rest...> {
+    static constexpr size_t count = 1 + sizeof...(Rest);
+
+    void begin(unsigned long now_ms) {
+        sensor.begin(now_ms);
+        rest.begin(now_ms);
+    }
+
+    void poll(unsigned long now_ms, monitor_data &data) {
+        if (not sensor.done() and sensor.start_conversion(now_ms) and sensor.poll_ready(now_ms)) {
+            unsigned long started_us = hal_micros();
+            sensor.read(data);
+            profiler.sensor(Sensor::profile, started_us);
+        }
+        rest.poll(now_ms, data);
+    }
+
+    bool done() const {
+        return sensor.done() and rest.done();
+    }
+
+    unsigned long wait_ms(unsigned long now_ms) const {
+        unsigned long wait = sensor.done() ? ULONG_MAX : sensor.wait_ms(now_ms);
+        return min(wait, rest.wait_ms(now_ms));
+    }
+
+    void finish(monitor_data &data) {
+        sensor.finish(data);
+        rest.finish(data);
+    }
+
+    Sensor sensor;
+    sensor_registry<Rest...> rest;
+};
+
+#endif //MONITOR_MONITOR_SENSOR_REGISTRY_HPP
@@ -0,0 +1,133 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_sensors.hpp"
+#include "monitor_battery.hpp"
+#include "monitor_log.hpp"
+
+void averaged_sensor::begin(unsigned long now_ms) {
+    mean = converging_mean<float>{mean.tolerance, mean.filter.quantum, SAMPLER_READINGS_MIN, SAMPLER_READINGS_LEN};
+    next_ms = now_ms;
+}
+
+bool averaged_sensor::start_conversion(unsigned long now_ms) {
+    if ((long) (now_ms - next_ms) < 0) {
+        return false;
+    }
+    next_ms = now_ms + SAMPLER_INTERVAL_MS;
+    return true;
+}
+
+unsigned long averaged_sensor::wait_ms(unsigned long now_ms) const {
+    long remaining = (long) (next_ms - now_ms);
+    return remaining > 0 ? (unsigned long) remaining : 0;
+}
+
+void battery_sensor::finish(monitor_data &data) {
+    int level = lround(mean.mean());
+    LOG_INFO("Raw ADC value: %d from %u samples.", level, mean.samples);
+    battery.measure(battery_mv(level));
+    data.battery_vdc = battery.percent();
+    LOG_INFO("Battery level: %d%% at %d mV open circuit.", data.battery_vdc, battery.current.ocv_mv);
+}
+
+bool current_sensor::start_conversion(unsigned long now_ms) {
+    if (converting) {
+        return true;
+    }
+    if (not averaged_sensor::start_conversion(now_ms)) {
+        return false;
+    }
+    if (not begun) {
+        unsigned long started_us = hal_micros();
+        hal_ina219_begin();
+        profiler.init(PROFILE_INIT_INA219, started_us);
+        begun = true;
+    }
+    hal_ina219_power(true);
+    converting = true;
+    converting_us = hal_micros();
+    return true;
+}
+
+void current_sensor::read(monitor_data &data) {
+    mean.add(read_current_ma());
+    hal_ina219_power(false);
+    converting = false;
+}
+
+void current_sensor::finish(monitor_data &data) {
+    double current_ma = mean.mean();
+    if (isnan(current_ma) or current_ma < 0) {
+        data.flags &= ~MONITOR_DATA_CURRENT_VALID;
+        LOG_ERROR("Error reading current sensor!");
+    } else {
+        data.current_cma = lround(current_ma * 100.0);
+        data.flags |= MONITOR_DATA_CURRENT_VALID;
+        LOG_INFO("Current : %.2fmA from %u samples.", data.current_cma / 100.0f, mean.samples);
+    }
+}
+
+bool temp_rh_sensor::start_conversion(unsigned long now_ms) {
+    if (now_ms < SAMPLER_DHT_WARMUP_MS) {
+        return false;
+    }
+    if (read_ms != 0 and now_ms - read_ms < SAMPLER_DHT_INTERVAL_MS) {
+        complete = true;  // Too soon for the DHT22; keep the last reading.
+        return false;
+    }
+    read_ms = now_ms;
+    if (not begun) {
+        unsigned long started_us = hal_micros();
+        hal_dht_begin();
+        profiler.init(PROFILE_INIT_DHT, started_us);
+        begun = true;
+    }
+    return true;
+}
+
+unsigned long temp_rh_sensor::wait_ms(unsigned long now_ms) const {
+    return now_ms < SAMPLER_DHT_WARMUP_MS ? SAMPLER_DHT_WARMUP_MS - now_ms : 0;
+}
+
+void temp_rh_sensor::read(monitor_data &data) {
+    float temperature_c = hal_temperature_c();
+    if (isnan(temperature_c)) {
+        data.flags &= ~MONITOR_DATA_TEMPERATURE_VALID;
+        LOG_ERROR("Error reading temperature!");
+    } else {
+        data.temperature_cf = lround(temperature_c * 180.0f + 3200.0f);
+        data.flags |= MONITOR_DATA_TEMPERATURE_VALID;
+        LOG_INFO("Temperature: %.2f ℉", data.temperature_cf / 100.0f);
+    }
+
+    float humidity = hal_relative_humidity();
+    if (isnan(humidity)) {
+        data.flags &= ~MONITOR_DATA_HUMIDITY_VALID;
+        LOG_ERROR("Error reading humidity!");
+    } else {
+        data.humidity_crh = lround(humidity * 100.0f);
+        data.flags |= MONITOR_DATA_HUMIDITY_VALID;
+        LOG_INFO("Relative Humidity: %.2f ϕ", data.humidity_crh / 100.0f);
+    }
+    complete = true;
+}
@@ -0,0 +1,123 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_SENSORS_HPP
+#define MONITOR_MONITOR_SENSORS_HPP
+
+#include "monitor_sensor_registry.hpp"
+#include "monitor_current_sensor.hpp"
+#include "monitor_read_battery.hpp"
+#include "monitor_filters.hpp"
+
+// Each reading is sampled until the 95% confidence interval of its mean is
+// within the tolerance, but at least MIN and at most LEN times.
+#define SAMPLER_READINGS_MIN 8
+#define SAMPLER_READINGS_LEN 30
+#ifndef SAMPLER_BATTERY_TOLERANCE
+#define SAMPLER_BATTERY_TOLERANCE 1.0f  // ADC counts, about 5.5 mV.
+#endif
+#ifndef SAMPLER_CURRENT_TOLERANCE_MA
+#define SAMPLER_CURRENT_TOLERANCE_MA 0.25f
+#endif
+// The resolution of each: an ADC count, and the INA219's current LSB at the
+// Adafruit library's default 32 V, 2 A calibration.
+#define SAMPLER_BATTERY_QUANTUM 1.0f
+#define SAMPLER_CURRENT_QUANTUM_MA 0.1f
+#define SAMPLER_INTERVAL_MS 33
+// The INA219 wakes from power down in 40 µs and converts in 532 µs at 12 bits.
+#define SAMPLER_INA219_CONVERSION_US 600
+// The DHT22 wants a moment after power-up before its first conversion, and
+// as long between conversions. Windows closer together keep its last reading.
+#define SAMPLER_DHT_WARMUP_MS 2000
+#define SAMPLER_DHT_INTERVAL_MS 2000
+
+/*
+ * A reading taken every SAMPLER_INTERVAL_MS until its converging_mean is
+ * done. The conversion happens as it is read.
+ */
+struct averaged_sensor {
+    averaged_sensor(float tolerance, float quantum)
+            : mean{tolerance, quantum, SAMPLER_READINGS_MIN, SAMPLER_READINGS_LEN} {}
+    void begin(unsigned long now_ms);
+    bool start_conversion(unsigned long now_ms);
+    bool poll_ready(unsigned long now_ms) { return true; }
+    bool done() const { return mean.done(); }
+    unsigned long wait_ms(unsigned long now_ms) const;
+    converging_mean<float> mean;
+    unsigned long next_ms{0};
+};
+
+// The battery level, from the ADC pin.
+struct battery_sensor : averaged_sensor {
+    static const profile_sensor profile = PROFILE_ADC;
+    battery_sensor() : averaged_sensor(SAMPLER_BATTERY_TOLERANCE, SAMPLER_BATTERY_QUANTUM) {}
+    void read(monitor_data &data) { mean.add(read_battery_adc()); }
+    void finish(monitor_data &data);
+};
+
+/*
+ * The current drawn, from the INA219. It is begun at its first conversion and
+ * kept powered down between conversions. Each one powers it up and waits
+ * SAMPLER_INA219_CONVERSION_US for the result.
+ */
+struct current_sensor : averaged_sensor {
+    static const profile_sensor profile = PROFILE_INA219;
+    current_sensor() : averaged_sensor(SAMPLER_CURRENT_TOLERANCE_MA, SAMPLER_CURRENT_QUANTUM_MA) {}
+    bool start_conversion(unsigned long now_ms);
+    bool poll_ready(unsigned long now_ms) { return hal_micros() - converting_us >= SAMPLER_INA219_CONVERSION_US; }
+    void read(monitor_data &data);
+    unsigned long wait_ms(unsigned long now_ms) const { return converting ? 1 : averaged_sensor::wait_ms(now_ms); }
+    void finish(monitor_data &data);
+    bool begun{false};
+    bool converting{false};
+    unsigned long converting_us{0};
+};
+
+/*
+ * The DHT22's temperature and humidity, read once per window after it has
+ * warmed up. A window within SAMPLER_DHT_INTERVAL_MS of the last reading
+ * keeps it. The reading goes into the data straight away. It is begun at its
+ * first conversion.
+ */
+struct temp_rh_sensor {
+    static const profile_sensor profile = PROFILE_DHT;
+    void begin(unsigned long now_ms) { complete = false; }
+    bool start_conversion(unsigned long now_ms);
+    bool poll_ready(unsigned long now_ms) { return true; }
+    void read(monitor_data &data);
+    bool done() const { return complete; }
+    unsigned long wait_ms(unsigned long now_ms) const;
+    void finish(monitor_data &data) {}
+    bool complete{false};
+    bool begun{false};
+    unsigned long read_ms{0};
+};
+
+// The sensors the sampler reads, in the order they are read. Add a driver
+// here, with a profile_sensor of its own, to sample another sensor.
+#ifndef MONITOR_SENSORS
+#define MONITOR_SENSORS battery_sensor, current_sensor, temp_rh_sensor
+#endif
+
+typedef sensor_registry<MONITOR_SENSORS> monitor_sensors;
+
+#endif //MONITOR_MONITOR_SENSORS_HPP
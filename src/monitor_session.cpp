@@ -0,0 +1,142 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_session.hpp"
+#include "ntp_time_utils.hpp"
+#include "monitor_log.hpp"
+
+extern ntp_time_utils time_util;
+
+/*
+ * Returns true while the session is up. Otherwise it tries to reconnect once
+ * the backoff has passed.
+ */
+bool monitor_session::poll() {
+    unsigned long now = hal_millis();
+    if (stats_ms == 0 or now - stats_ms >= SESSION_STATS_S * 1000UL) {
+        report();
+    }
+    if (connected and not hal_mqtt_connected()) {
+        LOG_ERROR("ERROR: The MQTT session dropped.");
+        connected = false;
+    }
+    if (not connected) {
+        if ((long) (now - retry_ms) < 0) {
+            return false;
+        }
+        if (not connect()) {
+            backoff_ms = backoff_ms ? min((uint32_t) SESSION_BACKOFF_MAX_MS, backoff_ms * 2)
+                                    : SESSION_BACKOFF_MIN_MS;
+            // Up to half again, so a power cut doesn't bring every unit back at once.
+            retry_ms = hal_millis() + backoff_ms + hal_micros() % (backoff_ms / 2 + 1);
+            LOG_WARN("Retrying in %lu ms.", retry_ms - hal_millis());
+            return false;
+        }
+        backoff_ms = 0;
+    }
+    if (now - last_sent_ms >= SESSION_PING_S * 1000UL) {
+        last_sent_ms = now;
+        if (not hal_mqtt_ping()) {
+            LOG_ERROR("ERROR: The broker didn't answer a ping.");
+            connected = false;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Count a publish and how long it took to write.
+ */
+void monitor_session::published(unsigned long started_us, bool ok) {
+    uint32_t elapsed_us = hal_micros() - started_us;
+    if (not ok) {
+        failures++;
+        return;
+    }
+    publishes++;
+    last_sent_ms = hal_millis();
+    uint8_t bucket{0};
+    while (bucket < SESSION_WRITE_BUCKETS - 1 and elapsed_us >> (bucket + 1)) {
+        bucket++;
+    }
+    write_time[bucket]++;
+    write_max_us = max(write_max_us, elapsed_us);
+}
+
+/*
+ * Print the statistics since the last report, then start them again.
+ */
+void monitor_session::report() {
+    uint32_t heap = hal_free_heap();
+    heap_min = heap_min ? min(heap_min, heap) : heap;
+    if (stats_ms != 0) {
+        unsigned long elapsed_ms = hal_millis() - stats_ms;
+        LOG_INFO("Session: %lu publishes in %lu ms, %lu failed, write p99 %lu us, max %lu us, heap %lu free, %lu least, "
+                 "%lu reconnects since boot.", publishes, elapsed_ms, failures, write_percentile_us(99),
+                 write_max_us, heap, heap_min, reconnects);
+    }
+    publishes = 0;
+    failures = 0;
+    memset(write_time, 0, sizeof(write_time));
+    write_max_us = 0;
+    stats_ms = hal_millis();
+}
+
+/*
+ * The bound of the histogram bucket the percentile falls in, so at most twice
+ * the true value.
+ */
+uint32_t monitor_session::write_percentile_us(uint32_t percent) const {
+    uint32_t wanted = (publishes * percent + 99) / 100;
+    uint32_t seen{0};
+    for (uint8_t bucket = 0; bucket < SESSION_WRITE_BUCKETS; bucket++) {
+        seen += write_time[bucket];
+        if (seen >= wanted and seen) {
+            return min(write_max_us, (uint32_t) ((2UL << bucket) - 1));
+        }
+    }
+    return 0;
+}
+
+/*
+ * Set the clock, which TLS needs, and connect to the broker.
+ */
+bool monitor_session::connect() {
+    if (not hal_wifi_connected()) {
+        LOG_WARN("WiFi is not connected.");
+        return false;
+    }
+    time_util.set_time_of_day();
+    int8_t status = hal_mqtt_connect();
+    if (status != 0) {
+        LOG_ERROR("ERROR: MQTT connect failed: %s", hal_mqtt_error(status));
+        return false;
+    }
+    if (ever_connected) {
+        reconnects++;
+    }
+    ever_connected = true;
+    connected = true;
+    last_sent_ms = hal_millis();
+    return true;
+}
@@ -0,0 +1,75 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_SESSION_HPP
+#define MONITOR_MONITOR_SESSION_HPP
+
+#include "monitor_hal.hpp"
+
+// Reconnect attempts back off from MIN to MAX, doubling after each failure.
+#ifndef SESSION_BACKOFF_MIN_MS
+#define SESSION_BACKOFF_MIN_MS 1000
+#endif
+#ifndef SESSION_BACKOFF_MAX_MS
+#define SESSION_BACKOFF_MAX_MS 300000
+#endif
+// Ping the broker when nothing was sent for this long. Adafruit_MQTT asks for
+// a keepalive of 300 s.
+#ifndef SESSION_PING_S
+#define SESSION_PING_S 60
+#endif
+// Print the publishing statistics this often.
+#ifndef SESSION_STATS_S
+#define SESSION_STATS_S 60
+#endif
+#define SESSION_WRITE_BUCKETS 24  // Powers of two of µs, up to 8 s.
+
+/*
+ * One MQTT session kept open for as long as there is power, for the gateway
+ * and mains powered monitors. poll() reconnects with exponential backoff and
+ * keeps the session alive with pings. It also keeps publishing statistics in
+ * constant memory: the rate, a histogram of the time each publish took to
+ * write and the free heap. A QoS 0 publish isn't acknowledged, so that is the
+ * time to hand it to the socket, not to reach the broker.
+ */
+struct monitor_session {
+    bool poll();
+    void published(unsigned long started_us, bool ok);
+    void report();
+    bool connected{false};
+    bool ever_connected{false};
+    uint32_t backoff_ms{0};
+    unsigned long retry_ms{0};
+    unsigned long last_sent_ms{0};
+    unsigned long stats_ms{0};
+    uint32_t reconnects{0};
+    uint32_t publishes{0};
+    uint32_t failures{0};
+    uint32_t write_time[SESSION_WRITE_BUCKETS]{};
+    uint32_t write_max_us{0};
+    uint32_t heap_min{0};
+private:
+    bool connect();
+    uint32_t write_percentile_us(uint32_t percent) const;
+};
+
+#endif //MONITOR_MONITOR_SESSION_HPP
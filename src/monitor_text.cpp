@@ -0,0 +1,165 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_text.hpp"
+#include "monitor_timezone.hpp"
+
+constexpr uint32_t powers_of_ten[10] {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// "00" to "99", so each division by 100 makes two digits.
+constexpr char digit_pairs[201] {
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899"
+};
+
+constexpr char base64_digits[] {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"};
+
+constexpr char weekday_names[] {"SunMonTueWedThuFriSat"};
+constexpr char month_names[] {"JanFebMarAprMayJunJulAugSepOctNovDec"};
+
+monitor_text::monitor_text(char *buffer, size_t buffer_len) : buffer(buffer), size(buffer_len) {
+    if (size == 0) {
+        overflow = true;
+    } else {
+        buffer[0] = '\0';
+    }
+}
+
+monitor_text &monitor_text::print(char c) {
+    if (overflow or len + 1 >= size) {
+        overflow = true;
+        return *this;
+    }
+    buffer[len++] = c;
+    buffer[len] = '\0';
+    return *this;
+}
+
+monitor_text &monitor_text::print(const char *text) {
+    while (*text != '\0' and not overflow) {
+        print(*text++);
+    }
+    return *this;
+}
+
+monitor_text &monitor_text::print_uint(uint32_t value, uint8_t width) {
+    char digits[10];
+    uint8_t count = 0;
+    while (value >= 100) {
+        uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        digits[count++] = digit_pairs[pair + 1];
+        digits[count++] = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        digits[count++] = digit_pairs[value * 2 + 1];
+        digits[count++] = digit_pairs[value * 2];
+    } else {
+        digits[count++] = (char) ('0' + value);
+    }
+    for (; width > count; width--) {
+        print('0');
+    }
+    while (count > 0) {
+        print(digits[--count]);
+    }
+    return *this;
+}
+
+monitor_text &monitor_text::print_int(int32_t value) {
+    if (value < 0) {
+        print('-');
+    }
+    return print_uint(value < 0 ? 0 - (uint32_t) value : (uint32_t) value);
+}
+
+/*
+ * A value held in units of 10^-value_places as decimal text with places
+ * decimals, rounding half away from zero as dtostrf() does.
+ */
+monitor_text &monitor_text::print_fixed(int32_t value, uint8_t value_places, uint8_t places) {
+    uint8_t kept = places < value_places ? places : value_places;
+    uint32_t dropped = powers_of_ten[value_places - kept];
+    uint32_t magnitude = value < 0 ? 0 - (uint32_t) value : (uint32_t) value;
+    magnitude = (magnitude + dropped / 2) / dropped;
+    if (value < 0 and magnitude != 0) {
+        print('-');
+    }
+    print_uint(magnitude / powers_of_ten[kept]);
+    if (places > 0) {
+        print('.');
+        print_uint(magnitude % powers_of_ten[kept], kept);
+        for (uint8_t i = kept; i < places; i++) {
+            print('0');
+        }
+    }
+    return *this;
+}
+
+/*
+ * 2011-12-28T16:44:28Z
+ */
+monitor_text &monitor_text::print_iso8601(time_t utc) {
+    civil_time t = civil_from_epoch(utc);
+    print_uint((uint32_t) t.year, 4).print('-').print_uint(t.month, 2).print('-').print_uint(t.day, 2);
+    print('T').print_uint(t.hour, 2).print(':').print_uint(t.minute, 2).print(':').print_uint(t.second, 2);
+    return print('Z');
+}
+
+/*
+ * Wed Dec 28 11:44:28 2011 EST, as strftime()'s "%c" and the zone.
+ */
+monitor_text &monitor_text::print_time(time_t local, const char *zone_name) {
+    civil_time t = civil_from_epoch(local);
+    for (uint8_t i = 0; i < 3; i++) {
+        print(weekday_names[t.weekday * 3 + i]);
+    }
+    print(' ');
+    for (uint8_t i = 0; i < 3; i++) {
+        print(month_names[(t.month - 1) * 3 + i]);
+    }
+    print(t.day < 10 ? "  " : " ").print_uint(t.day);
+    print(' ').print_uint(t.hour, 2).print(':').print_uint(t.minute, 2).print(':').print_uint(t.second, 2);
+    return print(' ').print_uint((uint32_t) t.year).print(' ').print(zone_name);
+}
+
+/*
+ * RFC 4648 base64, padded with '='.
+ */
+monitor_text &monitor_text::print_base64(const uint8_t *data, size_t data_len) {
+    for (size_t i = 0; i < data_len and not overflow; i += 3) {
+        uint32_t triple = (uint32_t) data[i] << 16;
+        if (i + 1 < data_len) {
+            triple |= (uint32_t) data[i + 1] << 8;
+        }
+        if (i + 2 < data_len) {
+            triple |= data[i + 2];
+        }
+        print(base64_digits[(triple >> 18) & 0x3F]).print(base64_digits[(triple >> 12) & 0x3F]);
+        print(i + 1 < data_len ? base64_digits[(triple >> 6) & 0x3F] : '=');
+        print(i + 2 < data_len ? base64_digits[triple & 0x3F] : '=');
+    }
+    return *this;
+}
@@ -0,0 +1,53 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_TEXT_HPP
+#define MONITOR_MONITOR_TEXT_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Writes text into a fixed buffer, e.g. an MQTT payload, without printf,
+ * floats or a heap. Numbers are fixed-point integers converted two digits at a
+ * time. Whatever doesn't fit is dropped and fits() turns false; the buffer
+ * always holds a terminated string.
+ */
+struct monitor_text {
+    monitor_text(char *buffer, size_t buffer_len);
+    monitor_text &print(const char *text);
+    monitor_text &print(char c);
+    monitor_text &print_uint(uint32_t value, uint8_t width = 0);  // Zero padded to width.
+    monitor_text &print_int(int32_t value);
+    monitor_text &print_fixed(int32_t value, uint8_t value_places, uint8_t places);
+    monitor_text &print_iso8601(time_t utc);
+    monitor_text &print_time(time_t local, const char *zone_name);
+    monitor_text &print_base64(const uint8_t *data, size_t data_len);
+    bool fits() const { return not overflow; }
+    char *buffer;
+    size_t size;
+    size_t len{0};
+    bool overflow{false};
+};
+
+#endif //MONITOR_MONITOR_TEXT_HPP
@@ -0,0 +1,257 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include <ctype.h>
+#include "monitor_timezone.hpp"
+
+// Days before each month, in common and leap years.
+constexpr int16_t days_before_month[2][13] {
+        {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365},
+        {0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366}
+};
+
+static constexpr int64_t floor_div(int64_t a, int64_t b) {
+    return a / b - (a % b < 0 ? 1 : 0);
+}
+
+static constexpr bool leap_year(int64_t year) {
+    return year % 4 == 0 and (year % 100 != 0 or year % 400 == 0);
+}
+
+/*
+ * Days from 1970-01-01 to January 1st of year. 477 leap days came before 1970.
+ */
+static constexpr int64_t days_to_year(int64_t year) {
+    return 365 * (year - 1970) + floor_div(year - 1, 4) - floor_div(year - 1, 100)
+           + floor_div(year - 1, 400) - 477;
+}
+
+static_assert(days_to_year(2000) == 10957, "January 1st 2000 is day 10957.");
+
+static int64_t year_of(int64_t days) {
+    int64_t year = 1970 + floor_div(days, 365);
+    while (days_to_year(year) > days) {
+        year--;
+    }
+    while (days_to_year(year + 1) <= days) {
+        year++;
+    }
+    return year;
+}
+
+/*
+ * Howard Hinnant's days_from_civil() run backwards, counting from March so
+ * that February's leap day comes last in the year.
+ */
+civil_time civil_from_epoch(int64_t seconds) {
+    civil_time t;
+    int64_t days = floor_div(seconds, 86400);
+    int32_t of_day = (int32_t) (seconds - days * 86400);
+    t.hour = (uint8_t) (of_day / 3600);
+    t.minute = (uint8_t) (of_day / 60 % 60);
+    t.second = (uint8_t) (of_day % 60);
+    t.weekday = (uint8_t) (((days + 4) % 7 + 7) % 7);  // 1970-01-01 was a Thursday.
+    int64_t shifted = days + 719468;  // Days since 0000-03-01.
+    int64_t era = floor_div(shifted, 146097);
+    int32_t day_of_era = (int32_t) (shifted - era * 146097);
+    int32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    int32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int32_t month_from_march = (5 * day_of_year + 2) / 153;
+    t.day = (uint8_t) (day_of_year - (153 * month_from_march + 2) / 5 + 1);
+    t.month = (uint8_t) (month_from_march < 10 ? month_from_march + 3 : month_from_march - 9);
+    t.year = (int32_t) (year_of_era + era * 400 + (t.month <= 2 ? 1 : 0));
+    return t;
+}
+
+static bool parse_number(const char *&p, long min, long max, long &value) {
+    if (not isdigit((unsigned char) *p)) {
+        return false;
+    }
+    for (value = 0; isdigit((unsigned char) *p); p++) {
+        value = value * 10 + (*p - '0');
+        if (value > max) {
+            return false;
+        }
+    }
+    return value >= min;
+}
+
+/*
+ * An abbreviation of at least three letters, or anything alphanumeric, '+'
+ * or '-' between '<' and '>'.
+ */
+static bool parse_name(const char *&p, char *name) {
+    size_t len = 0;
+    bool quoted = *p == '<';
+    for (p += quoted ? 1 : 0;
+         quoted ? isalnum((unsigned char) *p) or *p == '+' or *p == '-' : isalpha((unsigned char) *p);
+         p++) {
+        if (len == TIMEZONE_NAME_MAX) {
+            return false;
+        }
+        name[len++] = *p;
+    }
+    if (quoted and *p++ != '>') {
+        return false;
+    }
+    name[len] = '\0';
+    return len >= 3;
+}
+
+/*
+ * [+-]hh[:mm[:ss]] in seconds.
+ */
+static bool parse_time(const char *&p, int32_t &seconds, long max_hours) {
+    bool negative = *p == '-';
+    if (*p == '+' or *p == '-') {
+        p++;
+    }
+    long hours, minutes = 0, secs = 0;
+    if (not parse_number(p, 0, max_hours, hours)) {
+        return false;
+    }
+    if (*p == ':' and not parse_number(++p, 0, 59, minutes)) {
+        return false;
+    }
+    if (*p == ':' and not parse_number(++p, 0, 59, secs)) {
+        return false;
+    }
+    seconds = (int32_t) (hours * 3600 + minutes * 60 + secs) * (negative ? -1 : 1);
+    return true;
+}
+
+/*
+ * A date and an optional "/time", which defaults to 02:00:00.
+ */
+static bool parse_date(const char *&p, timezone_transition &rule) {
+    long value, week, weekday;
+    if (*p == 'J') {
+        rule.kind = TIMEZONE_JULIAN;
+        if (not parse_number(++p, 1, 365, value)) {
+            return false;
+        }
+        rule.day = (uint16_t) value;
+    } else if (*p == 'M') {
+        rule.kind = TIMEZONE_MONTH;
+        if (not parse_number(++p, 1, 12, value) or *p != '.'
+            or not parse_number(++p, 1, 5, week) or *p != '.'
+            or not parse_number(++p, 0, 6, weekday)) {
+            return false;
+        }
+        rule.month = (uint8_t) value;
+        rule.week = (uint8_t) week;
+        rule.weekday = (uint8_t) weekday;
+    } else {
+        rule.kind = TIMEZONE_DAY;
+        if (not parse_number(p, 0, 365, value)) {
+            return false;
+        }
+        rule.day = (uint16_t) value;
+    }
+    rule.time_s = 7200;
+    return *p != '/' or parse_time(++p, rule.time_s, 167);
+}
+
+/*
+ * Take the zone from a POSIX TZ rule: std offset [dst [offset] [,start,end]].
+ * Without start and end dates the US rules apply, as with glibc. On a bad
+ * rule the zone is left as it was and false is returned.
+ */
+bool monitor_timezone::parse(const char *rule) {
+    monitor_timezone zone;
+    const char *p = rule;
+    int32_t west_s;
+    if (not parse_name(p, zone.std_name) or not parse_time(p, west_s, 24)) {
+        return false;
+    }
+    zone.std_offset_s = -west_s;
+    zone.dst_offset_s = zone.std_offset_s;
+    if (*p != '\0') {
+        if (not parse_name(p, zone.dst_name)) {
+            return false;
+        }
+        zone.dst_offset_s = zone.std_offset_s + 3600;
+        if (*p != '\0' and *p != ',') {
+            if (not parse_time(p, west_s, 24)) {
+                return false;
+            }
+            zone.dst_offset_s = -west_s;
+        }
+        if (*p == '\0') {
+            p = ",M3.2.0,M11.1.0";
+        }
+        if (*p != ',' or not parse_date(++p, zone.start)
+            or *p != ',' or not parse_date(++p, zone.end) or *p != '\0') {
+            return false;
+        }
+        zone.has_dst = true;
+    }
+    *this = zone;
+    return true;
+}
+
+/*
+ * When a transition of the given year happens, in UTC. offset_s is the
+ * offset in force just before it.
+ */
+int64_t monitor_timezone::transition_utc(const timezone_transition &rule, int64_t year,
+                                         int32_t offset_s) const {
+    int64_t day = days_to_year(year);
+    int leap = leap_year(year) ? 1 : 0;
+    switch (rule.kind) {
+        case TIMEZONE_JULIAN:
+            day += rule.day - 1 + (leap and rule.day >= 60 ? 1 : 0);
+            break;
+        case TIMEZONE_DAY:
+            day += rule.day;
+            break;
+        case TIMEZONE_MONTH: {
+            int64_t first = day + days_before_month[leap][rule.month - 1];
+            int64_t first_weekday = ((first + 4) % 7 + 7) % 7;  // 1970-01-01 was a Thursday.
+            day = first + (rule.weekday - first_weekday + 7) % 7 + (rule.week - 1) * 7;
+            if (day >= days_to_year(year) + days_before_month[leap][rule.month]) {
+                day -= 7;  // Week 5 is the last, which may be the fourth.
+            }
+            break;
+        }
+    }
+    return day * 86400 + rule.time_s - offset_s;
+}
+
+/*
+ * The offset from UTC in force at utc, and whether it is daylight saving time.
+ * Like glibc, the transitions are those of the year utc falls in, in UTC.
+ */
+int32_t monitor_timezone::offset_s(time_t utc, bool &dst) const {
+    dst = false;
+    if (has_dst) {
+        int64_t year = year_of(floor_div(utc, 86400));
+        int64_t dst_start = transition_utc(start, year, std_offset_s);
+        int64_t dst_end = transition_utc(end, year, dst_offset_s);
+        if (dst_start < dst_end) {
+            dst = utc >= dst_start and utc < dst_end;
+        } else {  // Southern hemisphere; DST spans the new year.
+            dst = utc < dst_end or utc >= dst_start;
+        }
+    }
+    return dst ? dst_offset_s : std_offset_s;
+}
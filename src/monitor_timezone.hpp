@@ -0,0 +1,89 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_TIMEZONE_HPP
+#define MONITOR_MONITOR_TIMEZONE_HPP
+
+#include <stdint.h>
+#include <time.h>
+
+// The longest timezone abbreviation kept, e.g. "AEDT" or "+0530".
+#define TIMEZONE_NAME_MAX 7
+
+/*
+ * A date in a POSIX TZ rule: "Jn" (1 to 365, never counting February 29th),
+ * "n" (0 to 365, counting it) or "Mm.w.d" (weekday d of week w of month m,
+ * where week 5 is the last).
+ */
+enum timezone_date_kind {
+    TIMEZONE_JULIAN,
+    TIMEZONE_DAY,
+    TIMEZONE_MONTH,
+};
+
+struct timezone_transition {
+    timezone_date_kind kind;
+    uint8_t month;
+    uint8_t week;
+    uint8_t weekday;
+    uint16_t day;
+    int32_t time_s;  // Local time of day. May be negative or past 24 hours.
+};
+
+/*
+ * Seconds since 1970 broken down into a date and time of day, like gmtime().
+ */
+struct civil_time {
+    int32_t year;
+    uint8_t month;    // 1 to 12.
+    uint8_t day;      // 1 to 31.
+    uint8_t weekday;  // 0 is Sunday.
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+};
+
+civil_time civil_from_epoch(int64_t seconds);
+
+/*
+ * Local time by a POSIX TZ rule, e.g. "EST5EDT,M3.2.0,M11.1.0" or
+ * "AEST-10AEDT,M10.1.0,M4.1.0/3". The transitions are worked out for the year
+ * asked about, in integer arithmetic, so any zone and any year works without
+ * a table of dates. Offsets are seconds added to UTC, so east of Greenwich is
+ * positive; a POSIX rule writes them the other way round.
+ */
+struct monitor_timezone {
+    bool parse(const char *rule);
+    int32_t offset_s(time_t utc, bool &dst) const;
+    const char *name(bool dst) const { return dst ? dst_name : std_name; }
+    char std_name[TIMEZONE_NAME_MAX + 1]{"UTC"};
+    char dst_name[TIMEZONE_NAME_MAX + 1]{""};
+    int32_t std_offset_s{0};
+    int32_t dst_offset_s{0};
+    bool has_dst{false};
+    timezone_transition start{};
+    timezone_transition end{};
+private:
+    int64_t transition_utc(const timezone_transition &rule, int64_t year, int32_t offset_s) const;
+};
+
+#endif //MONITOR_MONITOR_TIMEZONE_HPP
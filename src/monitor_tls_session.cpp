@@ -0,0 +1,87 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifdef ARDUINO
+
+#include "monitor_tls_session.hpp"
+#include "monitor_log.hpp"
+
+/*
+ * Restore the cached session, if there is one and it hasn't expired.
+ * Otherwise the session is cleared, so a client that reconnects with it
+ * makes a full handshake. The system time of day must already be set.
+ */
+bool tls_session_cache::load(BearSSL::Session &session) {
+    valid = rtc_load(RTC_TLS_SESSION_OFFSET, cached);
+    if (not valid) {
+        // Back in RTC memory, so the next wake doesn't read the flash again.
+        valid = flash_load();
+        if (valid) {
+            rtc_save(RTC_TLS_SESSION_OFFSET, cached);
+        }
+    }
+    if (valid and time(nullptr) - (time_t) cached.created > TLS_SESSION_MAX_AGE_S) {
+        LOG_INFO("TLS session expired.");
+        valid = false;
+    }
+    session = valid ? cached.session : BearSSL::Session();
+    return valid;
+}
+
+/*
+ * Keep the session negotiated by the last connect. Returns true when it is a
+ * new session, i.e. a full handshake took place.
+ */
+bool tls_session_cache::store(const BearSSL::Session &session) {
+    if (valid and memcmp(&cached.session, &session, sizeof(session)) == 0) {
+        return false;
+    }
+    cached.created = time(nullptr);
+    cached.session = session;
+    valid = true;
+    rtc_save(RTC_TLS_SESSION_OFFSET, cached);
+    flash_save();
+    return true;
+}
+
+bool tls_session_cache::flash_load() {
+    rtc_region<record> region;
+    EEPROM.begin(sizeof(region));
+    EEPROM.get(TLS_SESSION_EEPROM_ADDRESS, region);
+    EEPROM.end();
+    if (region.crc != rtc_crc32(&region.data, sizeof(region.data))) {
+        return false;
+    }
+    cached = region.data;
+    return true;
+}
+
+void tls_session_cache::flash_save() {
+    rtc_region<record> region;
+    region.data = cached;
+    region.crc = rtc_crc32(&region.data, sizeof(region.data));
+    EEPROM.begin(sizeof(region));
+    EEPROM.put(TLS_SESSION_EEPROM_ADDRESS, region);
+    EEPROM.end();  // Commits to flash.
+}
+
+#endif
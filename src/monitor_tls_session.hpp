@@ -0,0 +1,63 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_TLS_SESSION_HPP
+#define MONITOR_MONITOR_TLS_SESSION_HPP
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <ctime>
+#include <cstring>
+#include <WiFiClientSecure.h>
+#include "monitor_rtc_memory.hpp"
+
+#ifndef TLS_SESSION_MAX_AGE_S
+#define TLS_SESSION_MAX_AGE_S 86400
+#endif
+
+#define TLS_SESSION_EEPROM_ADDRESS 0
+
+/*
+ * Keeps the BearSSL session parameters in RTC memory across deep sleep so that
+ * later wakes resume the TLS session with an abbreviated handshake. The server
+ * doesn't send its certificate on a resumed session so there is no chain to
+ * verify. A copy is kept in flash for cold boots; it is only rewritten when the
+ * server hands out a new session.
+ */
+struct tls_session_cache {
+    struct record {
+        uint32_t created;  // Unix epoch of the full handshake.
+        BearSSL::Session session;
+    };
+    bool load(BearSSL::Session &session);
+    bool store(const BearSSL::Session &session);
+    record cached;
+    bool valid{false};
+private:
+    bool flash_load();
+    void flash_save();
+};
+
+static_assert(sizeof(rtc_region<tls_session_cache::record>) <= RTC_TLS_SESSION_BLOCKS * 4,
+              "The TLS session outgrew its RTC memory region.");
+
+#endif //MONITOR_MONITOR_TLS_SESSION_HPP
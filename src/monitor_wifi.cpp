@@ -0,0 +1,94 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include <stdio.h>
+#include "monitor_wifi.hpp"
+#include "ntp_time_utils.hpp"
+#include "monitor_log.hpp"
+
+void monitor_wifi::begin() {
+    hal_wifi_on();
+    begin_ms = hal_millis();
+    fast = rtc_load(RTC_WIFI_LEASE_OFFSET, cached) and fresh();
+    hal_wifi_begin(fast ? &cached.wifi : nullptr);
+}
+
+/*
+ * Whether the cached lease may still be reused. It can't be judged without
+ * the time of day.
+ */
+bool monitor_wifi::fresh() const {
+    if (not system_time_set or cached.leased_at == 0) {
+        return false;
+    }
+    uint32_t age_s = (uint32_t) hal_time() - cached.leased_at;
+    if (age_s >= WIFI_LEASE_MAX_AGE_S) {
+        LOG_INFO("WiFi lease is %lu s old. Asking DHCP.", (unsigned long) age_s);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Call while waiting for WL_CONNECTED.
+ */
+void monitor_wifi::poll() {
+    if (fast and hal_millis() - begin_ms > WIFI_FAST_CONNECT_TIMEOUT_MS) {
+        LOG_WARN("Fast WiFi connect timed out. Scanning.");
+        fast = false;
+        hal_wifi_disconnect();
+        hal_wifi_begin(nullptr);
+    }
+}
+
+/*
+ * Call once WL_CONNECTED. Keeps the lease from a full scan for the next wake.
+ */
+void monitor_wifi::connected() {
+    if (reported) {
+        return;
+    }
+    reported = true;
+    if (fast) {
+        LOG_INFO("WiFi connected %lu ms after boot by fast connect.", hal_millis());
+    } else {
+        LOG_INFO("WiFi connected %lu ms after boot by full scan.", hal_millis());
+    }
+    if (not fast) {
+        hal_wifi_get_lease(cached.wifi);
+        cached.leased_at = system_time_set ? (uint32_t) hal_time() : 0;
+        rtc_save(RTC_WIFI_LEASE_OFFSET, cached);
+    }
+    char ip[16];
+    LOG_INFO("IP: %s", format_ip(cached.wifi.ip, ip, sizeof(ip)));
+    LOG_INFO("DNS: %s", format_ip(cached.wifi.dns, ip, sizeof(ip)));
+}
+
+/*
+ * Dotted quad of an address stored first octet lowest, as IPAddress does.
+ */
+char *monitor_wifi::format_ip(uint32_t ip, char *buffer, size_t buffer_len) {
+    snprintf(buffer, buffer_len, "%u.%u.%u.%u",
+             (unsigned) (ip & 0xFF), (unsigned) ((ip >> 8) & 0xFF),
+             (unsigned) ((ip >> 16) & 0xFF), (unsigned) (ip >> 24));
+    return buffer;
+}
@@ -0,0 +1,66 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_WIFI_HPP
+#define MONITOR_MONITOR_WIFI_HPP
+
+#include "monitor_hal.hpp"
+#include "monitor_rtc_memory.hpp"
+
+// How long a fast connect may take before falling back to a full scan.
+#ifndef WIFI_FAST_CONNECT_TIMEOUT_MS
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000
+#endif
+
+// How long a cached lease is reused before asking DHCP again, well inside the
+// lease time of the access point so the address isn't handed to someone else.
+#ifndef WIFI_LEASE_MAX_AGE_S
+#define WIFI_LEASE_MAX_AGE_S 43200
+#endif
+
+/*
+ * Reconnects to the last good access point by BSSID and channel, reusing the
+ * last DHCP lease as a static configuration. That skips the channel scan and
+ * the DHCP exchange. The lease is kept in RTC memory with the time it was
+ * handed out; without one, once it is WIFI_LEASE_MAX_AGE_S old, or when the
+ * fast connect times out, a full scan with DHCP is done instead.
+ */
+struct monitor_wifi {
+    struct lease {
+        hal_wifi_lease wifi;
+        uint32_t leased_at;  // 0 when the clock wasn't set, which is never reused.
+    };
+    void begin();
+    void poll();
+    void connected();
+    bool fresh() const;
+    static char *format_ip(uint32_t ip, char *buffer, size_t buffer_len);
+    lease cached{};
+    bool fast{false};
+    bool reported{false};
+    unsigned long begin_ms{0};
+};
+
+static_assert(sizeof(rtc_region<monitor_wifi::lease>) <= RTC_WIFI_LEASE_BLOCKS * 4,
+              "The WiFi lease outgrew its RTC memory region.");
+
+#endif //MONITOR_MONITOR_WIFI_HPP
@@ -21,73 +21,142 @@
  */
 
 #include "ntp_time_utils.hpp"
+#include "monitor_log.hpp"
 
-extern bool system_time_set;
+/*
+ * Rebuild the clock after deep sleep from the time we went to sleep and how
+ * long we slept, corrected by the learned drift of the sleep timer.
+ */
+void ntp_time_utils::begin() {
+    if (not rtc_load(RTC_CLOCK_OFFSET, clock)) {
+        clock = rtc_clock{};
+    }
+    // Only a timer wake knows how long it slept. Keep the learned drift anyway.
+    clock_valid = clock.epoch_at_sleep != 0
+                  and hal_reset_reason() == HAL_RESET_DEEP_SLEEP;
+    if (not clock_valid) {
+        clock.slept_s = 0;
+        return;
+    }
+    int64_t slept_ms = (int64_t) clock.sleep_ms * (1000000 + clock.drift_ppm) / 1000000;
+    hal_set_time((uint64_t) clock.epoch_at_sleep * 1000 + slept_ms + hal_millis());
+    clock.slept_s += clock.sleep_ms / 1000;
+    system_time_set = true;
+}
 
 /*
- * DST starts in March and ends in November.
- * Dates per https://www.timeanddate.com/time/change/usa/washington-dc
+ * SNTP is only needed every NTP_RESYNC_HOURS, or sooner once the sleep timer
+ * may have drifted by more than NTP_MAX_DRIFT_S.
  */
-const std::map<int, std::pair<int, int>> ntp_time_utils::dst_dates {
-        {2018, {11, 4}},
-        {2019, {10, 3}},
-        {2020, {8, 1}},
-        {2021, {14, 7}},
-        {2022, {13, 6}},
-        {2023, {12, 5}},
-        {2024, {10, 3}},
-        {2025, {9, 2}},
-        {2026, {8, 1}},
-        {2027, {14, 7}},
-        {2028, {12, 5}},
-        {2029, {11, 4}}
-};
+bool ntp_time_utils::needs_sync() {
+    if (not clock_valid) {
+        return true;
+    }
+    uint32_t since_sync_s = hal_time() - clock.last_sync_epoch;
+    uint32_t drift_bound_s = (uint64_t) clock.slept_s * NTP_DRIFT_PPM / 1000000;
+    return since_sync_s >= NTP_RESYNC_HOURS * 3600 or drift_bound_s > NTP_MAX_DRIFT_S;
+}
 
 /*
- * Set timezone abbreviation and daylight savings time offset.
+ * Set time using SNTP, when the clock carried across deep sleep is no longer
+ * good enough. The system clock is kept in UTC. Returns true when SNTP set it.
  */
-void ntp_time_utils::set_dst_usa(tm *time_o, time_t *time_stamp) {
-    int year = time_o->tm_year + 1900;
-    if (year > 2017 and year < 2030) {
-        std::pair<int, int> dst = dst_dates.at(year);
-        double dst_start_hour = ((31 + 28.25 + std::get<0>(dst) - 1) * 24) + 2;
-        double dst_end_hour = ((31 + 28.25 + 31 + 30 + 31 + 30 + 31 + 31 +
-                                30 + 31 + std::get<1>(dst) - 1) * 24) + 2;
-        double hours_since_new_year = (*time_stamp - (31557600 * (year - 1970))) / 3600;
-        if (dst_start_hour < hours_since_new_year and dst_end_hour > hours_since_new_year) {
-            memcpy(&EASTERN_TIMEZONE_ABBREV, " EDT", sizeof(EASTERN_TIMEZONE_ABBREV));
-            dst_offset_seconds = 3600;
+bool ntp_time_utils::set_time_of_day() {
+    if (not needs_sync()) {
+        return false;
+    }
+    uint64_t predicted_ms = hal_time_ms();
+    unsigned long started_ms = hal_millis();
+    hal_sntp_begin();
+    while (not hal_sntp_synced()) {
+        if (hal_millis() - started_ms > NTP_TIMEOUT_MS) {
+            LOG_WARN("SNTP timed out. Keeping the carried clock.");
+            return false;
         }
+        hal_delay(100);
+    }
+    synced(predicted_ms + (hal_millis() - started_ms), hal_time_ms());
+    return true;
+}
+
+/*
+ * Take the time of day from a gateway's ack, when the carried clock is no
+ * longer good enough. Returns true when it set the clock.
+ */
+bool ntp_time_utils::set_time(uint32_t epoch) {
+    if (epoch == 0 or not needs_sync()) {
+        return false;
+    }
+    uint64_t predicted_ms = hal_time_ms();
+    hal_set_time((uint64_t) epoch * 1000);
+    synced(predicted_ms, (uint64_t) epoch * 1000);
+    return true;
+}
+
+/*
+ * The clock was just set to now_ms, where the carried clock said predicted_ms.
+ */
+void ntp_time_utils::synced(uint64_t predicted_ms, uint64_t now_ms) {
+    time_t now = (time_t) (now_ms / 1000);
+    LOG_INFO("Time: %lld", now);
+    if (clock_valid and clock.slept_s >= 3600) {
+        // Learn how far the sleep timer ran off since the last sync.
+        int64_t error_ms = (int64_t) (now_ms - predicted_ms);
+        clock.drift_ppm += error_ms * 1000 / clock.slept_s;
+        LOG_INFO("Deep sleep timer drift: %ld ppm", clock.drift_ppm);
     }
+    clock.last_sync_epoch = now;
+    clock.slept_s = 0;
+    clock_valid = true;
+    system_time_set = true;
 }
 
 /*
- * Set time using SNTP.
+ * Called on the way into deep sleep.
  */
-void ntp_time_utils::set_time_of_day() {
-    time_t now = time(nullptr);
+void ntp_time_utils::sleep(uint32_t sleep_s) {
     if (not system_time_set) {
-        configTime(GMT_OFFSET * 3600,
-                   0,
-                   "pool.ntp.org",
-                   "time.nist.gov");
-        while (now < 8 * 3600 * 2) {
-            now = time(nullptr);
-            delay(500);
-            Serial.print("Time: ");  Serial.println(now);
+        return;
+    }
+    // The part second we are in is carried in sleep_ms.
+    uint64_t now_ms = hal_time_ms();
+    clock.epoch_at_sleep = (uint32_t) (now_ms / 1000);
+    clock.sleep_ms = (uint32_t) (now_ms % 1000) + sleep_s * 1000;
+    rtc_save(RTC_CLOCK_OFFSET, clock);
+}
+
+/*
+ * The local timezone, parsed from TIMEZONE_RULE on first use.
+ */
+const monitor_timezone &ntp_time_utils::timezone() {
+    if (not zone_valid) {
+        zone_valid = true;
+        if (not zone.parse(TIMEZONE_RULE)) {
+            LOG_ERROR("Bad TIMEZONE_RULE, using UTC: %s", TIMEZONE_RULE);
         }
-        system_time_set = true;
+#ifdef TIMEZONE_GMT_OFFSET
+        zone.std_offset_s = (int32_t) (TIMEZONE_GMT_OFFSET * 3600);
+        zone.dst_offset_s = zone.std_offset_s + 3600;
+#endif
     }
-    struct tm time_info;
-    gmtime_r(&now, &time_info);
-    set_dst_usa(&time_info, &now);
-    now += dst_offset_seconds;
-    extern monitor_data sensor;
-    std::strftime(sensor.unix_epoch_time,
-                  sizeof(sensor.unix_epoch_time),
-                  "%c",
-                  std::gmtime(&now));
-    strcat(&sensor.unix_epoch_time[sizeof(sensor.unix_epoch_time) -
-                                   sizeof(EASTERN_TIMEZONE_ABBREV)],
-                                   EASTERN_TIMEZONE_ABBREV);
-}
\ No newline at end of file
+    return zone;
+}
+
+/*
+ * Format a UTC timestamp as local time, e.g. "Wed Dec 28 11:44:28 2011 EST".
+ * The buffer must hold TIME_STRING_SIZE characters.
+ */
+char *ntp_time_utils::format_time(time_t utc, char *buffer, size_t buffer_len) {
+    monitor_text text(buffer, buffer_len);
+    print_time(text, utc);
+    return buffer;
+}
+
+/*
+ * Write a UTC timestamp as local time where it's needed, e.g. into a payload.
+ */
+monitor_text &ntp_time_utils::print_time(monitor_text &text, time_t utc) {
+    bool dst;
+    time_t local = utc + timezone().offset_s(utc, dst);
+    return text.print_time(local, zone.name(dst));
+}
@@ -23,18 +23,77 @@
 #ifndef MONITOR_NTP_TIME_UTILS_HPP
 #define MONITOR_NTP_TIME_UTILS_HPP
 
-#include <Arduino.h>
 #include <ctime>
-#include <map>
 #include <cstring>
-#include "monitor_data.hpp"
+#include "monitor_hal.hpp"
+#include "monitor_rtc_memory.hpp"
+#include "monitor_text.hpp"
+#include "monitor_timezone.hpp"
+
+#define TIME_STRING_SIZE (26 + TIMEZONE_NAME_MAX)  // Wed Dec 28 11:44:28 2011 EST
+
+/*
+ * Local time, as a POSIX TZ rule. Without one, US Eastern time shifted to
+ * GMT_OFFSET hours when that is defined.
+ */
+#ifndef TIMEZONE_RULE
+#define TIMEZONE_RULE "EST5EDT,M3.2.0,M11.1.0"
+#ifdef GMT_OFFSET
+#define TIMEZONE_GMT_OFFSET GMT_OFFSET
+#endif
+#endif
+
+// Resync with SNTP at least this often.
+#ifndef NTP_RESYNC_HOURS
+#define NTP_RESYNC_HOURS 6
+#endif
+
+// Resync once the clock may have drifted by this many seconds. At NTP_DRIFT_PPM
+// that takes NTP_MAX_DRIFT_S / NTP_DRIFT_PPM * 1e6 s of sleep, 8.3 hours by
+// default, so NTP_RESYNC_HOURS is what usually sets the pace.
+#ifndef NTP_MAX_DRIFT_S
+#define NTP_MAX_DRIFT_S 60
+#endif
+
+// Error of the deep sleep timer left after its drift has been learned.
+#ifndef NTP_DRIFT_PPM
+#define NTP_DRIFT_PPM 2000
+#endif
+
+#define NTP_TIMEOUT_MS 10000
+
+/*
+ * The clock carried across deep sleep in RTC memory.
+ */
+struct rtc_clock {
+    uint32_t last_sync_epoch;  // When SNTP last set the clock.
+    uint32_t epoch_at_sleep;   // The clock on the way into deep sleep, in whole seconds.
+    uint32_t sleep_ms;         // From then to the wake: the rest of that second and the sleep asked for.
+    uint32_t slept_s;          // Seconds slept since the last SNTP sync.
+    int32_t drift_ppm;         // Learned error of the deep sleep timer.
+};
 
 struct ntp_time_utils {
-    static const std::map<int, std::pair<int, int>> dst_dates;
-    void set_dst_usa(tm *time_o, time_t *time_stamp);
-    char EASTERN_TIMEZONE_ABBREV[5] = " EST";
-    void set_time_of_day();
-    int dst_offset_seconds{0};
+    void begin();
+    bool needs_sync();
+    bool set_time_of_day();
+    bool set_time(uint32_t epoch);
+    void sleep(uint32_t sleep_s);
+    char *format_time(time_t utc, char *buffer, size_t buffer_len);
+    monitor_text &print_time(monitor_text &text, time_t utc);
+    const monitor_timezone &timezone();
+    rtc_clock clock{};
+    bool clock_valid{false};
+private:
+    void synced(uint64_t predicted_ms, uint64_t now_ms);
+    monitor_timezone zone;
+    bool zone_valid{false};
 };
 
+// The clock has been set, by SNTP, a gateway's ack or across deep sleep. In main.cpp.
+extern volatile bool system_time_set;
+
+static_assert(sizeof(rtc_region<rtc_clock>) <= RTC_CLOCK_BLOCKS * 4,
+              "The clock outgrew its RTC memory region.");
+
 #endif //MONITOR_NTP_TIME_UTILS_HPP
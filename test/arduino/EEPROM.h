@@ -0,0 +1,55 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_TEST_EEPROM_H
+#define MONITOR_TEST_EEPROM_H
+
+#include <Arduino.h>
+
+/*
+ * The ESP8266 core's EEPROM: a RAM copy of a flash sector between begin() and
+ * end(), written back at end() if anything was put. The sector is kept in
+ * flash[] and the writes counted, for the test to look at.
+ */
+struct EEPROMClass {
+    void begin(size_t size) { copy_size = size; memcpy(copy, flash, size); dirty = false; }
+    template <typename T>
+    T &get(int address, T &data) { memcpy(&data, copy + address, sizeof(data)); return data; }
+    template <typename T>
+    const T &put(int address, const T &data) { memcpy(copy + address, &data, sizeof(data)); dirty = true; return data; }
+    bool end() {
+        if (dirty) {
+            memcpy(flash, copy, copy_size);
+            writes++;
+        }
+        return true;
+    }
+    uint8_t flash[4096];
+    uint8_t copy[4096];
+    size_t copy_size;
+    bool dirty;
+    int writes;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif //MONITOR_TEST_EEPROM_H
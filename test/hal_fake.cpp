@@ -0,0 +1,347 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include <stdio.h>
+#include "hal_fake.hpp"
+#include "monitor_log.hpp"
+
+hal_fake_state hal_fake;
+
+// What main.cpp defines in the firmware. The log is written nowhere.
+hal_console Serial;
+monitor_log logger;
+
+void hal_fake_reset() {
+    hal_fake.now_us = 0;
+    hal_fake.micros_step = 0;
+    hal_fake.boot_epoch_ms = 0;
+    hal_fake.sntp_synced = false;
+    hal_fake.sntp_boot_epoch_ms = 0;
+    hal_fake.sntp_begins = 0;
+    hal_fake.reset_reason = HAL_RESET_POWER_ON;
+    hal_fake.slept = false;
+    hal_fake.sleep_us = 0;
+    hal_fake.sleep_rf = HAL_RF_NO_CAL;
+    memset(hal_fake.rtc, 0, sizeof(hal_fake.rtc));
+    hal_fake.adc = 0;
+    hal_fake.current_ma = 0;
+    hal_fake.temperature_c = NAN;
+    hal_fake.humidity = NAN;
+    hal_fake.ina219_begins = 0;
+    hal_fake.dht_begins = 0;
+    hal_fake.ina219_on = false;
+    hal_fake.buttons_down = 0;
+    hal_fake.i2c.clear();
+    hal_fake.i2c_acks_left = -1;
+    hal_fake.wifi_on = false;
+    hal_fake.wifi_connected = false;
+    hal_fake.wifi_begins = 0;
+    hal_fake.wifi_began_with_lease = false;
+    memset(&hal_fake.lease, 0, sizeof(hal_fake.lease));
+    hal_fake.mqtt_connect_status = 0;
+    hal_fake.mqtt_connected = false;
+    hal_fake.mqtt_connects = 0;
+    hal_fake.published.clear();
+    hal_fake.publishes_left = -1;
+    hal_fake.link_sent.clear();
+    hal_fake.link_inbox.clear();
+    logger.used = 0;
+    logger.dropped = 0;
+}
+
+void hal_fake_wake(hal_reset reason) {
+    uint8_t rtc[sizeof(hal_fake.rtc)];
+    memcpy(rtc, hal_fake.rtc, sizeof(rtc));
+    hal_fake_reset();
+    memcpy(hal_fake.rtc, rtc, sizeof(rtc));
+    hal_fake.reset_reason = reason;
+}
+
+void hal_fake_advance_ms(unsigned long ms) {
+    hal_fake.now_us += (uint64_t) ms * 1000;
+}
+
+size_t hal_console::print(const char *text) {
+    return strlen(text);
+}
+
+size_t hal_console::print(char c) {
+    return 1;
+}
+
+size_t hal_console::print(int value) {
+    return snprintf(nullptr, 0, "%d", value);
+}
+
+size_t hal_console::print(unsigned int value) {
+    return snprintf(nullptr, 0, "%u", value);
+}
+
+size_t hal_console::print(long value) {
+    return snprintf(nullptr, 0, "%ld", value);
+}
+
+size_t hal_console::print(unsigned long value) {
+    return snprintf(nullptr, 0, "%lu", value);
+}
+
+size_t hal_console::print(double value, int digits) {
+    return snprintf(nullptr, 0, "%.*f", digits, value);
+}
+
+size_t hal_console::write(const uint8_t *data, size_t len) {
+    return len;
+}
+
+void hal_console::flush() {
+}
+
+const uint8_t *hal_native_oled_memory() {
+    static uint8_t memory[1024];
+    return memory;
+}
+
+void hal_begin() {
+}
+
+hal_reset hal_reset_reason() {
+    return hal_fake.reset_reason;
+}
+
+void hal_feed_watchdog() {
+}
+
+// Returns, unlike the real one; the test sees where it would have slept.
+void hal_deep_sleep(uint64_t sleep_us, hal_rf rf) {
+    hal_fake.slept = true;
+    hal_fake.sleep_us = sleep_us;
+    hal_fake.sleep_rf = rf;
+}
+
+uint32_t hal_free_heap() {
+    return 40000;
+}
+
+unsigned long hal_millis() {
+    return (unsigned long) (hal_fake.now_us / 1000);
+}
+
+unsigned long hal_micros() {
+    hal_fake.now_us += hal_fake.micros_step;
+    return (unsigned long) hal_fake.now_us;
+}
+
+void hal_delay(unsigned long ms) {
+    hal_fake_advance_ms(ms);
+}
+
+time_t hal_time() {
+    return (time_t) ((hal_fake.boot_epoch_ms + hal_fake.now_us / 1000) / 1000);
+}
+
+uint64_t hal_time_ms() {
+    return hal_fake.boot_epoch_ms + hal_fake.now_us / 1000;
+}
+
+void hal_set_time(uint64_t epoch_ms) {
+    hal_fake.boot_epoch_ms = epoch_ms - hal_fake.now_us / 1000;
+}
+
+void hal_sntp_begin() {
+    hal_fake.sntp_begins++;
+}
+
+bool hal_sntp_synced() {
+    if (hal_fake.sntp_synced) {
+        hal_fake.boot_epoch_ms = hal_fake.sntp_boot_epoch_ms;
+    }
+    return hal_fake.sntp_synced;
+}
+
+bool hal_rtc_read(uint32_t offset, void *data, size_t size) {
+    if (offset * 4 + size > sizeof(hal_fake.rtc)) {
+        return false;
+    }
+    memcpy(data, &hal_fake.rtc[offset * 4], size);
+    return true;
+}
+
+bool hal_rtc_write(uint32_t offset, const void *data, size_t size) {
+    if (offset * 4 + size > sizeof(hal_fake.rtc)) {
+        return false;
+    }
+    memcpy(&hal_fake.rtc[offset * 4], data, size);
+    return true;
+}
+
+void hal_ina219_begin() {
+    hal_fake.ina219_begins++;
+}
+
+void hal_ina219_power(bool on) {
+    hal_fake.ina219_on = on;
+}
+
+void hal_dht_begin() {
+    hal_fake.dht_begins++;
+}
+
+int hal_adc_read() {
+    return hal_fake.adc;
+}
+
+double hal_current_ma() {
+    return hal_fake.current_ma;
+}
+
+float hal_temperature_c() {
+    return hal_fake.temperature_c;
+}
+
+float hal_relative_humidity() {
+    return hal_fake.humidity;
+}
+
+bool hal_button_down(int pin) {
+    return hal_fake.buttons_down & (1u << pin);
+}
+
+void hal_button_attach(int pin, void (*isr)()) {
+}
+
+bool hal_i2c_write(uint8_t address, const uint8_t *data, size_t len) {
+    bool acked = hal_fake.i2c_acks_left != 0;
+    if (hal_fake.i2c_acks_left > 0) {
+        hal_fake.i2c_acks_left--;
+    }
+    hal_fake.i2c.push_back(hal_fake_i2c_write{address, std::vector<uint8_t>(data, data + len), acked});
+    return acked;
+}
+
+void hal_wifi_on() {
+    hal_fake.wifi_on = true;
+}
+
+void hal_wifi_begin(const hal_wifi_lease *lease) {
+    hal_fake.wifi_begins++;
+    hal_fake.wifi_began_with_lease = lease != nullptr;
+}
+
+void hal_wifi_disconnect() {
+    hal_fake.wifi_connected = false;
+}
+
+void hal_wifi_off() {
+    hal_fake.wifi_on = false;
+    hal_fake.wifi_connected = false;
+}
+
+bool hal_wifi_connected() {
+    return hal_fake.wifi_connected;
+}
+
+void hal_wifi_get_lease(hal_wifi_lease &lease) {
+    lease = hal_fake.lease;
+}
+
+char *hal_wifi_mac(char *buffer, size_t buffer_len) {
+    snprintf(buffer, buffer_len, "02:00:00:00:00:01");
+    return buffer;
+}
+
+int8_t hal_mqtt_connect() {
+    hal_fake.mqtt_connects++;
+    hal_fake.mqtt_connected = hal_fake.mqtt_connect_status == 0;
+    return hal_fake.mqtt_connect_status;
+}
+
+const char *hal_mqtt_error(int8_t status) {
+    return "fake";
+}
+
+bool hal_mqtt_publish(const char *topic, const uint8_t *payload, uint16_t payload_len) {
+    if (hal_fake.publishes_left == 0) {
+        return false;
+    }
+    if (hal_fake.publishes_left > 0) {
+        hal_fake.publishes_left--;
+    }
+    hal_fake.published.push_back(hal_fake_publish{topic, std::string((const char *) payload, payload_len)});
+    return true;
+}
+
+void hal_mqtt_disconnect() {
+    hal_fake.mqtt_connected = false;
+}
+
+bool hal_mqtt_ping() {
+    return hal_fake.mqtt_connected;
+}
+
+bool hal_mqtt_connected() {
+    return hal_fake.mqtt_connected;
+}
+
+bool hal_link_begin(bool gateway) {
+    return true;
+}
+
+bool hal_link_send(const hal_link_peer *peer, const uint8_t *data, size_t len) {
+    hal_fake_packet packet{};
+    if (peer) {
+        packet.peer = *peer;
+    }
+    packet.data.assign(data, data + len);
+    hal_fake.link_sent.push_back(packet);
+    return true;
+}
+
+size_t hal_link_receive(hal_link_peer &peer, uint8_t *buffer, size_t buffer_len, unsigned long timeout_ms) {
+    if (hal_fake.link_inbox.empty()) {
+        hal_fake_advance_ms(timeout_ms);
+        return 0;
+    }
+    hal_fake_packet packet = hal_fake.link_inbox.front();
+    hal_fake.link_inbox.erase(hal_fake.link_inbox.begin());
+    peer = packet.peer;
+    size_t len = min(packet.data.size(), buffer_len);
+    memcpy(buffer, packet.data.data(), len);
+    return len;
+}
+
+/*
+ * Not an HMAC, only keyed and deterministic, which is all the tests need of
+ * it: 32 bytes of FNV-1a over the key and then the data.
+ */
+void hal_hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len, uint8_t mac[32]) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < 32; i++) {
+        hash = (hash ^ (uint8_t) i) * 16777619u;
+        for (size_t k = 0; k < key_len; k++) {
+            hash = (hash ^ key[k]) * 16777619u;
+        }
+        for (size_t d = 0; d < data_len; d++) {
+            hash = (hash ^ data[d]) * 16777619u;
+        }
+        mac[i] = (uint8_t) (hash >> 24);
+    }
+}
@@ -0,0 +1,102 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_HAL_FAKE_HPP
+#define MONITOR_HAL_FAKE_HPP
+
+#include <string>
+#include <vector>
+#include "monitor_hal.hpp"
+
+/*
+ * A HAL for the host tests. Nothing happens on its own: time moves when a
+ * test moves it or the firmware calls hal_delay(), the sensors read what the
+ * test set, and what goes out on I2C, MQTT or the node link is kept for the
+ * test to look at. hal_fake_reset() is a cold boot with all of it cleared.
+ */
+struct hal_fake_i2c_write {
+    uint8_t address;
+    std::vector<uint8_t> data;
+    bool acked;
+};
+
+struct hal_fake_publish {
+    std::string topic;
+    std::string payload;
+};
+
+struct hal_fake_packet {
+    hal_link_peer peer;
+    std::vector<uint8_t> data;
+};
+
+struct hal_fake_state {
+    // Time since boot, and the time of day at boot in ms since the epoch.
+    uint64_t now_us;
+    unsigned long micros_step;  // Added on every hal_micros(), 0 for none.
+    uint64_t boot_epoch_ms;
+    bool sntp_synced;
+    uint64_t sntp_boot_epoch_ms;  // The true time of day at boot, which SNTP sets.
+    int sntp_begins;
+    hal_reset reset_reason;
+    bool slept;
+    uint64_t sleep_us;
+    hal_rf sleep_rf;
+    uint8_t rtc[512];
+
+    // Sensors.
+    int adc;
+    double current_ma;
+    float temperature_c;
+    float humidity;
+    int ina219_begins;
+    int dht_begins;
+    bool ina219_on;
+    unsigned buttons_down;  // Bit n for pin n.
+
+    std::vector<hal_fake_i2c_write> i2c;
+    long i2c_acks_left;  // Writes acked before the bus NACKs, -1 for all.
+
+    bool wifi_on;
+    bool wifi_connected;
+    int wifi_begins;
+    bool wifi_began_with_lease;
+    hal_wifi_lease lease;
+
+    int8_t mqtt_connect_status;
+    bool mqtt_connected;
+    int mqtt_connects;
+    std::vector<hal_fake_publish> published;
+    long publishes_left;  // Publishes that succeed before they fail, -1 for all.
+
+    std::vector<hal_fake_packet> link_sent;
+    std::vector<hal_fake_packet> link_inbox;
+};
+
+extern hal_fake_state hal_fake;
+
+void hal_fake_reset();
+// The next boot, with everything but the RTC memory cleared.
+void hal_fake_wake(hal_reset reason);
+void hal_fake_advance_ms(unsigned long ms);
+
+#endif //MONITOR_HAL_FAKE_HPP
@@ -0,0 +1,74 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef MONITOR_MONITOR_TEST_HPP
+#define MONITOR_MONITOR_TEST_HPP
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+/*
+ * The few things a host test needs: CHECK() counts a condition and prints the
+ * ones that fail, test_summary() prints the count and is main()'s result. A
+ * test that also measures something does so when run with "bench".
+ */
+struct test_counts {
+    long checks;
+    long failures;
+};
+
+inline test_counts &test_count() {
+    static test_counts counts{0, 0};
+    return counts;
+}
+
+inline bool test_check(bool passed, const char *condition, const char *file, int line) {
+    test_count().checks++;
+    if (not passed and test_count().failures++ < 20) {
+        printf("%s:%d: CHECK(%s) failed\n", file, line, condition);
+    }
+    return passed;
+}
+
+#define CHECK(condition) test_check((condition), #condition, __FILE__, __LINE__)
+
+inline int test_summary(const char *name) {
+    printf("%s: %ld checks, %ld failed\n", name, test_count().checks, test_count().failures);
+    return test_count().failures ? 1 : 0;
+}
+
+inline bool test_bench(int argc, char *argv[]) {
+    return argc > 1 and strcmp(argv[1], "bench") == 0;
+}
+
+// Wall clock ns per call of f, over count calls.
+template <typename F>
+double test_ns_per(long count, F f) {
+    auto started = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; i++) {
+        f(i);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / count;
+}
+
+#endif //MONITOR_MONITOR_TEST_HPP
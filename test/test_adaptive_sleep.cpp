@@ -0,0 +1,257 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "monitor_adaptive_sleep.hpp"
+#include "monitor_battery.hpp"
+#include "monitor_ring_buffer.hpp"
+
+/*
+ * Replays a trace of readings through the adaptive sleep and the queue, wake
+ * by wake as main.cpp does, and reports the uploads and the battery life
+ * against the old fixed 300 s interval with an upload every wake. Run with a
+ * CSV file of "epoch,temperature_f,humidity_rh,current_ma" lines to replay a
+ * recorded trace; without one, synthetic traces are replayed and checked.
+ */
+#define FIXED_SLEEP_S 300
+#define SAMPLE_AWAKE_MS 2000  // A sampling wake, radio off.
+#define UPLOAD_AWAKE_MS 4000  // An upload wake, radio on.
+
+struct trace_point {
+    uint32_t epoch;
+    float temperature_f;
+    float humidity_rh;
+    float current_ma;
+};
+
+typedef std::vector<trace_point> trace;
+
+struct replay_report {
+    uint32_t wakes{0};
+    uint32_t uploads{0};
+    uint32_t queued{0};
+    uint32_t longest_sleep_s{0};
+    uint32_t longest_between_queued_s{0};
+    uint32_t longest_lag_s{0};  // From a move outside the deadbands to the wake that saw it.
+    double mean_ua{0};
+    double life_days{0};
+};
+
+// The reading at a time, between the points of the trace.
+static monitor_data reading_at(const trace &points, uint32_t epoch) {
+    size_t i = 1;
+    while (i + 1 < points.size() and points[i].epoch < epoch) {
+        i++;
+    }
+    const trace_point &a = points[i - 1];
+    const trace_point &b = points[i];
+    float f = b.epoch == a.epoch ? 0.0f : max(0.0f, min(1.0f, (float) (epoch - a.epoch) / (b.epoch - a.epoch)));
+    monitor_data data{};
+    data.unix_epoch_time = epoch;
+    data.temperature_cf = (int16_t) lround((a.temperature_f + f * (b.temperature_f - a.temperature_f)) * 100);
+    data.humidity_crh = (uint16_t) lround((a.humidity_rh + f * (b.humidity_rh - a.humidity_rh)) * 100);
+    data.current_cma = (int32_t) lround((a.current_ma + f * (b.current_ma - a.current_ma)) * 100);
+    data.battery_vdc = 80;
+    data.flags = MONITOR_DATA_CURRENT_VALID | MONITOR_DATA_HUMIDITY_VALID | MONITOR_DATA_TEMPERATURE_VALID;
+    return data;
+}
+
+static bool moved(const monitor_data &a, const monitor_data &b) {
+    return abs(a.temperature_cf - b.temperature_cf) > ADAPTIVE_DEADBAND_CF
+           or abs((int32_t) a.humidity_crh - b.humidity_crh) > ADAPTIVE_DEADBAND_CRH
+           or abs(a.current_cma - b.current_cma) > ADAPTIVE_DEADBAND_CMA;
+}
+
+static void account(double &charge_uas, uint32_t awake_ms, double awake_ma, uint32_t sleep_s) {
+    charge_uas += awake_ms * awake_ma + (double) sleep_s * BATTERY_SLEEP_UA;
+}
+
+static replay_report replay(const trace &points) {
+    hal_fake_reset();
+    replay_report report;
+    double charge_uas{0};
+    uint32_t elapsed_s{0};
+    uint32_t last_queued{0};
+    monitor_data last_queued_reading{};
+    uint32_t end = points.back().epoch;
+    for (uint32_t epoch = points.front().epoch; epoch < end; ) {
+        hal_fake_wake(report.wakes++ ? HAL_RESET_DEEP_SLEEP : HAL_RESET_POWER_ON);
+        monitor_adaptive_sleep adaptive;
+        monitor_ring_buffer readings;
+        adaptive.begin();
+        readings.begin();
+        monitor_data reading = reading_at(points, epoch);
+        bool upload = readings.upload_due();
+        if (upload or adaptive.changed(reading)) {
+            readings.push(reading);
+            adaptive.queued(reading);
+            report.queued++;
+            if (last_queued) {
+                report.longest_between_queued_s = max(report.longest_between_queued_s, epoch - last_queued);
+            }
+            last_queued = epoch;
+            last_queued_reading = reading;
+        }
+        if (upload) {
+            monitor_data record;
+            while (readings.peek(record)) {
+                readings.pop();
+            }
+            report.uploads++;
+        }
+        uint32_t sleep_s = adaptive.sleep(reading);
+        readings.sleep(upload);
+        report.longest_sleep_s = max(report.longest_sleep_s, sleep_s);
+        account(charge_uas, upload ? UPLOAD_AWAKE_MS : SAMPLE_AWAKE_MS,
+                upload ? BATTERY_RADIO_MA : BATTERY_CPU_MA, sleep_s);
+
+        // How long a move outside the deadbands went unseen.
+        for (uint32_t t = epoch + 60; t < epoch + sleep_s and t < end; t += 60) {
+            if (moved(reading_at(points, t), last_queued_reading)) {
+                report.longest_lag_s = max(report.longest_lag_s, epoch + sleep_s - t);
+                break;
+            }
+        }
+        epoch += sleep_s + (upload ? UPLOAD_AWAKE_MS : SAMPLE_AWAKE_MS) / 1000;
+        elapsed_s += sleep_s;
+    }
+    report.mean_ua = charge_uas / 1000.0 / elapsed_s * 1000.0;
+    report.life_days = BATTERY_CAPACITY_MAH * 1000.0 / report.mean_ua / 24.0;
+    return report;
+}
+
+// The old firmware: an upload every FIXED_SLEEP_S.
+static double fixed_life_days() {
+    double ua = ((double) UPLOAD_AWAKE_MS * BATTERY_RADIO_MA + FIXED_SLEEP_S * BATTERY_SLEEP_UA)
+                / (FIXED_SLEEP_S + UPLOAD_AWAKE_MS / 1000.0);
+    return BATTERY_CAPACITY_MAH * 1000.0 / ua / 24.0;
+}
+
+static void print_report(const char *name, uint32_t seconds, const replay_report &report) {
+    printf("adaptive_sleep: %-8s %5u wakes, %4u uploads (%u fixed), %4u readings queued, "
+           "%5.0f uA, %5.0f days (%.0f fixed)\n",
+           name, report.wakes, report.uploads, seconds / (FIXED_SLEEP_S + UPLOAD_AWAKE_MS / 1000),
+           report.queued, report.mean_ua, report.life_days, fixed_life_days());
+}
+
+// A week of readings every minute, from f(seconds since the start).
+template <typename F>
+static trace synthetic(F f) {
+    trace points;
+    for (uint32_t t = 0; t <= 7 * 86400; t += 60) {
+        trace_point p = f(t);
+        p.epoch = 1538395200 + t;
+        points.push_back(p);
+    }
+    return points;
+}
+
+static void check_common(const replay_report &report) {
+    CHECK(report.longest_sleep_s <= ADAPTIVE_SLEEP_MAX_S);
+    // The heartbeat, give or take a sleep and an upload wake.
+    CHECK(report.longest_between_queued_s <= ADAPTIVE_HEARTBEAT_S + ADAPTIVE_SLEEP_MAX_S + UPLOAD_AWAKE_MS / 1000);
+    CHECK(report.longest_lag_s <= ADAPTIVE_SLEEP_MAX_S);
+    CHECK(report.life_days > fixed_life_days());
+}
+
+static void test_quiet_room() {
+    trace points = synthetic([](uint32_t t) { return trace_point{0, 70.0f, 40.0f, 15.0f}; });
+    replay_report report = replay(points);
+    print_report("quiet", 7 * 86400, report);
+    check_common(report);
+    // It sleeps the longest, and queues only the heartbeat.
+    CHECK(report.wakes < 7 * 86400 / ADAPTIVE_SLEEP_MAX_S + 10);
+    CHECK(report.queued <= 7 * 24 + 2);
+    CHECK(report.life_days > 3 * fixed_life_days());
+}
+
+static void test_daily_swing() {
+    // A day's temperature and humidity swing, with noise inside the deadbands.
+    trace points = synthetic([](uint32_t t) {
+        float day = (float) (2 * M_PI * t / 86400.0);
+        float noise = ((t * 2654435761u) >> 16 & 0xFF) / 255.0f - 0.5f;
+        return trace_point{0, 68.0f + 6.0f * sinf(day) + 0.3f * noise, 45.0f - 10.0f * sinf(day), 15.0f + noise};
+    });
+    replay_report report = replay(points);
+    print_report("daily", 7 * 86400, report);
+    check_common(report);
+}
+
+static void test_steps() {
+    // Long quiet spells broken by a step, as when a heater comes on.
+    trace points = synthetic([](uint32_t t) {
+        bool on = (t / 3600) % 5 == 0;
+        return trace_point{0, on ? 74.0f : 66.0f, on ? 35.0f : 45.0f, on ? 40.0f : 15.0f};
+    });
+    replay_report report = replay(points);
+    print_report("steps", 7 * 86400, report);
+    check_common(report);
+    // Each step is queued: two a cycle, over 33 cycles.
+    CHECK(report.queued >= 2 * (7 * 24 / 5));
+}
+
+static void test_ramp() {
+    // Always moving: the shortest sleep, and every reading queued.
+    trace points = synthetic([](uint32_t t) { return trace_point{0, 50.0f + t / 300.0f * 0.6f, 40.0f, 15.0f}; });
+    replay_report report = replay(points);
+    print_report("ramp", 7 * 86400, report);
+    CHECK(report.longest_sleep_s == ADAPTIVE_SLEEP_MIN_S);
+    CHECK(report.queued == report.wakes);
+}
+
+static trace load(const char *path) {
+    trace points;
+    FILE *file = fopen(path, "r");
+    if (not file) {
+        return points;
+    }
+    trace_point p;
+    char line[128];
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%u,%f,%f,%f", &p.epoch, &p.temperature_f, &p.humidity_rh, &p.current_ma) == 4) {
+            points.push_back(p);
+        }
+    }
+    fclose(file);
+    return points;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 and not test_bench(argc, argv)) {
+        trace points = load(argv[1]);
+        if (points.size() < 2) {
+            printf("adaptive_sleep: no trace in %s\n", argv[1]);
+            return 1;
+        }
+        print_report("trace", points.back().epoch - points.front().epoch, replay(points));
+        return 0;
+    }
+    test_quiet_room();
+    test_daily_swing();
+    test_steps();
+    test_ramp();
+    return test_summary("adaptive_sleep");
+}
@@ -0,0 +1,230 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "monitor_battery.hpp"
+#include "monitor_read_battery.hpp"
+
+monitor_battery battery;
+
+/*
+ * Replays synthetic discharges through monitor_battery, wake by wake as
+ * main.cpp does, against a simulated cell whose true state of charge is
+ * known. The cell and the board are off from the model in a different way in
+ * each scenario; the state of charge and the hours left must still follow.
+ */
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t next_random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double uniform() {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static float gaussian() {
+    return (float) (sqrt(-2.0 * log(1.0 - uniform())) * cos(2.0 * M_PI * uniform()));
+}
+
+// The LiPo open circuit voltage the model assumes, every 5% of charge.
+static const float model_ocv_mv[21] = {3270, 3610, 3690, 3710, 3730, 3750, 3770, 3790, 3800, 3820, 3840,
+                                       3850, 3870, 3910, 3950, 3980, 4020, 4080, 4110, 4150, 4200};
+
+// The simulated cell's curve: the model's, shifted by shift_mv and tilted.
+static float true_ocv_mv(float soc, float shift_mv, float tilt_mv) {
+    float x = soc * 20;
+    int i = max(0, min(19, (int) x));
+    return model_ocv_mv[i] + (model_ocv_mv[i + 1] - model_ocv_mv[i]) * (x - i) + shift_mv + tilt_mv * (soc - 0.5f);
+}
+
+struct discharge {
+    const char *name;
+    float start_soc;
+    float awake_bias;  // The true draw awake over the model's.
+    float sleep_ua;    // The true draw in deep sleep.
+    float resistance_mohm;
+    float shift_mv;
+    float tilt_mv;
+    bool cold_boot;    // RTC memory lost half way.
+    bool recharged;    // Charged to full at 40%.
+    float tolerance;   // Of the state of charge, once settled.
+};
+
+struct discharge_report {
+    long wakes{0};
+    double days{0};
+    float max_error{0};
+    float mean_error{0};
+    double runtime_error{0};  // The median, relative.
+    bool stretched{false};
+    bool gated{false};
+    float peak_margin_mv{1e9f};
+};
+
+/*
+ * The ADC pin's reading for a battery voltage, so that read_battery_adc()
+ * takes it from the fake HAL as it would from the divider.
+ */
+static int adc_pin(float battery_mv) {
+    return (int) lroundf((battery_mv * 22.0f / 122.0f - MONITOR_READ_BATTERY_VDC_CALIBRATION) / 0.97656f);
+}
+
+static discharge_report replay(const discharge &cell) {
+    static const uint32_t intervals[] = {300, 600, 1200, 1800};
+    discharge_report report;
+    hal_fake_reset();
+    float soc = cell.start_soc;
+    double t_s{0};
+    uint32_t sleep_s{300};
+    double error_sum{0};
+    long errors{0};
+    long settled_at{0};
+    double empty_at_s{-1};
+    bool recharged{false};
+    bool cold_booted{false};
+    std::vector<std::pair<double, double>> predictions;  // When, and the hours left then.
+    while (soc > 0.0f and t_s < 3.0e8) {
+        hal_fake_wake(HAL_RESET_DEEP_SLEEP);
+        bool radio = report.wakes % 6 == 0;
+        battery.begin(radio);
+        bool upload = radio and battery.can_transmit();
+        report.gated = report.gated or (radio and not upload);
+        float active_ma = (upload ? BATTERY_RADIO_MA : BATTERY_CPU_MA) * (1 + cell.awake_bias);
+        float ocv_mv = true_ocv_mv(soc, cell.shift_mv, cell.tilt_mv);
+        hal_fake.adc = adc_pin(ocv_mv - active_ma * cell.resistance_mohm / 1000 + 6.0f * gaussian());
+        battery.active_ma = upload ? BATTERY_RADIO_MA : BATTERY_CPU_MA;
+        battery.measure(battery_mv(read_battery_adc()));
+        if (upload) {
+            float peak_mv = ocv_mv - BATTERY_PEAK_MA * cell.resistance_mohm / 1000;
+            report.peak_margin_mv = min(report.peak_margin_mv, peak_mv - BATTERY_CUTOFF_MV);
+        }
+        if (report.wakes > settled_at + 200) {
+            float error = fabsf(battery.current.soc - soc);
+            report.max_error = max(report.max_error, error);
+            error_sum += error;
+            errors++;
+        }
+        if (soc < 0.8f and soc > 0.2f and report.wakes > settled_at + 500) {
+            predictions.push_back(std::make_pair(t_s, (double) battery.runtime_h()));
+        }
+        unsigned long awake_ms = upload ? 2800 + next_random() % 1700 : 1900 + next_random() % 400;
+        if (report.wakes % 40 == 0) {
+            sleep_s = intervals[next_random() % 4];
+        }
+        uint32_t stretched_s = battery.stretch(sleep_s);
+        report.stretched = report.stretched or stretched_s > sleep_s;
+        battery.sleep(monitor_data{}, awake_ms, stretched_s);
+
+        soc -= (active_ma * awake_ms / 3600.0f + cell.sleep_ua * stretched_s / 3600.0f) / (BATTERY_CAPACITY_MAH * 1000.0f);
+        if (empty_at_s < 0 and soc <= battery.empty_soc()) {
+            empty_at_s = t_s;
+        }
+        t_s += awake_ms / 1000.0 + stretched_s;
+        report.wakes++;
+        if (cell.cold_boot and not cold_booted and soc < cell.start_soc / 2) {
+            memset(hal_fake.rtc, 0, sizeof(hal_fake.rtc));
+            cold_booted = true;
+            settled_at = report.wakes;
+        }
+        if (cell.recharged and not recharged and soc < 0.4f) {
+            soc = 1.0f;
+            recharged = true;
+            settled_at = report.wakes;
+            predictions.clear();
+        }
+    }
+    report.days = t_s / 86400;
+    report.mean_error = errors ? (float) (error_sum / errors) : 0.0f;
+    std::vector<double> runtime_errors;
+    for (const std::pair<double, double> &prediction : predictions) {
+        double actual_h = (empty_at_s - prediction.first) / 3600;
+        runtime_errors.push_back(fabs(prediction.second - actual_h) / actual_h);
+    }
+    std::sort(runtime_errors.begin(), runtime_errors.end());
+    report.runtime_error = runtime_errors.empty() ? 1.0 : runtime_errors[runtime_errors.size() / 2];
+    return report;
+}
+
+static void test_table() {
+    float last{-1};
+    for (int mv = 3000; mv <= 4300; mv += 5) {
+        float soc = monitor_battery::soc_at(mv);
+        if (not CHECK(soc >= last and soc >= 0 and soc <= 1)) {
+            break;
+        }
+        last = soc;
+    }
+    for (int i = 0; i <= 20; i++) {
+        CHECK(fabsf(monitor_battery::soc_at((int) model_ocv_mv[i]) - i / 20.0f) < 1e-4f);
+        CHECK(monitor_battery::slope_at(i / 20.0f) > 0);
+    }
+    // The divider's full scale is a full cell.
+    CHECK(battery_mv(757) >= 4190 and battery_mv(757) <= 4210);
+    hal_fake_reset();
+    hal_fake.adc = adc_pin(4200);
+    CHECK(abs(battery_mv(read_battery_adc()) - 4200) <= 6);
+}
+
+static void test_discharges() {
+    const discharge cells[] = {
+            {"model right", 1.00f, 0.0f, 100, 200, 0, 0, false, false, 0.04f},
+            {"awake +30%", 1.00f, 0.3f, 100, 200, 0, 0, false, false, 0.06f},
+            {"awake -30%", 1.00f, -0.3f, 100, 200, 0, 0, false, false, 0.06f},
+            {"sleep 150 uA", 1.00f, 0.0f, 150, 200, 0, 0, false, false, 0.06f},
+            {"cell R 120, curve +10 mV", 1.00f, 0.0f, 100, 120, 10, 20, false, false, 0.08f},
+            {"cold boot at half", 0.80f, 0.0f, 100, 200, 0, 0, true, false, 0.06f},
+            {"recharged at 40%", 0.70f, 0.0f, 100, 200, 0, 0, false, true, 0.06f},
+    };
+    for (int run = 0; run < 3; run++) {
+        for (const discharge &cell : cells) {
+            discharge_report report = replay(cell);
+            if (run == 0) {
+                printf("battery: %-24s %6ld wakes %4.0f days, state of charge off by %4.1f%% at most, %4.1f%% "
+                       "mean, hours left off by %4.1f%%\n", cell.name, report.wakes, report.days,
+                       report.max_error * 100, report.mean_error * 100, report.runtime_error * 100);
+            }
+            bool passed = CHECK(report.max_error < cell.tolerance);
+            // It never transmits where the peak would pull the cell below 3.3 V.
+            passed = CHECK(report.peak_margin_mv > 3300 - BATTERY_CUTOFF_MV) and passed;
+            // Near empty the radio is kept off and the sleep stretched.
+            passed = CHECK(report.gated and report.stretched) and passed;
+            passed = CHECK(report.runtime_error < 0.12) and passed;
+            if (not passed) {
+                printf("  %s, run %d\n", cell.name, run);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    test_table();
+    test_discharges();
+    return test_summary("battery");
+}
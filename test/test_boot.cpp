@@ -0,0 +1,83 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_test.hpp"
+#include "monitor_boot.hpp"
+
+/*
+ * The decision table of monitor_boot.hpp, row for row, with every reset,
+ * button and power combination spelled out.
+ */
+struct boot_row {
+    hal_reset reset;
+    bool button_a_held;
+    bool mains;
+    bool buttons;
+    bool display;
+};
+
+static const boot_row table[] = {
+        {HAL_RESET_DEEP_SLEEP, false, false, false, false},
+        {HAL_RESET_DEEP_SLEEP, true, false, true, true},
+        {HAL_RESET_POWER_ON, false, false, true, false},
+        {HAL_RESET_POWER_ON, true, false, true, true},
+        {HAL_RESET_CRASH, false, false, false, false},
+        {HAL_RESET_CRASH, true, false, true, true},
+        {HAL_RESET_DEEP_SLEEP, false, true, true, false},
+        {HAL_RESET_DEEP_SLEEP, true, true, true, true},
+        {HAL_RESET_POWER_ON, false, true, true, false},
+        {HAL_RESET_POWER_ON, true, true, true, true},
+        {HAL_RESET_CRASH, false, true, true, false},
+        {HAL_RESET_CRASH, true, true, true, true},
+};
+
+static void test_plan() {
+    for (const boot_row &row : table) {
+        monitor_boot boot = monitor_boot::plan(row.reset, row.button_a_held, row.mains);
+        if (not CHECK(boot.buttons == row.buttons and boot.display == row.display)) {
+            printf("  reset %d, button A %s, %s: buttons %d, display %d\n", row.reset,
+                   row.button_a_held ? "held" : "up", row.mains ? "mains" : "battery", boot.buttons, boot.display);
+        }
+    }
+}
+
+static void test_table_complete() {
+    // Each combination is in the table once.
+    const hal_reset resets[] = {HAL_RESET_POWER_ON, HAL_RESET_DEEP_SLEEP, HAL_RESET_CRASH};
+    for (hal_reset reset : resets) {
+        for (int held = 0; held < 2; held++) {
+            for (int mains = 0; mains < 2; mains++) {
+                int rows{0};
+                for (const boot_row &row : table) {
+                    rows += row.reset == reset and row.button_a_held == (held != 0) and row.mains == (mains != 0);
+                }
+                CHECK(rows == 1);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    test_plan();
+    test_table_complete();
+    return test_summary("boot");
+}
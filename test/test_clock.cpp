@@ -0,0 +1,156 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "ntp_time_utils.hpp"
+
+volatile bool system_time_set{false};
+
+#define SLEEP_S 300
+#define AWAKE_MS 1730
+#define WEEK_S (7 * 24 * 3600)
+
+/*
+ * A monitor waking every SLEEP_S for a week on a deep sleep timer that runs
+ * off by timer_ppm, against the true time of day.
+ */
+struct drift_simulation {
+    explicit drift_simulation(int32_t timer_ppm) : timer_ppm{timer_ppm} {}
+    int32_t timer_ppm;
+    bool sntp_answers{true};
+    uint64_t world_ms{1538395200000ull};
+    uint32_t wakes{0};
+    uint32_t syncs{0};
+    uint32_t longest_between_syncs_s{0};
+    int64_t worst_error_ms{0};         // Of the carried clock, at boot.
+    int64_t worst_late_error_ms{0};    // After the first day.
+    int32_t drift_ppm{0};              // What the clock learned.
+
+    void run(uint32_t seconds) {
+        uint64_t until_ms = world_ms + (uint64_t) seconds * 1000;
+        uint64_t last_sync_ms = world_ms;
+        uint64_t started_ms = world_ms;
+        while (world_ms < until_ms) {
+            hal_fake_wake(wakes++ == 0 ? HAL_RESET_POWER_ON : HAL_RESET_DEEP_SLEEP);
+            hal_fake.sntp_boot_epoch_ms = world_ms;
+            hal_fake.sntp_synced = sntp_answers;
+            system_time_set = false;
+            ntp_time_utils clock;
+            clock.begin();
+            if (system_time_set) {
+                int64_t error_ms = (int64_t) hal_fake.boot_epoch_ms - (int64_t) world_ms;
+                worst_error_ms = max(worst_error_ms, error_ms < 0 ? -error_ms : error_ms);
+                if (world_ms - started_ms > 86400000ull) {
+                    worst_late_error_ms = max(worst_late_error_ms, error_ms < 0 ? -error_ms : error_ms);
+                }
+            }
+            hal_delay(AWAKE_MS);
+            if (clock.set_time_of_day()) {
+                syncs++;
+                longest_between_syncs_s = max(longest_between_syncs_s, (uint32_t) ((world_ms - last_sync_ms) / 1000));
+                last_sync_ms = world_ms;
+            }
+            world_ms += hal_millis();
+            clock.sleep(SLEEP_S);
+            world_ms += (uint64_t) SLEEP_S * (1000000 + timer_ppm) / 1000;
+            drift_ppm = clock.clock.drift_ppm;
+        }
+    }
+};
+
+static void test_drift(int32_t timer_ppm) {
+    hal_fake_reset();
+    drift_simulation week{timer_ppm};
+    week.run(WEEK_S);
+    printf("clock: timer off by %+5d ppm: %u SNTP syncs in %u wakes, learned %+5d ppm, "
+           "carried clock off by at most %lld ms, %lld ms after the first day\n",
+           timer_ppm, week.syncs, week.wakes, week.drift_ppm,
+           (long long) week.worst_error_ms, (long long) week.worst_late_error_ms);
+    // A cold boot, then every NTP_RESYNC_HOURS.
+    CHECK(week.syncs >= WEEK_S / (NTP_RESYNC_HOURS * 3600));
+    CHECK(week.syncs <= WEEK_S / (NTP_RESYNC_HOURS * 3600) + 2);
+    CHECK(week.longest_between_syncs_s <= NTP_RESYNC_HOURS * 3600 + 2 * SLEEP_S);
+    // A timer within NTP_DRIFT_PPM never takes the carried clock past the
+    // bound. Any timer's drift is learned, after which the clock stays within
+    // a fraction of a second.
+    if (timer_ppm <= NTP_DRIFT_PPM and timer_ppm >= -NTP_DRIFT_PPM) {
+        CHECK(week.worst_error_ms <= NTP_MAX_DRIFT_S * 1000);
+    }
+    CHECK(week.worst_late_error_ms <= 100);
+    CHECK(week.drift_ppm > timer_ppm - 50 and week.drift_ppm < timer_ppm + 50);
+}
+
+static void test_sntp_down() {
+    // SNTP doesn't answer: each wake gives up after NTP_TIMEOUT_MS and keeps
+    // the carried clock.
+    hal_fake_reset();
+    drift_simulation day{1500};
+    day.run(SLEEP_S);
+    day.sntp_answers = false;
+    day.run(24 * 3600);
+    CHECK(day.syncs == 1);
+    CHECK(day.worst_error_ms < 24 * 3600 * 1500 / 1000 + 1000);
+
+    // A cold boot has no clock at all until SNTP answers.
+    hal_fake_wake(HAL_RESET_POWER_ON);
+    system_time_set = false;
+    ntp_time_utils clock;
+    clock.begin();
+    CHECK(not system_time_set);
+    CHECK(clock.needs_sync());
+    CHECK(not clock.set_time_of_day());
+    CHECK(hal_millis() >= NTP_TIMEOUT_MS);
+    CHECK(not system_time_set);
+}
+
+static void test_gateway_time() {
+    // A node takes the time of day from the gateway's ack, on the same policy.
+    hal_fake_reset();
+    system_time_set = false;
+    ntp_time_utils clock;
+    clock.begin();
+    CHECK(not clock.set_time(0));
+    CHECK(clock.set_time(1538395200));
+    CHECK(system_time_set);
+    CHECK(hal_time() == 1538395200);
+    CHECK(not clock.set_time(1538395300));  // Not due yet.
+    clock.sleep(SLEEP_S);
+
+    hal_fake_wake(HAL_RESET_DEEP_SLEEP);
+    system_time_set = false;
+    ntp_time_utils woken;
+    woken.begin();
+    CHECK(system_time_set);
+    CHECK(hal_time() == 1538395200 + SLEEP_S);
+    CHECK(not woken.needs_sync());
+}
+
+int main(int argc, char *argv[]) {
+    test_drift(0);
+    test_drift(1500);
+    test_drift(-4000);
+    test_drift(20000);
+    test_sntp_down();
+    test_gateway_time();
+    return test_summary("clock");
+}
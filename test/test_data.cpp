@@ -0,0 +1,133 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "monitor_test.hpp"
+#include "monitor_data.hpp"
+#include "monitor_text.hpp"
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t next_random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+// What the wire carries for a value in hundredths, read back.
+static int32_t round_trip(int32_t centi) {
+    char text[CENTI_TEXT_SIZE];
+    format_centi(centi, text, sizeof(text));
+    return (int32_t) llround(strtod(text, nullptr) * 100.0);
+}
+
+static void test_text_round_trip() {
+    // Every value of each field, or a spread of the current's, comes back
+    // from its text unchanged at AIO_FLOAT_PRECISION places.
+    static_assert(AIO_FLOAT_PRECISION >= 2, "The round trip is only lossless at 2 places or more.");
+    long lost{0};
+    for (int32_t cf = INT16_MIN; cf <= INT16_MAX; cf++) {
+        lost += round_trip(cf) != cf;
+    }
+    for (int32_t crh = 0; crh <= UINT16_MAX; crh++) {
+        lost += round_trip(crh) != crh;
+    }
+    for (int32_t cma = -1000000; cma <= 1000000; cma++) {
+        lost += round_trip(cma) != cma;
+    }
+    for (int i = 0; i < 1000000; i++) {
+        int32_t cma = (int32_t) next_random();
+        lost += round_trip(cma) != cma;
+    }
+    CHECK(round_trip(INT32_MAX) == INT32_MAX);
+    CHECK(round_trip(INT32_MIN) == INT32_MIN);
+    CHECK(lost == 0);
+}
+
+static void test_sensor_round_trip() {
+    // A reading rounded to hundredths reads back as the double it came from
+    // did with two places, away from the halves where a double is neither.
+    char fixed[CENTI_TEXT_SIZE];
+    char printed[32];
+    long differ{0};
+    for (int i = 0; i < 1000000; i++) {
+        double value = ((int64_t) (next_random() % 4000001) - 2000000) / 1000.0 + (next_random() % 1000) / 1e7;
+        double hundredths = value * 100.0;
+        if (fabs(hundredths - floor(hundredths) - 0.5) < 1e-6) {
+            continue;
+        }
+        format_centi((int32_t) lround(hundredths), fixed, sizeof(fixed));
+        snprintf(printed, sizeof(printed), "%.2f", value);
+        if (strcmp(printed, "-0.00") == 0) {
+            strcpy(printed, "0.00");
+        }
+        differ += strcmp(fixed, printed) != 0;
+    }
+    CHECK(differ == 0);
+
+    // A half is rounded away from zero, as dtostrf() did.
+    CHECK(strcmp(format_centi(-5, fixed, sizeof(fixed)), "-0.05") == 0);
+    CHECK(strcmp(format_centi(0, fixed, sizeof(fixed)), "0.00") == 0);
+}
+
+static void test_celsius() {
+    // The display's ℃ from the ℉ kept, rounded to the nearest hundredth.
+    long wrong{0};
+    for (int32_t cf = INT16_MIN; cf <= INT16_MAX; cf++) {
+        wrong += centi_f_to_c(cf) != (int32_t) lround((cf - 3200) * 5 / 9.0);
+    }
+    CHECK(wrong == 0);
+    CHECK(centi_f_to_c(3200) == 0);
+    CHECK(centi_f_to_c(21200) == 10000);
+    CHECK(centi_f_to_c(-4000) == -4000);
+}
+
+static void test_record() {
+    // The 16 byte record copies, as it does into RTC memory, bit for bit.
+    for (int i = 0; i < 100000; i++) {
+        monitor_data data{};
+        data.unix_epoch_time = (uint32_t) next_random();
+        data.current_cma = (int32_t) next_random();
+        data.temperature_cf = (int16_t) next_random();
+        data.humidity_crh = (uint16_t) next_random();
+        data.battery_vdc = (int8_t) next_random();
+        data.flags = (uint8_t) next_random();
+        uint8_t bytes[sizeof(monitor_data)];
+        memcpy(bytes, &data, sizeof(bytes));
+        monitor_data copy;
+        memcpy(&copy, bytes, sizeof(copy));
+        if (not CHECK(memcmp(&copy, &data, sizeof(data)) == 0 and copy.current_cma == data.current_cma
+                      and copy.temperature_cf == data.temperature_cf and copy.humidity_crh == data.humidity_crh)) {
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    test_text_round_trip();
+    test_sensor_round_trip();
+    test_celsius();
+    test_record();
+    return test_summary("data");
+}
@@ -0,0 +1,199 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "monitor_display_mode.hpp"
+#include "monitor_battery.hpp"
+
+monitor_profiler profiler;
+monitor_battery battery;
+
+// As main.cpp's display_step() sleeps between passes.
+#define DISPLAY_POLL_MS 20
+
+struct display_run {
+    monitor_display_mode mode;
+    monitor_display_mode::button_queue buttons;
+    monitor_sampler sampler;
+    monitor_data data{};
+    unsigned readings{0};
+    unsigned long last_reading_ms{0};
+    unsigned long longest_gap_ms{0};  // Between readings.
+    unsigned long off_ms{0};          // When it went back to DISPLAY_OFF.
+
+    // The battery loop of main.cpp for ms, or until display mode ends.
+    void run(unsigned long ms) {
+        unsigned long until_ms = hal_millis() + ms;
+        while ((long) (hal_millis() - until_ms) < 0) {
+            mode.handle(buttons);
+            if (mode.timed_out() or not mode.on) {
+                off_ms = hal_millis();
+                return;
+            }
+            if (mode.step(sampler, data)) {
+                if (readings++) {
+                    longest_gap_ms = max(longest_gap_ms, hal_millis() - last_reading_ms);
+                }
+                last_reading_ms = hal_millis();
+            }
+            mode.dirty = false;  // Drawn.
+            hal_delay(mode.state == DISPLAY_SAMPLING ? min(sampler.idle_ms(), (unsigned long) DISPLAY_POLL_MS)
+                                                     : DISPLAY_POLL_MS);
+        }
+    }
+
+    // A press as the interrupt queues it, with the contacts bouncing.
+    void press(uint8_t button, int bounces = 0) {
+        buttons.push(button);
+        for (int i = 0; i < bounces; i++) {
+            hal_delay(2);
+            buttons.push(button);
+        }
+    }
+};
+
+static void cold_boot() {
+    hal_fake_reset();
+    profiler = monitor_profiler{};
+    battery = monitor_battery{};
+    hal_fake.adc = 700;
+    hal_fake.current_ma = 12.34;
+    hal_fake.temperature_c = 20.0f;
+    hal_fake.humidity = 45.5f;
+}
+
+static void test_timeout() {
+    // Button A held at boot: the display waits, samples every
+    // DISPLAY_REFRESH_MS, and goes off DISPLAY_TIMEOUT_S after boot.
+    cold_boot();
+    display_run d;
+    d.mode.begin();
+    CHECK(d.mode.on and d.mode.state == DISPLAY_OFF);
+    d.mode.step(d.sampler, d.data);
+    CHECK(d.mode.state == DISPLAY_WAITING and d.mode.dirty);
+    d.run(DISPLAY_REFRESH_MS - DISPLAY_POLL_MS);
+    CHECK(d.mode.state == DISPLAY_WAITING);
+    d.run(2 * DISPLAY_POLL_MS);
+    CHECK(d.mode.state == DISPLAY_SAMPLING);
+    d.run(SAMPLER_DHT_WARMUP_MS + DISPLAY_POLL_MS);
+    CHECK(d.readings == 1 and d.mode.state == DISPLAY_WAITING);
+    CHECK(d.data.temperature_cf == 6800);
+
+    d.run(DISPLAY_TIMEOUT_S * 1000UL);
+    CHECK(not d.mode.on and d.mode.state == DISPLAY_OFF);
+    CHECK(d.off_ms >= DISPLAY_TIMEOUT_S * 1000UL and d.off_ms < DISPLAY_TIMEOUT_S * 1000UL + DISPLAY_POLL_MS);
+    // A reading every refresh, and the window of the DHT22 between them.
+    CHECK(d.readings >= DISPLAY_TIMEOUT_S * 1000UL / (DISPLAY_REFRESH_MS + SAMPLER_DHT_INTERVAL_MS));
+    CHECK(d.longest_gap_ms <= DISPLAY_REFRESH_MS + SAMPLER_DHT_INTERVAL_MS + 2 * DISPLAY_POLL_MS);
+    printf("display_mode: %u readings in %lu s, at most %lu ms apart\n", d.readings, d.off_ms / 1000,
+           d.longest_gap_ms);
+
+    // Off, it stays off.
+    CHECK(not d.mode.timed_out());
+    d.mode.handle(d.buttons);
+    CHECK(d.mode.state == DISPLAY_OFF);
+}
+
+static void test_presses_keep_it_on() {
+    // Each press starts the timeout again.
+    cold_boot();
+    display_run d;
+    d.mode.begin();
+    for (int i = 0; i < 4; i++) {
+        d.run(DISPLAY_TIMEOUT_S * 1000UL - 1000);
+        CHECK(d.mode.on);
+        d.press(BUTTON_C, 3);
+    }
+    unsigned long pressed_ms = hal_millis();
+    d.run(2 * DISPLAY_TIMEOUT_S * 1000UL);
+    CHECK(not d.mode.on and d.mode.state == DISPLAY_OFF);
+    CHECK(d.off_ms - pressed_ms >= DISPLAY_TIMEOUT_S * 1000UL);
+    CHECK(d.off_ms - pressed_ms < DISPLAY_TIMEOUT_S * 1000UL + DISPLAY_POLL_MS);
+    CHECK(not d.mode.celsius);  // Pressed four times.
+}
+
+static void test_buttons() {
+    cold_boot();
+    display_run d;
+
+    // Button A turns display mode on and the first step starts waiting.
+    d.press(BUTTON_A, 5);
+    d.mode.handle(d.buttons);
+    CHECK(d.mode.on and d.mode.dirty and d.mode.state == DISPLAY_OFF);
+    d.run(DISPLAY_REFRESH_MS + DISPLAY_POLL_MS);
+    CHECK(d.mode.state == DISPLAY_SAMPLING);
+
+    // B steps through the pages; the bounces are one press.
+    d.press(BUTTON_B, 4);
+    d.mode.handle(d.buttons);
+    CHECK(d.mode.page == 1 and d.mode.dirty);
+    d.mode.dirty = false;
+    hal_delay(BUTTON_DEBOUNCE_MS - 10);
+    d.press(BUTTON_B);  // Still bouncing.
+    d.mode.handle(d.buttons);
+    CHECK(d.mode.page == 1 and not d.mode.dirty);
+    hal_delay(BUTTON_DEBOUNCE_MS);
+    d.press(BUTTON_B);
+    d.mode.handle(d.buttons);
+    CHECK(d.mode.page == 2);
+    hal_delay(BUTTON_DEBOUNCE_MS);
+    d.press(BUTTON_B);
+    d.mode.handle(d.buttons);
+    CHECK(d.mode.page == 0);
+
+    // Another button right after isn't a bounce.
+    d.press(BUTTON_C);
+    d.mode.handle(d.buttons);
+    CHECK(d.mode.celsius);
+    CHECK(d.mode.state == DISPLAY_SAMPLING);  // The window carries on.
+
+    // Button A turns it off partway through a window.
+    hal_delay(BUTTON_DEBOUNCE_MS);
+    d.press(BUTTON_A, 2);
+    d.mode.handle(d.buttons);
+    CHECK(not d.mode.on and d.mode.state == DISPLAY_OFF);
+
+    // And on again, starting with a wait.
+    hal_delay(BUTTON_DEBOUNCE_MS);
+    d.press(BUTTON_A);
+    d.mode.handle(d.buttons);
+    CHECK(d.mode.on and d.mode.state == DISPLAY_OFF);
+    d.mode.step(d.sampler, d.data);
+    CHECK(d.mode.state == DISPLAY_WAITING);
+
+    // Presses between passes of loop() queue up to BUTTON_EVENTS.
+    for (int i = 0; i < BUTTON_EVENTS + 2; i++) {
+        d.press(i % 2 ? BUTTON_B : BUTTON_C);
+    }
+    CHECK(d.buttons.dropped == 2);
+    d.mode.handle(d.buttons);
+    CHECK(d.mode.page == BUTTON_EVENTS / 2 % 3);
+    CHECK(d.mode.celsius);  // Toggled BUTTON_EVENTS / 2 times.
+}
+
+int main(int argc, char *argv[]) {
+    test_timeout();
+    test_presses_keep_it_on();
+    test_buttons();
+    return test_summary("display_mode");
+}
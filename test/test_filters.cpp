@@ -0,0 +1,273 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "monitor_test.hpp"
+#include "monitor_filters.hpp"
+#include "monitor_sensors.hpp"
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t next_random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double uniform() {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double gaussian() {
+    return sqrt(-2.0 * log(1.0 - uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+/*
+ * The ADC's battery reading as the sampler sees it: a level with 2 counts of
+ * noise, whole counts, and a 25 count spike on one sample in ten from a WiFi
+ * transmission.
+ */
+static float adc_sample(double level) {
+    double sample = level + 2.0 * gaussian() + (next_random() % 10 == 0 ? 25.0 : 0.0);
+    return (float) lround(sample);
+}
+
+static void test_running_stats() {
+    // Against a two-pass mean and variance, for a reading far from zero where
+    // a sum of squares in float would have lost them.
+    for (int trial = 0; trial < 100; trial++) {
+        running_stats<float> stats;
+        std::vector<double> samples;
+        double level = 500.0 + uniform() * 500.0;
+        for (int i = 0; i < 30; i++) {
+            samples.push_back(level + 3.0 * gaussian());
+            stats.add((float) samples.back());
+        }
+        double mean{0};
+        for (double sample : samples) {
+            mean += sample;
+        }
+        mean /= samples.size();
+        double variance{0};
+        for (double sample : samples) {
+            variance += (sample - mean) * (sample - mean);
+        }
+        variance /= samples.size() - 1;
+        if (not CHECK(stats.count == 30 and fabs(stats.mean - mean) < 1e-3
+                      and fabs(stats.variance() - variance) < 1e-3 * variance)) {
+            break;
+        }
+    }
+
+    running_stats<float> stats;
+    CHECK(stats.variance() == 0.0f and not stats.within(1.0f, 1.96f));
+    stats.add(746.0f);
+    CHECK(stats.variance() == 0.0f and not stats.within(1.0f, 1.96f));
+    // 746 and 754 in turn: a variance of 16, so a 95% interval of ±1 wants 62
+    // samples or so.
+    for (int i = 1; i < 60; i++) {
+        stats.add(i % 2 ? 754.0f : 746.0f);
+    }
+    CHECK(fabs(stats.mean - 750.0f) < 1e-4);
+    CHECK(not stats.within(1.0f, 1.96f));
+    for (int i = 60; i < 64; i++) {
+        stats.add(i % 2 ? 754.0f : 746.0f);
+    }
+    CHECK(stats.within(1.0f, 1.96f));
+}
+
+static void test_median_filter() {
+    // The median of the last N, against a sort of them, and of as many as
+    // there are until N have come.
+    median_filter<int, 5> median;
+    std::vector<int> samples;
+    long wrong{0};
+    for (int i = 0; i < 100000; i++) {
+        int sample = (int) (next_random() % 100);
+        samples.push_back(sample);
+        std::vector<int> last(samples.end() - std::min<size_t>(samples.size(), 5), samples.end());
+        std::sort(last.begin(), last.end());
+        wrong += median.add(sample) != last[last.size() / 2];
+    }
+    CHECK(wrong == 0);
+
+    // A median of 3 takes out a single spike, but not two in a row.
+    median_filter<float, 3> spikes;
+    CHECK(spikes.add(750.0f) == 750.0f);
+    CHECK(spikes.add(775.0f) == 775.0f);
+    CHECK(spikes.add(750.0f) == 750.0f);
+    CHECK(spikes.add(775.0f) == 775.0f);
+    CHECK(spikes.add(775.0f) == 775.0f);
+}
+
+static void test_ema_filter() {
+    ema_filter<float> ema(0.25f);
+    CHECK(ema.add(100.0f) == 100.0f);
+    CHECK(ema.add(200.0f) == 125.0f);
+    CHECK(ema.add(125.0f) == 125.0f);
+    // A step is followed within 1% after 17 samples: 0.75^17 < 0.01.
+    for (int i = 0; i < 16; i++) {
+        ema.add(225.0f);
+    }
+    CHECK(ema.value < 224.0f);
+    CHECK(ema.add(225.0f) > 224.0f);
+}
+
+static void test_outlier_filter() {
+    // A steady reading on a step of its resolution: nothing is rejected even
+    // after a run of one value, where the variance alone would be 0.
+    outlier_filter<float> steady(3.0f, 5, SAMPLER_BATTERY_QUANTUM);
+    for (int i = 0; i < 6; i++) {
+        steady.add(748.0f);
+    }
+    for (int i = 0; i < 24; i++) {
+        steady.add(749.0f);
+    }
+    CHECK(steady.rejected == 0 and steady.stats.count == 30);
+
+    // A spike is taken until there are min_count samples to judge it by, and
+    // left out after.
+    outlier_filter<float> spiked(3.0f, 5, SAMPLER_BATTERY_QUANTUM);
+    CHECK(spiked.add(750.0f));
+    CHECK(spiked.add(775.0f));
+    outlier_filter<float> judged(3.0f, 5, SAMPLER_BATTERY_QUANTUM);
+    for (int i = 0; i < 5; i++) {
+        judged.add(i % 2 ? 751.0f : 749.0f);
+    }
+    CHECK(not judged.add(775.0f));
+    CHECK(not judged.add(725.0f));
+    CHECK(judged.add(752.0f));
+    CHECK(judged.rejected == 2 and judged.stats.count == 6);
+}
+
+/*
+ * Sampling windows of the simulated ADC, each at a level of its own, through
+ * converging_mean as the battery sensor takes them and through the fixed mean
+ * of 30 samples it took before.
+ */
+struct window_results {
+    double samples;
+    double error;
+    double fixed_error;
+    long out_of_bounds;
+};
+
+static window_results sample_windows(int windows) {
+    window_results results{0, 0, 0, 0};
+    for (int window = 0; window < windows; window++) {
+        double level = 566.0 + uniform() * (757.0 - 566.0);
+        converging_mean<float> mean{SAMPLER_BATTERY_TOLERANCE, SAMPLER_BATTERY_QUANTUM,
+                                    SAMPLER_READINGS_MIN, SAMPLER_READINGS_LEN};
+        float fixed{0};
+        for (int i = 0; i < SAMPLER_READINGS_LEN; i++) {
+            float sample = adc_sample(level);
+            fixed += sample;
+            if (not mean.done()) {
+                mean.add(sample);
+            }
+        }
+        fixed /= SAMPLER_READINGS_LEN;
+        results.out_of_bounds += mean.samples < SAMPLER_READINGS_MIN or mean.samples > SAMPLER_READINGS_LEN;
+        results.samples += mean.samples;
+        results.error += fabs(mean.mean() - level);
+        results.fixed_error += fabs(fixed - level);
+    }
+    results.samples /= windows;
+    results.error /= windows;
+    results.fixed_error /= windows;
+    return results;
+}
+
+static void test_converging_mean() {
+    // A reading that holds still is done at the least samples.
+    converging_mean<float> still{SAMPLER_BATTERY_TOLERANCE, SAMPLER_BATTERY_QUANTUM,
+                                 SAMPLER_READINGS_MIN, SAMPLER_READINGS_LEN};
+    for (int i = 0; i < SAMPLER_READINGS_MIN - 1; i++) {
+        still.add(700.0f);
+        CHECK(not still.done());
+    }
+    still.add(700.0f);
+    CHECK(still.done() and still.mean() == 700.0f);
+
+    // One too noisy to converge stops at the most.
+    converging_mean<float> noisy{SAMPLER_BATTERY_TOLERANCE, SAMPLER_BATTERY_QUANTUM,
+                                 SAMPLER_READINGS_MIN, SAMPLER_READINGS_LEN};
+    int taken{0};
+    while (not noisy.done()) {
+        noisy.add(700.0f + (float) (next_random() % 41) - 20.0f);
+        taken++;
+    }
+    CHECK(taken == SAMPLER_READINGS_LEN);
+
+    // On the simulated ADC it takes fewer samples than the fixed mean and
+    // leaves the spikes out of the mean, which the fixed mean is biased by.
+    window_results results = sample_windows(100000);
+    printf("converging_mean: %.1f samples, %.2f counts mean absolute error; fixed mean of %d: %.2f counts\n",
+           results.samples, results.error, SAMPLER_READINGS_LEN, results.fixed_error);
+    CHECK(results.out_of_bounds == 0);
+    CHECK(results.samples < 0.6 * SAMPLER_READINGS_LEN);
+    CHECK(results.error < 0.6 * results.fixed_error);
+    CHECK(results.fixed_error > 2.0);
+}
+
+static void bench() {
+    const long count = 4000000;
+    std::vector<float> samples(4096);
+    for (float &sample : samples) {
+        sample = adc_sample(700.0);
+    }
+    volatile float sink;
+    running_stats<float> stats;
+    double stats_ns = test_ns_per(count, [&](long i) { stats.add(samples[i & 4095]); });
+    sink = stats.mean;
+    median_filter<float, 3> median;
+    double median_ns = test_ns_per(count, [&](long i) { sink = median.add(samples[i & 4095]); });
+    outlier_filter<float> outliers(3.0f, 5, SAMPLER_BATTERY_QUANTUM);
+    double outlier_ns = test_ns_per(count, [&](long i) { outliers.add(samples[i & 4095]); });
+    sink = outliers.stats.mean;
+    converging_mean<float> mean{SAMPLER_BATTERY_TOLERANCE, SAMPLER_BATTERY_QUANTUM, 0, UINT16_MAX};
+    double mean_ns = test_ns_per(count, [&](long i) {
+        if (mean.samples == UINT16_MAX) {
+            mean = converging_mean<float>{SAMPLER_BATTERY_TOLERANCE, SAMPLER_BATTERY_QUANTUM, 0, UINT16_MAX};
+        }
+        mean.add(samples[i & 4095]);
+        sink = mean.done();
+    });
+    printf("ns per sample: running_stats %.1f, median of 3 %.1f, outlier_filter %.1f, converging_mean and done() %.1f\n",
+           stats_ns, median_ns, outlier_ns, mean_ns);
+    (void) sink;
+}
+
+int main(int argc, char *argv[]) {
+    test_running_stats();
+    test_median_filter();
+    test_ema_filter();
+    test_outlier_filter();
+    test_converging_mean();
+    if (test_bench(argc, argv)) {
+        bench();
+    }
+    return test_summary("filters");
+}
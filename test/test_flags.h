@@ -0,0 +1,36 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+/*
+ * The build flags of the host tests, the README's example ones. The tests
+ * include this ahead of every source, the way PlatformIO passes build_flags.
+ */
+#define TIMEZONE_RULE "EST5EDT,M3.2.0,M11.1.0"
+#define WIFI_SSID "WiFi_AP_SSID"
+#define WIFI_PASS "WiFi Password"
+#define WIFI_MAC_ADDR {0xE0, 0x9A, 0x4C, 0xB5, 0x5F, 0xC7}
+#define AIO_USERNAME "adafruit_user_name"
+#define AIO_KEY "dafruit_user_key"
+#define AIO_SERVER "io.adafruit.com"
+#define AIO_SERVERPORT 8883
+#define AIO_FLOAT_PRECISION 2
+#define AIO_GROUP_KEY "monitor-one"
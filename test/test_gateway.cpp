@@ -0,0 +1,150 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "monitor_gateway.hpp"
+#include "monitor_profiler.hpp"
+#include "monitor_session.hpp"
+#include "ntp_time_utils.hpp"
+
+ntp_time_utils time_util;
+monitor_profiler profiler;
+monitor_session session;
+volatile bool system_time_set{true};
+
+#define TAKEN_AT 1538395200  // 2018-10-01T12:00:00Z
+
+static const uint8_t node_mac[6]{0xE0, 0x9A, 0x4C, 0xB5, 0x5F, 0xC7};
+
+static monitor_node_frame frame(uint32_t sequence, uint32_t epoch) {
+    monitor_node_frame frame{NODE_FRAME_VERSION, NODE_FRAME_READING, {}, sequence, {}, {}};
+    memcpy(frame.node, node_mac, sizeof(frame.node));
+    frame.reading.unix_epoch_time = epoch;
+    frame.reading.battery_vdc = 80;
+    frame.reading.temperature_cf = (int16_t) (7000 + sequence % 100);
+    frame.reading.flags = MONITOR_DATA_TEMPERATURE_VALID;
+    node_tag(&frame, offsetof(monitor_node_frame, tag), frame.tag);
+    return frame;
+}
+
+// The frame sent over UDP, where peers have no MAC address. Whether it was acked.
+static bool deliver(monitor_gateway &gateway, const monitor_node_frame &sent) {
+    hal_fake_packet packet{};
+    packet.data.assign((const uint8_t *) &sent, (const uint8_t *) &sent + sizeof(sent));
+    hal_fake.link_inbox.push_back(packet);
+    hal_fake.link_sent.clear();
+    gateway.poll();
+    if (hal_fake.link_sent.size() != 1 or hal_fake.link_sent[0].data.size() != sizeof(monitor_node_ack)) {
+        return false;
+    }
+    monitor_node_ack ack;
+    memcpy(&ack, hal_fake.link_sent[0].data.data(), sizeof(ack));
+    return ack.type == NODE_FRAME_ACK and ack.sequence == sent.sequence
+           and node_tag_valid(&ack, offsetof(monitor_node_ack, tag), ack.tag);
+}
+
+static void start(monitor_gateway &gateway) {
+    hal_fake_reset();
+    hal_fake.boot_epoch_ms = (uint64_t) TAKEN_AT * 1000;
+    hal_fake.sntp_synced = true;
+    hal_fake.sntp_boot_epoch_ms = hal_fake.boot_epoch_ms;
+    hal_fake.wifi_connected = true;
+    session = monitor_session{};
+    gateway.begin();
+    gateway.poll();  // Connects the session and starts the link.
+    CHECK(gateway.link_up);
+}
+
+static void test_replay() {
+    static monitor_gateway gateway;
+    start(gateway);
+
+    // Readings in order are each published once and acked.
+    CHECK(deliver(gateway, frame(1, TAKEN_AT)));
+    CHECK(deliver(gateway, frame(2, TAKEN_AT + 300)));
+    CHECK(deliver(gateway, frame(3, TAKEN_AT + 600)));
+    CHECK(hal_fake.published.size() == 3 and gateway.stats.published == 3);
+
+    // The last again: its ack was lost, so it is acked but not published.
+    CHECK(deliver(gateway, frame(3, TAKEN_AT + 600)));
+    CHECK(hal_fake.published.size() == 3 and gateway.stats.duplicates == 1);
+
+    // Older frames, recorded off the link and sent again, are dropped.
+    CHECK(not deliver(gateway, frame(1, TAKEN_AT)));
+    CHECK(not deliver(gateway, frame(2, TAKEN_AT + 300)));
+    CHECK(hal_fake.published.size() == 3 and gateway.stats.replayed == 2);
+
+    // A later sequence number taken earlier is no newer either.
+    CHECK(not deliver(gateway, frame(4, TAKEN_AT + 300)));
+    CHECK(hal_fake.published.size() == 3 and gateway.stats.replayed == 3);
+
+    // A frame with a forged tag is invalid.
+    monitor_node_frame forged = frame(5, TAKEN_AT + 900);
+    forged.tag[0] ^= 1;
+    CHECK(not deliver(gateway, forged));
+    CHECK(gateway.stats.invalid == 1);
+    CHECK(deliver(gateway, frame(5, TAKEN_AT + 900)));
+    CHECK(hal_fake.published.size() == 4);
+}
+
+static void test_wraparound() {
+    // The sequence number wraps; readings of a node without a clock are
+    // told apart by it alone.
+    static monitor_gateway gateway;
+    start(gateway);
+    CHECK(deliver(gateway, frame(UINT32_MAX - 1, 0)));
+    CHECK(deliver(gateway, frame(UINT32_MAX, 0)));
+    CHECK(deliver(gateway, frame(0, 0)));
+    CHECK(deliver(gateway, frame(1, 0)));
+    CHECK(hal_fake.published.size() == 4);
+
+    // One from before the wrap is older, and only acked for the time of day.
+    CHECK(deliver(gateway, frame(UINT32_MAX, 0)));
+    CHECK(hal_fake.published.size() == 4 and gateway.stats.replayed == 1);
+}
+
+static void test_node_restart() {
+    // A node that lost its RTC memory counts from 1 again. Its readings are
+    // later, so they are published, and its old frames are still replays.
+    static monitor_gateway gateway;
+    start(gateway);
+    CHECK(deliver(gateway, frame(500, TAKEN_AT)));
+    CHECK(deliver(gateway, frame(1, TAKEN_AT + 300)));
+    CHECK(hal_fake.published.size() == 2);
+    CHECK(not deliver(gateway, frame(500, TAKEN_AT)));
+    CHECK(hal_fake.published.size() == 2 and gateway.stats.replayed == 1);
+
+    // Its clock lost too: readings at time 0 are acked, for the time of day,
+    // but not published. The readings after that have the time again.
+    CHECK(deliver(gateway, frame(1, 0)));
+    CHECK(hal_fake.published.size() == 2 and gateway.stats.replayed == 2);
+    CHECK(deliver(gateway, frame(2, TAKEN_AT + 600)));
+    CHECK(hal_fake.published.size() == 3);
+}
+
+int main(int argc, char *argv[]) {
+    test_replay();
+    test_wraparound();
+    test_node_restart();
+    return test_summary("gateway");
+}
@@ -0,0 +1,264 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "monitor_oled_frame.hpp"
+
+/*
+ * The SSD1306 end of the bus, in horizontal addressing mode: just the column
+ * and page address commands and the data that fills the window they set.
+ */
+struct fake_ssd1306 {
+    uint8_t memory[OLED_FRAME_SIZE];
+    uint8_t window[4]{0, OLED_WIDTH - 1, 0, OLED_PAGES - 1};
+    uint8_t column{0};
+    uint8_t page{0};
+    uint8_t command{0};
+    size_t arguments{0};
+    size_t data_bytes{0};
+    bool bad{false};
+
+    void command_byte(uint8_t byte) {
+        if (arguments) {
+            size_t at = command == OLED_COLUMN_ADDRESS ? 2 - arguments : 4 - arguments;
+            window[at] = byte;
+            if (--arguments == 0) {
+                column = window[0];
+                page = window[2];
+            }
+            return;
+        }
+        command = byte;
+        arguments = byte == OLED_COLUMN_ADDRESS or byte == OLED_PAGE_ADDRESS ? 2 : 0;
+        bad |= arguments == 0;  // flush() sends nothing else.
+    }
+
+    void data_byte(uint8_t byte) {
+        memory[page * OLED_WIDTH + column] = byte;
+        data_bytes++;
+        if (column++ == window[1]) {
+            column = window[0];
+            page = page == window[3] ? window[2] : page + 1;
+        }
+    }
+
+    // A write that wasn't acked is lost; the panel keeps what it had.
+    void receive(const hal_fake_i2c_write &write) {
+        if (not write.acked) {
+            return;
+        }
+        bad |= write.address != OLED_I2C_ADDRESS or write.data.size() > OLED_I2C_BUFFER;
+        for (size_t i = 0; i < write.data.size(); i++) {
+            if (write.data[i] == OLED_CONTROL_COMMAND and i + 1 < write.data.size()) {
+                command_byte(write.data[++i]);
+            } else if (write.data[i] == OLED_CONTROL_DATA) {
+                while (++i < write.data.size()) {
+                    data_byte(write.data[i]);
+                }
+            } else {
+                bad = true;
+            }
+        }
+    }
+};
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint32_t next_random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t) rng;
+}
+
+// The bytes on the bus for n data bytes in a window: the address byte of each
+// write, the six window commands and a data control byte per write.
+static size_t bus_bytes(size_t n) {
+    size_t first = OLED_I2C_BUFFER - 13;
+    size_t writes = n <= first ? 1 : 1 + (n - first + OLED_I2C_BUFFER - 2) / (OLED_I2C_BUFFER - 1);
+    return writes + 12 + writes + n;
+}
+
+struct oled_bus {
+    monitor_oled_frame frame;
+    fake_ssd1306 panel;
+    uint8_t pixels[OLED_FRAME_SIZE]{};
+
+    // Flush and hand what went out to the panel. Returns the bytes sent.
+    size_t flush() {
+        hal_fake.i2c.clear();
+        panel.data_bytes = 0;
+        size_t sent = frame.flush(pixels);
+        size_t on_bus{0};
+        for (const hal_fake_i2c_write &write : hal_fake.i2c) {
+            panel.receive(write);
+            on_bus += 1 + write.data.size();
+        }
+        CHECK(sent == on_bus);
+        CHECK(not panel.bad);
+        CHECK(memcmp(panel.memory, pixels, sizeof(pixels)) == 0);
+        return sent;
+    }
+};
+
+static void test_full_frame() {
+    hal_fake_reset();
+    oled_bus b;
+    memset(b.panel.memory, 0xA5, sizeof(b.panel.memory));  // Power-up garbage.
+    for (size_t i = 0; i < sizeof(b.pixels); i++) {
+        b.pixels[i] = (uint8_t) i;
+    }
+    CHECK(b.flush() == bus_bytes(OLED_FRAME_SIZE));
+    CHECK(bus_bytes(OLED_FRAME_SIZE) == 534);
+    CHECK(hal_fake.i2c.size() == 5);
+    CHECK(b.panel.data_bytes == OLED_FRAME_SIZE);
+    const uint8_t window[] = {0x80, 0x21, 0x80, 0, 0x80, 127, 0x80, 0x22, 0x80, 0, 0x80, 3, 0x40};
+    CHECK(memcmp(hal_fake.i2c[0].data.data(), window, sizeof(window)) == 0);
+
+    // Nothing changed: nothing sent.
+    CHECK(b.flush() == 0);
+    CHECK(hal_fake.i2c.empty());
+
+    // After invalidate(), the panel may hold anything.
+    b.frame.invalidate();
+    memset(b.panel.memory, 0, sizeof(b.panel.memory));
+    CHECK(b.flush() == 534);
+}
+
+static void test_known_diffs() {
+    hal_fake_reset();
+    oled_bus b;
+    b.flush();
+
+    // One byte: a window of one column of one page, in one write.
+    b.pixels[2 * OLED_WIDTH + 40] = 0xFF;
+    CHECK(b.flush() == 15);
+    const uint8_t one[] = {0x80, 0x21, 0x80, 40, 0x80, 40, 0x80, 0x22, 0x80, 2, 0x80, 2, 0x40, 0xFF};
+    CHECK(hal_fake.i2c.size() == 1);
+    CHECK(hal_fake.i2c[0].data.size() == sizeof(one));
+    CHECK(memcmp(hal_fake.i2c[0].data.data(), one, sizeof(one)) == 0);
+
+    // A line of text on the second page, columns 10 to 69.
+    for (int column = 10; column < 70; column++) {
+        b.pixels[OLED_WIDTH + column] = (uint8_t) column;
+    }
+    CHECK(b.flush() == bus_bytes(60));
+    CHECK(b.panel.window[0] == 10 and b.panel.window[1] == 69);
+    CHECK(b.panel.window[2] == 1 and b.panel.window[3] == 1);
+
+    // Two far corners bound the whole frame.
+    b.pixels[0] ^= 1;
+    b.pixels[OLED_FRAME_SIZE - 1] ^= 1;
+    CHECK(b.flush() == bus_bytes(OLED_FRAME_SIZE));
+
+    // Two bytes in one column, a page apart: three pages of one column.
+    b.pixels[0 * OLED_WIDTH + 100] ^= 0x0F;
+    b.pixels[2 * OLED_WIDTH + 100] ^= 0xF0;
+    CHECK(b.flush() == bus_bytes(3));
+    CHECK(b.panel.window[0] == 100 and b.panel.window[1] == 100);
+    CHECK(b.panel.window[2] == 0 and b.panel.window[3] == 2);
+    CHECK(b.frame.bytes_sent == 534 + 15 + bus_bytes(60) + 534 + bus_bytes(3));
+}
+
+static void test_nack() {
+    // A write the panel didn't ack: the next flush sends the whole frame,
+    // even with nothing changed since.
+    hal_fake_reset();
+    oled_bus b;
+    b.flush();
+    b.pixels[2 * OLED_WIDTH + 40] = 0xFF;
+    hal_fake.i2c_acks_left = 0;
+    hal_fake.i2c.clear();
+    CHECK(b.frame.flush(b.pixels) == 15);
+    CHECK(not b.frame.shown_valid and b.frame.nacks == 1);
+    hal_fake.i2c_acks_left = -1;
+    CHECK(b.flush() == 534);
+    CHECK(b.flush() == 0);
+
+    // Partway through a full frame: the writes after the NACK aren't sent.
+    b.frame.invalidate();
+    memset(b.panel.memory, 0, sizeof(b.panel.memory));
+    b.pixels[0] = 0x01;
+    hal_fake.i2c_acks_left = 2;
+    hal_fake.i2c.clear();
+    CHECK(b.frame.flush(b.pixels) == 3 * OLED_I2C_BUFFER + 3);
+    CHECK(hal_fake.i2c.size() == 3 and not hal_fake.i2c[2].acked);
+    for (const hal_fake_i2c_write &write : hal_fake.i2c) {
+        b.panel.receive(write);
+    }
+    CHECK(memcmp(b.panel.memory, b.pixels, sizeof(b.pixels)) != 0);
+    hal_fake.i2c_acks_left = -1;
+    CHECK(b.flush() == 534);
+    CHECK(b.frame.nacks == 2 and b.frame.writes == 5 + 1 + 5 + 3 + 5);
+}
+
+static void test_random_diffs() {
+    // Changes anywhere: the panel always ends up with the frame, and the
+    // bytes sent are those of the rectangle that bounds what differs.
+    hal_fake_reset();
+    oled_bus b;
+    b.flush();
+    for (int i = 0; i < 20000; i++) {
+        uint8_t p0 = next_random() % OLED_PAGES, p1 = next_random() % OLED_PAGES;
+        uint8_t c0 = next_random() % OLED_WIDTH, c1 = next_random() % OLED_WIDTH;
+        uint8_t pages[2] = {min(p0, p1), max(p0, p1)};
+        uint8_t columns[2] = {min(c0, c1), max(c0, c1)};
+        b.pixels[pages[0] * OLED_WIDTH + columns[0]] ^= 1 + next_random() % 255;
+        b.pixels[pages[1] * OLED_WIDTH + columns[1]] ^= 1 + next_random() % 255;
+        for (int n = next_random() % 8; n > 0; n--) {
+            uint8_t page = pages[0] + next_random() % (pages[1] - pages[0] + 1);
+            uint8_t column = columns[0] + next_random() % (columns[1] - columns[0] + 1);
+            b.pixels[page * OLED_WIDTH + column] = (uint8_t) next_random();
+        }
+        // The bounds of what differs from the panel.
+        uint8_t bounds[4] = {OLED_PAGES, 0, OLED_WIDTH, 0};
+        for (uint8_t page = 0; page < OLED_PAGES; page++) {
+            for (uint8_t column = 0; column < OLED_WIDTH; column++) {
+                if (b.pixels[page * OLED_WIDTH + column] != b.panel.memory[page * OLED_WIDTH + column]) {
+                    bounds[0] = min(bounds[0], page);
+                    bounds[1] = max(bounds[1], page);
+                    bounds[2] = min(bounds[2], column);
+                    bounds[3] = max(bounds[3], column);
+                }
+            }
+        }
+        size_t area = bounds[0] == OLED_PAGES ? 0 : (size_t) (bounds[1] - bounds[0] + 1) * (bounds[3] - bounds[2] + 1);
+        if (not CHECK(b.flush() == (area ? bus_bytes(area) : 0))) {
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    test_full_frame();
+    test_known_diffs();
+    test_nack();
+    test_random_diffs();
+    if (test_bench(argc, argv)) {
+        // The time the bus takes at 400 kHz, 9 bits a byte: a clock tick and a full frame.
+        printf("oled_frame: a one character change %zu bytes, %.2f ms; a full frame %zu bytes, %.2f ms\n",
+               bus_bytes(6), bus_bytes(6) * 9 / 400.0, bus_bytes(OLED_FRAME_SIZE),
+               bus_bytes(OLED_FRAME_SIZE) * 9 / 400.0);
+    }
+    return test_summary("oled_frame");
+}
@@ -0,0 +1,185 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include <map>
+#include <string>
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "monitor_publish.hpp"
+#include "monitor_profiler.hpp"
+#include "monitor_session.hpp"
+#include "ntp_time_utils.hpp"
+
+ntp_time_utils time_util;
+monitor_profiler profiler;
+monitor_session session;
+volatile bool system_time_set{false};
+
+#define CREATED_AT 1538395200  // 2018-10-01T12:00:00Z
+
+// One group message: its created_at and each feed's value, as text.
+struct group_message {
+    std::string created_at;
+    std::map<std::string, std::string> feeds;
+    bool valid;
+};
+
+static group_message parse(const std::string &json) {
+    group_message message{};
+    const std::string head = "{\"created_at\":\"";
+    const std::string middle = "\",\"feeds\":{";
+    size_t middle_at = json.find(middle);
+    if (json.compare(0, head.size(), head) != 0 or middle_at == std::string::npos
+        or json.compare(json.size() - 2, 2, "}}") != 0) {
+        return message;
+    }
+    message.created_at = json.substr(head.size(), middle_at - head.size());
+    std::string feeds = json.substr(middle_at + middle.size(), json.size() - 2 - middle_at - middle.size());
+    message.valid = true;
+    size_t at = 0;
+    while (at < feeds.size()) {
+        size_t comma = feeds.find(',', at);
+        std::string feed = feeds.substr(at, comma == std::string::npos ? std::string::npos : comma - at);
+        size_t colon = feed.find("\":");
+        if (feed[0] != '"' or colon == std::string::npos) {
+            message.valid = false;
+            return message;
+        }
+        message.feeds[feed.substr(1, colon - 1)] = feed.substr(colon + 2);
+        at = comma == std::string::npos ? feeds.size() : comma + 1;
+    }
+    return message;
+}
+
+static monitor_data reading(int32_t current_cma, int16_t temperature_cf, uint16_t humidity_crh, int8_t battery) {
+    monitor_data data{};
+    data.current_cma = current_cma;
+    data.temperature_cf = temperature_cf;
+    data.humidity_crh = humidity_crh;
+    data.battery_vdc = battery;
+    data.flags = MONITOR_DATA_CURRENT_VALID | MONITOR_DATA_HUMIDITY_VALID | MONITOR_DATA_TEMPERATURE_VALID;
+    return data;
+}
+
+/*
+ * Every feed of the reading arrives once, in messages that each fit the
+ * Adafruit_MQTT buffer and carry the reading's time.
+ */
+static std::map<std::string, std::string> published_feeds() {
+    std::map<std::string, std::string> feeds;
+    for (const hal_fake_publish &p : hal_fake.published) {
+        CHECK(p.topic == GROUP);
+        CHECK(1 + 2 + 2 + p.topic.size() + p.payload.size() <= MAXBUFFERSIZE);
+        group_message message = parse(p.payload);
+        CHECK(message.valid);
+        CHECK(message.created_at == "2018-10-01T12:00:00Z");
+        for (const auto &feed : message.feeds) {
+            CHECK(feeds.count(feed.first) == 0);
+            feeds[feed.first] = feed.second;
+        }
+    }
+    return feeds;
+}
+
+static void test_all_feeds() {
+    hal_fake_reset();
+    std::bitset<5> status = publish_group(reading(1234, 6800, 4550, 87), CREATED_AT);
+    CHECK(status.all());
+    CHECK(not hal_fake.published.empty());
+    std::map<std::string, std::string> feeds = published_feeds();
+    CHECK(feeds.size() == 4);
+    CHECK(feeds[AIO_FEED_BATTERY_VDC] == "87");
+    CHECK(feeds[AIO_FEED_CURRENT_MA] == "12.34");
+    CHECK(feeds[AIO_FEED_HUMIDITY_RH] == "45.50");
+    CHECK(feeds[AIO_FEED_TEMPERATURE_F] == "68.00");
+    // The old unix-epoch-eastern feed is the message's created_at now.
+    CHECK(feeds.count(AIO_FEED_UNIX_EPOCH_TIME) == 0);
+    printf("publish: %zu group messages for one reading at MAXBUFFERSIZE %d\n", hal_fake.published.size(), MAXBUFFERSIZE);
+}
+
+static void test_widest_values() {
+    hal_fake_reset();
+    CHECK(publish_group(reading(INT32_MIN + 1, INT16_MIN, UINT16_MAX, -128), CREATED_AT).all());
+    std::map<std::string, std::string> feeds = published_feeds();
+    CHECK(feeds.size() == 4);
+    CHECK(feeds[AIO_FEED_CURRENT_MA] == "-21474836.47");
+    CHECK(feeds[AIO_FEED_TEMPERATURE_F] == "-327.68");
+    CHECK(feeds[AIO_FEED_HUMIDITY_RH] == "655.35");
+    CHECK(feeds[AIO_FEED_BATTERY_VDC] == "-128");
+}
+
+static void test_failed_readings() {
+    // Readings that failed are left out; the battery is always there.
+    hal_fake_reset();
+    monitor_data data = reading(1234, 6800, 4550, 87);
+    data.flags = MONITOR_DATA_HUMIDITY_VALID;
+    CHECK(publish_group(data, CREATED_AT).all());
+    CHECK(hal_fake.published.size() == 1);
+    std::map<std::string, std::string> feeds = published_feeds();
+    CHECK(feeds.size() == 2);
+    CHECK(feeds.count(AIO_FEED_BATTERY_VDC) == 1);
+    CHECK(feeds.count(AIO_FEED_HUMIDITY_RH) == 1);
+}
+
+static void test_failed_publish() {
+    // All or nothing: a reading that went in part is published again, whole.
+    for (long left = 0; left < 2; left++) {
+        hal_fake_reset();
+        hal_fake.publishes_left = left;
+        CHECK(publish_group(reading(1234, 6800, 4550, 87), CREATED_AT).none());
+    }
+    CHECK(session.failures == 2);
+}
+
+static void test_per_feed() {
+    // AIO_PUBLISH_PER_FEED: a message per feed, the time included.
+    hal_fake_reset();
+    CHECK(publish_feeds(reading(1234, 6800, 4550, 87), CREATED_AT).all());
+    CHECK(hal_fake.published.size() == 5);
+    std::map<std::string, std::string> feeds;
+    for (const hal_fake_publish &p : hal_fake.published) {
+        feeds[p.topic] = p.payload;
+    }
+    CHECK(feeds[BATTERY_VDC] == "87");
+    CHECK(feeds[CURRENT_MA] == "12.34");
+    CHECK(feeds[HUMIDITY_RH] == "45.50");
+    CHECK(feeds[TEMPERATURE_F] == "68.00");
+    CHECK(feeds[UNIX_EPOCH_TIME] == "Mon Oct  1 08:00:00 2018 EDT");
+}
+
+int main(int argc, char *argv[]) {
+    test_all_feeds();
+    test_widest_values();
+    test_failed_readings();
+    test_failed_publish();
+    test_per_feed();
+    if (test_bench(argc, argv)) {
+        hal_fake_reset();
+        monitor_data data = reading(1234, 6800, 4550, 87);
+        double ns = test_ns_per(1000000, [&](long i) {
+            hal_fake.published.clear();
+            publish_group(data, CREATED_AT + i);
+        });
+        printf("publish: publish_group %.0f ns per reading, with the fake publish\n", ns);
+    }
+    return test_summary("publish");
+}
@@ -0,0 +1,131 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "monitor_radio.hpp"
+
+// How long each wake is awake before it sleeps.
+#define AWAKE_MS 2000
+
+// A wake for the given reason, which keeps RTC memory, AWAKE_MS along.
+static monitor_radio wake(hal_reset reason) {
+    hal_fake_wake(reason);
+    monitor_radio radio;
+    radio.begin(hal_reset_reason());
+    hal_fake_advance_ms(AWAKE_MS);
+    return radio;
+}
+
+static void test_states() {
+    hal_fake_reset();
+    // Power on: the radio is on and calibrated.
+    monitor_radio radio = wake(HAL_RESET_POWER_ON);
+    CHECK(radio.on() and radio.booted == HAL_RF_CAL and radio.current.cal_age_s == 0 and not radio.display);
+
+    // A next wake that only samples boots with the radio disabled.
+    CHECK(radio.sleep(false, 300) == HAL_RF_DISABLED);
+    radio = wake(HAL_RESET_DEEP_SLEEP);
+    CHECK(not radio.on() and radio.booted == HAL_RF_DISABLED and radio.current.cal_age_s == 302);
+
+    // One that transmits, with a fresh calibration, boots without calibrating.
+    CHECK(radio.sleep(true, 600) == HAL_RF_NO_CAL);
+    radio = wake(HAL_RESET_DEEP_SLEEP);
+    CHECK(radio.on() and radio.booted == HAL_RF_NO_CAL and radio.current.cal_age_s == 904);
+
+    // Once the age passes the interval, the next wake that transmits calibrates.
+    CHECK(radio.sleep(false, RADIO_CAL_INTERVAL_S) == HAL_RF_DISABLED);
+    radio = wake(HAL_RESET_DEEP_SLEEP);
+    CHECK(radio.sleep(true, 300) == HAL_RF_CAL);
+    radio = wake(HAL_RESET_DEEP_SLEEP);
+    CHECK(radio.booted == HAL_RF_CAL and radio.current.cal_age_s == 0);
+
+    // A hop from a wake with the radio off comes back with it on, in display
+    // mode for that one wake.
+    CHECK(radio.sleep(false, 300) == HAL_RF_DISABLED);
+    radio = wake(HAL_RESET_DEEP_SLEEP);
+    CHECK(not radio.on());
+    CHECK(radio.hop(true) == HAL_RF_NO_CAL);
+    radio = wake(HAL_RESET_DEEP_SLEEP);
+    CHECK(radio.on() and radio.display);
+    CHECK(radio.sleep(false, 300) == HAL_RF_DISABLED);
+    radio = wake(HAL_RESET_DEEP_SLEEP);
+    CHECK(not radio.display);
+
+    // A hop past the interval calibrates.
+    uint32_t cal_age_s = radio.current.cal_age_s;
+    radio.current.cal_age_s = RADIO_CAL_INTERVAL_S;
+    CHECK(radio.hop(false) == HAL_RF_CAL);
+    radio.current.cal_age_s = cal_age_s;
+
+    // A crash boots with the radio on and keeps the age; a power on resets it.
+    CHECK(radio.sleep(false, 300) == HAL_RF_DISABLED);
+    radio = wake(HAL_RESET_CRASH);
+    CHECK(radio.on() and radio.booted == HAL_RF_CAL and radio.current.cal_age_s == cal_age_s + 302);
+    radio = wake(HAL_RESET_POWER_ON);
+    CHECK(radio.on() and radio.current.cal_age_s == 0);
+
+    // Spoiled RTC memory after deep sleep: the radio is taken to be on.
+    CHECK(radio.sleep(false, 300) == HAL_RF_DISABLED);
+    hal_fake.rtc[RTC_RADIO_OFFSET * 4 + 5] ^= 0xFF;
+    radio = wake(HAL_RESET_DEEP_SLEEP);
+    CHECK(radio.on() and radio.current.cal_age_s == 0);
+}
+
+static void test_next() {
+    // The table in monitor_radio.hpp, either side of the interval.
+    CHECK(monitor_radio::next(0, false) == HAL_RF_DISABLED);
+    CHECK(monitor_radio::next(RADIO_CAL_INTERVAL_S, false) == HAL_RF_DISABLED);
+    CHECK(monitor_radio::next(RADIO_CAL_INTERVAL_S - 1, true) == HAL_RF_NO_CAL);
+    CHECK(monitor_radio::next(RADIO_CAL_INTERVAL_S, true) == HAL_RF_CAL);
+}
+
+static void test_week() {
+    // A week of wakes every 300 s, one in six transmitting: only those have
+    // the radio, and it calibrates on the first of them past the interval.
+    hal_fake_reset();
+    monitor_radio radio = wake(HAL_RESET_POWER_ON);
+    long on_without_transmit{0};
+    long off_to_transmit{0};
+    long stale{0};
+    long calibrations{0};
+    for (int i = 1; i <= 7 * 288; i++) {
+        bool transmits = i % 6 == 0;
+        radio.sleep(transmits, 300);
+        radio = wake(HAL_RESET_DEEP_SLEEP);
+        on_without_transmit += radio.on() and not transmits;
+        off_to_transmit += transmits and not radio.on();
+        calibrations += radio.booted == HAL_RF_CAL;
+        stale += radio.on() and radio.current.cal_age_s > RADIO_CAL_INTERVAL_S + 6 * 302;
+    }
+    CHECK(on_without_transmit == 0);
+    CHECK(off_to_transmit == 0);
+    CHECK(stale == 0);
+    CHECK(calibrations >= 7 * 86400 / (RADIO_CAL_INTERVAL_S + 6 * 302) and calibrations <= 7 * 86400 / RADIO_CAL_INTERVAL_S + 1);
+}
+
+int main(int argc, char *argv[]) {
+    test_states();
+    test_next();
+    test_week();
+    return test_summary("radio");
+}
@@ -0,0 +1,202 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include <vector>
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "monitor_ring_buffer.hpp"
+
+// A record told apart by its time.
+static monitor_data record_at(uint32_t t) {
+    monitor_data record{};
+    record.unix_epoch_time = t;
+    record.current_cma = (int32_t) t * 3;
+    return record;
+}
+
+// The next wake: a fresh queue with only the RTC memory to go on.
+static monitor_ring_buffer wake() {
+    monitor_ring_buffer ring;
+    ring.begin();
+    return ring;
+}
+
+// Pops everything, oldest first, checking peek() against the batch peek().
+static std::vector<uint32_t> drain(monitor_ring_buffer &ring) {
+    monitor_data batch[RING_BUFFER_CAPACITY];
+    size_t batched = ring.peek(batch, RING_BUFFER_CAPACITY);
+    CHECK(batched == ring.pending());
+    std::vector<uint32_t> times;
+    monitor_data record;
+    while (ring.peek(record)) {
+        CHECK(times.size() < batched and batch[times.size()].unix_epoch_time == record.unix_epoch_time);
+        times.push_back(record.unix_epoch_time);
+        ring.pop();
+    }
+    CHECK(ring.pending() == 0);
+    return times;
+}
+
+static bool ascending_from(const std::vector<uint32_t> &times, uint32_t first) {
+    for (size_t i = 0; i < times.size(); i++) {
+        if (times[i] != first + i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_cold_boot() {
+    hal_fake_reset();
+    monitor_ring_buffer ring = wake();
+    CHECK(not ring.state_valid);
+    CHECK(ring.pending() == 0);
+    CHECK(ring.upload_due());  // The state was lost; find out where we are.
+    monitor_data record;
+    CHECK(not ring.peek(record));
+}
+
+static void test_wraparound() {
+    // Each wake pushes one reading and nothing is uploaded: the queue keeps
+    // the newest RING_BUFFER_CAPACITY, across many laps of the slots.
+    hal_fake_reset();
+    for (uint32_t t = 1; t <= 5 * RING_BUFFER_CAPACITY + 3; t++) {
+        monitor_ring_buffer ring = wake();
+        ring.push(record_at(t));
+        ring.sleep(false);
+        CHECK(ring.pending() == min<size_t>(t, RING_BUFFER_CAPACITY));
+    }
+    monitor_ring_buffer ring = wake();
+    std::vector<uint32_t> times = drain(ring);
+    CHECK(times.size() == RING_BUFFER_CAPACITY);
+    CHECK(ascending_from(times, 5 * RING_BUFFER_CAPACITY + 4 - RING_BUFFER_CAPACITY));
+
+    // The acknowledgements survive deep sleep, and the sequence carries on.
+    monitor_ring_buffer next = wake();
+    CHECK(next.pending() == 0);
+    next.push(record_at(1000));
+    CHECK(drain(next) == std::vector<uint32_t>{1000});
+}
+
+static void test_partial_upload() {
+    // An upload cut short leaves the rest queued, in order.
+    hal_fake_reset();
+    monitor_ring_buffer ring = wake();
+    for (uint32_t t = 1; t <= 6; t++) {
+        ring.push(record_at(t));
+    }
+    ring.pop();
+    ring.pop();
+    ring.sleep(true);
+    monitor_ring_buffer next = wake();
+    CHECK(next.pending() == 4);
+    next.push(record_at(7));
+    CHECK(ascending_from(drain(next), 3));
+}
+
+static void test_upload_cadence() {
+    hal_fake_reset();
+    int uploads{0};
+    for (int w = 0; w < 10 * UPLOAD_EVERY_N_WAKES; w++) {
+        monitor_ring_buffer ring = wake();
+        bool due = ring.upload_due();
+        ring.push(record_at(w + 1));
+        if (due) {
+            uploads++;
+            drain(ring);
+        }
+        ring.sleep(due);
+        CHECK(ring.pending() < RING_BUFFER_CAPACITY);
+    }
+    // The first wake finds no state, then every UPLOAD_EVERY_N_WAKES.
+    CHECK(uploads == 1 + (10 * UPLOAD_EVERY_N_WAKES - 1) / UPLOAD_EVERY_N_WAKES);
+}
+
+static void test_power_loss_in_slot() {
+    // Power lost after any byte of a slot write: that slot, which held the
+    // oldest record, is lost. Nothing else is, and nothing made up appears.
+    const size_t slot_bytes = sizeof(rtc_region<monitor_ring_buffer::slot>);
+    for (size_t torn = 1; torn < slot_bytes; torn++) {
+        hal_fake_reset();
+        monitor_ring_buffer ring = wake();
+        for (uint32_t t = 1; t <= RING_BUFFER_CAPACITY; t++) {
+            ring.push(record_at(t));
+        }
+        ring.sleep(false);
+        uint8_t before[sizeof(hal_fake.rtc)];
+        memcpy(before, hal_fake.rtc, sizeof(before));
+        ring.push(record_at(RING_BUFFER_CAPACITY + 1));
+        size_t at = (RTC_RING_SLOTS_OFFSET + (RING_BUFFER_CAPACITY + 1) % RING_BUFFER_CAPACITY * RTC_RING_SLOT_BLOCKS) * 4;
+        memcpy(hal_fake.rtc + at + torn, before + at + torn, slot_bytes - torn);
+
+        // Once the bytes still to come equal the old ones the write is done.
+        monitor_ring_buffer::slot written;
+        bool complete = rtc_load(at / 4, written) and written.seq == RING_BUFFER_CAPACITY + 1;
+
+        monitor_ring_buffer next = wake();
+        CHECK(next.state_valid);
+        std::vector<uint32_t> times = drain(next);
+        CHECK(times.size() == (complete ? RING_BUFFER_CAPACITY : RING_BUFFER_CAPACITY - 1));
+        CHECK(ascending_from(times, 2));
+    }
+}
+
+static void test_power_loss_in_header() {
+    // The header spoiled: the surviving records are sent again, not lost.
+    hal_fake_reset();
+    monitor_ring_buffer ring = wake();
+    for (uint32_t t = 1; t <= 5; t++) {
+        ring.push(record_at(t));
+    }
+    ring.pop();
+    ring.pop();
+    ring.sleep(true);
+    hal_fake.rtc[RTC_RING_HEADER_OFFSET * 4 + 5] ^= 0x40;
+    monitor_ring_buffer next = wake();
+    CHECK(not next.state_valid);
+    CHECK(next.upload_due());
+    CHECK(ascending_from(drain(next), 1));
+    CHECK(next.state_valid);
+}
+
+static void test_slot_out_of_place() {
+    // A slot whose sequence number doesn't belong there, say from a build
+    // with another RING_BUFFER_CAPACITY, counts as empty.
+    hal_fake_reset();
+    monitor_ring_buffer ring = wake();
+    ring.push(record_at(1));
+    monitor_ring_buffer::slot stray{RING_BUFFER_CAPACITY + 2, record_at(99)};
+    rtc_save(RTC_RING_SLOTS_OFFSET + 3 * RTC_RING_SLOT_BLOCKS, stray);
+    monitor_ring_buffer next = wake();
+    CHECK(drain(next) == std::vector<uint32_t>{1});
+}
+
+int main(int argc, char *argv[]) {
+    test_cold_boot();
+    test_wraparound();
+    test_partial_upload();
+    test_upload_cadence();
+    test_power_loss_in_slot();
+    test_power_loss_in_header();
+    test_slot_out_of_place();
+    return test_summary("ring_buffer");
+}
@@ -0,0 +1,159 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "monitor_sampler.hpp"
+#include "monitor_battery.hpp"
+
+monitor_profiler profiler;
+monitor_battery battery;
+
+// How long the fakes take, roughly as on a Huzzah: a scan and DHCP, and the
+// two blocking 30 sample loops the sampler replaced.
+#define WIFI_ASSOCIATE_MS 2800
+#define BLOCKING_LOOP_MS (SAMPLER_READINGS_LEN * 33)
+
+static void cold_boot() {
+    hal_fake_reset();
+    profiler = monitor_profiler{};
+    battery = monitor_battery{};
+    hal_fake.adc = 700;
+    hal_fake.current_ma = 12.34;
+    hal_fake.temperature_c = 20.0f;
+    hal_fake.humidity = 45.5f;
+}
+
+/*
+ * A wake: the window runs while WiFi associates. The ms until both are done,
+ * and the longest any one poll took.
+ */
+static unsigned long sampled_wake(monitor_sampler &sampler, monitor_data &data, unsigned long &longest_poll_ms) {
+    unsigned long started_ms = hal_millis();
+    sampler.begin();
+    longest_poll_ms = 0;
+    while (not sampler.complete or hal_millis() - started_ms < WIFI_ASSOCIATE_MS) {
+        unsigned long poll_ms = hal_millis();
+        sampler.poll(data);
+        longest_poll_ms = max(longest_poll_ms, hal_millis() - poll_ms);
+        unsigned long wifi_ms = WIFI_ASSOCIATE_MS - min(hal_millis() - started_ms, (unsigned long) WIFI_ASSOCIATE_MS);
+        hal_delay(max(1ul, min(sampler.idle_ms(), wifi_ms)));
+    }
+    return hal_millis() - started_ms;
+}
+
+static void test_steady_readings() {
+    cold_boot();
+    monitor_sampler sampler;
+    monitor_data data{};
+    unsigned long longest_poll_ms;
+    unsigned long wake_ms = sampled_wake(sampler, data, longest_poll_ms);
+
+    CHECK(sampler.complete);
+    CHECK(longest_poll_ms == 0);  // The fake sensors convert at once.
+    // Steady readings converge at the minimum, in the same window.
+    CHECK(sampler.sensors.sensor.mean.samples == SAMPLER_READINGS_MIN);
+    CHECK(sampler.sensors.rest.sensor.mean.samples == SAMPLER_READINGS_MIN);
+    CHECK(data.current_cma == 1234);
+    CHECK(data.temperature_cf == 6800);
+    CHECK(data.humidity_crh == 4550);
+    CHECK(data.flags == (MONITOR_DATA_CURRENT_VALID | MONITOR_DATA_HUMIDITY_VALID | MONITOR_DATA_TEMPERATURE_VALID));
+    CHECK(data.battery_vdc == battery.percent());
+    CHECK(battery.known);
+
+    // Each peripheral is begun once, and the INA219 left powered down.
+    CHECK(hal_fake.ina219_begins == 1);
+    CHECK(hal_fake.dht_begins == 1);
+    CHECK(not hal_fake.ina219_on);
+
+    // The window hides behind the association. Sequentially the two loops
+    // and the DHT22 came first.
+    unsigned long blocking_ms = 2 * BLOCKING_LOOP_MS + SAMPLER_DHT_WARMUP_MS + WIFI_ASSOCIATE_MS;
+    CHECK(wake_ms == WIFI_ASSOCIATE_MS);
+    printf("sampler: wake of %lu ms, %lu ms with the blocking loops\n", wake_ms, blocking_ms);
+}
+
+static void test_noisy_readings() {
+    cold_boot();
+    monitor_sampler sampler;
+    monitor_data data{};
+    sampler.begin();
+    unsigned n{0};
+    while (not sampler.poll(data)) {
+        hal_fake.adc = 700 + (n % 2 ? 9 : -9);
+        hal_fake.current_ma = 12.0 + (n++ % 3) * 2.0;
+        hal_delay(sampler.idle_ms());
+    }
+    // Noise takes more samples, but never more than the cap.
+    CHECK(sampler.sensors.sensor.mean.samples > SAMPLER_READINGS_MIN);
+    CHECK(sampler.sensors.sensor.mean.samples <= SAMPLER_READINGS_LEN);
+    CHECK(sampler.sensors.rest.sensor.mean.samples > SAMPLER_READINGS_MIN);
+    CHECK(sampler.sensors.rest.sensor.mean.samples <= SAMPLER_READINGS_LEN);
+    CHECK(data.current_cma > 1200 and data.current_cma < 1600);
+}
+
+static void test_failed_readings() {
+    cold_boot();
+    hal_fake.current_ma = NAN;
+    hal_fake.temperature_c = NAN;
+    monitor_sampler sampler;
+    monitor_data data{};
+    data.flags = MONITOR_DATA_CURRENT_VALID | MONITOR_DATA_TEMPERATURE_VALID;
+    sampler.begin();
+    sampler.wait(data);
+    CHECK(not (data.flags & MONITOR_DATA_CURRENT_VALID));
+    CHECK(not (data.flags & MONITOR_DATA_TEMPERATURE_VALID));
+    CHECK(data.flags & MONITOR_DATA_HUMIDITY_VALID);
+}
+
+static void test_windows_close_together() {
+    cold_boot();
+    monitor_sampler sampler;
+    monitor_data data{};
+    sampler.begin();
+    sampler.wait(data);
+    unsigned long first_ms = hal_millis();
+    CHECK(first_ms >= SAMPLER_DHT_WARMUP_MS);
+
+    // Too soon for the DHT22: the window keeps its last reading and waits
+    // only for the others.
+    hal_fake.temperature_c = 30.0f;
+    sampler.begin();
+    sampler.wait(data);
+    CHECK(hal_millis() - first_ms < SAMPLER_DHT_INTERVAL_MS);
+    CHECK(data.temperature_cf == 6800);
+    CHECK(hal_fake.dht_begins == 1);
+    CHECK(hal_fake.ina219_begins == 1);
+
+    hal_delay(SAMPLER_DHT_INTERVAL_MS);
+    sampler.begin();
+    sampler.wait(data);
+    CHECK(data.temperature_cf == 8600);
+}
+
+int main(int argc, char *argv[]) {
+    test_steady_readings();
+    test_noisy_readings();
+    test_failed_readings();
+    test_windows_close_together();
+    return test_summary("sampler");
+}
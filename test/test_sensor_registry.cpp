@@ -0,0 +1,227 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "monitor_sensor_registry.hpp"
+
+monitor_profiler profiler;
+
+#define FAKE_READINGS 30
+
+/*
+ * Drivers with a conversion every Period ms that takes Latency ms, like the
+ * ADC, the INA219 and a sensor in forced mode such as a BME280. Each reading
+ * adds its count to the current, so the data shows which were taken.
+ */
+template <unsigned long Period, unsigned long Latency, profile_sensor Profile>
+struct fake_sensor {
+    static const profile_sensor profile = Profile;
+    void begin(unsigned long now_ms) {
+        next_ms = now_ms;
+        converting = false;
+        reads = 0;
+    }
+    bool start_conversion(unsigned long now_ms) {
+        if (converting) {
+            return true;
+        }
+        if ((long) (now_ms - next_ms) < 0) {
+            return false;
+        }
+        converting = true;
+        ready_ms = now_ms + Latency;
+        next_ms = now_ms + Period;
+        return true;
+    }
+    bool poll_ready(unsigned long now_ms) { return (long) (now_ms - ready_ms) >= 0; }
+    void read(monitor_data &data) {
+        converting = false;
+        data.current_cma += ++reads;
+    }
+    bool done() const { return reads >= FAKE_READINGS; }
+    unsigned long wait_ms(unsigned long now_ms) const {
+        long wait = (long) ((converting ? ready_ms : next_ms) - now_ms);
+        return wait > 0 ? (unsigned long) wait : 0;
+    }
+    void finish(monitor_data &data) { finished++; }
+    bool converting{false};
+    unsigned long next_ms{0};
+    unsigned long ready_ms{0};
+    int reads{0};
+    int finished{0};
+};
+
+typedef fake_sensor<33, 0, PROFILE_ADC> fake_adc;
+typedef fake_sensor<33, 1, PROFILE_INA219> fake_ina219;
+typedef fake_sensor<70, 8, PROFILE_DHT> fake_bme280;
+
+/*
+ * The same drivers behind a virtual interface, the usual alternative to the
+ * registry, for the benchmark.
+ */
+struct virtual_sensor {
+    virtual ~virtual_sensor() {}
+    virtual void begin(unsigned long now_ms) = 0;
+    virtual bool start_conversion(unsigned long now_ms) = 0;
+    virtual bool poll_ready(unsigned long now_ms) = 0;
+    virtual void read(monitor_data &data) = 0;
+    virtual bool done() const = 0;
+    virtual profile_sensor profile() const = 0;
+};
+
+template <typename Sensor>
+struct boxed_sensor : virtual_sensor {
+    void begin(unsigned long now_ms) override { sensor.begin(now_ms); }
+    bool start_conversion(unsigned long now_ms) override { return sensor.start_conversion(now_ms); }
+    bool poll_ready(unsigned long now_ms) override { return sensor.poll_ready(now_ms); }
+    void read(monitor_data &data) override { sensor.read(data); }
+    bool done() const override { return sensor.done(); }
+    profile_sensor profile() const override { return Sensor::profile; }
+    Sensor sensor;
+};
+
+static void test_window() {
+    // A window polled every ms: each driver is read as it is ready until it
+    // is done, and the registry is done when the slowest is.
+    hal_fake_reset();
+    hal_fake.micros_step = 3;
+    profiler = monitor_profiler{};
+    sensor_registry<fake_adc, fake_ina219, fake_bme280> registry;
+    CHECK(registry.count == 3);
+    monitor_data data{};
+    registry.begin(0);
+    CHECK(registry.wait_ms(0) == 0);
+    unsigned long now_ms{0};
+    unsigned long adc_done_ms{0};
+    while (not registry.done() and now_ms < 5000) {
+        registry.poll(now_ms, data);
+        if (registry.sensor.done() and adc_done_ms == 0) {
+            adc_done_ms = now_ms;
+        }
+        now_ms++;
+    }
+    CHECK(registry.sensor.reads == FAKE_READINGS);
+    CHECK(registry.rest.sensor.reads == FAKE_READINGS);
+    CHECK(registry.rest.rest.sensor.reads == FAKE_READINGS);
+    CHECK(data.current_cma == 3 * FAKE_READINGS * (FAKE_READINGS + 1) / 2);
+    CHECK(adc_done_ms == (FAKE_READINGS - 1) * 33);
+    CHECK(now_ms - 1 == (FAKE_READINGS - 1) * 70 + 8);
+    // Polls past done read nothing more.
+    registry.poll(now_ms, data);
+    CHECK(data.current_cma == 3 * FAKE_READINGS * (FAKE_READINGS + 1) / 2);
+
+    // Every read was profiled, under its own sensor, 3 µs for each.
+    CHECK(profiler.current.sensor_us[PROFILE_ADC] == 3 * FAKE_READINGS);
+    CHECK(profiler.current.sensor_us[PROFILE_INA219] == 3 * FAKE_READINGS);
+    CHECK(profiler.current.sensor_us[PROFILE_DHT] == 3 * FAKE_READINGS);
+
+    registry.finish(data);
+    CHECK(registry.sensor.finished == 1 and registry.rest.sensor.finished == 1
+          and registry.rest.rest.sensor.finished == 1);
+}
+
+static void test_wait() {
+    // The wait is the shortest of the drivers not yet done, and forever when
+    // there are none.
+    sensor_registry<> none;
+    CHECK(none.done() and none.wait_ms(0) == ULONG_MAX);
+
+    hal_fake_reset();
+    sensor_registry<fake_adc, fake_bme280> registry;
+    monitor_data data{};
+    registry.begin(0);
+    registry.poll(0, data);
+    CHECK(registry.sensor.reads == 1);
+    CHECK(registry.wait_ms(0) == 8);
+    CHECK(registry.wait_ms(5) == 3);
+    registry.poll(8, data);
+    CHECK(registry.wait_ms(8) == 25);
+    registry.sensor.reads = FAKE_READINGS;
+    CHECK(registry.wait_ms(8) == 62);
+    registry.rest.sensor.reads = FAKE_READINGS;
+    CHECK(registry.done() and registry.wait_ms(8) == ULONG_MAX);
+}
+
+/*
+ * Polls windows of 2500 ms, every ms until every driver is done, and the ns
+ * per poll.
+ */
+template <typename Poll>
+static double time_polls(Poll poll, const char *name) {
+    monitor_data data{};
+    unsigned long polls{0};
+    auto started = std::chrono::steady_clock::now();
+    for (int window = 0; window < 20000; window++) {
+        for (unsigned long now_ms = 0; now_ms < 2500; now_ms++) {
+            polls++;
+            if (poll(now_ms, data, now_ms == 0)) {
+                break;
+            }
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / polls;
+    printf("sensor_registry: %-8s %.1f ns per poll over %lu polls (%d)\n", name, ns, polls, data.current_cma);
+    return ns;
+}
+
+static void bench() {
+    hal_fake_reset();
+    hal_fake.micros_step = 3;
+    sensor_registry<fake_adc, fake_ina219, fake_bme280> registry;
+    time_polls([&](unsigned long now_ms, monitor_data &data, bool first) {
+        if (first) {
+            registry.begin(now_ms);
+        }
+        registry.poll(now_ms, data);
+        return registry.done();
+    }, "registry");
+
+    boxed_sensor<fake_adc> adc;
+    boxed_sensor<fake_ina219> ina219;
+    boxed_sensor<fake_bme280> bme280;
+    virtual_sensor *sensors[] = {&adc, &ina219, &bme280};
+    time_polls([&](unsigned long now_ms, monitor_data &data, bool first) {
+        bool done{true};
+        for (virtual_sensor *sensor : sensors) {
+            if (first) {
+                sensor->begin(now_ms);
+            }
+            if (not sensor->done() and sensor->start_conversion(now_ms) and sensor->poll_ready(now_ms)) {
+                unsigned long started_us = hal_micros();
+                sensor->read(data);
+                profiler.sensor(sensor->profile(), started_us);
+            }
+            done = done and sensor->done();
+        }
+        return done;
+    }, "virtual");
+}
+
+int main(int argc, char *argv[]) {
+    test_window();
+    test_wait();
+    if (test_bench(argc, argv)) {
+        bench();
+    }
+    return test_summary("sensor_registry");
+}
@@ -0,0 +1,217 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include "monitor_test.hpp"
+#include "monitor_text.hpp"
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t next_random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+// 2101-01-01, past the last year the firmware could see.
+static const uint64_t until = 4133980800ULL;
+
+/*
+ * The snprintf() formatter print_fixed() replaced: a value in hundredths
+ * rounded half away from zero to places, which past 2 are zeros.
+ */
+static char *snprintf_centi(int32_t centi, uint8_t places, char *buffer, size_t buffer_len) {
+    const int rounded_places = places < 2 ? places : 2;
+    const uint32_t scale = rounded_places == 2 ? 1 : (rounded_places == 1 ? 10 : 100);
+    const uint32_t divisor = 100 / scale;
+    uint32_t magnitude = centi < 0 ? 0 - (uint32_t) centi : (uint32_t) centi;
+    magnitude = (magnitude + scale / 2) / scale;
+    const char *sign = (centi < 0 and magnitude != 0) ? "-" : "";
+    if (rounded_places == 0) {
+        snprintf(buffer, buffer_len, "%s%lu", sign, (unsigned long) magnitude);
+    } else {
+        snprintf(buffer, buffer_len, "%s%lu.%0*lu%.*s", sign, (unsigned long) (magnitude / divisor),
+                 rounded_places, (unsigned long) (magnitude % divisor), places - rounded_places, "000000");
+    }
+    return buffer;
+}
+
+static void test_fixed() {
+    const int32_t edges[] = {0, 1, -1, 4, 5, -5, 49, 50, -50, 99, 100, -100, 995, -995,
+                             INT32_MAX, INT32_MIN, INT32_MIN + 1};
+    char expected[32];
+    char printed[32];
+    for (uint8_t places = 0; places <= 6; places++) {
+        long wrong{0};
+        for (int i = 0; i < 300000; i++) {
+            int32_t centi = i < 17 ? edges[i]
+                                   : (i % 2 ? (int32_t) next_random() : (int32_t) (next_random() % 20001) - 10000);
+            snprintf_centi(centi, places, expected, sizeof(expected));
+            monitor_text(printed, sizeof(printed)).print_fixed(centi, 2, places);
+            if (strcmp(expected, printed) != 0 and wrong++ == 0) {
+                printf("  %d at %u places: \"%s\", not \"%s\"\n", centi, places, printed, expected);
+            }
+        }
+        CHECK(wrong == 0);
+    }
+    monitor_text(printed, sizeof(printed)).print_int(INT32_MIN).print(' ').print_uint(7, 3).print(' ').print_int(-42);
+    CHECK(strcmp(printed, "-2147483648 007 -42") == 0);
+}
+
+static void test_time() {
+    // The timestamps, against strftime() of gmtime_r().
+    char expected[64];
+    char printed[64];
+    long wrong{0};
+    for (int i = 0; i < 500000; i++) {
+        time_t t = i ? (time_t) (next_random() % until) : 0;
+        struct tm utc;
+        gmtime_r(&t, &utc);
+        strftime(expected, sizeof(expected), "%Y-%m-%dT%H:%M:%SZ", &utc);
+        monitor_text(printed, sizeof(printed)).print_iso8601(t);
+        wrong += strcmp(expected, printed) != 0;
+        strftime(expected, sizeof(expected), "%c EST", &utc);
+        monitor_text(printed, sizeof(printed)).print_time(t, "EST");
+        wrong += strcmp(expected, printed) != 0;
+    }
+    CHECK(wrong == 0);
+    monitor_text(printed, sizeof(printed)).print_time(1538380800, "EDT");
+    CHECK(strcmp(printed, "Mon Oct  1 08:00:00 2018 EDT") == 0);
+}
+
+static void test_base64() {
+    char printed[16];
+    const uint8_t bytes[] = {'M', 'a', 'n'};
+    monitor_text(printed, sizeof(printed)).print_base64(bytes, 3);
+    CHECK(strcmp(printed, "TWFu") == 0);
+    monitor_text(printed, sizeof(printed)).print_base64(bytes, 2);
+    CHECK(strcmp(printed, "TWE=") == 0);
+    monitor_text(printed, sizeof(printed)).print_base64(bytes, 1);
+    CHECK(strcmp(printed, "TQ==") == 0);
+    const uint8_t high[] = {0xfb, 0xff, 0xbf};
+    monitor_text(printed, sizeof(printed)).print_base64(high, 3);
+    CHECK(strcmp(printed, "+/+/") == 0);
+}
+
+// A payload with every kind of thing printed in it.
+static void print_payload(monitor_text &text, int32_t value, time_t t, uint8_t places, uint8_t width,
+                          const uint8_t *bytes, size_t bytes_len) {
+    text.print("{\"x\":").print_fixed(value, 2, places).print(",\"t\":\"").print_time(t, "AEDT")
+            .print_iso8601(t).print_int(value).print_uint((uint32_t) value, width).print('"')
+            .print_base64(bytes, bytes_len);
+}
+
+/*
+ * Bounds: the payload printed into buffers of every size up to a little past
+ * what it needs, with canaries after the buffer. Nothing past the buffer is
+ * written, the text is a terminated prefix of the whole payload, and fits()
+ * is only false when it was cut.
+ */
+static void test_bounds() {
+    long overruns{0};
+    long not_prefix{0};
+    long wrong_fit{0};
+    long whole_cut{0};
+    for (int i = 0; i < 500000; i++) {
+        int32_t value = (int32_t) next_random();
+        time_t t = (time_t) (next_random() % until);
+        uint8_t places = next_random() % 8;
+        uint8_t width = next_random() % 12;
+        uint8_t bytes[8];
+        size_t bytes_len = next_random() % (sizeof(bytes) + 1);
+        for (uint8_t &byte : bytes) {
+            byte = (uint8_t) next_random();
+        }
+        char whole[160];
+        monitor_text full(whole, sizeof(whole));
+        print_payload(full, value, t, places, width, bytes, bytes_len);
+        whole_cut += not full.fits();
+        size_t size = next_random() % (full.len + 3);
+        char buffer[192];
+        memset(buffer, 0x5A, sizeof(buffer));
+        monitor_text cut(buffer, size);
+        print_payload(cut, value, t, places, width, bytes, bytes_len);
+        for (size_t at = size; at < sizeof(buffer); at++) {
+            if ((unsigned char) buffer[at] != 0x5A) {
+                overruns++;
+                break;
+            }
+        }
+        if (size) {
+            size_t len = strnlen(buffer, size);
+            not_prefix += len >= size or len != cut.len or strncmp(buffer, whole, len) != 0;
+        }
+        wrong_fit += cut.fits() != (size > full.len);
+    }
+    CHECK(whole_cut == 0);
+    CHECK(overruns == 0);
+    CHECK(not_prefix == 0);
+    CHECK(wrong_fit == 0);
+}
+
+/*
+ * The group payload's values and timestamp, by monitor_text, by the snprintf()
+ * and strftime() it replaced, and by "%.2f" of a double as dtostrf() printed
+ * the values before that, without the timestamp.
+ */
+static void bench() {
+    const long count = 2000000;
+    char payload[64];
+    volatile size_t sink{0};
+    double text_ns = test_ns_per(count, [&](long i) {
+        monitor_text json(payload, sizeof(payload));
+        json.print_fixed((int32_t) (i * 7 - 70000), 2, 2).print(',').print_fixed((int32_t) (i % 10000), 2, 2)
+                .print(',').print_iso8601(1500000000 + i);
+        sink = json.len;
+    });
+    double snprintf_ns = test_ns_per(count, [&](long i) {
+        char current[12];
+        char humidity[12];
+        char created_at[21];
+        snprintf_centi((int32_t) (i * 7 - 70000), 2, current, sizeof(current));
+        snprintf_centi((int32_t) (i % 10000), 2, humidity, sizeof(humidity));
+        time_t t = 1500000000 + i;
+        struct tm utc;
+        gmtime_r(&t, &utc);
+        strftime(created_at, sizeof(created_at), "%Y-%m-%dT%H:%M:%SZ", &utc);
+        sink = snprintf(payload, sizeof(payload), "%s,%s,%s", current, humidity, created_at);
+    });
+    double double_ns = test_ns_per(count, [&](long i) {
+        sink = snprintf(payload, sizeof(payload), "%.2f,%.2f", (i * 7 - 70000) / 100.0, (i % 10000) / 100.0);
+    });
+    printf("text: monitor_text %.0f ns, snprintf and strftime %.0f ns, \"%%.2f\" of doubles without the time %.0f ns\n",
+           text_ns, snprintf_ns, double_ns);
+    (void) sink;
+}
+
+int main(int argc, char *argv[]) {
+    test_fixed();
+    test_time();
+    test_base64();
+    test_bounds();
+    if (test_bench(argc, argv)) {
+        bench();
+    }
+    return test_summary("text");
+}
@@ -0,0 +1,166 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include "monitor_test.hpp"
+#include "monitor_timezone.hpp"
+
+/*
+ * Rules glibc reads the same way: the common zones, half and quarter hours,
+ * names in angle brackets, southern hemisphere years, transitions at negative
+ * times and past 24 hours, and every kind of date.
+ */
+static const char *zones[] = {
+        "EST5EDT,M3.2.0,M11.1.0", "CST6CDT,M3.2.0/2:00:00,M11.1.0/2:00:00", "PST8PDT,M3.2.0,M11.1.0",
+        "MST7", "UTC0", "GMT0BST,M3.5.0/1,M10.5.0", "CET-1CEST,M3.5.0,M10.5.0/3",
+        "AEST-10AEDT,M10.1.0,M4.1.0/3", "NZST-12NZDT,M9.5.0,M4.1.0/3", "<+0530>-5:30", "IST-5:30",
+        "<-03>3<-02>,M3.5.0/-2,M10.5.0/-1", "ACST-9:30ACDT,M10.1.0,M4.1.0/3", "EST5EDT4,0/0,J365/25",
+        "IST-1GMT0,M10.5.0,M3.5.0/1", "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0", "XXX3YYY,J60/2,J300/30",
+        "AAA-3BBB,59/12:30:15,300/167", "HST10", "CHAST-12:45CHADT,M9.5.0/2:45,M4.1.0/3:45",
+        "<-01>1<+00>0,M3.5.0/0,M10.5.0/1", "WET0WEST,M3.5.0/1,M10.5.0", "ABC-14", "ABC12",
+};
+
+static const char *bad_rules[] = {
+        "", "E5", "EST", "EST5EDT,M13.1.0,M11.1.0", "EST5EDT,M3.2.0", "<AB>5", "EST5EDT,M3.2.0,M11.1.0x",
+        "ESTTTTTT5",
+};
+
+// 2101-01-01, past the last year the firmware could see.
+static const time_t until = 4133980800;
+
+static bool same_as_glibc(const monitor_timezone &tz, time_t utc) {
+    struct tm local;
+    localtime_r(&utc, &local);
+    bool dst;
+    int32_t offset_s = tz.offset_s(utc, dst);
+    return offset_s == local.tm_gmtoff and dst == (local.tm_isdst > 0) and strcmp(tz.name(dst), local.tm_zone) == 0;
+}
+
+/*
+ * Every zone against glibc's localtime_r() with TZ set to the same rule, every
+ * few hours from 1970 to 2100, and to the second around every transition,
+ * which is found by bisecting where glibc's offset changes.
+ */
+static void test_zones() {
+    for (const char *zone : zones) {
+        monitor_timezone tz;
+        if (not CHECK(tz.parse(zone))) {
+            printf("  %s\n", zone);
+            continue;
+        }
+        setenv("TZ", zone, 1);
+        tzset();
+        long mismatches{0};
+        long transitions{0};
+        uint64_t seed{1};
+        time_t before{0};
+        struct tm local;
+        localtime_r(&before, &local);
+        long before_offset_s = local.tm_gmtoff;
+        for (time_t t = 0; t < until;) {
+            localtime_r(&t, &local);
+            if (local.tm_gmtoff != before_offset_s) {
+                time_t low = before;
+                time_t high = t;
+                while (high - low > 1) {
+                    time_t middle = low + (high - low) / 2;
+                    struct tm at;
+                    localtime_r(&middle, &at);
+                    (at.tm_gmtoff == before_offset_s ? low : high) = middle;
+                }
+                for (time_t around = high - 2; around <= high + 1; around++) {
+                    mismatches += not same_as_glibc(tz, around);
+                }
+                transitions++;
+            }
+            before_offset_s = local.tm_gmtoff;
+            before = t;
+            mismatches += not same_as_glibc(tz, t);
+            // Every 1 to 5 hours, so that no transition is missed and the times of day vary.
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            t += 3600 + (time_t) ((seed >> 33) % 14400);
+        }
+        if (not CHECK(mismatches == 0 and (transitions > 0) == tz.has_dst)) {
+            printf("  %s: %ld mismatches, %ld transitions\n", zone, mismatches, transitions);
+        }
+    }
+    unsetenv("TZ");
+    tzset();
+}
+
+static void test_bad_rules() {
+    for (const char *rule : bad_rules) {
+        monitor_timezone tz;
+        if (not CHECK(not tz.parse(rule))) {
+            printf("  accepted \"%s\"\n", rule);
+        }
+    }
+}
+
+static void test_civil_time() {
+    // The broken down date against gmtime_r(), through 2100.
+    long wrong{0};
+    uint64_t seed{7};
+    for (int i = 0; i < 1000000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        time_t t = i < 2 ? (i ? until - 1 : 0) : (time_t) ((seed >> 11) % until);
+        struct tm utc;
+        gmtime_r(&t, &utc);
+        civil_time civil = civil_from_epoch(t);
+        wrong += civil.year != utc.tm_year + 1900 or civil.month != utc.tm_mon + 1 or civil.day != utc.tm_mday
+                 or civil.weekday != utc.tm_wday or civil.hour != utc.tm_hour or civil.minute != utc.tm_min
+                 or civil.second != utc.tm_sec;
+    }
+    CHECK(wrong == 0);
+}
+
+static void bench() {
+    monitor_timezone tz;
+    tz.parse("EST5EDT,M3.2.0,M11.1.0");
+    setenv("TZ", "EST5EDT,M3.2.0,M11.1.0", 1);
+    tzset();
+    volatile long sink{0};
+    const long count = 2000000;
+    double ours_ns = test_ns_per(count, [&](long i) {
+        bool dst;
+        sink = tz.offset_s(1500000000 + i * 997, dst);
+    });
+    double glibc_ns = test_ns_per(count, [&](long i) {
+        time_t t = 1500000000 + i * 997;
+        struct tm local;
+        localtime_r(&t, &local);
+        sink = local.tm_gmtoff;
+    });
+    printf("timezone: offset_s() %.0f ns, glibc localtime_r() %.0f ns\n", ours_ns, glibc_ns);
+    (void) sink;
+}
+
+int main(int argc, char *argv[]) {
+    test_zones();
+    test_bad_rules();
+    test_civil_time();
+    if (test_bench(argc, argv)) {
+        bench();
+    }
+    return test_summary("timezone");
+}
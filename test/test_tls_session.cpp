@@ -0,0 +1,139 @@
+/*
+    Copyright (c) 2018 Patrick Moffitt
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "monitor_test.hpp"
+#include "hal_fake.hpp"
+#include "monitor_tls_session.hpp"
+
+EEPROMClass EEPROM;
+
+static BearSSL::Session session_of(uint8_t id) {
+    BearSSL::Session session{};
+    memset(session.parameters.session_id, id, sizeof(session.parameters.session_id));
+    session.parameters.session_id_len = 32;
+    session.parameters.version = 0x0303;
+    memset(session.parameters.master_secret, id ^ 0x5A, sizeof(session.parameters.master_secret));
+    return session;
+}
+
+static bool same(const BearSSL::Session &a, const BearSSL::Session &b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// RTC memory lost with power, the flash kept.
+static void power_cycle() {
+    memset(hal_fake.rtc, 0, sizeof(hal_fake.rtc));
+    hal_fake.reset_reason = HAL_RESET_POWER_ON;
+}
+
+static void test_first_boot() {
+    hal_fake_reset();
+    memset(&EEPROM, 0, sizeof(EEPROM));
+    tls_session_cache cache;
+    BearSSL::Session session{};
+    CHECK(not cache.load(session));
+    CHECK(not cache.valid);
+    CHECK(EEPROM.writes == 0);
+
+    // A full handshake is kept in RTC memory and flash; the same session
+    // handed back on a resumed handshake writes neither.
+    CHECK(cache.store(session_of(1)));
+    CHECK(EEPROM.writes == 1);
+    CHECK(not cache.store(session_of(1)));
+    CHECK(EEPROM.writes == 1);
+}
+
+static void test_deep_sleep() {
+    // The next wake resumes from RTC memory.
+    hal_fake.reset_reason = HAL_RESET_DEEP_SLEEP;
+    tls_session_cache cache;
+    BearSSL::Session session{};
+    CHECK(cache.load(session));
+    CHECK(same(session, session_of(1)));
+
+    // The server handed out a new session: both copies are rewritten.
+    CHECK(cache.store(session_of(2)));
+    CHECK(EEPROM.writes == 2);
+    tls_session_cache next;
+    CHECK(next.load(session));
+    CHECK(same(session, session_of(2)));
+}
+
+static void test_cold_boot() {
+    // A cold boot falls back on the flash and puts the session back in RTC
+    // memory, so the wake after it doesn't read the flash.
+    power_cycle();
+    tls_session_cache cache;
+    BearSSL::Session session{};
+    CHECK(cache.load(session));
+    CHECK(same(session, session_of(2)));
+    memset(EEPROM.flash, 0xFF, sizeof(EEPROM.flash));
+    tls_session_cache next;
+    CHECK(next.load(session));
+    CHECK(same(session, session_of(2)));
+
+    // Neither copy: a full handshake.
+    power_cycle();
+    tls_session_cache none;
+    CHECK(not none.load(session));
+}
+
+static void test_expiry() {
+    tls_session_cache cache;
+    CHECK(cache.store(session_of(3)));
+    tls_session_cache::record record;
+    CHECK(rtc_load(RTC_TLS_SESSION_OFFSET, record));
+    record.created = time(nullptr) - TLS_SESSION_MAX_AGE_S + 60;
+    rtc_save(RTC_TLS_SESSION_OFFSET, record);
+    BearSSL::Session session{};
+    tls_session_cache fresh;
+    CHECK(fresh.load(session));
+
+    record.created = time(nullptr) - TLS_SESSION_MAX_AGE_S - 60;
+    rtc_save(RTC_TLS_SESSION_OFFSET, record);
+    tls_session_cache expired;
+    CHECK(not expired.load(session));
+    CHECK(not expired.valid);
+    // The session the client still holds from the last connect is cleared,
+    // so a reconnect on mains or as the gateway makes a full handshake.
+    CHECK(same(session, BearSSL::Session{}));
+}
+
+static void test_corrupt_copies() {
+    // A bit flipped in RTC memory and in flash is no session at all.
+    tls_session_cache cache;
+    CHECK(cache.store(session_of(4)));
+    hal_fake.rtc[RTC_TLS_SESSION_OFFSET * 4 + 20] ^= 0x01;
+    EEPROM.flash[TLS_SESSION_EEPROM_ADDRESS + 20] ^= 0x01;
+    BearSSL::Session session{};
+    tls_session_cache corrupt;
+    CHECK(not corrupt.load(session));
+}
+
+int main(int argc, char *argv[]) {
+    test_first_boot();
+    test_deep_sleep();
+    test_cold_boot();
+    test_expiry();
+    test_corrupt_copies();
+    return test_summary("tls_session");
+}
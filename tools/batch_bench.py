@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""
+Benchmark the batch format against the group JSON on made-up sensor traces.
+
+Makes --days of readings like the monitor's: temperature and humidity that
+follow the time of day, a current draw with noise and steps, a battery that
+runs down, at the adaptive sleep intervals plus the time each wake takes, and
+the odd failed sensor read. It builds monitor_batch.cpp into a small host
+program with the compiler in $CXX, encodes the readings in batches of up to
+--batch readings in a --size byte buffer, as the firmware does with a full
+queue, checks that batch_bridge.py decodes them back to the same readings, and
+reports the bytes per reading and the encode time:
+
+    ./batch_bench.py --days 7 --batch 8
+
+The encode time is the host's, a few hundred times faster than the ESP8266's.
+"""
+
+import argparse
+import base64
+import math
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+import batch_bridge
+
+SRC = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src')
+SLEEP_S = (300, 600, 1200, 1800)
+GROUP_TOPIC = 'user/groups/monitor-one'
+BATCH_TOPIC = 'user/feeds/monitor-one.batch'
+RECORD = struct.Struct('<IihHbBH')
+
+HARNESS = r'''
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "monitor_batch.hpp"
+
+// Readings on stdin; batches, one per line in hex, then the time per reading.
+int main(int argc, char **argv) {
+    size_t batch_max = strtoul(argv[1], nullptr, 10);
+    std::vector<uint8_t> buffer(strtoul(argv[2], nullptr, 10));
+    std::vector<monitor_data> readings;
+    monitor_data reading;
+    while (fread(&reading, sizeof(reading), 1, stdin) == 1) {
+        readings.push_back(reading);
+    }
+    monitor_batch batch(buffer.data(), buffer.size());
+    size_t encoded{0};
+    long rounds{0};
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{};
+    do {
+        for (size_t at = 0; at < readings.size(); at += batch.count) {
+            size_t count = std::min(batch_max, readings.size() - at);
+            batch.begin(readings[at].unix_epoch_time, monitor_batch::interval(&readings[at], count));
+            while (batch.count < count and batch.add(readings[at + batch.count])) {
+            }
+            if (batch.count == 0) {
+                return 1;
+            }
+            if (rounds == 0) {
+                for (size_t i = 0; i < batch.len; i++) {
+                    printf("%02x", batch.buffer[i]);
+                }
+                printf("\n");
+            }
+            encoded += batch.count;
+        }
+        rounds++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < 0.5);
+    printf("ns %.1f\n", elapsed.count() * 1e9 / encoded);
+    return 0;
+}
+'''
+
+
+def traces(days, seed):
+    """The readings, as monitor_data fields, oldest first."""
+    rng = random.Random(seed)
+    at = 1760000000
+    battery, current_step = 97.0, 0.0
+    sleep_s = SLEEP_S[0]
+    readings = []
+    while at < 1760000000 + days * 86400:
+        hour = (at % 86400) / 3600
+        daily = math.sin((hour - 9) / 24 * 2 * math.pi)
+        temperature = 68 + 6 * daily + rng.gauss(0, 0.15)
+        humidity = 45 - 8 * daily + rng.gauss(0, 0.4)
+        if rng.random() < 0.05:
+            current_step = rng.choice((0.0, 12.0, -6.0))
+        current = 80 + current_step + rng.gauss(0, 1.5)
+        battery -= rng.uniform(0.005, 0.03)
+        flags = batch_bridge.ALL_VALID
+        if rng.random() < 0.02:
+            flags &= ~(batch_bridge.HUMIDITY_VALID | batch_bridge.TEMPERATURE_VALID)  # A DHT timeout.
+        if rng.random() < 0.01:
+            flags &= ~batch_bridge.CURRENT_VALID
+        readings.append((at, round(current * 100) if flags & batch_bridge.CURRENT_VALID else 0,
+                         round(temperature * 100) if flags & batch_bridge.TEMPERATURE_VALID else 0,
+                         round(humidity * 100) if flags & batch_bridge.HUMIDITY_VALID else 0,
+                         round(battery), flags, 0))
+        # The adaptive sleep settles at one interval for a while; each wake takes a few seconds.
+        if rng.random() < 0.1:
+            sleep_s = rng.choice(SLEEP_S)
+        at += sleep_s + rng.randint(2, 9)
+    return readings
+
+
+def group_json(reading, room):
+    """The group messages publish_group() sends for a reading, with room bytes for each payload."""
+    at, current, temperature, humidity, battery, flags, _ = reading
+    feeds = ['"battery-vdc":%d' % battery]
+    if flags & batch_bridge.CURRENT_VALID:
+        feeds.append('"current-ma":%.2f' % (current / 100))
+    if flags & batch_bridge.HUMIDITY_VALID:
+        feeds.append('"humidity-rh":%.2f' % (humidity / 100))
+    if flags & batch_bridge.TEMPERATURE_VALID:
+        feeds.append('"temperature-f":%.2f' % (temperature / 100))
+    head = '{"created_at":"%s","feeds":{' % time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime(at))
+    messages = [[]]
+    for feed in feeds:
+        if messages[-1] and len(head + ','.join(messages[-1] + [feed]) + '}}') > room:
+            messages.append([])
+        messages[-1].append(feed)
+    return [head + ','.join(message) + '}}' for message in messages]
+
+
+def build(directory):
+    harness = os.path.join(directory, 'harness.cpp')
+    program = os.path.join(directory, 'harness')
+    with open(harness, 'w') as source:
+        source.write(HARNESS)
+    subprocess.run((os.environ.get('CXX', 'g++'), '-std=gnu++11', '-O2', '-I', SRC, harness,
+                    os.path.join(SRC, 'monitor_batch.cpp'), '-o', program), check=True)
+    return program
+
+
+def check(readings, batches):
+    """Each decoded reading matches the one encoded."""
+    decoded = [reading for batch in batches for reading in batch_bridge.decode(batch)]
+    if len(decoded) != len(readings):
+        return '%d readings decoded of %d.' % (len(decoded), len(readings))
+    for sent, got in zip(readings, decoded):
+        at, current, temperature, humidity, battery, flags, _ = sent
+        expected = {'created_at': at, 'battery-vdc': battery,
+                    'current-ma': current / 100 if flags & batch_bridge.CURRENT_VALID else None,
+                    'humidity-rh': humidity / 100 if flags & batch_bridge.HUMIDITY_VALID else None,
+                    'temperature-f': temperature / 100 if flags & batch_bridge.TEMPERATURE_VALID else None}
+        if got != expected:
+            return 'Reading at %d decoded as %s, not %s.' % (at, got, expected)
+    return None
+
+
+def main():
+    options = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    options.add_argument('--days', type=float, default=7)
+    options.add_argument('--batch', type=int, default=8, help='readings per batch, RING_BUFFER_CAPACITY on the device')
+    options.add_argument('--size', type=int, default=96, help='the batch buffer, BATCH_SIZE_MAX')
+    options.add_argument('--buffer', type=int, default=150, help='the Adafruit_MQTT buffer, MAXBUFFERSIZE')
+    options.add_argument('--seed', type=int, default=1)
+    args = options.parse_args()
+    readings = traces(args.days, args.seed)
+    with tempfile.TemporaryDirectory() as directory:
+        program = build(directory)
+        output = subprocess.run((program, str(args.batch), str(args.size)), check=True, stdout=subprocess.PIPE,
+                                input=b''.join(RECORD.pack(*reading) for reading in readings)).stdout.decode()
+    lines = output.split()
+    ns = float(lines[-1])
+    batches = [bytes.fromhex(line) for line in lines[:-2]]
+    error = check(readings, batches)
+    if error:
+        sys.exit('batch_bench: %s' % error)
+
+    n = len(readings)
+    group = [message for reading in readings
+             for message in group_json(reading, args.buffer - (5 + len(GROUP_TOPIC)))]
+    json_bytes = sum(len(message) for message in group)
+    binary_bytes = sum(len(batch) for batch in batches)
+    text_bytes = sum(len(base64.b64encode(batch)) for batch in batches)
+    json_packets = json_bytes + len(group) * (5 + len(GROUP_TOPIC))
+    batch_packets = text_bytes + len(batches) * (5 + len(BATCH_TOPIC))
+    print('%d readings over %g days in %d batches of up to %d, all decoded the same'
+          % (n, args.days, len(batches), args.batch))
+    print('  %-22s %7s %9s' % ('', 'bytes', 'per read'))
+    for name, total in (('group JSON', json_bytes), ('monitor_data structs', RECORD.size * n),
+                        ('batch', binary_bytes), ('batch in base64', text_bytes),
+                        ('group MQTT packets', json_packets), ('batch MQTT packets', batch_packets)):
+        print('  %-22s %7d %9.1f' % (name, total, total / n))
+    print('  batch is %.1fx smaller than the JSON, %.1fx in base64; %.1fx fewer bytes on the wire'
+          % (json_bytes / binary_bytes, json_bytes / text_bytes, json_packets / batch_packets))
+    print('  encode %.1f ns per reading on this host' % ns)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+"""
+Spread the monitor's batches over its Adafruit IO feeds.
+
+Built with AIO_PUBLISH_BATCH, the firmware sends a backlog of readings as one
+base64 message in the batch feed (monitor_batch.hpp has the format). This
+subscribes to that feed over MQTT and posts each reading to the battery,
+current, humidity and temperature feeds with the time it was taken, through
+the Adafruit IO REST API, so the dashboards look as if each reading had been
+published on its own:
+
+    ./batch_bridge.py --username me --key aio_XXXX --group monitor-one
+
+With --dry-run it prints the values instead of posting them. --broker takes a
+plain MQTT broker, host:port, in place of io.adafruit.com, and batches given
+as arguments, or - for lines on stdin, are decoded without a broker at all:
+
+    ./batch_bridge.py --dry-run AQSr7szWBooOAL4BoosBgEfobAgA7wXjAX4AAMMG0wGSAYYcAKcDR0Y=
+
+The unix-epoch-eastern feed is left alone; created_at carries the time.
+"""
+
+import argparse
+import base64
+import json
+import os
+import select
+import socket
+import ssl
+import struct
+import sys
+import time
+import urllib.request
+
+VERSION = 1
+CURRENT_VALID, HUMIDITY_VALID, TEMPERATURE_VALID = 0x01, 0x02, 0x04
+ALL_VALID = CURRENT_VALID | HUMIDITY_VALID | TEMPERATURE_VALID
+FEEDS = ('battery-vdc', 'current-ma', 'humidity-rh', 'temperature-f')
+CONNECT, CONNACK, PUBLISH, SUBSCRIBE, PINGREQ = 1, 2, 3, 8, 12
+KEEPALIVE_S = 60
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.at = 0
+
+    def byte(self):
+        if self.at >= len(self.data):
+            raise ValueError('The batch ends early.')
+        self.at += 1
+        return self.data[self.at - 1]
+
+    def varint(self):
+        value, shift = 0, 0
+        while True:
+            byte = self.byte()
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def zigzag(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+
+def wrap(value):
+    """value as the int32 the firmware's arithmetic leaves it."""
+    return (value + 2 ** 31) % 2 ** 32 - 2 ** 31
+
+
+def decode(data):
+    """The readings of a batch, oldest first. None for a reading not taken."""
+    reader = Reader(data)
+    version = reader.byte()
+    if version != VERSION:
+        raise ValueError('Batch version %d, not %d.' % (version, VERSION))
+    count = reader.byte()
+    base_time = reader.varint()
+    interval = reader.varint()
+    at, flags = wrap(base_time - interval), ALL_VALID
+    battery = current = humidity = temperature = 0
+    readings = []
+    for _ in range(count):
+        time_field = reader.varint()
+        zigzag = time_field >> 1
+        at = (at + interval + ((zigzag >> 1) ^ -(zigzag & 1))) % 2 ** 32
+        if time_field & 1:
+            flags = reader.byte()
+        battery = wrap(battery + reader.zigzag())
+        reading = {'created_at': at, 'battery-vdc': battery,
+                   'current-ma': None, 'humidity-rh': None, 'temperature-f': None}
+        if flags & CURRENT_VALID:
+            current = wrap(current + reader.zigzag())
+            reading['current-ma'] = current / 100
+        if flags & HUMIDITY_VALID:
+            humidity = wrap(humidity + reader.zigzag())
+            reading['humidity-rh'] = humidity / 100
+        if flags & TEMPERATURE_VALID:
+            temperature = wrap(temperature + reader.zigzag())
+            reading['temperature-f'] = temperature / 100
+        readings.append(reading)
+    return readings
+
+
+def feed_values(readings):
+    """Each feed's values, as the REST API's batch create takes them."""
+    values = {feed: [] for feed in FEEDS}
+    for reading in readings:
+        created_at = time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime(reading['created_at']))
+        for feed in FEEDS:
+            if reading[feed] is not None:
+                values[feed].append({'value': str(reading[feed]), 'created_at': created_at})
+    return values
+
+
+def post(args, values):
+    for feed, data in values.items():
+        if not data:
+            continue
+        if args.dry_run:
+            for point in data:
+                print('%s.%s %s %s' % (args.group, feed, point['created_at'], point['value']))
+            continue
+        url = '%s/api/v2/%s/feeds/%s.%s/data/batch' % (args.api, args.username, args.group, feed)
+        request = urllib.request.Request(url, json.dumps({'data': data}).encode(), method='POST',
+                                         headers={'X-AIO-Key': args.key, 'Content-Type': 'application/json'})
+        with urllib.request.urlopen(request, timeout=30) as response:
+            response.read()
+
+
+def bridge(args, text):
+    try:
+        readings = decode(base64.b64decode(text.strip(), validate=True))
+    except ValueError as error:
+        print('batch_bridge: skipping %r: %s' % (text[:40], error), file=sys.stderr)
+        return
+    post(args, feed_values(readings))
+
+
+def packet(kind, body, flags=0):
+    length, header = len(body), bytearray()
+    while True:
+        header.append((length & 0x7F) | (0x80 if length > 0x7F else 0))
+        length >>= 7
+        if not length:
+            break
+    return bytes([kind << 4 | flags]) + bytes(header) + body
+
+
+def string(text):
+    data = text.encode()
+    return struct.pack('>H', len(data)) + data
+
+
+def receive(connection, n):
+    data = b''
+    while len(data) < n:
+        chunk = connection.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError('The broker closed the connection.')
+        data += chunk
+    return data
+
+
+def read_packet(connection):
+    kind = receive(connection, 1)[0]
+    length, shift = 0, 0
+    while True:
+        byte = receive(connection, 1)[0]
+        length |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            break
+    return kind >> 4, kind & 0x0F, receive(connection, length)
+
+
+def subscribe(args):
+    """Each batch published to the batch feed, as it arrives."""
+    host, _, port = args.broker.partition(':')
+    port = int(port) if port else 8883 if host == 'io.adafruit.com' else 1883
+    connection = socket.create_connection((host, port))
+    if port == 8883:
+        connection = ssl.create_default_context().wrap_socket(connection, server_hostname=host)
+    client = 'batch-bridge-%d' % os.getpid()
+    connection.sendall(packet(CONNECT, string('MQTT') + bytes([4, 0xC2]) + struct.pack('>H', KEEPALIVE_S)
+                              + string(client) + string(args.username) + string(args.key)))
+    kind, _, body = read_packet(connection)
+    if kind != CONNACK or body[1] != 0:
+        raise ConnectionError('The broker refused the connection.')
+    topic = '%s/feeds/%s.batch' % (args.username, args.group)
+    connection.sendall(packet(SUBSCRIBE, struct.pack('>H', 1) + string(topic) + bytes([0]), 0x02))
+    while True:
+        pending = getattr(connection, 'pending', lambda: 0)()
+        if not pending and not select.select([connection], [], [], KEEPALIVE_S / 2)[0]:
+            connection.sendall(packet(PINGREQ, b''))
+            continue
+        kind, flags, body = read_packet(connection)
+        if kind == PUBLISH:
+            topic_len = struct.unpack_from('>H', body)[0]
+            start = 2 + topic_len + (2 if flags & 0x06 else 0)
+            yield body[start:].decode(errors='replace')
+
+
+def main():
+    options = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    options.add_argument('batch', nargs='*', help='batches to decode, or - for lines on stdin, not the broker')
+    options.add_argument('--username', default=os.environ.get('AIO_USERNAME', ''))
+    options.add_argument('--key', default=os.environ.get('AIO_KEY', ''))
+    options.add_argument('--group', default='monitor-one', help='the AIO_GROUP_KEY the firmware was built with')
+    options.add_argument('--broker', default='io.adafruit.com', help='host or host:port; TLS on port 8883')
+    options.add_argument('--api', default='https://io.adafruit.com', help='the REST API to post the values to')
+    options.add_argument('--dry-run', action='store_true', help='print the values rather than post them')
+    args = options.parse_args()
+    if args.batch:
+        texts = sys.stdin if args.batch == ['-'] else args.batch
+    else:
+        if not args.username or (not args.key and not args.dry_run):
+            options.error('--username and --key, or AIO_USERNAME and AIO_KEY, are needed.')
+        texts = subscribe(args)
+    try:
+        for text in texts:
+            bridge(args, text)
+            sys.stdout.flush()
+    except (OSError, ConnectionError) as error:
+        sys.exit('batch_bridge: %s' % error)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()
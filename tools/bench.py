@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""
+Benchmark the firmware's wakes against the local broker over a set of networks.
+
+Runs the native build (see Native Build in the README), built with NATIVE_TLS
+and the bench CA, for --wakes wakes from a cold boot against bench_broker.py,
+once per network configuration. For each one it reports the time from wake to
+deep sleep, the bytes on the wire per upload, how many publishes succeeded,
+and the mean time and round trips of the full and the resumed TLS handshakes:
+
+    ./bench.py --program ../.pio/build/native_tls/program
+
+A configuration is name:latency_ms:loss_percent; pass --config for your own.
+Only the network changes from one configuration to the next, so the results
+are a baseline to compare networking changes against.
+"""
+
+import argparse
+import os
+import re
+import signal
+import socket
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+import bench_broker
+import log_decode
+
+CONFIGS = ('lan:1:0', 'wan:40:0', 'lossy:40:2', 'poor:150:5')
+WAKE = re.compile(r'^Wake \d+: awake (\d+) ms')
+STATUS = re.compile(r'^Publish status \w+: ([01])')
+HANDSHAKE = re.compile(r'(Full|Resumed) handshake: (\d+) us, round trips: (\d+)')
+SUMMARY = re.compile(r'(\d+) connections, (\d+) publishes, (\d+) bytes up, (\d+) bytes down, (\d+) losses')
+
+
+def wait_for_port(broker, port, timeout_s=30.0):
+    deadline = time.monotonic() + timeout_s
+    while time.monotonic() < deadline and broker.poll() is None:
+        try:
+            socket.create_connection(('127.0.0.1', port), timeout=0.5).close()
+            return
+        except OSError:
+            time.sleep(0.1)
+    raise RuntimeError('The broker did not start.')
+
+
+def handshake_means(handshakes):
+    """The mean ms and round trips of some handshakes, 0 for none."""
+    if not handshakes:
+        return 0, 0
+    return (statistics.mean(us for us, _ in handshakes) / 1000,
+            statistics.mean(round_trips for _, round_trips in handshakes))
+
+
+def run(args, name, latency_ms, loss):
+    broker = subprocess.Popen(
+        [sys.executable, bench_broker.__file__, '--quiet', '--listen', '127.0.0.1', '--port', str(args.port),
+         '--ca-dir', args.ca_dir, '--latency-ms', str(latency_ms), '--loss', str(loss), '--seed', str(args.seed)],
+        stdout=subprocess.PIPE, text=True)
+    try:
+        wait_for_port(broker, args.port)
+        with tempfile.TemporaryDirectory() as directory:
+            output = log_decode.decode(subprocess.run(
+                [args.program, '-n', str(args.wakes), '-s', os.path.join(directory, 'bench.state'),
+                 '-b', '127.0.0.1:%d' % args.port],
+                stdout=subprocess.PIPE, stderr=subprocess.STDOUT).stdout)
+    finally:
+        broker.send_signal(signal.SIGTERM)
+        summary = SUMMARY.search(broker.communicate()[0])
+    upload_ms, sample_ms, statuses = [], [], []
+    handshakes = {'Full': [], 'Resumed': []}
+    upload = False
+    for line in output.splitlines():
+        if line.startswith('MQTT connected') or line.startswith('ERROR: MQTT connect failed'):
+            upload = True
+        handshake = HANDSHAKE.search(line)
+        if handshake:
+            handshakes[handshake.group(1)].append((int(handshake.group(2)), int(handshake.group(3))))
+        status = STATUS.match(line)
+        if status:
+            statuses.append(int(status.group(1)))
+        wake = WAKE.match(line)
+        if wake:
+            (upload_ms if upload else sample_ms).append(int(wake.group(1)))
+            upload = False
+    connections, publishes, bytes_up, bytes_down, losses = (int(g) for g in summary.groups()) if summary \
+        else (0, 0, 0, 0, 0)
+    return {
+        'name': name,
+        'latency_ms': latency_ms,
+        'loss': loss,
+        'wakes': len(upload_ms) + len(sample_ms),
+        'uploads': len(upload_ms),
+        'upload_ms': statistics.mean(upload_ms) if upload_ms else 0,
+        'upload_max_ms': max(upload_ms) if upload_ms else 0,
+        'sample_ms': statistics.mean(sample_ms) if sample_ms else 0,
+        'bytes': (bytes_up + bytes_down) / connections if connections else 0,
+        'success': 100.0 * sum(statuses) / len(statuses) if statuses else 0,
+        'received': publishes,
+        'losses': losses,
+        'full': handshake_means(handshakes['Full']),
+        'resumed': handshake_means(handshakes['Resumed']),
+    }
+
+
+def main():
+    options = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    options.add_argument('--program', default='../.pio/build/native_tls/program',
+                         help='the native build, with NATIVE_TLS and the bench CA')
+    options.add_argument('--config', action='append', help='name:latency_ms:loss_percent, repeatable')
+    options.add_argument('--wakes', type=int, default=24)
+    options.add_argument('--port', type=int, default=18883)
+    options.add_argument('--ca-dir', default='bench_ca')
+    options.add_argument('--seed', type=int, default=1)
+    args = options.parse_args()
+    bench_broker.make_ca(args.ca_dir, ['localhost', '127.0.0.1'])
+    if not os.access(args.program, os.X_OK):
+        sys.exit('Build %s with -DNATIVE_TLS and -DAIO_CA_CERT=\'"%s"\' first.'
+                 % (args.program, os.path.abspath(os.path.join(args.ca_dir, 'ca_cert.h'))))
+    print('%-8s %7s %5s %6s %8s %9s %9s %11s %9s %9s %13s %16s'
+          % ('config', 'latency', 'loss', 'wakes', 'uploads', 'upload ms', 'max ms', 'sampling ms',
+             'bytes/up', 'published', 'full TLS', 'resumed TLS'))
+    for config in args.config or CONFIGS:
+        name, latency_ms, loss = config.split(':')
+        result = run(args, name, float(latency_ms), float(loss))
+        print('%-8s %5.0fms %4.1f%% %6d %8d %9.0f %9d %11.0f %9.0f %8.1f%% %5.0fms %3.1f RT %8.0fms %3.1f RT'
+              % (result['name'], result['latency_ms'], result['loss'], result['wakes'], result['uploads'],
+                 result['upload_ms'], result['upload_max_ms'], result['sample_ms'], result['bytes'],
+                 result['success'], result['full'][0], result['full'][1], result['resumed'][0],
+                 result['resumed'][1]))
+
+
+if __name__ == '__main__':
+    main()
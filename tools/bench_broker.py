@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+"""
+A local stand-in for io.adafruit.com: an MQTT broker on TLS port 8883 behind a
+proxy that adds latency and loss.
+
+The first run makes a self-signed CA and a broker certificate for --host in
+--ca-dir, and writes ca_cert.h, which defines caCert[] and caCertLen from that
+CA. Build the firmware with -DAIO_CA_CERT='"path/to/ca_cert.h"' and AIO_SERVER
+set to one of the hosts, and it checks the broker's certificate just as it
+checks io.adafruit.com's:
+
+    ./bench_broker.py --host 192.168.1.10 --latency-ms 40 --loss 2
+
+The broker takes any username and key. It answers CONNECT, PUBLISH (QoS 0 and
+1), PINGREQ and DISCONNECT, which is all the firmware sends. Each connection
+ends with a line of what crossed the wire, counted at the proxy, so the bytes
+include the TLS handshake and record overhead but not TCP/IP headers. Like
+io.adafruit.com, the broker lets a client resume its TLS session, for as long
+as the broker runs.
+
+Latency is added to every chunk in each direction. A TCP stream can't lose
+bytes, so loss is modeled as what the sender sees: a chunk is lost with the
+given probability and arrives a retransmission timeout later, the timeout
+doubling on each loss in a row. tools/bench.py runs the native build against
+this broker for a set of such network configurations.
+"""
+
+import argparse
+import asyncio
+import os
+import random
+import signal
+import ssl
+import subprocess
+import tempfile
+import time
+
+CONNECT, CONNACK, PUBLISH, PUBACK, PINGREQ, PINGRESP, DISCONNECT = 1, 2, 3, 4, 12, 13, 14
+
+
+def make_ca(directory, hosts):
+    """The CA, the broker's certificate and ca_cert.h, unless already made."""
+    files = {name: os.path.join(directory, name) for name in
+             ('ca.key', 'ca.pem', 'ca.der', 'broker.key', 'broker.pem', 'ca_cert.h')}
+    if all(os.path.exists(path) for path in files.values()):
+        return files
+    os.makedirs(directory, exist_ok=True)
+
+    def openssl(*args):
+        subprocess.run(('openssl',) + args, check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    openssl('req', '-x509', '-newkey', 'rsa:2048', '-nodes', '-days', '3650', '-subj', '/CN=Monitor Bench CA',
+            '-addext', 'basicConstraints=critical,CA:TRUE', '-addext', 'keyUsage=critical,keyCertSign,cRLSign',
+            '-keyout', files['ca.key'], '-out', files['ca.pem'])
+    openssl('x509', '-in', files['ca.pem'], '-outform', 'DER', '-out', files['ca.der'])
+    names = ','.join(('IP:' if h.replace('.', '').isdigit() or ':' in h else 'DNS:') + h for h in hosts)
+    with tempfile.NamedTemporaryFile('w', suffix='.cnf', delete=False) as ext:
+        ext.write('subjectAltName=%s\nextendedKeyUsage=serverAuth\n' % names)
+    csr = files['broker.pem'] + '.csr'
+    try:
+        openssl('req', '-newkey', 'rsa:2048', '-nodes', '-subj', '/CN=' + hosts[0],
+                '-keyout', files['broker.key'], '-out', csr)
+        openssl('x509', '-req', '-in', csr, '-CA', files['ca.pem'], '-CAkey', files['ca.key'],
+                '-CAcreateserial', '-days', '825', '-extfile', ext.name, '-out', files['broker.pem'])
+    finally:
+        os.unlink(ext.name)
+        if os.path.exists(csr):
+            os.unlink(csr)
+    with open(files['ca.der'], 'rb') as der_file:
+        der = der_file.read()
+    lines = [', '.join('0x%02X' % b for b in der[i:i + 15]) for i in range(0, len(der), 15)]
+    with open(files['ca_cert.h'], 'w') as header:
+        header.write('// Monitor Bench CA, made by tools/bench_broker.py for hosts %s\n' % ' '.join(hosts))
+        header.write('const unsigned char caCert[] PROGMEM = {\n        %s\n};\n' % ',\n        '.join(lines))
+        header.write('const unsigned int caCertLen = %d;\n' % len(der))
+    return files
+
+
+class Stats:
+    def __init__(self):
+        self.connections = 0
+        self.publishes = 0
+        self.bytes_up = 0
+        self.bytes_down = 0
+        self.losses = 0
+
+
+async def read_packet(reader):
+    """One MQTT control packet: its type, flags and body."""
+    first = (await reader.readexactly(1))[0]
+    remaining, multiplier = 0, 1
+    while True:
+        digit = (await reader.readexactly(1))[0]
+        remaining += (digit & 0x7F) * multiplier
+        multiplier *= 128
+        if not digit & 0x80:
+            break
+    return first >> 4, first & 0x0F, await reader.readexactly(remaining)
+
+
+async def mqtt_session(reader, writer, stats, quiet):
+    try:
+        while True:
+            kind, flags, body = await read_packet(reader)
+            if kind == CONNECT:
+                writer.write(bytes((CONNACK << 4, 2, 0, 0)))
+            elif kind == PUBLISH:
+                stats.publishes += 1
+                topic_len = body[0] << 8 | body[1]
+                topic = body[2:2 + topic_len].decode(errors='replace')
+                payload = body[2 + topic_len:]
+                if (flags >> 1) & 3:  # QoS 1 or 2 carry a packet identifier.
+                    writer.write(bytes((PUBACK << 4, 2)) + payload[:2])
+                    payload = payload[2:]
+                if not quiet:
+                    print('PUBLISH %s %s' % (topic, payload.decode(errors='replace')), flush=True)
+            elif kind == PINGREQ:
+                writer.write(bytes((PINGRESP << 4, 0)))
+            elif kind == DISCONNECT:
+                break
+            await writer.drain()
+    except (asyncio.IncompleteReadError, ConnectionError, ssl.SSLError):
+        pass
+    finally:
+        writer.close()
+
+
+class Shaper:
+    """Delivers the chunks of one direction in order, each after its delay."""
+
+    def __init__(self, args, stats):
+        self.args = args
+        self.stats = stats
+        self.last_due = 0.0
+
+    def delay(self):
+        seconds = self.args.latency_ms / 1000.0
+        rto = self.args.rto_ms / 1000.0
+        while random.random() < self.args.loss / 100.0:
+            self.stats.losses += 1
+            seconds += rto
+            rto *= 2
+        return seconds
+
+    async def pump(self, reader, writer, count):
+        try:
+            while True:
+                chunk = await reader.read(65536)
+                if not chunk:
+                    break
+                count(len(chunk))
+                # Later chunks never overtake earlier ones, as in a TCP stream.
+                self.last_due = max(self.last_due, time.monotonic() + self.delay())
+                await asyncio.sleep(max(0.0, self.last_due - time.monotonic()))
+                writer.write(chunk)
+                await writer.drain()
+        except ConnectionError:
+            pass
+        finally:
+            writer.close()
+
+
+async def proxy_session(client_reader, client_writer, args, stats, broker_port):
+    stats.connections += 1
+    number = stats.connections
+    started = time.monotonic()
+    up, down, publishes = stats.bytes_up, stats.bytes_down, stats.publishes
+    try:
+        broker_reader, broker_writer = await asyncio.open_connection('127.0.0.1', broker_port)
+    except OSError:
+        client_writer.close()
+        return
+
+    def count_up(n):
+        stats.bytes_up += n
+
+    def count_down(n):
+        stats.bytes_down += n
+
+    await asyncio.gather(Shaper(args, stats).pump(client_reader, broker_writer, count_up),
+                         Shaper(args, stats).pump(broker_reader, client_writer, count_down))
+    if not args.quiet:
+        print('Connection %d: %d bytes up, %d bytes down, %d publishes in %.0f ms.'
+              % (number, stats.bytes_up - up, stats.bytes_down - down, stats.publishes - publishes,
+                 (time.monotonic() - started) * 1000.0), flush=True)
+
+
+async def serve(args, stats):
+    context = None
+    if not args.plain:
+        files = make_ca(args.ca_dir, args.host)
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(files['broker.pem'], files['broker.key'])
+    broker = await asyncio.start_server(lambda r, w: mqtt_session(r, w, stats, args.quiet),
+                                        '127.0.0.1', 0, ssl=context)
+    broker_port = broker.sockets[0].getsockname()[1]
+    proxy = await asyncio.start_server(lambda r, w: proxy_session(r, w, args, stats, broker_port),
+                                       args.listen, args.port)
+    stop = asyncio.Event()
+    for number in (signal.SIGINT, signal.SIGTERM):
+        asyncio.get_running_loop().add_signal_handler(number, stop.set)
+    async with broker, proxy:
+        await stop.wait()
+    # Let what is still in flight arrive before the totals are printed.
+    sessions = asyncio.all_tasks() - {asyncio.current_task()}
+    if sessions:
+        await asyncio.wait(sessions, timeout=1.0 + 4 * (args.latency_ms + args.rto_ms) / 1000.0)
+    for session in sessions:
+        session.cancel()
+    await asyncio.gather(*sessions, return_exceptions=True)
+
+
+def parser():
+    options = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    options.add_argument('--host', action='append',
+                         help='a name or address the firmware connects to; repeat for more '
+                              '(default localhost and 127.0.0.1)')
+    options.add_argument('--listen', default='0.0.0.0', help='address to listen on')
+    options.add_argument('--port', type=int, default=8883)
+    options.add_argument('--plain', action='store_true', help='plain MQTT without TLS')
+    options.add_argument('--ca-dir', default='bench_ca', help='where the CA and ca_cert.h are kept')
+    options.add_argument('--latency-ms', type=float, default=0.0, help='one way, added to every chunk')
+    options.add_argument('--loss', type=float, default=0.0, help='percent of chunks lost and retransmitted')
+    options.add_argument('--rto-ms', type=float, default=200.0, help='the first retransmission timeout')
+    options.add_argument('--quiet', action='store_true', help="don't print publishes or connections")
+    options.add_argument('--seed', type=int)
+    return options
+
+
+def main():
+    args = parser().parse_args()
+    args.host = args.host or ['localhost', '127.0.0.1']
+    random.seed(args.seed)
+    stats = Stats()
+    asyncio.run(serve(args, stats))
+    print('%d connections, %d publishes, %d bytes up, %d bytes down, %d losses.'
+          % (stats.connections, stats.publishes, stats.bytes_up, stats.bytes_down, stats.losses))
+
+
+if __name__ == '__main__':
+    main()
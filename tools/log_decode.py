@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+"""
+Turn the monitor's binary log frames back into text.
+
+The firmware logs with LOG_ERROR, LOG_WARN, LOG_INFO and LOG_DEBUG
+(monitor_log.hpp). It keeps compact records in RAM and writes them to the
+serial port as one frame on the way into deep sleep. A record carries the
+FNV-1a hash of its format string rather than the string, so this finds the
+format strings in the sources, --src, and prints each record as printf would
+have. Anything on the port that isn't a frame, the boot ROM's chatter say, is
+passed through as it is:
+
+    ./log_decode.py monitor.log
+    pio device monitor --raw | ./log_decode.py --time
+
+The decoded lines are what soak_report.py and profile_report.py read.
+"""
+
+import argparse
+import glob
+import os
+import re
+import struct
+import sys
+
+MARKER = b'\0ML'
+HEADER = len(MARKER) + 4
+LEVELS = {'ERROR': 'E', 'WARN': 'W', 'INFO': 'I', 'DEBUG': 'D'}
+CALL = re.compile(r'\bLOG_(ERROR|WARN|INFO|DEBUG)\(\s*((?:"(?:[^"\\\n]|\\.)*"\s*)+)')
+LITERAL = re.compile(r'"((?:[^"\\\n]|\\.)*)"')
+ESCAPE = re.compile(r'\\(x[0-9A-Fa-f]+|[0-7]{1,3}|.)')
+CONVERSION = re.compile(r'%([-+ #0]*)(\d*)(\.\d+)?(hh|h|ll|l|L|z|j|t)?([diouxXeEfFgGcs%])')
+SRC = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src')
+SIMPLE_ESCAPES = {'n': '\n', 't': '\t', 'r': '\r', '0': '\0', '\\': '\\', '"': '"', "'": "'"}
+
+
+def fnv1a(data):
+    value = 2166136261
+    for byte in data:
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def unescape(literal):
+    def replace(match):
+        escape = match.group(1)
+        if escape in SIMPLE_ESCAPES:
+            return SIMPLE_ESCAPES[escape]
+        if escape[0] == 'x':
+            return chr(int(escape[1:], 16))
+        if escape[0] in '01234567':
+            return chr(int(escape, 8))
+        return escape
+    return ESCAPE.sub(replace, literal)
+
+
+def formats(src):
+    """Each message ID in the sources, with its level and format string."""
+    table = {}
+    for path in sorted(glob.glob(os.path.join(src, '*.cpp')) + glob.glob(os.path.join(src, '*.hpp'))):
+        with open(path, encoding='utf-8') as source:
+            text = source.read()
+        for call in CALL.finditer(text):
+            fmt = ''.join(unescape(part) for part in LITERAL.findall(call.group(2)))
+            data = fmt.encode('utf-8')
+            key = fnv1a(data)
+            if key in table and table[key][1] != fmt:
+                print('log_decode: "%s" and "%s" have the same ID.' % (table[key][1], fmt), file=sys.stderr)
+            table[key] = (LEVELS[call.group(1)], fmt)
+    return table
+
+
+class Record:
+    def __init__(self, data):
+        self.data = data
+        self.at = 0
+
+    def varint(self):
+        value, shift = 0, 0
+        while True:
+            if self.at >= len(self.data):
+                raise IndexError
+            byte = self.data[self.at]
+            self.at += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def integer(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def real(self):
+        if self.at + 4 > len(self.data):
+            raise IndexError
+        self.at += 4
+        return struct.unpack_from('<f', self.data, self.at - 4)[0]
+
+    def string(self):
+        length = self.varint()
+        text = self.data[self.at:self.at + length]
+        self.at += length
+        return text.decode('utf-8', errors='replace')
+
+
+def render(fmt, record):
+    def replace(match):
+        flags, width, precision, _, conversion = match.groups()
+        if conversion == '%':
+            return '%'
+        try:
+            if conversion in 'eEfFgG':
+                value = record.real()
+            elif conversion == 's':
+                value = record.string()
+            else:
+                value = record.integer()
+                if conversion in 'oxX' and value < 0:
+                    value &= 0xFFFFFFFF
+                if conversion == 'i':
+                    conversion = 'd'
+        except IndexError:
+            return '?'
+        return ('%' + flags + width + (precision or '') + conversion) % value
+    return CONVERSION.sub(replace, fmt)
+
+
+class Decoder:
+    """Splits a byte stream into text and frames, as the bytes come."""
+
+    def __init__(self, table, times=False):
+        self.table = table
+        self.times = times
+        self.pending = b''
+
+    def feed(self, data):
+        self.pending += data
+        out = []
+        while True:
+            start = self.pending.find(MARKER)
+            if start < 0:
+                # Keep a partial marker for the next chunk.
+                keep = next((n for n in range(len(MARKER) - 1, 0, -1) if self.pending.endswith(MARKER[:n])), 0)
+                out.append(self.pending[:len(self.pending) - keep].decode('utf-8', errors='replace'))
+                self.pending = self.pending[len(self.pending) - keep:]
+                break
+            out.append(self.pending[:start].decode('utf-8', errors='replace'))
+            if len(self.pending) < start + HEADER:
+                self.pending = self.pending[start:]
+                break
+            length, dropped = struct.unpack_from('<HH', self.pending, start + len(MARKER))
+            if len(self.pending) < start + HEADER + length:
+                self.pending = self.pending[start:]
+                break
+            out.extend(self.frame(self.pending[start + HEADER:start + HEADER + length], dropped))
+            self.pending = self.pending[start + HEADER + length:]
+        return ''.join(out)
+
+    def frame(self, data, dropped):
+        lines = []
+        if dropped:
+            lines.append('(%d log records dropped)\n' % dropped)
+        at = 0
+        while at < len(data) and data[at]:
+            record = Record(data[at:at + data[at]])
+            at += data[at]
+            record.at = 5
+            key = struct.unpack_from('<I', record.data, 1)[0] if len(record.data) >= 5 else None
+            try:
+                ms = record.varint()
+            except IndexError:
+                ms = 0
+            level, fmt = self.table.get(key, ('?', None))
+            text = render(fmt, record) if fmt is not None else 'Unknown log record %08x.' % (key or 0)
+            if self.times:
+                text = '[%8d ms] %s %s' % (ms, level, text)
+            lines.append(text + '\n')
+        return lines
+
+
+def decode(data, src=None, times=False):
+    """All of a captured log as text."""
+    decoder = Decoder(formats(src or SRC), times)
+    return decoder.feed(data) + decoder.pending.decode('utf-8', errors='replace')
+
+
+def main():
+    options = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    options.add_argument('log', nargs='?', type=argparse.FileType('rb'), default=sys.stdin.buffer)
+    options.add_argument('--src', default=SRC, help='the firmware sources the log came from')
+    options.add_argument('--time', action='store_true', help='prefix each record with its millis() and level')
+    args = options.parse_args()
+    decoder = Decoder(formats(args.src), args.time)
+    read = getattr(args.log, 'read1', args.log.read)
+    while True:
+        chunk = read(4096)
+        if not chunk:
+            break
+        sys.stdout.write(decoder.feed(chunk))
+        sys.stdout.flush()
+    sys.stdout.write(decoder.feed(b'') + decoder.pending.decode('utf-8', errors='replace'))
+
+
+if __name__ == '__main__':
+    main()
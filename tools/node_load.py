@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""
+Load generator for a monitor gateway: hundreds of simulated battery nodes.
+
+Each node sends a monitor_node_frame (monitor_node.hpp) over UDP every
+--interval seconds, with a little jitter, and waits for the gateway's ack.
+Frames not acked in --timeout-ms are sent again, up to --retries times, the
+way a node keeps a reading queued until the next upload. Run it against a
+native gateway build or an ESP8266 gateway built with MONITOR_LINK_UDP:
+
+    ./node_load.py --nodes 500 --interval 10 --duration 60 127.0.0.1:4210
+
+At the end it prints the acked throughput and the ack latency, which is the
+time the gateway takes to publish a reading. --key is the gateway's
+NODE_LINK_KEY, which tags frames and acks.
+"""
+
+import argparse
+import hashlib
+import heapq
+import hmac
+import random
+import select
+import socket
+import statistics
+import struct
+import time
+
+FRAME = struct.Struct('<BB6sI' 'IihHbBH')  # Header, then monitor_data; the tag follows.
+ACK = struct.Struct('<BB6sII')
+VERSION, READING, ACKED = 2, 1, 2
+TAG_SIZE = 8
+VALID = 0x07  # Current, humidity and temperature.
+
+
+def tag(key, message):
+    """The NODE_TAG_SIZE bytes of HMAC-SHA256 that follow a frame or an ack."""
+    return hmac.new(key, message, hashlib.sha256).digest()[:TAG_SIZE]
+
+
+class Node:
+    def __init__(self, index):
+        self.mac = bytes([0x02, 0x00]) + index.to_bytes(4, 'big')  # Locally administered.
+        self.sequence = 0
+        self.frame = None
+        self.sent_at = 0.0
+        self.first_sent_at = 0.0
+        self.tries = 0
+
+    def next_frame(self, key):
+        self.sequence += 1
+        self.tries = 0
+        frame = FRAME.pack(VERSION, READING, self.mac, self.sequence,
+                                0,  # Unstamped; the gateway stamps it.
+                                random.randint(5000, 12000),
+                                random.randint(6500, 7500),
+                                random.randint(3500, 5500),
+                                random.randint(40, 100),
+                                VALID, 0)
+        self.frame = frame + tag(key, frame)
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def run(args):
+    host, _, port = args.gateway.partition(':')
+    address = (host, int(port or 4210))
+    key = args.key.encode()
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setblocking(False)
+    nodes = {}
+    due = []  # (when, mac) for each node's next send or retry.
+    start = time.monotonic()
+    for i in range(args.nodes):
+        node = Node(i)
+        nodes[node.mac] = node
+        heapq.heappush(due, (start + random.uniform(0, args.interval), node.mac))
+    sent = acked = retries = lost = stray = 0
+    latencies = []
+    end = start + args.duration
+    while True:
+        now = time.monotonic()
+        while due and due[0][0] <= now:
+            _, mac = heapq.heappop(due)
+            node = nodes[mac]
+            if node.frame is None:
+                if now >= end:
+                    continue
+                node.next_frame(key)
+                node.first_sent_at = now
+            elif node.tries > args.retries:
+                lost += 1
+                node.frame = None
+                heapq.heappush(due, (now + args.interval * random.uniform(0.9, 1.1), mac))
+                continue
+            else:
+                retries += 1
+            sock.sendto(node.frame, address)
+            sent += 1
+            node.tries += 1
+            node.sent_at = now
+            heapq.heappush(due, (now + args.timeout_ms / 1000.0, mac))
+        if now >= end and not any(n.frame for n in nodes.values()):
+            break
+        wait = max(0.0, due[0][0] - now) if due else 0.1
+        readable, _, _ = select.select([sock], [], [], min(wait, 0.1))
+        while readable:
+            try:
+                data = sock.recv(64)
+            except BlockingIOError:
+                break
+            now = time.monotonic()
+            if len(data) != ACK.size + TAG_SIZE or not hmac.compare_digest(tag(key, data[:ACK.size]),
+                                                                         data[ACK.size:]):
+                stray += 1
+                continue
+            version, kind, mac, sequence, _ = ACK.unpack(data[:ACK.size])
+            node = nodes.get(mac)
+            if version != VERSION or kind != ACKED or not node or not node.frame or sequence != node.sequence:
+                stray += 1  # Late ack of a frame already given up on, or already acked.
+                continue
+            acked += 1
+            latencies.append((now - node.sent_at) * 1000.0)
+            node.frame = None
+            # Drop the pending retry; the next frame is due an interval after the first try.
+            due = [(when, m) for when, m in due if m != mac]
+            heapq.heapify(due)
+            heapq.heappush(due, (node.first_sent_at + args.interval * random.uniform(0.9, 1.1), mac))
+    elapsed = time.monotonic() - start
+    print('%d nodes, %.1f s: %d frames sent, %d retries, %d acked, %d lost, %d stray acks.'
+          % (args.nodes, elapsed, sent, retries, acked, lost, stray))
+    print('Offered %.1f readings/s, acked %.1f readings/s.'
+          % (args.nodes / args.interval, acked / elapsed))
+    if latencies:
+        print('Ack latency: median %.1f ms, p99 %.1f ms, max %.1f ms.'
+              % (statistics.median(latencies), percentile(latencies, 0.99), max(latencies)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('gateway', nargs='?', default='127.0.0.1:4210', help='host[:port]')
+    parser.add_argument('--nodes', type=int, default=200)
+    parser.add_argument('--interval', type=float, default=10.0, help='seconds between readings of a node')
+    parser.add_argument('--duration', type=float, default=30.0, help='seconds to offer load for')
+    parser.add_argument('--timeout-ms', type=float, default=300.0, help='like NODE_ACK_TIMEOUT_MS')
+    parser.add_argument('--retries', type=int, default=2)
+    parser.add_argument('--key', default='', help="the gateway's NODE_LINK_KEY")
+    parser.add_argument('--seed', type=int)
+    args = parser.parse_args()
+    random.seed(args.seed)
+    run(args)
+
+
+if __name__ == '__main__':
+    main()
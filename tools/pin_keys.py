@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""
+Write the header of pinned server public keys that AIO_PINNED_KEYS names.
+
+Each source is a certificate or public key in PEM, or host:port for the key of
+the certificate that server presents. List the key the server holds now first,
+then the keys it may move to, which the operator can usually get ahead of a
+certificate renewal:
+
+    ./pin_keys.py io.adafruit.com:8883 next_key.pem > ../src/aio_pins.h
+
+Build with -DAIO_PINNED_KEYS='"aio_pins.h"'. The header keeps each key's DER
+SubjectPublicKeyInfo in flash, with a comment of its pin, the base64 SHA-256
+of that DER as used by HPKP and curl's --pinnedpubkey, to check it against:
+
+    openssl x509 -in cert.pem -pubkey -noout | openssl pkey -pubin -outform DER |
+        openssl dgst -sha256 -binary | base64
+"""
+
+import argparse
+import base64
+import hashlib
+import re
+import subprocess
+import sys
+
+PEM = re.compile(r'-----BEGIN ([A-Z ]+)-----.+?-----END \1-----\n?', re.DOTALL)
+
+
+def openssl(args, text):
+    return subprocess.run(('openssl',) + tuple(args), input=text, stdout=subprocess.PIPE,
+                          stderr=subprocess.DEVNULL, check=True).stdout
+
+
+def server_certificate(address):
+    host = address.rsplit(':', 1)[0].strip('[]')
+    output = openssl(('s_client', '-connect', address, '-servername', host), b'').decode(errors='replace')
+    match = PEM.search(output)
+    if not match:
+        raise RuntimeError('%s presented no certificate.' % address)
+    return match.group(0)
+
+
+def public_key_der(source):
+    """The DER SubjectPublicKeyInfo of a PEM file or of a server's certificate."""
+    if ':' in source and not source.endswith('.pem'):
+        pem = server_certificate(source)
+    else:
+        with open(source) as pem_file:
+            pem = pem_file.read()
+    match = PEM.search(pem)
+    if not match:
+        raise RuntimeError('%s holds no PEM certificate or key.' % source)
+    if match.group(1) != 'PUBLIC KEY':
+        pem = openssl(('x509', '-pubkey', '-noout'), match.group(0).encode()).decode()
+    return openssl(('pkey', '-pubin', '-outform', 'DER'), pem.encode())
+
+
+def header(sources):
+    lines = ['// Pinned server public keys, made by tools/pin_keys.py from %s' % ' '.join(sources)]
+    for number, source in enumerate(sources):
+        der = public_key_der(source)
+        pin = base64.b64encode(hashlib.sha256(der).digest()).decode()
+        rows = [', '.join('0x%02X' % b for b in der[i:i + 15]) for i in range(0, len(der), 15)]
+        lines.append('// Pin %d, sha256//%s from %s' % (number, pin, source))
+        lines.append('const unsigned char pinnedKey%d[] PROGMEM = {\n        %s\n};'
+                     % (number, ',\n        '.join(rows)))
+    lines.append('const aio_pinned_key pinnedKeys[] = {')
+    lines.extend('        {pinnedKey%d, sizeof(pinnedKey%d)},' % (n, n) for n in range(len(sources)))
+    lines.append('};')
+    return '\n'.join(lines) + '\n'
+
+
+def main():
+    options = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    options.add_argument('source', nargs='+', help='a PEM certificate or public key, or host:port')
+    options.add_argument('-o', '--output', type=argparse.FileType('w'), default=sys.stdout)
+    args = options.parse_args()
+    try:
+        args.output.write(header(args.source))
+    except (OSError, RuntimeError, subprocess.CalledProcessError) as error:
+        sys.exit(str(error))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""
+Per-phase latency histograms and charge per wake from the monitor's profiles.
+
+Reads the base64 records written by monitor_profiler (monitor_profiler.hpp):
+the "PROFILE ..." lines of a serial log, or the values of the diagnostics
+feed downloaded from io.adafruit.com. Any 96 character base64 token in the
+input is tried, or 80 for the records of older firmware.
+
+    ./profile_report.py serial.log
+    pio device monitor --raw | ./log_decode.py | tee serial.log | ./profile_report.py
+
+A serial log is binary until log_decode.py has turned it into text.
+
+The charge is estimated from how long each wake spends in each phase and a
+rough current for each state of the ESP8266. Pass your own measurements with
+the --*-ma options.
+"""
+
+import argparse
+import base64
+import binascii
+import re
+import statistics
+import struct
+import sys
+
+RECORDS = {1: struct.Struct('<BBBBII8I3II'), 2: struct.Struct('<BBBBII8I3II3I')}
+PHASES = ('boot', 'sensors', 'wifi', 'ntp', 'tls', 'first_publish', 'last_publish', 'sleep')
+SENSORS = ('adc', 'ina219', 'dht')
+INITS = ('ina219', 'dht', 'oled')
+UPLOAD_WAKE, COLD_BOOT, WIFI_FAST, NTP_SYNCED, DISPLAY, RADIO_OFF, RF_CAL = 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40
+TOKEN = re.compile(r'[A-Za-z0-9+/]{80}(?:[A-Za-z0-9+/]{16})?')
+
+
+def parse(lines):
+    seen = set()
+    for line in lines:
+        for token in TOKEN.findall(line):
+            try:
+                raw = base64.b64decode(token, validate=True)
+            except binascii.Error:
+                continue
+            record = RECORDS.get(raw[0])
+            if not record or len(raw) != record.size or raw in seen:
+                continue
+            seen.add(raw)  # A feed holds each record once, a log may repeat it.
+            fields = record.unpack(raw)
+            yield {
+                'flags': fields[1],
+                'publishes': fields[2],
+                'wake': fields[4],
+                'sleep_s': fields[5],
+                'phase_us': dict(zip(PHASES, fields[6:14])),
+                'sensor_us': dict(zip(SENSORS, fields[14:17])),
+                'publish_us': fields[17],
+                'init_us': dict(zip(INITS, fields[18:21] or (0, 0, 0))),
+            }
+
+
+def durations(record):
+    """
+    Time spent in each phase. Sampling overlaps WiFi association, so both start
+    at boot. Publishing waits for whichever of the two finishes last.
+    """
+    p = record['phase_us']
+    starts = {
+        'boot': 0,
+        'sensors': p['boot'],
+        'wifi': p['boot'],
+        'ntp': p['wifi'],
+        'tls': p['ntp'],
+        'first_publish': max(p['tls'], p['sensors']),
+        'last_publish': p['first_publish'],
+        'sleep': max(p[phase] for phase in PHASES[:-1]),
+    }
+    return {phase: p[phase] - starts[phase] for phase in PHASES if p[phase]}
+
+
+def charge_mah(record, args):
+    """Estimated charge for the wake and the deep sleep after it."""
+    p = record['phase_us']
+    awake_us = p['sleep'] or max(p.values())
+    segments = [(0, p['boot'], args.rf_off_boot_ma if record['flags'] & RADIO_OFF else args.boot_ma)]
+    if record['flags'] & UPLOAD_WAKE:
+        # The radio is on from boot. Transmitting starts with the handshake.
+        tx_start = p['ntp'] or p['wifi'] or awake_us
+        tx_end = p['last_publish'] or p['tls'] or tx_start
+        segments += [(p['boot'], tx_start, args.radio_ma),
+                     (tx_start, tx_end, args.tx_ma),
+                     (tx_end, awake_us, args.radio_ma)]
+    else:
+        segments.append((p['boot'], awake_us, args.cpu_ma))
+    awake = sum(max(0, end - start) * ma for start, end, ma in segments) / 3.6e9
+    return awake + record['sleep_s'] * args.sleep_ma / 3600.0
+
+
+def histogram(values, buckets, width=40):
+    low, high = min(values), max(values)
+    if low == high:
+        print(f'    {low:9.2f} ms |{"#" * width} {len(values)}')
+        return
+    step = (high - low) / buckets
+    counts = [0] * buckets
+    for value in values:
+        counts[min(int((value - low) / step), buckets - 1)] += 1
+    most = max(counts)
+    for i, count in enumerate(counts):
+        bar = '#' * round(count * width / most)
+        print(f'    {low + i * step:9.2f} ms |{bar} {count}')
+
+
+def report(records, args):
+    groups = [('sampling', [r for r in records if not r['flags'] & UPLOAD_WAKE]),
+              ('upload', [r for r in records if r['flags'] & UPLOAD_WAKE])]
+    for name, group in groups:
+        if not group:
+            continue
+        print(f'== {len(group)} {name} wakes ==')
+        for phase in PHASES:
+            values = [durations(r)[phase] / 1000.0 for r in group if phase in durations(r)]
+            if not values:
+                continue
+            print(f'  {phase:14} n={len(values):<5} min={min(values):.2f} '
+                  f'median={statistics.median(values):.2f} max={max(values):.2f} ms')
+            if args.histograms:
+                histogram(values, args.buckets)
+        for sensor in SENSORS:
+            values = [r['sensor_us'][sensor] / 1000.0 for r in group]
+            print(f'  {sensor + " reads":14} mean={statistics.mean(values):.2f} ms per wake')
+        for peripheral in INITS:
+            begun = [r['init_us'][peripheral] / 1000.0 for r in group if r['init_us'][peripheral]]
+            if begun:
+                print(f'  {peripheral + " begin":14} n={len(begun):<5} mean={statistics.mean(begun):.2f} ms')
+        publishes = [r for r in group if r['publishes']]
+        if publishes:
+            per_message = [r['publish_us'] / r['publishes'] / 1000.0 for r in publishes]
+            print(f'  {"publish":14} mean={statistics.mean(per_message):.2f} ms per message')
+        if name == 'upload':
+            fast = sum(1 for r in group if r['flags'] & WIFI_FAST)
+            synced = sum(1 for r in group if r['flags'] & NTP_SYNCED)
+            print(f'  fast WiFi reconnects {fast}/{len(group)}, SNTP syncs {synced}/{len(group)}')
+        display = sum(1 for r in group if r['flags'] & DISPLAY)
+        if display:
+            print(f'  woke for the display {display}/{len(group)}')
+        radio_off = sum(1 for r in group if r['flags'] & RADIO_OFF)
+        calibrated = sum(1 for r in group if r['flags'] & RF_CAL)
+        print(f'  radio off {radio_off}/{len(group)}, RF calibrated {calibrated}/{len(group)}')
+        charges = [charge_mah(r, args) for r in group]
+        print(f'  charge         mean={statistics.mean(charges) * 1000:.2f} µAh per wake and sleep')
+        print()
+    charges = [charge_mah(r, args) for r in records]
+    cycle_s = [(r['phase_us']['sleep'] / 1e6) + r['sleep_s'] for r in records]
+    per_day = statistics.mean(charges) * 86400 / statistics.mean(cycle_s)
+    print(f'Average {statistics.mean(charges) * 1000:.2f} µAh per wake, {per_day:.2f} mAh per day, '
+          f'about {args.battery_mah / per_day:.0f} days on a {args.battery_mah:.0f} mAh battery.')
+    # Against booting the same wakes with the radio on and uncalibrated.
+    radio_off = [r for r in records if r['flags'] & RADIO_OFF]
+    if radio_off:
+        saved = sum(r['phase_us']['boot'] * (args.boot_ma - args.rf_off_boot_ma) for r in radio_off) / 3.6e9
+        saved_per_day = saved / len(records) * 86400 / statistics.mean(cycle_s)
+        print(f'Booting {len(radio_off)} of {len(records)} wakes with the radio off saved about '
+              f'{saved_per_day:.2f} mAh per day.')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('files', nargs='*', help='logs or feed exports; stdin if none')
+    parser.add_argument('--histograms', action='store_true', help='print a histogram per phase')
+    parser.add_argument('--buckets', type=int, default=10)
+    parser.add_argument('--boot-ma', type=float, default=70.0, help='ROM boot and RF init')
+    parser.add_argument('--rf-off-boot-ma', type=float, default=20.0, help='ROM boot with the radio disabled')
+    parser.add_argument('--cpu-ma', type=float, default=20.0, help='awake with the radio off')
+    parser.add_argument('--radio-ma', type=float, default=75.0, help='radio on, mostly receiving')
+    parser.add_argument('--tx-ma', type=float, default=120.0, help='TLS handshake and publishing')
+    parser.add_argument('--sleep-ma', type=float, default=0.1, help='deep sleep, whole board')
+    parser.add_argument('--battery-mah', type=float, default=2500.0)
+    args = parser.parse_args()
+
+    lines = []
+    for name in args.files or ['-']:
+        with (sys.stdin if name == '-' else open(name, errors='replace')) as f:
+            lines.extend(f)
+    records = list(parse(lines))
+    if not records:
+        sys.exit('No profile records found.')
+    report(records, args)
+
+
+if __name__ == '__main__':
+    main()
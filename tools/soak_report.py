@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""
+Summarize a soak test from the "Session:" lines of a monitor's serial log.
+
+A mains powered monitor (MONITOR_MAINS) or a gateway prints one line every
+SESSION_STATS_S seconds (monitor_session.cpp). Capture its console through
+log_decode.py for as long as the soak should run, then:
+
+    pio device monitor --raw | ./log_decode.py > monitor.log
+    ./soak_report.py monitor.log
+
+It prints the sustained publish rate, the worst p99 and maximum time a publish
+took to write, the failures and reconnects, and the free heap at the start and end
+of the run with its lowest point, so a leak shows as a falling trend.
+"""
+
+import argparse
+import re
+import sys
+
+SESSION = re.compile(r'Session: (\d+) publishes in (\d+) ms, (\d+) failed, write p99 (\d+) us, max (\d+) us, '
+                     r'heap (\d+) free, (\d+) least, (\d+) reconnects since boot\.')
+
+
+def report(lines):
+    periods = [tuple(int(g) for g in m.groups()) for m in map(SESSION.search, lines) if m]
+    if not periods:
+        print('No Session lines found.')
+        return 1
+    publishes = sum(p[0] for p in periods)
+    elapsed_ms = sum(p[1] for p in periods)
+    failures = sum(p[2] for p in periods)
+    heap = [p[5] for p in periods]
+    print('%d periods, %.1f h: %d publishes, %.2f/s sustained, %d failed, %d reconnects.'
+          % (len(periods), elapsed_ms / 3600000.0, publishes, publishes * 1000.0 / max(elapsed_ms, 1),
+             failures, periods[-1][7]))
+    print('Publish write time: worst p99 %d us, max %d us.'
+          % (max(p[3] for p in periods), max(p[4] for p in periods)))
+    print('Heap: %d bytes free at start, %d at end, %d least.' % (heap[0], heap[-1], min(p[6] for p in periods)))
+    # Compare the first and last quarters so a single busy period doesn't read as a leak.
+    quarter = max(1, len(heap) // 4)
+    drift = sum(heap[-quarter:]) / quarter - sum(heap[:quarter]) / quarter
+    if drift < 0:
+        print('Heap fell %.0f bytes between the first and last quarter of the run.' % -drift)
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('log', nargs='?', type=argparse.FileType('r', errors='replace'), default=sys.stdin)
+    args = parser.parse_args()
+    sys.exit(report(args.log))
+
+
+if __name__ == '__main__':
+    main()